@@ -13,6 +13,11 @@
  * (Project ID: 671951) www.nextgenio.eu
  */
 
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <map>
+#include <memory>
 #include <vector>
 #include <thread>
 #include <future>
@@ -26,10 +31,14 @@
 #include "metkit/hypercube/HyperCube.h"
 
 #include "fdb5/api/DistFDB.h"
+#include "fdb5/api/helpers/AsyncExecutor.h"
 #include "fdb5/database/Notifier.h"
+#include "fdb5/database/WriteVisitor.h"
 #include "fdb5/api/helpers/FDBToolRequest.h"
 #include "fdb5/api/helpers/ListIterator.h"
 #include "fdb5/io/HandleGatherer.h"
+#include "fdb5/rules/Schema.h"
+#include "fdb5/types/Type.h"
 #include "fdb5/LibFdb5.h"
 
 using eckit::Log;
@@ -50,10 +59,24 @@ struct DistributionError : public eckit::Exception {
 //----------------------------------------------------------------------------------------------------------------------
 
 DistFDB::DistFDB(const Config& config, const std::string& name) :
-    FDBBase(config, name) {
+    FDBBase(config, name),
+    hashedRetrieve_(config.getBool("hashedRetrieve", false)),
+    fallback_(Fallback::Parallel),
+    maxHashedFields_(config.getInt("hashedRetrieveMaxFields", 10000)) {
 
     ASSERT(config.getString("type", "") == "dist");
 
+    // When retrieving, what to do with fields not found on their hash-preferred lane
+
+    std::string fallback = config.getString("hashedRetrieveFallback", "parallel");
+    if (fallback == "none") {
+        fallback_ = Fallback::None;
+    } else if (fallback == "sequential") {
+        fallback_ = Fallback::Sequential;
+    } else if (fallback != "parallel") {
+        throw eckit::UserError("Unknown hashedRetrieveFallback: " + fallback + " (expected none, sequential or parallel)", Here());
+    }
+
     // Configure the available lanes.
 
     if (!config.has("lanes")) throw eckit::UserError("No lanes configured for pool", Here());
@@ -155,27 +178,30 @@ void DistFDB::archive(const Key& key, const void* data, size_t length) {
  */
 
 template <typename QueryFN>
-auto DistFDB::queryInternal(const FDBToolRequest& request, const QueryFN& fn) -> decltype(fn(*(FDB*)(nullptr), request)) {
+auto DistFDB::queryInternal(const FDBToolRequest& request, const QueryFN& fn, bool ordered) -> decltype(fn(*(FDB*)(nullptr), request)) {
 
     using QueryIterator = decltype(fn(*(FDB*)(nullptr), request));
     using ValueType = typename QueryIterator::value_type;
 
-    std::vector<std::future<QueryIterator>> futures;
-    std::queue<APIIterator<ValueType>> iterQueue;
+    // Query all the lanes concurrently, and return elements as soon as any lane has them.
+    // Listings are returned lane by lane, in the configured order, so that a field found
+    // on more than one lane is always reported (and deduplicated) the same way.
+
+    std::vector<typename APIFanInIterator<ValueType>::Generator> lanes;
 
     for (FDB& lane : lanes_) {
         if (lane.enabled(ControlIdentifier::Retrieve)) {
-            futures.emplace_back(std::async(std::launch::async, [&lane, &fn, &request] {
-                return fn(lane, request);
-            }));
+            // Issue the query here rather than in the generator, so that every lane sees it
+            // even if the returned iterator is discarded unread.
+            auto it = std::make_shared<APIIterator<ValueType>>(fn(lane, request));
+            lanes.emplace_back([it] { return std::move(*it); });
         }
     }
 
-    for (std::future<QueryIterator>& f : futures) {
-        iterQueue.push(f.get());
+    if (ordered) {
+        return QueryIterator(new APIOrderedFanInIterator<ValueType>(std::move(lanes)));
     }
-
-    return QueryIterator(new APIAggregateIterator<ValueType>(std::move(iterQueue)));
+    return QueryIterator(new APIFanInIterator<ValueType>(std::move(lanes)));
 }
 
 
@@ -184,15 +210,298 @@ ListIterator DistFDB::list(const FDBToolRequest& request) {
     return queryInternal(request,
                          [](FDB& fdb, const FDBToolRequest& request) {
                             return fdb.list(request);
-                         });
+                         }, true);
+}
+
+// Fields are archived to the first writable lane in their rendezvous hash order, so for
+// fully specified requests that is where to look first.
+//
+// n.b. The hash is computed over the archived key, so a request is only looked up this way if
+//      each of its fields is exactly a key of the schema, once canonicalised. Anything else
+//      (partial requests, extra keywords, parameters named other than by id) is sent to all
+//      the lanes.
+
+namespace {
+
+/// Records the full key of the rule that a field matches
+
+class KeyMatcher : public WriteVisitor {
+
+public: // methods
+
+    KeyMatcher(const Schema& schema, std::vector<Key>& prev) : WriteVisitor(prev), schema_(schema) {}
+
+    const Key& full() const { return full_; }
+
+protected: // methods
+
+    bool selectDatabase(const Key&, const Key&) override { return true; }
+    bool selectIndex(const Key&, const Key&) override { return true; }
+    bool selectDatum(const Key&, const Key& full) override {
+        full_ = full;
+        return true;
+    }
+
+    const Schema& databaseSchema() const override { return schema_; }
+
+    void print(std::ostream& out) const override { out << "KeyMatcher[" << full_ << "]"; }
+
+private: // members
+
+    const Schema& schema_;
+    Key full_;
+};
+
+bool isInteger(const std::string& value) {
+    return !value.empty() && std::all_of(value.begin(), value.end(), [](char c) { return std::isdigit(c); });
+}
+
+}  // namespace
+
+bool DistFDB::canonicalField(eckit::StringDict& field) const {
+
+    const Schema& schema(config_.schema());
+
+    Key key;
+    for (auto& kv : field) {
+        const Type& type(schema.lookupType(kv.first));
+
+        // Parameters are matched against what the database holds, e.g. by short name
+        if (type.type() == "Param" && !isInteger(kv.second)) return false;
+
+        try {
+            kv.second = type.canonicalise(kv.first, kv.second);
+        } catch (eckit::Exception&) {
+            return false;
+        }
+        key.set(kv.first, kv.second);
+    }
+
+    std::vector<Key> prev;
+    KeyMatcher matcher(schema, prev);
+    schema.expand(key, matcher);
+
+    if (!matcher.rule()) return false;
+
+    // Every keyword must be used by the rule. n.b. missing optional keywords are empty.
+    eckit::StringDict used;
+    for (const auto& kv : matcher.full().keyDict()) {
+        if (!kv.second.empty()) used.insert(kv);
+    }
+    return used == field;
+}
+
+bool DistFDB::expandFields(const metkit::mars::MarsRequest& request, std::vector<eckit::StringDict>& fields) const {
+
+    fields.clear();
+    fields.emplace_back();
+
+    for (const std::string& param : request.params()) {
+        const std::vector<std::string>& values(request.values(param));
+        if (values.empty()) return false;
+        if (fields.size() * values.size() > maxHashedFields_) return false;
+
+        std::vector<eckit::StringDict> expanded;
+        expanded.reserve(fields.size() * values.size());
+        for (const eckit::StringDict& field : fields) {
+            for (const std::string& value : values) {
+                expanded.push_back(field);
+                expanded.back()[param] = value;
+            }
+        }
+        std::swap(fields, expanded);
+    }
+
+    if (request.params().empty()) return false;
+
+    for (eckit::StringDict& field : fields) {
+        if (!canonicalField(field)) return false;
+    }
+
+    return true;
+}
+
+ListIterator DistFDB::hashedInspect(const metkit::mars::MarsRequest& request, std::vector<eckit::StringDict>&& fields) {
+
+    // Lanes in which to look for each field, in order of preference
+
+    std::vector<std::vector<size_t>> laneOrders(fields.size());
+
+    for (size_t i = 0; i < fields.size(); ++i) {
+        std::vector<size_t> order;
+        hash_.hashOrder(fields[i], order);
+        for (size_t idx : order) {
+            if (lanes_[idx].enabled(ControlIdentifier::Retrieve)) laneOrders[i].push_back(idx);
+        }
+    }
+
+    return ListIterator(new ListAsyncIterator(
+        [this, request, fields = std::move(fields), laneOrders = std::move(laneOrders)](eckit::Queue<ListElement>& queue) {
+
+            // n.b. a request may name the same field more than once
+            std::map<eckit::StringDict, std::vector<size_t>> fieldIndex;
+            for (size_t i = 0; i < fields.size(); ++i) fieldIndex[fields[i]].push_back(i);
+
+            // Each lane is asked once for all the fields wanted from it, and what it returns is
+            // split back into those fields. n.b. the merged request spans the hypercube of the
+            // fields, so anything else that it matches is dropped.
+
+            using Found = std::vector<std::vector<ListElement>>;
+
+            auto lookup = [&](size_t laneIdx, const std::vector<size_t>& fieldIdxs) {
+                metkit::mars::MarsRequest laneRequest;
+                for (size_t n = 0; n < fieldIdxs.size(); ++n) {
+                    metkit::mars::MarsRequest fieldRequest(request);
+                    for (const auto& kv : fields[fieldIdxs[n]]) {
+                        fieldRequest.setValue(kv.first, kv.second);
+                    }
+                    if (n == 0) {
+                        laneRequest = fieldRequest;
+                    } else {
+                        laneRequest.merge(fieldRequest);
+                    }
+                }
+
+                std::map<size_t, size_t> wanted;
+                for (size_t n = 0; n < fieldIdxs.size(); ++n) wanted.emplace(fieldIdxs[n], n);
+
+                Found found(fieldIdxs.size());
+                ListIterator it = lanes_[laneIdx].inspect(laneRequest);
+                ListElement elem;
+                while (it.next(elem)) {
+                    eckit::StringDict key;
+                    for (const auto& kv : elem.combinedKey()) {
+                        if (!kv.second.empty()) key.insert(kv);
+                    }
+                    auto f = fieldIndex.find(key);
+                    if (f == fieldIndex.end()) continue;
+                    for (size_t fieldIdx : f->second) {
+                        auto w = wanted.find(fieldIdx);
+                        if (w != wanted.end()) found[w->second].push_back(elem);
+                    }
+                }
+                return found;
+            };
+
+            // Query the lanes in parallel, each for the fields given for it
+
+            auto lookupAll = [&](const std::vector<std::vector<size_t>>& fieldsByLane) {
+                std::vector<Found> found(lanes_.size());
+                std::vector<std::future<void>> laneWorkers;
+                AsyncWaitGuard<decltype(laneWorkers)> waitForLanes(laneWorkers);
+
+                for (size_t laneIdx = 0; laneIdx < lanes_.size(); ++laneIdx) {
+                    if (fieldsByLane[laneIdx].empty()) continue;
+                    laneWorkers.emplace_back(AsyncExecutor::instance().submit([&, laneIdx] {
+                        found[laneIdx] = lookup(laneIdx, fieldsByLane[laneIdx]);
+                    }));
+                }
+
+                // n.b. wait for all the workers before reporting any error, as they refer to
+                //      state on this stack
+
+                std::exception_ptr error;
+                for (auto& w : laneWorkers) {
+                    try {
+                        w.get();
+                    } catch (...) {
+                        if (!error) error = std::current_exception();
+                    }
+                }
+                if (error) std::rethrow_exception(error);
+                return found;
+            };
+
+            // Ask for each field the lane at a given position in its order of preference
+
+            std::vector<std::vector<ListElement>> results(fields.size());
+
+            auto lookupRank = [&](const std::vector<size_t>& fieldIdxs, size_t rank) {
+                std::vector<std::vector<size_t>> fieldsByLane(lanes_.size());
+                for (size_t fieldIdx : fieldIdxs) {
+                    if (rank < laneOrders[fieldIdx].size()) {
+                        fieldsByLane[laneOrders[fieldIdx][rank]].push_back(fieldIdx);
+                    }
+                }
+                std::vector<Found> found = lookupAll(fieldsByLane);
+                for (size_t laneIdx = 0; laneIdx < lanes_.size(); ++laneIdx) {
+                    for (size_t n = 0; n < fieldsByLane[laneIdx].size(); ++n) {
+                        std::vector<ListElement>& result(results[fieldsByLane[laneIdx][n]]);
+                        std::move(found[laneIdx][n].begin(), found[laneIdx][n].end(), std::back_inserter(result));
+                    }
+                }
+            };
+
+            std::vector<size_t> missing(fields.size());
+            for (size_t i = 0; i < fields.size(); ++i) missing[i] = i;
+
+            auto stillMissing = [&] {
+                missing.erase(std::remove_if(missing.begin(), missing.end(),
+                                             [&](size_t i) { return !results[i].empty(); }),
+                              missing.end());
+            };
+
+            lookupRank(missing, 0);
+            stillMissing();
+
+            // Sequentially, stop looking for a field as soon as a lane has it. In parallel, all
+            // the other lanes are asked at once, and what each has reported in order of preference.
+
+            size_t lanes = 0;
+            for (const auto& order : laneOrders) lanes = std::max(lanes, order.size());
+
+            if (fallback_ == Fallback::Sequential) {
+                for (size_t rank = 1; rank < lanes && !missing.empty(); ++rank) {
+                    lookupRank(missing, rank);
+                    stillMissing();
+                }
+            }
+
+            if (fallback_ == Fallback::Parallel && !missing.empty()) {
+                // Where each field is in the request to each lane, in order of preference
+                std::vector<std::vector<size_t>> fieldsByLane(lanes_.size());
+                std::vector<std::vector<size_t>> positions(fields.size());
+                for (size_t fieldIdx : missing) {
+                    for (size_t n = 1; n < laneOrders[fieldIdx].size(); ++n) {
+                        std::vector<size_t>& laneFields(fieldsByLane[laneOrders[fieldIdx][n]]);
+                        positions[fieldIdx].push_back(laneFields.size());
+                        laneFields.push_back(fieldIdx);
+                    }
+                }
+                std::vector<Found> found = lookupAll(fieldsByLane);
+                for (size_t fieldIdx : missing) {
+                    for (size_t n = 1; n < laneOrders[fieldIdx].size(); ++n) {
+                        std::vector<ListElement>& laneFound(found[laneOrders[fieldIdx][n]][positions[fieldIdx][n - 1]]);
+                        std::vector<ListElement>& result(results[fieldIdx]);
+                        std::move(laneFound.begin(), laneFound.end(), std::back_inserter(result));
+                    }
+                }
+            }
+
+            // Return the fields in the order they were requested
+
+            for (std::vector<ListElement>& found : results) {
+                for (ListElement& elem : found) {
+                    queue.emplace(std::move(elem));
+                }
+            }
+        }));
 }
 
 ListIterator DistFDB::inspect(const metkit::mars::MarsRequest& request) {
     Log::debug<LibFdb5>() << "DistFDB::inspect() : " << request << std::endl;
+
+    if (hashedRetrieve_) {
+        std::vector<eckit::StringDict> fields;
+        if (expandFields(request, fields)) {
+            return hashedInspect(request, std::move(fields));
+        }
+    }
+
     return queryInternal(request,
                          [](FDB& fdb, const FDBToolRequest& request) {
                             return fdb.inspect(request.request());
-                         });
+                         }, true);
 }
 
 DumpIterator DistFDB::dump(const FDBToolRequest& request, bool simple) {
@@ -257,12 +566,16 @@ MoveIterator DistFDB::move(const FDBToolRequest& request, const eckit::URI& dest
 void DistFDB::flush() {
 
     std::vector<std::future<void>> futures;
+    AsyncWaitGuard<decltype(futures)> waitForLanes(futures);
 
     for (FDB& lane : lanes_) {
-        futures.emplace_back(std::async(std::launch::async, [&lane] {
+        futures.emplace_back(AsyncExecutor::instance().submit([&lane] {
             lane.flush();
         }));
     }
+
+    for (auto& f : futures) f.wait();
+    for (auto& f : futures) f.get();
 }
 
 FDBStats DistFDB::stats() const {
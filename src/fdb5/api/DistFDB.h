@@ -72,13 +72,34 @@ private: // methods
     virtual void print(std::ostream& s) const override;
 
     template <typename QueryFN>
-    auto queryInternal(const FDBToolRequest& request, const QueryFN& fn) -> decltype(fn(*(FDB*)(nullptr), request));
+    auto queryInternal(const FDBToolRequest& request, const QueryFN& fn, bool ordered=false) -> decltype(fn(*(FDB*)(nullptr), request));
+
+    /// Expand a request into the individual fields it describes. Returns false if there
+    /// are too many to look up one at a time, or if they are not all complete keys.
+    bool expandFields(const metkit::mars::MarsRequest& request, std::vector<eckit::StringDict>& fields) const;
+
+    /// Canonicalise a field's values through the schema. Returns false unless the field is
+    /// then exactly the key of a schema rule, as it would have been archived.
+    bool canonicalField(eckit::StringDict& field) const;
+
+    /// Look up each field on the lane it is most likely to have been archived to (as
+    /// given by the rendezvous hash), falling back to the other lanes if it is not found.
+    /// Each lane is sent one request for all the fields looked up on it at each stage.
+    ListIterator hashedInspect(const metkit::mars::MarsRequest& request, std::vector<eckit::StringDict>&& fields);
+
+private: // types
+
+    enum class Fallback { None, Sequential, Parallel };
 
 private:
 
     eckit::RendezvousHash hash_;
 
     std::vector<FDB> lanes_;
+
+    bool hashedRetrieve_;
+    Fallback fallback_;
+    size_t maxHashedFields_;
 };
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -20,12 +20,13 @@
 #include "eckit/message/Message.h"
 #include "eckit/message/Reader.h"
 
-#include "metkit/hypercube/HyperCubePayloaded.h"
+#include "metkit/hypercube/HyperCube.h"
 
 #include "fdb5/LibFdb5.h"
 #include "fdb5/api/FDB.h"
 #include "fdb5/api/FDBFactory.h"
 #include "fdb5/api/helpers/FDBToolRequest.h"
+#include "fdb5/api/helpers/FieldCache.h"
 #include "fdb5/database/Key.h"
 #include "fdb5/io/HandleGatherer.h"
 #include "fdb5/message/MessageDecoder.h"
@@ -37,7 +38,16 @@ namespace fdb5 {
 FDB::FDB(const Config &config) :
     internal_(FDBFactory::instance().build(config)),
     dirty_(false),
-    reportStats_(config.getBool("statistics", false)) {}
+    reportStats_(config.getBool("statistics", false)) {
+
+    // Keep the data of recently retrieved fields in memory, up to fieldCacheSize bytes
+
+    long fieldCacheSize = config.getLong("fieldCacheSize", 0);
+    if (fieldCacheSize > 0) {
+        long maxFieldSize = config.getLong("fieldCacheMaxFieldSize", 64 * 1024 * 1024);
+        fieldCache_ = std::make_shared<FieldCache>(fieldCacheSize, maxFieldSize);
+    }
+}
 
 
 FDB::~FDB() {
@@ -100,6 +110,31 @@ void FDB::archive(const Key& key, const void* data, size_t length) {
     eckit::Timer timer;
     timer.start();
 
+    archiveInternal(key, data, length);
+
+    timer.stop();
+    stats_.addArchive(length, timer);
+}
+
+void FDB::archive(const KeyedField* fields, size_t count) {
+    if (count == 0) return;
+    ASSERT(fields);
+
+    eckit::Timer timer;
+    timer.start();
+
+    size_t length = 0;
+    for (size_t i = 0; i < count; ++i) {
+        archiveInternal(fields[i].key, fields[i].data, fields[i].length);
+        length += fields[i].length;
+    }
+
+    timer.stop();
+    stats_.addArchive(length, timer, count);
+}
+
+void FDB::archiveInternal(const Key& key, const void* data, size_t length) {
+
     auto stepunit = key.find("stepunits");
     if (stepunit != key.end()) {
         Key k;
@@ -119,9 +154,6 @@ void FDB::archive(const Key& key, const void* data, size_t length) {
         internal_->archive(key, data, length);
     }
     dirty_ = true;
-
-    timer.stop();
-    stats_.addArchive(length, timer);
 }
 
 bool FDB::sorted(const metkit::mars::MarsRequest &request) {
@@ -140,13 +172,6 @@ bool FDB::sorted(const metkit::mars::MarsRequest &request) {
     return sorted;
 }
 
-class ListElementDeduplicator : public metkit::hypercube::Deduplicator<ListElement> {
-public:
-    bool toReplace(const ListElement& existing, const ListElement& replacement) const override {
-        return existing.timestamp() < replacement.timestamp();
-    }
-};
-
 eckit::DataHandle* FDB::read(const eckit::URI& uri) {
     FieldLocation* loc = FieldLocationFactory::instance().build(uri.scheme(), uri);
     return loc->dataHandle();
@@ -165,56 +190,61 @@ eckit::DataHandle* FDB::read(const std::vector<eckit::URI>& uris, bool sorted) {
     
 
 eckit::DataHandle* FDB::read(ListIterator& it, bool sorted) {
-    eckit::Timer timer;
-    timer.start();
-
     HandleGatherer result(sorted);
     ListElement el;
+    size_t hits = 0;
+    double lookupTime = 0;
 
     static bool dedup = eckit::Resource<bool>("fdbDeduplicate;$FDB_DEDUPLICATE_FIELDS", false);
     if (dedup) {
-        if (it.next(el)) {
-            // build the request representing the tensor-product of all retrieved fields
-            metkit::mars::MarsRequest cubeRequest = el.combinedKey().request();
-            std::vector<ListElement> elements{el};
-
-            while (it.next(el)) {
-                cubeRequest.merge(el.combinedKey().request());
-                elements.push_back(el);
-            }
-
-            // checking all retrieved fields against the hypercube, to remove duplicates
-            ListElementDeduplicator dedup;
-            metkit::hypercube::HyperCubePayloaded<ListElement> cube(cubeRequest, dedup);
-            for(auto el: elements) {
-                cube.add(el.combinedKey().request(), el);
-            }
+        // remove duplicates as the fields arrive, keeping the most recent of each
+        ListElementDeduplicator fields;
+        while (it.next(el)) {
+            fields.add(std::move(el));
+        }
 
-            if (cube.countVacant() > 0) {
-                std::stringstream ss;
-                ss << "No matching data for requests:" << std::endl;
-                for (auto req: cube.vacantRequests()) {
-                    ss << "    " << req << std::endl;
-                }
-                eckit::Log::warning() << ss.str() << std::endl;
+        std::vector<metkit::mars::MarsRequest> vacant = fields.vacantRequests();
+        if (!vacant.empty()) {
+            std::stringstream ss;
+            ss << "No matching data for requests:" << std::endl;
+            for (const auto& req : vacant) {
+                ss << "    " << req << std::endl;
             }
+            eckit::Log::warning() << ss.str() << std::endl;
+        }
 
-            for (size_t i=0; i< cube.size(); i++) {
-                ListElement element;
-                if (cube.find(i, element)) {
-                    result.add(element.location().dataHandle());
-                }
-            }
+        for (const ListElement& element : fields.elements()) {
+            result.add(dataHandle(element, hits, lookupTime));
         }
     }
     else {
         while (it.next(el)) {
-            result.add(el.location().dataHandle());
+            result.add(dataHandle(el, hits, lookupTime));
         }
     }
+
+    if (fieldCache_) {
+        stats_.addFieldCache(hits, result.count() - hits, lookupTime);
+    }
+
     return result.dataHandle();
 }
 
+eckit::DataHandle* FDB::dataHandle(const ListElement& element, size_t& hits, double& lookupTime) {
+
+    if (!fieldCache_) return element.location().dataHandle();
+
+    eckit::Timer timer;
+    eckit::DataHandle* dh = fieldCache_->cachedHandle(element);
+    lookupTime += timer.elapsed();
+
+    if (dh) {
+        ++hits;
+        return dh;
+    }
+    return fieldCache_->readThroughHandle(element);
+}
+
 eckit::DataHandle* FDB::retrieve(const metkit::mars::MarsRequest& request) {
     ListIterator it = inspect(request);
     return read(it, sorted(request));
@@ -47,6 +47,7 @@ namespace metkit { class MarsRequest; }
 namespace fdb5 {
 
 class FDBBase;
+class FieldCache;
 class FDBToolRequest;
 class Key;
 
@@ -56,6 +57,15 @@ class Key;
 
 class FDB {
 
+public: // types
+
+    /// A field whose key is already known, for archiving in bulk
+    struct KeyedField {
+        const Key& key;
+        const void* data;
+        size_t length;
+    };
+
 public: // methods
 
     FDB(const Config& config = Config().expandConfig());
@@ -76,6 +86,8 @@ public: // methods
     void archive(const metkit::mars::MarsRequest& request, eckit::DataHandle& handle);
     // disclaimer: this is a low-level API. The provided key and the corresponding data are not checked for consistency
     void archive(const Key& key, const void* data, size_t length);
+    // as above, for a span of count fields, with a single update of the statistics
+    void archive(const KeyedField* fields, size_t count);
 
     /// Flushes all buffers and closes all data handles into a consistent DB state
     /// @note always safe to call
@@ -138,6 +150,12 @@ private: // methods
 
     bool sorted(const metkit::mars::MarsRequest &request);
 
+    void archiveInternal(const Key& key, const void* data, size_t length);
+
+    /// A handle on the field's data, from the field cache if there is one. Counts the cache hits,
+    /// and accumulates the time spent looking the field up.
+    eckit::DataHandle* dataHandle(const ListElement& element, size_t& hits, double& lookupTime);
+
 private: // members
 
     std::unique_ptr<FDBBase> internal_;
@@ -146,6 +164,9 @@ private: // members
     bool reportStats_;
 
     FDBStats stats_;
+
+    // Only if enabled with fieldCacheSize in the configuration
+    std::shared_ptr<FieldCache> fieldCache_;
 };
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -31,6 +31,8 @@ FDBStats::FDBStats() :
     numArchive_(0),
     numFlush_(0),
     numRetrieve_(0),
+    numFieldCacheHit_(0),
+    numFieldCacheMiss_(0),
     bytesArchive_(0),
     bytesRetrieve_(0),
     sumBytesArchiveSquared_(0),
@@ -38,9 +40,11 @@ FDBStats::FDBStats() :
     elapsedArchive_(0),
     elapsedFlush_(0),
     elapsedRetrieve_(0),
+    elapsedFieldCache_(0),
     sumArchiveTimingSquared_(0),
     sumRetrieveTimingSquared_(0),
-    sumFlushTimingSquared_(0) {}
+    sumFlushTimingSquared_(0),
+    sumFieldCacheTimingSquared_(0) {}
 
 
 FDBStats::~FDBStats() {}
@@ -50,6 +54,8 @@ FDBStats& FDBStats::operator+=(const FDBStats& rhs) {
     numArchive_ += rhs.numArchive_;
     numFlush_ += rhs.numFlush_;
     numRetrieve_ += rhs.numRetrieve_;
+    numFieldCacheHit_ += rhs.numFieldCacheHit_;
+    numFieldCacheMiss_ += rhs.numFieldCacheMiss_;
     bytesArchive_ += rhs.bytesArchive_;
     bytesRetrieve_ += rhs.bytesRetrieve_;
     sumBytesArchiveSquared_ += rhs.sumBytesArchiveSquared_;
@@ -57,9 +63,11 @@ FDBStats& FDBStats::operator+=(const FDBStats& rhs) {
     elapsedArchive_ += rhs.elapsedArchive_;
     elapsedFlush_ += rhs.elapsedFlush_;
     elapsedRetrieve_ += rhs.elapsedRetrieve_;
+    elapsedFieldCache_ += rhs.elapsedFieldCache_;
     sumArchiveTimingSquared_ += rhs.sumArchiveTimingSquared_;
     sumRetrieveTimingSquared_ += rhs.sumRetrieveTimingSquared_;
     sumFlushTimingSquared_ += rhs.sumFlushTimingSquared_;
+    sumFieldCacheTimingSquared_ += rhs.sumFieldCacheTimingSquared_;
     return *this;
 }
 
@@ -115,6 +123,33 @@ void FDBStats::addFlush(eckit::Timer& timer) {
 }
 
 
+// Timings are of the cache lookups only (not the reads), per field looked up
+
+void FDBStats::addFieldCache(size_t hits, size_t misses, double lookupTime) {
+
+    size_t nfields = hits + misses;
+    if (nfields == 0) return;
+
+    numFieldCacheHit_ += hits;
+    numFieldCacheMiss_ += misses;
+
+    double elapsed = lookupTime / nfields;
+    elapsedFieldCache_ += elapsed * nfields;
+    sumFieldCacheTimingSquared_ += elapsed * elapsed * nfields;
+
+    Log::debug<LibFdb5>() << "Field cache hits: " << hits
+                         << ", misses: " << misses
+                         << ", hit ratio: " << fieldCacheHitRatio()
+                         << ", time per field: " << Seconds(elapsed) << std::endl;
+}
+
+
+double FDBStats::fieldCacheHitRatio() const {
+    size_t lookups = numFieldCacheHit_ + numFieldCacheMiss_;
+    return lookups ? double(numFieldCacheHit_) / lookups : 0;
+}
+
+
 void FDBStats::report(std::ostream& out, const char* prefix) const {
 
     // Archive statistics
@@ -131,6 +166,16 @@ void FDBStats::report(std::ostream& out, const char* prefix) const {
     reportTimeStats(out, "retrieve time", numRetrieve_, elapsedRetrieve_, sumRetrieveTimingSquared_, prefix);
     reportRate(out, "retrieve rate", bytesRetrieve_, elapsedRetrieve_, prefix);
 
+    // Field cache statistics
+
+    if (numFieldCacheHit_ + numFieldCacheMiss_ > 0) {
+        reportCount(out, "num field cache hits", numFieldCacheHit_, prefix);
+        reportCount(out, "num field cache misses", numFieldCacheMiss_, prefix);
+        reportCount(out, "field cache hit percentage", size_t(100 * fieldCacheHitRatio() + 0.5), prefix);
+        reportTimeStats(out, "field cache lookup time", numFieldCacheHit_ + numFieldCacheMiss_,
+                        elapsedFieldCache_, sumFieldCacheTimingSquared_, prefix);
+    }
+
     // Flush statistics
 
     reportCount(out, "num flush", numFlush_, prefix);
@@ -41,6 +41,9 @@ public:
     void addArchive(size_t length, eckit::Timer& timer, size_t nfields=1);
     void addRetrieve(size_t length, eckit::Timer& timer);
     void addFlush(eckit::Timer& timer);
+    void addFieldCache(size_t hits, size_t misses, double lookupTime);
+
+    double fieldCacheHitRatio() const;
 
     void report(std::ostream& out, const char* indent) const;
 
@@ -51,6 +54,8 @@ private: // members
     size_t numArchive_;
     size_t numFlush_;
     size_t numRetrieve_;
+    size_t numFieldCacheHit_;
+    size_t numFieldCacheMiss_;
 
     size_t bytesArchive_;
     size_t bytesRetrieve_;
@@ -61,10 +66,12 @@ private: // members
     double elapsedArchive_;
     double elapsedFlush_;
     double elapsedRetrieve_;
+    double elapsedFieldCache_;
 
     double sumArchiveTimingSquared_;
     double sumRetrieveTimingSquared_;
     double sumFlushTimingSquared_;
+    double sumFieldCacheTimingSquared_;
 };
 
 //----------------------------------------------------------------------------------------------------------------------
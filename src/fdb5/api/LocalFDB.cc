@@ -69,10 +69,11 @@ template<typename VisitorType, typename ... Ts>
 APIIterator<typename VisitorType::ValueType> LocalFDB::queryInternal(const FDBToolRequest& request, Ts ... args) {
 
     using ValueType = typename VisitorType::ValueType;
+    using QueueType = typename VisitorType::QueueType;
     using QueryIterator = APIIterator<ValueType>;
-    using AsyncIterator = APIAsyncIterator<ValueType>;
+    using AsyncIterator = APIAsyncIterator<ValueType, QueueType>;
 
-    auto async_worker = [this, request, args...] (Queue<ValueType>& queue) {
+    auto async_worker = [this, request, args...] (QueueType& queue) {
         EntryVisitMechanism mechanism(config_);
         VisitorType visitor(queue, request.request(), args...);
         mechanism.visit(request, visitor);
@@ -19,6 +19,8 @@
 #include "fdb5/api/RemoteFDB.h"
 #include "fdb5/LibFdb5.h"
 #include "fdb5/io/HandleGatherer.h"
+#include "fdb5/remote/ClientConnection.h"
+#include "fdb5/remote/ListElementBatch.h"
 #include "fdb5/remote/Messages.h"
 #include "fdb5/remote/RemoteFieldLocation.h"
 #include "fdb5/api/helpers/FDBToolRequest.h"
@@ -32,9 +34,7 @@
 #include "eckit/distributed/Transport.h"
 #include "eckit/config/Resource.h"
 #include "eckit/serialisation/MemoryStream.h"
-#include "eckit/utils/Translator.h"
 #include "eckit/runtime/Main.h"
-#include "eckit/os/BackTrace.h"
 
 #include "metkit/mars/MarsRequest.h"
 
@@ -42,87 +42,18 @@ using namespace eckit;
 using namespace eckit::net;
 using namespace fdb5::remote;
 
-
-namespace eckit {
-template<> struct Translator<Endpoint, std::string> {
-    std::string operator()(const net::Endpoint& e) {
-        std::stringstream ss;
-        ss << e;
-        return ss.str();
-    }
-};
-}
-
 namespace fdb5 {
 
 //----------------------------------------------------------------------------------------------------------------------
 
-class ConnectionError : public eckit::Exception {
-public:
-    ConnectionError(const int);
-    ConnectionError(const int, const eckit::net::Endpoint&);
-
-    bool retryOnClient() const override { return true; } 
-};
-
-ConnectionError::ConnectionError(const int retries) {
-    std::ostringstream s;
-    s << "Unable to create a connection with the FDB server after " << retries << " retries";
-    reason(s.str());
-    Log::status() << what() << std::endl;
-}
-
-ConnectionError::ConnectionError(const int retries, const eckit::net::Endpoint& endpoint) {
-    std::ostringstream s;
-    s << "Unable to create a connection with the FDB endpoint " << endpoint << " after " << retries << " retries";
-    reason(s.str());
-    Log::status() << what() << std::endl;
-}
-
-//----------------------------------------------------------------------------------------------------------------------
-
-namespace {
-class TCPException : public Exception {
-public:
-    TCPException(const std::string& msg, const CodeLocation& here) :
-        Exception(std::string("TCPException: ") + msg, here) {
-
-        eckit::Log::error() << "TCP Exception; backtrace(): " << std::endl;
-        eckit::Log::error() << eckit::BackTrace::dump() << std::endl;
-    }
-};
-}
-
-class RemoteFDBException : public RemoteException {
-public:
-    RemoteFDBException(const std::string& msg, const net::Endpoint& endpoint):
-        RemoteException(msg, eckit::Translator<Endpoint, std::string>()(endpoint)) {}
-};
-
-//----------------------------------------------------------------------------------------------------------------------
-
-// n.b. if we get integer overflow, we reuse the IDs. This is not a
-//      big deal. The idea that we could be on the 2.1 billionth (successful)
-//      request, and still have an ongoing request 0 is ... laughable.
-
-static uint32_t generateRequestID() {
-
-    static std::mutex m;
-    static uint32_t id = 0;
-
-    std::lock_guard<std::mutex> lock(m);
-    return ++id;
-}
-
-
 RemoteFDB::RemoteFDB(const eckit::Configuration& config, const std::string& name) :
     FDBBase(config, name),
     controlEndpoint_(config.getString("host"), config.getInt("port")),
+    pooled_(config.getBool("connectionPool", eckit::Resource<bool>("fdbRemoteConnectionPool;$FDB_REMOTE_CONNECTION_POOL", true))),
     archiveID_(0),
     maxArchiveQueueLength_(eckit::Resource<size_t>("fdbRemoteArchiveQueueLength;$FDB_REMOTE_ARCHIVE_QUEUE_LENGTH", 200)),
     maxArchiveBatchSize_(config.getInt("maxBatchSize", 1)),
-    retrieveMessageQueue_(eckit::Resource<size_t>("fdbRemoteRetrieveQueueLength;$FDB_REMOTE_RETRIEVE_QUEUE_LENGTH", 200)),
-    connected_(false) {}
+    retrieveMessageQueue_(std::make_shared<MessageQueue>()) {}
 
 
 RemoteFDB::~RemoteFDB() {
@@ -136,390 +67,67 @@ RemoteFDB::~RemoteFDB() {
         eckit::Main::instance().terminate();
     }
 
-    disconnect();
+    // n.b. a pooled connection stays open for reuse by other clients, until it is evicted.
 }
 
 
 // Functions for management of the connection
-
-// Protocol negotiation:
-//
-// i) Connect to server. Send:
-//     - session identification
-//     - supported functionality for protocol negotiation
-//
-// ii) Server responds. Sends:
-//     - returns the client session id (for verification)
-//     - the server session id
-//     - endpoint for data connection
-//     - selected functionality for protocol negotiation
-//
-// iii) Open data connection, and write to server:
-//     - client session id
-//     - server session id
-//
-// This appears quite verbose in terms of protocol negotiation, but the repeated
-// sending of both session ids allows clients and servers to be sure that they are
-// connected to the correct endpoint in a multi-process, multi-host environment.
 //
-// This was an issue on the NextGenIO prototype machine, where TCP connections were
-// getting lost, and/or incorrectly reset, and as a result sessions were being
-// mispaired by the network stack!
+// Connections are obtained from the process-wide ClientConnectionPool, so that many
+// short-lived FDB objects talking to the same server reuse one handshake, one pair of
+// sockets and one listening thread. See ClientConnection for the protocol negotiation.
 
-void RemoteFDB::connect() {
+remote::ClientConnection& RemoteFDB::connection() {
 
-    if (!connected_) {
+    if (!connection_ || !connection_->healthy()) {
 
-        static int fdbMaxConnectRetries = eckit::Resource<int>("fdbMaxConnectRetries", 5);
-
-        try {
-            // Connect to server, and check that the server is happy on the response
-
-            Log::debug<LibFdb5>() << "Connecting to host: " << controlEndpoint_ << std::endl;
-            controlClient_.connect(controlEndpoint_, fdbMaxConnectRetries);
-            writeControlStartupMessage();
-            SessionID serverSession = verifyServerStartupResponse();
-
-            // Connect to the specified data port
-            Log::debug<LibFdb5>() << "Received data endpoint from host: " << dataEndpoint_ << std::endl;
-            dataClient_.connect(dataEndpoint_, fdbMaxConnectRetries);
-            writeDataStartupMessage(serverSession);
-
-            // And the connections are set up. Let everything start up!
-            listeningThread_ = std::thread([this] { listeningThreadLoop(); });
-            connected_ = true;
-        } catch(TooManyRetries& e) {
-            if (controlClient_.isConnected()) {
-                controlClient_.close();
-                throw ConnectionError(fdbMaxConnectRetries, dataEndpoint_);
-            } else {
-                throw ConnectionError(fdbMaxConnectRetries, controlEndpoint_);
-            }
+        if (pooled_) {
+            connection_ = remote::ClientConnectionPool::instance().connection(controlEndpoint_, config_);
+        } else {
+            remote::ClientConnectionPool& pool(remote::ClientConnectionPool::instance());
+            connection_ = std::make_shared<remote::ClientConnection>(
+                controlEndpoint_, pool.compression(config_), pool.bandwidth(config_));
+            connection_->connect();
         }
-    }
-}
-
-void RemoteFDB::disconnect() {
-    if (connected_) {
-
-        // Send termination message
-        controlWrite(fdb5::remote::Message::Exit, generateRequestID());
 
-        listeningThread_.join();
-
-        // Close both the control and data connections
-        controlClient_.close();
-        dataClient_.close();
-        connected_ = false;
+        // Any reads outstanding on a failed connection have been interrupted, so
+        // start afresh.
+        retrieveMessageQueue_ = std::make_shared<MessageQueue>();
     }
-}
-
-void RemoteFDB::writeControlStartupMessage() {
-
-    Buffer payload(4096);
-    MemoryStream s(payload);
-    s << sessionID_;
-    s << controlEndpoint_;
-    s << LibFdb5::instance().remoteProtocolVersion().used();
 
-    // TODO: Abstract this dictionary into a RemoteConfiguration object, which
-    //       understands how to do the negotiation, etc, but uses Value (i.e.
-    //       essentially JSON) over the wire for flexibility.
-    s << availableFunctionality().get();
-
-    controlWrite(fdb5::remote::Message::Startup, 0, payload.data(), s.position());
+    return *connection_;
 }
 
-SessionID RemoteFDB::verifyServerStartupResponse() {
-
-    MessageHeader hdr;
-    controlRead(&hdr, sizeof(hdr));
-
-    ASSERT(hdr.marker == StartMarker);
-    ASSERT(hdr.version == CurrentVersion);
-    ASSERT(hdr.message == fdb5::remote::Message::Startup);
-    ASSERT(hdr.requestID == 0);
+void RemoteFDB::acquireArchiveConnection() {
 
-    Buffer payload(hdr.payloadSize);
-    eckit::FixedString<4> tail;
-    controlRead(payload, hdr.payloadSize);
-    controlRead(&tail, sizeof(tail));
-    ASSERT(tail == EndMarker);
+    ASSERT(!archiveConnection_);
 
-    MemoryStream s(payload);
-    SessionID clientSession(s);
-    SessionID serverSession(s);
-    Endpoint dataEndpoint(s);
-    LocalConfiguration serverFunctionality(s);
-
-    dataEndpoint_ = dataEndpoint;
-
-    if (dataEndpoint_.hostname() != controlEndpoint_.hostname()) {
-        Log::warning() << "Data and control interface hostnames do not match. "
-                       << dataEndpoint_.hostname() << " /= "
-                       << controlEndpoint_.hostname() << std::endl;
-    }
-
-    if (clientSession != sessionID_) {
-        std::stringstream ss;
-        ss << "Session ID does not match session received from server: "
-           << sessionID_ << " != " << clientSession;
-        throw BadValue(ss.str(), Here());
+    if (pooled_) {
+        archiveConnection_ = remote::ClientConnectionPool::instance().archiveConnection(controlEndpoint_, config_);
+    } else {
+        connection();
+        ASSERT(connection_->acquireArchive());
+        archiveConnection_ = connection_;
     }
-
-    return serverSession;
-}
-
-void RemoteFDB::writeDataStartupMessage(const eckit::SessionID& serverSession) {
-
-    Buffer payload(1024);
-    MemoryStream s(payload);
-
-    s << sessionID_;
-    s << serverSession;
-
-    dataWrite(fdb5::remote::Message::Startup, 0, payload.data(), s.position());
 }
 
-eckit::LocalConfiguration RemoteFDB::availableFunctionality() const {
-    eckit::LocalConfiguration conf;
-    std::vector<int> remoteFieldLocationVersions = {1};
-    conf.set("RemoteFieldLocation", remoteFieldLocationVersions);
-    return conf;
-}
-
-void RemoteFDB::listeningThreadLoop() {
-
-    /// @note This routine retrieves BOTH normal API asynchronously returned data, AND
-    /// fields that are being returned by a retrieve() call. These need to go into different
-    /// queues
-    /// --> Test if the requestID is a known API request, otherwise push onto the retrieve queue
-
-
-    /// @note messageQueues_ is a map of requestID:MessageQueue. At the point that
-    /// a request is complete, errored or otherwise killed, it needs to be removed
-    /// from the map. The shared_ptr allows this removal to be asynchronous with
-    /// the actual task cleaning up and returning to the client.
-
-    try {
-
-    MessageHeader hdr;
-    eckit::FixedString<4> tail;
-
-    while (true) {
-
-        dataRead(&hdr, sizeof(hdr));
-
-        ASSERT(hdr.marker == StartMarker);
-        ASSERT(hdr.version == CurrentVersion);
-
-        switch (hdr.message) {
-
-        case fdb5::remote::Message::Exit:
-            return;
-
-        case fdb5::remote::Message::Blob: {
-            Buffer payload(hdr.payloadSize);
-            if (hdr.payloadSize > 0) dataRead(payload, hdr.payloadSize);
-
-            auto it = messageQueues_.find(hdr.requestID);
-            if (it != messageQueues_.end()) {
-                it->second->emplace(std::make_pair(hdr, std::move(payload)));
-            } else {
-                retrieveMessageQueue_.emplace(std::make_pair(hdr, std::move(payload)));
-            }
-            break;
-        }
-
-        case fdb5::remote::Message::Complete: {
-            auto it = messageQueues_.find(hdr.requestID);
-            if (it != messageQueues_.end()) {
-                it->second->close();
-
-                // Remove entry (shared_ptr --> message queue will be destroyed when it
-                // goes out of scope in the worker thread).
-                messageQueues_.erase(it);
-
-            } else {
-                retrieveMessageQueue_.emplace(std::make_pair(hdr, Buffer(0)));
-            }
-            break;
-        }
-
-        case fdb5::remote::Message::Error: {
-
-            auto it = messageQueues_.find(hdr.requestID);
-            if (it != messageQueues_.end()) {
-                std::string msg;
-                if (hdr.payloadSize > 0) {
-                    msg.resize(hdr.payloadSize, ' ');
-                    dataRead(&msg[0], hdr.payloadSize);
-                }
-                it->second->interrupt(std::make_exception_ptr(RemoteFDBException(msg, dataEndpoint_)));
-
-                // Remove entry (shared_ptr --> message queue will be destroyed when it
-                // goes out of scope in the worker thread).
-                messageQueues_.erase(it);
-
-            } else if (hdr.requestID == archiveID_) {
-
-                std::lock_guard<std::mutex> lock(archiveQueuePtrMutex_);
-
-                if (archiveQueue_) {
-                    std::string msg;
-                    if (hdr.payloadSize > 0) {
-                        msg.resize(hdr.payloadSize, ' ');
-                        dataRead(&msg[0], hdr.payloadSize);
-                    }
-
-                    archiveQueue_->interrupt(std::make_exception_ptr(RemoteFDBException(msg, dataEndpoint_)));
-                }
-            } else {
-                Buffer payload(hdr.payloadSize);
-                if (hdr.payloadSize > 0) dataRead(payload, hdr.payloadSize);
-                retrieveMessageQueue_.emplace(std::make_pair(hdr, std::move(payload)));
-            }
-            break;
-        }
-
-        default: {
-            std::stringstream ss;
-            ss << "ERROR: Unexpected message recieved (" << static_cast<int>(hdr.message) << "). ABORTING";
-            Log::status() << ss.str() << std::endl;
-            Log::error() << "Retrieving... " << ss.str() << std::endl;
-            throw SeriousBug(ss.str(), Here());
-        }
-        };
-
-        // Ensure we have consumed exactly the correct amount from the socket.
-
-        dataRead(&tail, sizeof(tail));
-        ASSERT(tail == EndMarker);
-    }
-
-    // We don't want to let exceptions escape inside a worker thread.
-
-    } catch (const std::exception& e) {
-        for (auto& it : messageQueues_) {
-            it.second->interrupt(std::make_exception_ptr(e));
-        }
-        messageQueues_.clear();
-        retrieveMessageQueue_.interrupt(std::make_exception_ptr(e));
-        {
-            std::lock_guard<std::mutex> lock(archiveQueuePtrMutex_);
-            if (archiveQueue_) archiveQueue_->interrupt(std::make_exception_ptr(e));
-        }
-    } catch (...) {
-        for (auto& it : messageQueues_) {
-            it.second->interrupt(std::current_exception());
-        }
-        messageQueues_.clear();
-        retrieveMessageQueue_.interrupt(std::current_exception());
-        {
-            std::lock_guard<std::mutex> lock(archiveQueuePtrMutex_);
-            if (archiveQueue_) archiveQueue_->interrupt(std::current_exception());
-        }
+void RemoteFDB::releaseArchiveConnection() {
+    if (archiveConnection_) {
+        archiveConnection_->releaseArchive();
+        archiveConnection_.reset();
     }
 }
 
-void RemoteFDB::controlWriteCheckResponse(fdb5::remote::Message msg, uint32_t requestID, const void* payload, uint32_t payloadLength) {
-
-    controlWrite(msg, requestID, payload, payloadLength);
-
-    // Wait for the receipt acknowledgement
-
-    MessageHeader response;
-    controlRead(&response, sizeof(MessageHeader));
-
-    handleError(response);
-
-    ASSERT(response.marker == StartMarker);
-    ASSERT(response.version == CurrentVersion);
-    ASSERT(response.message == fdb5::remote::Message::Received);
-
-    eckit::FixedString<4> tail;
-    controlRead(&tail, sizeof(tail));
-    ASSERT(tail == EndMarker);
-}
-
-void RemoteFDB::controlWrite(fdb5::remote::Message msg, uint32_t requestID, const void* payload, uint32_t payloadLength) {
-
-    ASSERT((payload == nullptr) == (payloadLength == 0));
-
-    MessageHeader message(msg, requestID, payloadLength);
-    controlWrite(&message, sizeof(message));
-    if (payload) {
-        controlWrite(payload, payloadLength);
-    }
-    controlWrite(&EndMarker, sizeof(EndMarker));
-}
-
-void RemoteFDB::controlWrite(const void* data, size_t length) {
-    size_t written = controlClient_.write(data, length);
-    if (length != written) {
-        std::stringstream ss;
-        ss << "Write error. Expected " << length << " bytes, wrote " << written;
-        throw TCPException(ss.str(), Here());
-    }
-}
-
-void RemoteFDB::controlRead(void* data, size_t length) {
-    size_t read = controlClient_.read(data, length);
-    if (length != read) {
-        std::stringstream ss;
-        ss << "Read error. Expected " << length << " bytes, read " << read;
-        throw TCPException(ss.str(), Here());
-    }
-}
-
-void RemoteFDB::dataWrite(fdb5::remote::Message msg, uint32_t requestID, const void* payload, uint32_t payloadLength) {
-
-    ASSERT((payload == nullptr) == (payloadLength == 0));
-
-    MessageHeader message(msg, requestID, payloadLength);
-    dataWrite(&message, sizeof(message));
-    if (payload) {
-        dataWrite(payload, payloadLength);
-    }
-    dataWrite(&EndMarker, sizeof(EndMarker));
-}
-
-void RemoteFDB::dataWrite(const void* data, size_t length) {
-    size_t written = dataClient_.write(data, length);
-    if (length != written) {
-        std::stringstream ss;
-        ss << "Write error. Expected " << length << " bytes, wrote " << written;
-        throw TCPException(ss.str(), Here());
-    }
-}
-
-void RemoteFDB::dataRead(void* data, size_t length) {
-    size_t read = dataClient_.read(data, length);
-    if (length != read) {
-        std::stringstream ss;
-        ss << "Read error. Expected " << length << " bytes, read " << read;
-        throw TCPException(ss.str(), Here());
-    }
-}
-
-void RemoteFDB::handleError(const MessageHeader& hdr) {
-
-    ASSERT(hdr.marker == StartMarker);
-    ASSERT(hdr.version == CurrentVersion);
-
-    if (hdr.message == fdb5::remote::Message::Error) {
-        ASSERT(hdr.payloadSize > 9);
-
-        std::string what(hdr.payloadSize, ' ');
-        controlRead(&what[0], hdr.payloadSize);
-        what[hdr.payloadSize] = 0; // Just in case
-
+void RemoteFDB::abandonArchiveConnection() {
+    if (archiveConnection_) {
+        std::shared_ptr<remote::ClientConnection> conn;
+        std::swap(conn, archiveConnection_);
+        if (connection_ == conn) connection_.reset();
         try {
-            eckit::FixedString<4> tail;
-            controlRead(&tail, sizeof(tail));
-        } catch (...) {}
-
-        throw RemoteFDBException(what, controlEndpoint_);
+            conn->disconnect();
+        } catch (std::exception& e) {
+            Log::error() << "Error closing connection to " << conn->controlEndpoint() << ": " << e.what() << std::endl;
+        }
     }
 }
 
@@ -542,14 +150,28 @@ struct BaseAPIHelper {
     typedef T ValueType;
 
     static size_t bufferSize() { return 4096; }
-    static size_t queueSize() { return 100; }
     static fdb5::remote::Message message() { return msgID; }
 
     void encodeExtra(eckit::Stream& s) const {}
     static ValueType valueFromStream(eckit::Stream& s, RemoteFDB* fdb) { return ValueType(s); }
+
+    // Only helpers whose elements the server sends in batches need to decode them
+    template <typename QueueType>
+    static void valuesFromBatch(const eckit::Buffer&, QueueType&, RemoteFDB*) { NOTIMP; }
 };
 
-using ListHelper = BaseAPIHelper<ListElement, fdb5::remote::Message::List>;
+struct ListHelper : BaseAPIHelper<ListElement, fdb5::remote::Message::List> {
+
+    // n.b. decoding is lazy, pacing with the consumer of the (bounded) iterator queue
+    template <typename QueueType>
+    static void valuesFromBatch(const eckit::Buffer& payload, QueueType& queue, RemoteFDB*) {
+        remote::ListElementBatchDecoder batch(payload);
+        ListElement elem;
+        while (batch.next(elem)) {
+            queue.emplace(std::move(elem));
+        }
+    }
+};
 
 struct InspectHelper : BaseAPIHelper<ListElement, fdb5::remote::Message::Inspect> {
 
@@ -557,6 +179,15 @@ struct InspectHelper : BaseAPIHelper<ListElement, fdb5::remote::Message::Inspect
         ListElement elem(s);
         return ListElement(elem.key(), RemoteFieldLocation(fdb, elem.location()).make_shared(), elem.timestamp());
     }
+
+    template <typename QueueType>
+    static void valuesFromBatch(const eckit::Buffer& payload, QueueType& queue, RemoteFDB* fdb) {
+        remote::ListElementBatchDecoder batch(payload);
+        ListElement elem;
+        while (batch.next(elem)) {
+            queue.emplace(ListElement(elem.key(), RemoteFieldLocation(fdb, elem.location()).make_shared(), elem.timestamp()));
+        }
+    }
 };
 
 using StatsHelper = BaseAPIHelper<StatsElement, fdb5::remote::Message::Stats>;
@@ -665,6 +296,9 @@ private:
 // i) Set up a Queue to receive the messages as they come in
 // ii) Encode the request+arguments and send them to the server
 // iii) Return an AsyncIterator that pulls messages off the queue, and returns them to the caller.
+//
+// The elements are only ever decoded on the AsyncIterator's worker thread, so the lock-free
+// SPSCQueue is used between it and the caller.
 
 
 template <typename HelperClass>
@@ -672,17 +306,17 @@ auto RemoteFDB::forwardApiCall(const HelperClass& helper, const FDBToolRequest&
 
     using ValueType = typename HelperClass::ValueType;
     using IteratorType = APIIterator<ValueType>;
-    using AsyncIterator = APIAsyncIterator<ValueType>;
+    using QueueType = SPSCQueue<ValueType>;
+    using AsyncIterator = APIAsyncIterator<ValueType, QueueType>;
 
-    connect();
+    ClientConnection& conn(connection());
 
     // Ensure we have an entry in the message queue before we trigger anything that
     // will result in return messages
 
-    uint32_t id = generateRequestID();
-    auto entry = messageQueues_.emplace(id, std::make_shared<MessageQueue>(HelperClass::queueSize()));
-    ASSERT(entry.second);
-    std::shared_ptr<MessageQueue> messageQueue(entry.first->second);
+    uint32_t id = ClientConnection::generateRequestID();
+    std::shared_ptr<MessageQueue> messageQueue(std::make_shared<MessageQueue>());
+    conn.addRequest(id, messageQueue);
 
     // Encode the request and send it to the server
 
@@ -691,7 +325,12 @@ auto RemoteFDB::forwardApiCall(const HelperClass& helper, const FDBToolRequest&
     s << request;
     helper.encodeExtra(s);
 
-    controlWriteCheckResponse(HelperClass::message(), id, encodeBuffer, s.position());
+    try {
+        conn.controlWriteCheckResponse(HelperClass::message(), id, encodeBuffer, s.position());
+    } catch (...) {
+        conn.removeRequest(id);
+        throw;
+    }
 
     // Return an AsyncIterator to allow the messages to be retrieved in the API
 
@@ -699,11 +338,13 @@ auto RemoteFDB::forwardApiCall(const HelperClass& helper, const FDBToolRequest&
     return IteratorType(
         // n.b. Don't worry about catching exceptions in lambda, as
         // this is handled in the AsyncIterator.
-        new AsyncIterator([messageQueue, remoteFDB](eckit::Queue<ValueType>& queue) {
+        new AsyncIterator([messageQueue, remoteFDB](QueueType& queue) {
             StoredMessage msg = std::make_pair(remote::MessageHeader{}, eckit::Buffer{0});
                         while (true) {
                             if (messageQueue->pop(msg) == -1) {
                                 break;
+                            } else if (msg.first.message == remote::Message::ListBatch) {
+                                HelperClass::valuesFromBatch(msg.second, queue, remoteFDB);
                             } else {
                                 MemoryStream s(msg.second);
                                 queue.emplace(HelperClass::valueFromStream(s, remoteFDB));
@@ -759,17 +400,30 @@ MoveIterator RemoteFDB::move(const FDBToolRequest& request, const eckit::URI& de
 // Here we do archive/flush related stuff
 void RemoteFDB::archive(const Key& key, const void* data, size_t length) {
 
-    connect();
-
     // if there is no archiving thread active, then start one.
     // n.b. reset the archiveQueue_ after a potential flush() cycle.
 
     if (!archiveFuture_.valid()) {
 
+        // The server handles one archive at a time per connection, so we need a
+        // connection whose archive slot is free. This may not be the one used for reads.
+        acquireArchiveConnection();
+
         // Start the archival request on the remote side
         ASSERT(archiveID_ == 0);
-        uint32_t id = generateRequestID();
-        controlWriteCheckResponse(fdb5::remote::Message::Archive, id);
+        uint32_t id = ClientConnection::generateRequestID();
+        archiveConnection_->addArchiveRequest(id, [this](std::exception_ptr e) {
+            std::lock_guard<std::mutex> lock(archiveQueuePtrMutex_);
+            if (archiveQueue_) archiveQueue_->interrupt(e);
+        });
+
+        try {
+            archiveConnection_->controlWriteCheckResponse(fdb5::remote::Message::Archive, id);
+        } catch (...) {
+            archiveConnection_->removeRequest(id);
+            abandonArchiveConnection();
+            throw;
+        }
         archiveID_ = id;
 
         // Reset the queue after previous done/errors
@@ -807,19 +461,37 @@ void RemoteFDB::flush() {
             std::lock_guard<std::mutex> lock(archiveQueuePtrMutex_);
             archiveQueue_->close();
         }
-        FDBStats stats = archiveFuture_.get();
-        ASSERT(!archiveQueue_);
-        archiveID_ = 0;
+        // Whatever happens, this archive is over. On success the archive slot is handed back to
+        // the connection, on error the connection is closed.
+        uint32_t id = archiveID_;
+        FDBStats stats;
+        try {
+            stats = archiveFuture_.get();
+            ASSERT(!archiveQueue_);
+            archiveID_ = 0;
+
+            ASSERT(stats.numFlush() == 0);
+            size_t numArchive = stats.numArchive();
 
-        ASSERT(stats.numFlush() == 0);
-        size_t numArchive = stats.numArchive();
+            Buffer sendBuf(4096);
+            MemoryStream s(sendBuf);
+            s << numArchive;
 
-        Buffer sendBuf(4096);
-        MemoryStream s(sendBuf);
-        s << numArchive;
+            // The flush call is blocking
+            archiveConnection_->controlWriteCheckResponse(fdb5::remote::Message::Flush, ClientConnection::generateRequestID(), sendBuf, s.position());
+        } catch (...) {
+            archiveID_ = 0;
+            {
+                std::lock_guard<std::mutex> lock(archiveQueuePtrMutex_);
+                archiveQueue_.reset();
+            }
+            archiveConnection_->removeRequest(id);
+            abandonArchiveConnection();
+            throw;
+        }
 
-        // The flush call is blocking
-        controlWriteCheckResponse(fdb5::remote::Message::Flush, generateRequestID(), sendBuf, s.position());
+        archiveConnection_->removeRequest(id);
+        releaseArchiveConnection();
 
         internalStats_ += stats;
     }
@@ -858,12 +530,13 @@ FDBStats RemoteFDB::archiveThreadLoop(uint32_t requestID) {
         // And note that we are done. (don't time this, as already being blocked
         // on by the ::flush() routine)
 
-        MessageHeader hdr(fdb5::remote::Message::Flush, requestID);
-        dataWrite(&hdr, sizeof(hdr));
-        dataWrite(&EndMarker, sizeof(EndMarker));
+        archiveConnection_->dataWrite(fdb5::remote::Message::Flush, requestID);
 
         archiveID_ = 0;
-        archiveQueue_.reset();
+        {
+            std::lock_guard<std::mutex> lock(archiveQueuePtrMutex_);
+            archiveQueue_.reset();
+        }
 
     } catch (...) {
         archiveQueue_->interrupt(std::current_exception());
@@ -901,23 +574,30 @@ long RemoteFDB::sendArchiveData(uint32_t id, const std::vector<std::pair<Key, Bu
                           sizeof(MessageHeader) + sizeof(EndMarker));
     }
 
-    // Construct the containing message
+    // Construct the contents of the containing message, which may be compressed as a
+    // whole before sending.
 
-    MessageHeader message(fdb5::remote::Message::MultiBlob, id, containedSize);
-    dataWrite(&message, sizeof(message));
+    Buffer batch(containedSize);
+    char* pos = batch;
 
     long dataSent = 0;
 
     for (size_t i = 0; i < count; ++i) {
         MessageHeader containedMessage(fdb5::remote::Message::Blob, id, elements[i].second.size() + keySizes[i]);
-        dataWrite(&containedMessage, sizeof(containedMessage));
-        dataWrite(keyBuffers[i], keySizes[i]);
-        dataWrite(elements[i].second.data(), elements[i].second.size());
-        dataWrite(&EndMarker, sizeof(EndMarker));
+        ::memcpy(pos, &containedMessage, sizeof(containedMessage));
+        pos += sizeof(containedMessage);
+        ::memcpy(pos, keyBuffers[i], keySizes[i]);
+        pos += keySizes[i];
+        ::memcpy(pos, elements[i].second.data(), elements[i].second.size());
+        pos += elements[i].second.size();
+        ::memcpy(pos, &EndMarker, sizeof(EndMarker));
+        pos += sizeof(EndMarker);
         dataSent += elements[i].second.size();
     }
 
-    dataWrite(&EndMarker, sizeof(EndMarker));
+    ASSERT(size_t(pos - batch) == containedSize);
+
+    archiveConnection_->dataWriteBatch(id, batch, containedSize);
     return dataSent;
 }
 
@@ -931,11 +611,13 @@ void RemoteFDB::sendArchiveData(uint32_t id, const Key& key, const void* data, s
     MemoryStream keyStream(keyBuffer);
     keyStream << key;
 
+    ClientConnection& conn(*archiveConnection_);
+
     MessageHeader message(fdb5::remote::Message::Blob, id, length + keyStream.position());
-    dataWrite(&message, sizeof(message));
-    dataWrite(keyBuffer, keyStream.position());
-    dataWrite(data, length);
-    dataWrite(&EndMarker, sizeof(EndMarker));
+    conn.dataWrite(&message, sizeof(message));
+    conn.dataWrite(keyBuffer, keyStream.position());
+    conn.dataWrite(data, length);
+    conn.dataWrite(&EndMarker, sizeof(EndMarker));
 }
 
 // -----------------------------------------------------------------------------------------------------
@@ -951,6 +633,11 @@ void RemoteFDB::sendArchiveData(uint32_t id, const Key& key, const void* data, s
 ///       in the stream
 ///
 /// --> Retrieve is a _streaming_ service.
+///
+/// A handle that is closed (or destroyed) before it has been read to the end discards the rest
+/// of its stream. Otherwise the remaining data would be read by the next handle sharing the
+/// queue. Handles that are not read at all leave their data buffered, until the connection
+/// abandons them (see ClientConnection).
 
 namespace {
 
@@ -959,15 +646,26 @@ class FDBRemoteDataHandle : public DataHandle {
 public: // methods
 
     FDBRemoteDataHandle(uint32_t requestID,
-                        RemoteFDB::MessageQueue& queue,
+                        std::shared_ptr<RemoteFDB::MessageQueue> queue,
+                        std::shared_ptr<ClientConnection> connection,
                         const net::Endpoint& remoteEndpoint) :
         requestID_(requestID),
         queue_(queue),
+        connection_(connection),
         remoteEndpoint_(remoteEndpoint),
         pos_(0),
         overallPosition_(0),
         currentBuffer_(0),
         complete_(false) {}
+
+    ~FDBRemoteDataHandle() override {
+        try {
+            discard();
+        } catch (std::exception& e) {
+            Log::error() << "Error discarding remote read " << requestID_ << ": " << e.what() << std::endl;
+        }
+    }
+
     virtual bool canSeek() const override { return false; }
 
 private: // methods
@@ -982,7 +680,9 @@ private: // methods
     void openForWrite(const Length&) override { NOTIMP; }
     void openForAppend(const Length&) override { NOTIMP; }
     long write(const void*, long) override { NOTIMP; }
-    void close() override {}
+    void close() override {
+        discard();
+    }
 
     long read(void* pos, long sz) override {
 
@@ -993,15 +693,10 @@ private: // methods
         // If we are in the DataHandle, then there MUST be data to read
 
         RemoteFDB::StoredMessage msg = std::make_pair(remote::MessageHeader{}, eckit::Buffer{0});
-        ASSERT(queue_.pop(msg) != -1);
-
-        // TODO; Error handling in the retrieve pathway
+        if (!next(msg)) return 0;
 
         const MessageHeader& hdr(msg.first);
 
-        ASSERT(hdr.marker == StartMarker);
-        ASSERT(hdr.version == CurrentVersion);
-
         // Handle any remote errors communicated from the server
 
         if (hdr.message == fdb5::remote::Message::Error) {
@@ -1012,7 +707,6 @@ private: // methods
         // Are we now complete
 
         if (hdr.message == fdb5::remote::Message::Complete) {
-            complete_ = 0;
             return 0;
         }
 
@@ -1025,6 +719,53 @@ private: // methods
         return bufferRead(pos, sz);
     }
 
+    // Pop the next message of this request. Returns false if the connection has closed the queue.
+
+    bool next(RemoteFDB::StoredMessage& msg) {
+
+        ASSERT(!complete_);
+
+        try {
+            if (queue_->pop(msg) == -1) {
+                complete_ = true;
+                return false;
+            }
+        } catch (...) {
+            // The connection failed, and its routes have already been dropped
+            complete_ = true;
+            throw;
+        }
+
+        const MessageHeader& hdr(msg.first);
+
+        ASSERT(hdr.marker == StartMarker);
+        ASSERT(hdr.version == CurrentVersion);
+        ASSERT(hdr.requestID == requestID_);
+
+        // The connection drops the route once the request has ended
+
+        if (hdr.message == fdb5::remote::Message::Complete || hdr.message == fdb5::remote::Message::Error) {
+            complete_ = true;
+        }
+
+        return true;
+    }
+
+    // Consume whatever remains of the stream. The server sends the whole of a field, so this is
+    // bounded, and each message popped frees the data buffered for it.
+
+    void discard() {
+
+        Buffer nullBuffer(0);
+        std::swap(currentBuffer_, nullBuffer);
+        pos_ = 0;
+
+        RemoteFDB::StoredMessage msg = std::make_pair(remote::MessageHeader{}, eckit::Buffer{0});
+        while (!complete_) {
+            if (!next(msg)) break;
+        }
+    }
+
     // A helper function that returns some, or all, of a buffer that has
     // already been retrieved.
 
@@ -1062,7 +803,8 @@ private: // methods
 private: // members
 
     uint32_t requestID_;
-    RemoteFDB::MessageQueue& queue_;
+    std::shared_ptr<RemoteFDB::MessageQueue> queue_;
+    std::shared_ptr<ClientConnection> connection_;  // outlives the request's route
     net::Endpoint remoteEndpoint_;
     size_t pos_;
     Offset overallPosition_;
@@ -1099,22 +841,38 @@ eckit::DataHandle* RemoteFDB::dataHandle(const FieldLocation& fieldLocation) {
 
 eckit::DataHandle* RemoteFDB::dataHandle(const FieldLocation& fieldLocation, const Key& remapKey) {
 
-    connect();
+    ClientConnection& conn(connection());
 
     Buffer encodeBuffer(4096);
     MemoryStream s(encodeBuffer);
     s << fieldLocation;
     s << remapKey;
 
-    uint32_t id = generateRequestID();
+    uint32_t id = ClientConnection::generateRequestID();
 
-    controlWriteCheckResponse(fdb5::remote::Message::Read, id, encodeBuffer, s.position());
+    // Reads for this RemoteFDB share one ordered queue. See note above. If the connection
+    // abandoned the reads, as they were not consumed, those that follow start afresh.
+    if (retrieveMessageQueue_->interrupted()) {
+        retrieveMessageQueue_ = std::make_shared<MessageQueue>();
+    }
+    conn.addStreamRequest(id, retrieveMessageQueue_);
 
-    return new FDBRemoteDataHandle(id, retrieveMessageQueue_, controlEndpoint_);
+    try {
+        conn.controlWriteCheckResponse(fdb5::remote::Message::Read, id, encodeBuffer, s.position());
+    } catch (...) {
+        conn.removeRequest(id);
+        throw;
+    }
+
+    return new FDBRemoteDataHandle(id, retrieveMessageQueue_, connection_, controlEndpoint_);
 }
 
 void RemoteFDB::print(std::ostream &s) const {
-    s << "RemoteFDB(host=" << controlEndpoint_ << ", data=" << dataEndpoint_ << ")";
+    s << "RemoteFDB(host=" << controlEndpoint_;
+    if (connection_) {
+        s << ", data=" << connection_->dataEndpoint();
+    }
+    s << ")";
 }
 
 static FDBBuilder<RemoteFDB> remoteFdbBuilder("remote");
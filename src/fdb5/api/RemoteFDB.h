@@ -25,12 +25,10 @@
 #include "eckit/container/Queue.h"
 #include "eckit/io/Buffer.h"
 #include "eckit/net/Endpoint.h"
-#include "eckit/net/TCPClient.h"
-#include "eckit/net/TCPStream.h"
-#include "eckit/runtime/SessionID.h"
 
 #include "fdb5/api/FDB.h"
 #include "fdb5/api/FDBFactory.h"
+#include "fdb5/remote/ClientConnection.h"
 #include "fdb5/remote/Messages.h"
 
 namespace fdb5 {
@@ -43,8 +41,8 @@ class RemoteFDB : public FDBBase {
 
 public: // types
 
-    using StoredMessage = std::pair<remote::MessageHeader, eckit::Buffer>;
-    using MessageQueue = eckit::Queue<StoredMessage>;
+    using StoredMessage = remote::ClientConnection::StoredMessage;
+    using MessageQueue = remote::ClientConnection::MessageQueue;
     using ArchiveQueue = eckit::Queue<std::pair<fdb5::Key, eckit::Buffer>>;
 
 public: // method
@@ -88,31 +86,16 @@ private: // methods
 
     // Methods to control the connection
 
-    void connect();
-    void disconnect();
+    /// Obtain a (possibly shared) connection for API calls and reads, replacing
+    /// the current one if it has failed.
+    remote::ClientConnection& connection();
 
-    // Session negotiation with the server
-    void writeControlStartupMessage();
-    eckit::SessionID verifyServerStartupResponse();
-    void writeDataStartupMessage(const eckit::SessionID& serverSession);
+    void acquireArchiveConnection();
+    void releaseArchiveConnection();
 
-    // Construct dictionary for protocol negotiation
-
-    eckit::LocalConfiguration availableFunctionality() const;
-
-    // Listen to the dataClient for incoming messages, and push them onto
-    // appropriate queues.
-    void listeningThreadLoop();
-
-    // Handle data going in either direction on the wire
-    void controlWriteCheckResponse(remote::Message msg, uint32_t requestID, const void* payload=nullptr, uint32_t payloadLength=0);
-    void controlWrite(remote::Message msg, uint32_t requestID, const void* payload=nullptr, uint32_t payloadLength=0);
-    void controlWrite(const void* data, size_t length);
-    void controlRead(void* data, size_t length);
-    void dataWrite(remote::Message msg, uint32_t requestID, const void* payload=nullptr, uint32_t payloadLength=0);
-    void dataWrite(const void* data, size_t length);
-    void dataRead(void* data, size_t length);
-    void handleError(const remote::MessageHeader& hdr);
+    /// After an error the state of the archive on the server is unknown, so the connection is
+    /// closed (and so dropped from the pool) rather than released for reuse
+    void abandonArchiveConnection();
 
     // Worker for the API functions
 
@@ -132,26 +115,15 @@ private: // methods
 
 private: // members
 
-    eckit::SessionID sessionID_;
-
     eckit::net::Endpoint controlEndpoint_;
-    eckit::net::Endpoint dataEndpoint_;
 
-    eckit::net::TCPClient controlClient_;
-    eckit::net::TCPClient dataClient_;
+    // If pooling is disabled, the connection is private to this RemoteFDB
+    bool pooled_;
 
-    FDBStats internalStats_;
+    std::shared_ptr<remote::ClientConnection> connection_;
+    std::shared_ptr<remote::ClientConnection> archiveConnection_;
 
-    // Listen on the dataClient for incoming messages.
-    std::thread listeningThread_;
-
-    // Where do we put received messages
-    // @note This is a map of requestID:MessageQueue. At the point that a request is
-    // complete, errored or otherwise killed, it needs to be removed from the map.
-    // The shared_ptr allows this removal to be asynchronous with the actual task
-    // cleaning up and returning to the client.
-
-    std::map<uint32_t, std::shared_ptr<MessageQueue>> messageQueues_;
+    FDBStats internalStats_;
 
     // Asynchronised helpers for archiving
 
@@ -166,9 +138,7 @@ private: // members
     size_t maxArchiveBatchSize_;
     std::mutex archiveQueuePtrMutex_;
     std::unique_ptr<ArchiveQueue> archiveQueue_;
-    MessageQueue retrieveMessageQueue_;
-
-    bool connected_;
+    std::shared_ptr<MessageQueue> retrieveMessageQueue_;
 };
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -13,6 +13,10 @@
  * (Project ID: 671951) www.nextgenio.eu
  */
 
+#include <memory>
+#include <set>
+
+#include "eckit/config/Resource.h"
 #include "eckit/log/Log.h"
 #include "eckit/message/Message.h"
 #include "eckit/utils/Tokenizer.h"
@@ -32,10 +36,68 @@ static FDBBuilder<SelectFDB> selectFdbBuilder("select");
 
 //----------------------------------------------------------------------------------------------------------------------
 
+SelectMatcher::SelectMatcher(const std::string& pattern) :
+    kind_(Kind::Regex),
+    regex_(pattern) {
+
+    std::string body(pattern);
+
+    bool anchored = false;
+    bool grouped = false;
+    if (body.size() >= 2 && body.front() == '^' && body.back() == '$' && body[body.size() - 2] != '\\') {
+        anchored = true;
+        body = body.substr(1, body.size() - 2);
+        if (body.size() >= 4 && body.compare(0, 2, "\\(") == 0 && body.compare(body.size() - 2, 2, "\\)") == 0) {
+            grouped = true;
+            body = body.substr(2, body.size() - 4);
+        }
+    }
+
+    std::vector<std::string> alternatives;
+    size_t start = 0;
+    while (true) {
+        size_t pos = body.find("\\|", start);
+        alternatives.push_back(body.substr(start, pos == std::string::npos ? pos : pos - start));
+        if (pos == std::string::npos) break;
+        start = pos + 2;
+    }
+
+    // n.b. ^a\|b$ anchors each alternative differently. Leave it to the regex.
+    if (anchored && !grouped && alternatives.size() > 1) return;
+    if (!anchored && grouped) return;
+
+    for (const std::string& alt : alternatives) {
+        if (alt.empty() || alt.find_first_of(".[]*^$\\") != std::string::npos) return;
+    }
+
+    if (anchored) {
+        kind_ = Kind::Exact;
+        exact_.insert(alternatives.begin(), alternatives.end());
+    } else {
+        kind_ = Kind::Contains;
+        contains_ = alternatives;
+    }
+}
+
+bool SelectMatcher::match(const std::string& value) const {
+    switch (kind_) {
+        case Kind::Exact:
+            return exact_.find(value) != exact_.end();
+        case Kind::Contains:
+            for (const std::string& alt : contains_) {
+                if (value.find(alt) != std::string::npos) return true;
+            }
+            return false;
+        default:
+            return regex_.match(value);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
 
-std::map<std::string, eckit::Regex> parseFDBSelect(const eckit::LocalConfiguration& config) {
+std::map<std::string, SelectMatcher> parseFDBSelect(const eckit::LocalConfiguration& config) {
 
-    std::map<std::string, eckit::Regex> selectDict;
+    std::map<std::string, SelectMatcher> selectDict;
 
     // Select operates as constraints of the form: class=regex,key=regex,...
     // By default, there is no select.
@@ -56,7 +118,7 @@ std::map<std::string, eckit::Regex> parseFDBSelect(const eckit::LocalConfigurati
             throw eckit::UserError(ss.str(), Here());
         }
 
-        selectDict[kv[0]] = eckit::Regex(kv[1]);
+        selectDict.emplace(kv[0], SelectMatcher(kv[1]));
     }
 
     return selectDict;
@@ -72,30 +134,60 @@ SelectFDB::SelectFDB(const Config& config, const std::string& name) :
         throw eckit::UserError("fdbs not specified for select FDB", Here());
     }
 
+    std::set<std::string> keywords;
     for (const auto& c : config.getSubConfigs("fdbs")) {
         subFdbs_.emplace_back(std::make_pair(parseFDBSelect(c), FDB(c)));
+        for (const auto& kv : subFdbs_.back().first) keywords.insert(kv.first);
     }
+    selectKeywords_.assign(keywords.begin(), keywords.end());
 }
 
 
 SelectFDB::~SelectFDB() {}
 
-void SelectFDB::archive(const Key& key, const void* data, size_t length) {
+// Which sub-FDB a key is archived to only depends on the values of the select keywords,
+// and there are few distinct combinations of those in a stream of fields.
 
-    for (auto& iter : subFdbs_) {
+size_t SelectFDB::route(const Key& key) {
 
-        const SelectMap& select(iter.first);
-        FDB& fdb(iter.second);
+    static size_t maxRoutes = eckit::Resource<size_t>("fdbSelectMaxCachedRoutes", 4096);
 
-        if (matches(key, select, true)) {
-            fdb.archive(key, data, length);
-            return;
+    std::string values;
+    for (const std::string& keyword : selectKeywords_) {
+        eckit::StringDict::const_iterator i = key.find(keyword);
+        if (i == key.end()) {
+            values += '\1';
+        } else {
+            values += i->second;
         }
+        values += '\0';
+    }
+
+    auto it = routes_.find(values);
+    if (it != routes_.end()) return it->second;
+
+    size_t idx = 0;
+    for (; idx < subFdbs_.size(); ++idx) {
+        if (matches(key, subFdbs_[idx].first, true)) break;
+    }
+
+    if (routes_.size() >= maxRoutes) routes_.clear();
+    routes_.emplace(std::move(values), idx);
+
+    return idx;
+}
+
+void SelectFDB::archive(const Key& key, const void* data, size_t length) {
+
+    size_t idx = route(key);
+
+    if (idx == subFdbs_.size()) {
+        std::stringstream ss;
+        ss << "No matching fdb for key: " << key;
+        throw eckit::UserError(ss.str(), Here());
     }
 
-    std::stringstream ss;
-    ss << "No matching fdb for key: " << key;
-    throw eckit::UserError(ss.str(), Here());
+    subFdbs_[idx].second.archive(key, data, length);
 }
 
 ListIterator SelectFDB::inspect(const metkit::mars::MarsRequest& request) {
@@ -117,12 +209,16 @@ ListIterator SelectFDB::inspect(const metkit::mars::MarsRequest& request) {
 }
 
 template <typename QueryFN>
-auto SelectFDB::queryInternal(const FDBToolRequest& request, const QueryFN& fn) -> decltype(fn(*(FDB*)(nullptr), request)) {
+auto SelectFDB::queryInternal(const FDBToolRequest& request, const QueryFN& fn, bool ordered) -> decltype(fn(*(FDB*)(nullptr), request)) {
 
     using QueryIterator = decltype(fn(*(FDB*)(nullptr), request));
     using ValueType = typename QueryIterator::value_type;
 
-    std::queue<APIIterator<ValueType>> iterQueue;
+    // Query the matching sub-FDBs concurrently, and return elements as soon as any has them.
+    // Listings are returned sub-FDB by sub-FDB, in the configured order, so that duplicates
+    // are always resolved the same way.
+
+    std::vector<typename APIFanInIterator<ValueType>::Generator> subFdbs;
 
     for (auto& iter : subFdbs_) {
 
@@ -130,11 +226,17 @@ auto SelectFDB::queryInternal(const FDBToolRequest& request, const QueryFN& fn)
         FDB& fdb(iter.second);
 
         if (matches(request.request(), select, false) || request.all()) {
-            iterQueue.push(fn(fdb, request));
+            // Issue the query here rather than in the generator, so that every matching sub-FDB sees it
+            // even if the returned iterator is discarded unread.
+            auto it = std::make_shared<APIIterator<ValueType>>(fn(fdb, request));
+            subFdbs.emplace_back([it] { return std::move(*it); });
         }
     }
 
-    return QueryIterator(new APIAggregateIterator<ValueType>(std::move(iterQueue)));
+    if (ordered) {
+        return QueryIterator(new APIOrderedFanInIterator<ValueType>(std::move(subFdbs)));
+    }
+    return QueryIterator(new APIFanInIterator<ValueType>(std::move(subFdbs)));
 }
 
 ListIterator SelectFDB::list(const FDBToolRequest& request) {
@@ -142,7 +244,7 @@ ListIterator SelectFDB::list(const FDBToolRequest& request) {
     return queryInternal(request,
                          [](FDB& fdb, const FDBToolRequest& request) {
                             return fdb.list(request);
-                         });
+                         }, true);
 }
 
 DumpIterator SelectFDB::dump(const FDBToolRequest& request, bool simple) {
@@ -213,7 +315,7 @@ bool SelectFDB::matches(const Key &key, const SelectMap &select, bool requireMis
     for (const auto& kv : select) {
 
         const std::string& k(kv.first);
-        const eckit::Regex& re(kv.second);
+        const SelectMatcher& re(kv.second);
 
         eckit::StringDict::const_iterator i = key.find(k);
         if (i == key.end()) {
@@ -231,7 +333,7 @@ bool SelectFDB::matches(const metkit::mars::MarsRequest& request, const SelectMa
     for (const auto& kv : select) {
 
         const std::string& k(kv.first);
-        const eckit::Regex& re(kv.second);
+        const SelectMatcher& re(kv.second);
 
         const std::vector<std::string>& request_values = request.values(k, /* emptyOK */ true);
 
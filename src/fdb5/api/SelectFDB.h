@@ -22,6 +22,8 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "eckit/utils/Regex.h"
 
@@ -32,11 +34,41 @@ namespace fdb5 {
 
 //----------------------------------------------------------------------------------------------------------------------
 
+/// The value constraint of a select condition (keyword=regex).
+///
+/// Matching follows eckit::Regex (POSIX basic regular expressions, unanchored), but the
+/// common forms are compiled to plain string comparisons:
+///   - literals (od) and literal alternations (od\|rd) match as substrings
+///   - anchored literals (^od$) and alternations (^\(od\|rd\)$) match as hash lookups
+/// Anything else is matched with the regex.
+
+class SelectMatcher {
+
+public: // methods
+
+    SelectMatcher(const std::string& pattern);
+
+    bool match(const std::string& value) const;
+
+private: // types
+
+    enum class Kind { Exact, Contains, Regex };
+
+private: // members
+
+    Kind kind_;
+    std::unordered_set<std::string> exact_;
+    std::vector<std::string> contains_;
+    eckit::Regex regex_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
 class SelectFDB : public FDBBase {
 
 private: // types
 
-    using SelectMap = std::map<std::string, eckit::Regex>;
+    using SelectMap = std::map<std::string, SelectMatcher>;
 
 public: // methods
 
@@ -78,11 +110,18 @@ private: // methods
     bool matches(const metkit::mars::MarsRequest& request, const SelectMap& select, bool requireMissing) const;
 
     template <typename QueryFN>
-    auto queryInternal(const FDBToolRequest& request, const QueryFN& fn) -> decltype(fn(*(FDB*)(nullptr), request));
+    auto queryInternal(const FDBToolRequest& request, const QueryFN& fn, bool ordered=false) -> decltype(fn(*(FDB*)(nullptr), request));
+
+    /// Index of the sub-FDB to archive the key into, or subFdbs_.size() if none
+    size_t route(const Key& key);
 
 private: // members
 
     std::vector<std::pair<SelectMap, FDB>> subFdbs_;
+
+    // Routing decisions for archive, by the values of the keywords used in any select
+    std::vector<std::string> selectKeywords_;
+    std::unordered_map<std::string, size_t> routes_;
 };
 
 //----------------------------------------------------------------------------------------------------------------------
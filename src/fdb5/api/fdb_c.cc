@@ -8,6 +8,13 @@
  * does it submit to any jurisdiction.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <numeric>
+
+#include "eckit/config/Resource.h"
+#include "eckit/io/AutoCloser.h"
 #include "eckit/io/MemoryHandle.h"
 #include "eckit/io/FileDescHandle.h"
 #include "eckit/message/Message.h"
@@ -17,6 +24,7 @@
 
 #include "fdb5/fdb5_version.h"
 #include "fdb5/api/FDB.h"
+#include "fdb5/api/helpers/AsyncExecutor.h"
 #include "fdb5/api/helpers/FDBToolRequest.h"
 #include "fdb5/api/helpers/ListIterator.h"
 #include "fdb5/database/Key.h"
@@ -178,6 +186,109 @@ private:
     DataHandle* dh_;
 };
 
+struct fdb_scatterreader_t {
+public:
+    fdb_scatterreader_t(FDB& fdb, const metkit::mars::MarsRequest& request) : cancelled_(false) {
+        ListIterator it = fdb.inspect(request);
+        ListElement el;
+        while (it.next(el)) {
+            fields_.emplace_back(std::move(el));
+        }
+    }
+
+    size_t count() const { return fields_.size(); }
+
+    void lengths(size_t lengths[]) const {
+        for (size_t i = 0; i < fields_.size(); ++i) {
+            lengths[i] = fields_[i].location().length();
+        }
+    }
+
+    void key(size_t index, fdb_split_key_t* key) const {
+        ASSERT(index < fields_.size());
+        ASSERT(key);
+        key->set(fields_[index].key());
+    }
+
+    int read(void* buffers[], const size_t sizes[], size_t parallel) {
+
+        static size_t defaultParallel = eckit::Resource<size_t>("fdbScatterReadParallelism;$FDB_SCATTER_READ_PARALLELISM", 8);
+
+        for (size_t i = 0; i < fields_.size(); ++i) {
+            ASSERT(buffers[i]);
+            if (sizes[i] < fields_[i].location().length()) {
+                std::stringstream ss;
+                ss << "Buffer " << i << " of " << sizes[i] << " bytes is too small for field of "
+                   << fields_[i].location().length() << " bytes";
+                throw eckit::UserError(ss.str(), Here());
+            }
+        }
+
+        // Read the fields in storage order, to make the most of any readahead
+
+        std::vector<size_t> order(fields_.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            const FieldLocation& la(fields_[a].location());
+            const FieldLocation& lb(fields_[b].location());
+            return std::make_pair(la.uri().name(), la.offset()) < std::make_pair(lb.uri().name(), lb.offset());
+        });
+
+        // Each worker claims the next unread field, so at most `parallel` reads are in flight
+
+        std::atomic<size_t> next(0);
+        auto worker = [this, &order, &next, buffers] {
+            size_t i;
+            while (!cancelled_ && (i = next++) < order.size()) {
+                readField(fields_[order[i]], buffers[order[i]]);
+            }
+        };
+
+        if (parallel == 0) parallel = defaultParallel;
+        size_t nworkers = std::max<size_t>(1, std::min(parallel, fields_.size()));
+
+        std::vector<std::future<void>> workers;
+        AsyncWaitGuard<decltype(workers)> waitForWorkers(workers);
+        for (size_t n = 0; n < nworkers; ++n) {
+            workers.emplace_back(AsyncExecutor::instance().submit(worker));
+        }
+
+        // n.b. wait for all the workers before reporting any error, as they refer to this stack
+        for (auto& w : workers) w.wait();
+        for (auto& w : workers) w.get();
+
+        return cancelled_ ? FDB_ERROR_CANCELLED : FDB_SUCCESS;
+    }
+
+    void cancel() { cancelled_ = true; }
+
+private:
+    void readField(const ListElement& el, void* buffer) {
+        const FieldLocation& loc(el.location());
+        std::unique_ptr<DataHandle> dh(loc.dataHandle());
+        long length = loc.length();
+
+        dh->openForRead();
+        eckit::AutoCloser<DataHandle> closer(*dh);
+
+        char* p = static_cast<char*>(buffer);
+        long done = 0;
+        while (done < length && !cancelled_) {
+            long n = dh->read(p + done, length - done);
+            if (n <= 0) {
+                std::stringstream ss;
+                ss << "Short read of field from " << loc.uri() << ": " << done << " of " << length << " bytes";
+                throw eckit::ReadError(ss.str(), Here());
+            }
+            done += n;
+        }
+    }
+
+private:
+    std::vector<ListElement> fields_;
+    std::atomic<bool> cancelled_;
+};
+
 //----------------------------------------------------------------------------------------------------------------------
 
 /* Error handling */
@@ -195,6 +306,8 @@ const char* fdb_error_string(int err) {
         return g_current_error_str.c_str();
     case FDB_ITERATION_COMPLETE:
         return "Iteration complete";
+    case FDB_ERROR_CANCELLED:
+        return "Cancelled";
     default:
         return "<unknown>";
     };
@@ -316,6 +429,25 @@ int fdb_archive(fdb_handle_t* fdb, fdb_key_t* key, const char* data, size_t leng
         fdb->archive(*key, data, length);
     });
 }
+int fdb_archive_batch(fdb_handle_t* fdb, fdb_key_t* keys[], const char* data[], const size_t lengths[], size_t count) {
+    return wrapApiFunction([fdb, keys, data, lengths, count] {
+        ASSERT(fdb);
+        if (count == 0) return;
+        ASSERT(keys);
+        ASSERT(data);
+        ASSERT(lengths);
+
+        std::vector<FDB::KeyedField> fields;
+        fields.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            ASSERT(keys[i]);
+            ASSERT(data[i]);
+            fields.push_back(FDB::KeyedField{*keys[i], data[i], lengths[i]});
+        }
+
+        fdb->archive(fields.data(), fields.size());
+    });
+}
 int fdb_archive_multiple(fdb_handle_t* fdb, fdb_request_t* req, const char* data, size_t length) {
     return wrapApiFunction([fdb, req, data, length] {
         ASSERT(fdb);
@@ -367,6 +499,54 @@ int fdb_delete_handle(fdb_handle_t* fdb) {
     });
 }
 
+int fdb_new_scatterreader(fdb_handle_t* fdb, fdb_request_t* req, fdb_scatterreader_t** sr) {
+    return wrapApiFunction([fdb, req, sr] {
+        ASSERT(fdb);
+        ASSERT(req);
+        ASSERT(sr);
+        *sr = new fdb_scatterreader_t(*fdb, req->request());
+    });
+}
+int fdb_scatterreader_count(fdb_scatterreader_t* sr, size_t* count) {
+    return wrapApiFunction([sr, count] {
+        ASSERT(sr);
+        ASSERT(count);
+        *count = sr->count();
+    });
+}
+int fdb_scatterreader_lengths(fdb_scatterreader_t* sr, size_t lengths[]) {
+    return wrapApiFunction([sr, lengths] {
+        ASSERT(sr);
+        ASSERT(lengths || sr->count() == 0);
+        sr->lengths(lengths);
+    });
+}
+int fdb_scatterreader_splitkey(fdb_scatterreader_t* sr, size_t index, fdb_split_key_t* key) {
+    return wrapApiFunction([sr, index, key] {
+        ASSERT(sr);
+        sr->key(index, key);
+    });
+}
+int fdb_scatterreader_read(fdb_scatterreader_t* sr, void* buffers[], const size_t sizes[], size_t parallel) {
+    return wrapApiFunction(std::function<int()>{[sr, buffers, sizes, parallel] {
+        ASSERT(sr);
+        ASSERT((buffers && sizes) || sr->count() == 0);
+        return sr->read(buffers, sizes, parallel);
+    }});
+}
+int fdb_scatterreader_cancel(fdb_scatterreader_t* sr) {
+    return wrapApiFunction([sr] {
+        ASSERT(sr);
+        sr->cancel();
+    });
+}
+int fdb_delete_scatterreader(fdb_scatterreader_t* sr) {
+    return wrapApiFunction([sr] {
+        ASSERT(sr);
+        delete sr;
+    });
+}
+
 /** ancillary functions for creating/destroying FDB objects */
 
 int fdb_new_key(fdb_key_t** key) {
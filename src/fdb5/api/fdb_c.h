@@ -63,7 +63,8 @@ enum FdbErrorValues {
     FDB_SUCCESS                  = 0,
     FDB_ERROR_GENERAL_EXCEPTION  = 1,
     FDB_ERROR_UNKNOWN_EXCEPTION  = 2,
-    FDB_ITERATION_COMPLETE       = 3
+    FDB_ITERATION_COMPLETE       = 3,
+    FDB_ERROR_CANCELLED          = 4
 };
 
 /** Returns a human-readable error message for the last error given an error code
@@ -305,6 +306,17 @@ int fdb_new_handle(fdb_handle_t** fdb);
  */
 int fdb_archive(fdb_handle_t* fdb, fdb_key_t* key, const char* data, size_t length);
 
+/** Archives a batch of fields, whose keys are already known, to a FDB instance.
+ * \warning this is a low-level API. As for #fdb_archive, the keys and data are not checked for consistency
+ * \param fdb FDB instance.
+ * \param keys Array of #count keys used for indexing and archiving the data
+ * \param data Array of #count pointers to the binary data to archive
+ * \param lengths Array of #count sizes of the data to archive with the corresponding key
+ * \param count Number of fields to archive
+ * \returns Return code (#FdbErrorValues)
+ */
+int fdb_archive_batch(fdb_handle_t* fdb, fdb_key_t* keys[], const char* data[], const size_t lengths[], size_t count);
+
 /** Archives multiple messages to a FDB instance.
  * \param fdb FDB instance.
  * \param req If Request #req is not nullptr, the number of messages and their metadata are checked against the provided request 
@@ -345,6 +357,69 @@ int fdb_delete_handle(fdb_handle_t* fdb);
 
 /** @} */
 
+
+/** \defgroup ScatterReader */
+/** @{ */
+
+struct fdb_scatterreader_t;
+/** Opaque type for the ScatterReader object. Reads the fields matching a request directly into caller-supplied buffers. */
+typedef struct fdb_scatterreader_t fdb_scatterreader_t;
+
+/** Finds the fields that match a fully specified request, so that their sizes are known before any data is read.
+ * \param fdb FDB instance. Must outlive the ScatterReader
+ * \param req User Request
+ * \param sr ScatterReader instance. Returned instance must be deleted using #fdb_delete_scatterreader.
+ * \returns Return code (#FdbErrorValues)
+ */
+int fdb_new_scatterreader(fdb_handle_t* fdb, fdb_request_t* req, fdb_scatterreader_t** sr);
+
+/** Returns the number of fields found.
+ * \param sr ScatterReader instance
+ * \param count Number of fields
+ * \returns Return code (#FdbErrorValues)
+ */
+int fdb_scatterreader_count(fdb_scatterreader_t* sr, size_t* count);
+
+/** Returns the size in bytes of each of the fields found.
+ * \param sr ScatterReader instance
+ * \param lengths Array of (at least) #fdb_scatterreader_count sizes, to be filled in
+ * \returns Return code (#FdbErrorValues)
+ */
+int fdb_scatterreader_lengths(fdb_scatterreader_t* sr, size_t lengths[]);
+
+/** Lazy extraction of the key of a field, key metadata can be retrieved with fdb_splitkey_next_metadata.
+ * \param sr ScatterReader instance
+ * \param index Index of the field, less than #fdb_scatterreader_count
+ * \param key SplitKey instance (must be already initialised by #fdb_new_splitkey)
+ * \returns Return code (#FdbErrorValues)
+ */
+int fdb_scatterreader_splitkey(fdb_scatterreader_t* sr, size_t index, fdb_split_key_t* key);
+
+/** Reads each field directly into its own buffer. Fields are read in parallel, with at most #parallel reads in flight.
+ * \param sr ScatterReader instance
+ * \param buffers Array of #fdb_scatterreader_count destination buffers, one per field
+ * \param sizes Array of the capacities of the #buffers, which must be at least the corresponding field lengths
+ * \param parallel Maximum number of concurrent reads. If zero, a default is used
+ * \returns Return code (#FdbErrorValues). FDB_ERROR_CANCELLED if #fdb_scatterreader_cancel was called, in which case
+ *          the contents of the buffers are undefined
+ */
+int fdb_scatterreader_read(fdb_scatterreader_t* sr, void* buffers[], const size_t sizes[], size_t parallel);
+
+/** Stops a #fdb_scatterreader_read in progress as soon as possible. May be called from any thread.
+ * \note The ScatterReader cannot be read from after it has been cancelled
+ * \param sr ScatterReader instance
+ * \returns Return code (#FdbErrorValues)
+ */
+int fdb_scatterreader_cancel(fdb_scatterreader_t* sr);
+
+/** Deallocates ScatterReader object and associated resources.
+ * \param sr ScatterReader instance
+ * \returns Return code (#FdbErrorValues)
+ */
+int fdb_delete_scatterreader(fdb_scatterreader_t* sr);
+
+/** @} */
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 
 #ifdef __cplusplus
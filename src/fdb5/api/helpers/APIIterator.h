@@ -21,10 +21,17 @@
 
 #include "eckit/container/Queue.h"
 
+#include "fdb5/api/helpers/AsyncExecutor.h"
+#include "fdb5/api/helpers/SPSCQueue.h"
+
+#include <atomic>
 #include <functional>
+#include <future>
 #include <memory>
 #include <queue>
 #include <exception>
+#include <thread>
+#include <vector>
 
 /*
  * Given a standard, copyable, element, provide a mechanism for iterating over
@@ -112,18 +119,27 @@ private: // members
 //
 // --> Use a (mutex protected) queue.
 // --> Producer/consumer relationship
+//
+// If the worker function only pushes elements from its own thread, the lock-free
+// SPSCQueue can be used as the QueueType instead.
+//
+// The worker runs on the shared AsyncExecutor. If the iterator is destroyed early,
+// a worker that has not yet started is skipped, and a running one is interrupted at
+// its next push.
 
-template <typename ValueType>
+template <typename ValueType, typename QueueType = eckit::Queue<ValueType>>
 class APIAsyncIterator : public APIIteratorBase<ValueType> {
 
 public: // methods
 
-    APIAsyncIterator(std::function<void(eckit::Queue<ValueType>&)> workerFn,
+    APIAsyncIterator(std::function<void(QueueType&)> workerFn,
                      size_t queueSize=100) :
-        queue_(queueSize) {
+        queue_(queueSize),
+        cancelled_(false) {
 
-        // Add a call to set_done() on the eckit::Queue.
+        // Add a call to set_done() on the queue.
         auto fullWorker = [workerFn, this] {
+            if (cancelled_) return;
             try {
                 workerFn(queue_);
                 queue_.close();
@@ -133,28 +149,163 @@ public: // methods
             }
         };
 
-        workerThread_ = std::thread(fullWorker);
+        worker_ = AsyncExecutor::instance().submit(fullWorker);
     }
 
     virtual ~APIAsyncIterator() override {
         if (!queue_.closed()) {
+            cancelled_ = true;
             queue_.interrupt(std::make_exception_ptr(eckit::SeriousBug("Destructing incomplete async queue", Here())));
         }
-        ASSERT(workerThread_.joinable());
-        workerThread_.join();
+        ASSERT(worker_.valid());
+        worker_.wait();
+    }
+
+    virtual bool next(ValueType& elem) override {
+        return !(queue_.pop(elem) == -1);
+    }
+
+private: // members
+
+    QueueType queue_;
+
+    std::atomic<bool> cancelled_;
+    std::future<void> worker_;
+};
+
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// Combine together a number of iterators, consuming them all concurrently. Elements are
+// returned as soon as any of the iterators produces them, so the order between (but not
+// within) the iterators is lost.
+//
+// Each iterator is obtained from its supplied function, and consumed, on its own
+// (AsyncExecutor) thread. n.b. SelectFDB and DistFDB issue their queries eagerly in
+// queryInternal, so that every lane sees them even if this iterator is abandoned, and
+// the functions only hand over the resulting iterators.
+
+template <typename ValueType>
+class APIFanInIterator : public APIIteratorBase<ValueType> {
+
+public: // types
+
+    using Generator = std::function<APIIterator<ValueType>()>;
+
+public: // methods
+
+    APIFanInIterator(std::vector<Generator>&& generators, size_t queueSize=100) :
+        queue_(queueSize),
+        remaining_(generators.size()),
+        cancelled_(false) {
+
+        if (generators.empty()) {
+            queue_.close();
+            return;
+        }
+
+        try {
+            for (Generator& generator : generators) {
+                workers_.emplace_back(AsyncExecutor::instance().submit([this, generator] {
+                    if (cancelled_) return;
+                    try {
+                        APIIterator<ValueType> iterator(generator());
+                        ValueType elem;
+                        while (iterator.next(elem)) {
+                            queue_.emplace(std::move(elem));
+                        }
+                        if (--remaining_ == 0) {
+                            queue_.close();
+                        }
+                    } catch (...) {
+                        // Really avoid calling std::terminate on worker thread.
+                        queue_.interrupt(std::current_exception());
+                    }
+                }));
+            }
+        } catch (...) {
+            // The workers already started refer to this iterator, which is never completed
+            stop();
+            throw;
+        }
+    }
+
+    virtual ~APIFanInIterator() override {
+        stop();
     }
 
     virtual bool next(ValueType& elem) override {
         return !(queue_.pop(elem) == -1);
     }
 
+private: // methods
+
+    void stop() {
+        if (!queue_.closed()) {
+            cancelled_ = true;
+            queue_.interrupt(std::make_exception_ptr(eckit::SeriousBug("Destructing incomplete fan-in queue", Here())));
+        }
+        for (std::future<void>& w : workers_) {
+            w.wait();
+        }
+    }
+
 private: // members
 
     eckit::Queue<ValueType> queue_;
+    std::atomic<size_t> remaining_;
 
-    std::thread workerThread_;
+    std::atomic<bool> cancelled_;
+    std::vector<std::future<void>> workers_;
 };
 
+//----------------------------------------------------------------------------------------------------------------------
+
+// As APIFanInIterator, the iterators are consumed concurrently, but here the elements of each
+// are returned in turn, in the order that the iterators were supplied. The combined order is
+// then deterministic, e.g. so that removing duplicates always keeps the same element.
+//
+// Each iterator is produced into its own bounded queue, so the later ones only run ahead by
+// up to queueSize elements.
+
+template <typename ValueType>
+class APIOrderedFanInIterator : public APIIteratorBase<ValueType> {
+
+public: // types
+
+    using Generator = typename APIFanInIterator<ValueType>::Generator;
+
+public: // methods
+
+    APIOrderedFanInIterator(std::vector<Generator>&& generators, size_t queueSize=100) :
+        iterators_(start(std::move(generators), queueSize)) {}
+
+    virtual ~APIOrderedFanInIterator() override {}
+
+    virtual bool next(ValueType& elem) override {
+        return iterators_.next(elem);
+    }
+
+private: // methods
+
+    static std::queue<APIIterator<ValueType>> start(std::vector<Generator>&& generators, size_t queueSize) {
+        std::queue<APIIterator<ValueType>> iterators;
+        for (Generator& generator : generators) {
+            iterators.emplace(new APIAsyncIterator<ValueType>([generator](eckit::Queue<ValueType>& queue) {
+                APIIterator<ValueType> iterator(generator());
+                ValueType elem;
+                while (iterator.next(elem)) {
+                    queue.emplace(std::move(elem));
+                }
+            }, queueSize));
+        }
+        return iterators;
+    }
+
+private: // members
+
+    APIAggregateIterator<ValueType> iterators_;
+};
 
 //----------------------------------------------------------------------------------------------------------------------
 
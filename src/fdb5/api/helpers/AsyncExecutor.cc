@@ -0,0 +1,111 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <chrono>
+#include <thread>
+
+#include "eckit/config/Resource.h"
+#include "eckit/exception/Exceptions.h"
+#include "eckit/log/Log.h"
+
+#include "fdb5/api/helpers/AsyncExecutor.h"
+
+namespace fdb5 {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+AsyncExecutor& AsyncExecutor::instance() {
+    // n.b. never destroyed. The detached worker threads may outlive static destruction.
+    static AsyncExecutor* executor = new AsyncExecutor;
+    return *executor;
+}
+
+AsyncExecutor::AsyncExecutor() :
+    maxIdle_(eckit::Resource<size_t>("fdbAsyncMaxIdleThreads;$FDB_ASYNC_MAX_IDLE_THREADS", 64)),
+    idleTimeout_(eckit::Resource<size_t>("fdbAsyncIdleTimeout;$FDB_ASYNC_IDLE_TIMEOUT", 60)),
+    threads_(0),
+    idle_(0),
+    threadsCreated_(0),
+    tasksRun_(0) {}
+
+AsyncExecutor::~AsyncExecutor() {}
+
+void AsyncExecutor::enqueue(std::function<void()>&& task) {
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Never leave a task waiting for a busy thread. At worst this starts a thread that then
+    // finds no work, if a busy thread picks the task up first.
+
+    if (tasks_.size() < idle_) {
+        tasks_.emplace_back(std::move(task));
+        ++tasksRun_;
+        cv_.notify_one();
+        return;
+    }
+
+    // n.b. the new thread can't take the task until the lock is released, and if it can't be
+    //      started the task is never queued
+
+    std::thread worker(&AsyncExecutor::workerLoop, this);
+    worker.detach();
+    ++threads_;
+    ++threadsCreated_;
+
+    tasks_.emplace_back(std::move(task));
+    ++tasksRun_;
+}
+
+void AsyncExecutor::workerLoop() {
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+
+        if (!tasks_.empty()) {
+            std::function<void()> task(std::move(tasks_.front()));
+            tasks_.pop_front();
+            lock.unlock();
+
+            try {
+                task();
+            }
+            catch (std::exception& e) {
+                // Tasks from submit() capture their own exceptions
+                eckit::Log::error() << "** " << e.what() << " Caught in " << Here() << std::endl;
+                eckit::Log::error() << "** Exception is ignored" << std::endl;
+            }
+
+            // Release anything captured by the task before waiting for more
+            task = nullptr;
+            lock.lock();
+            continue;
+        }
+
+        if (idle_ >= maxIdle_) break;
+
+        ++idle_;
+        bool woken = cv_.wait_for(lock, std::chrono::seconds(idleTimeout_), [this] { return !tasks_.empty(); });
+        --idle_;
+
+        if (!woken) break;
+    }
+
+    --threads_;
+}
+
+AsyncExecutor::Stats AsyncExecutor::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Stats{threads_, idle_, threadsCreated_, tasksRun_};
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace fdb5
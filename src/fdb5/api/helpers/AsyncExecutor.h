@@ -0,0 +1,122 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+/// @date   Oct 2026
+
+#ifndef fdb5_helpers_AsyncExecutor_H
+#define fdb5_helpers_AsyncExecutor_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+
+#include "eckit/memory/NonCopyable.h"
+
+namespace fdb5 {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// The shared pool of threads on which the asynchronous parts of the API run (the producers
+/// behind APIAsyncIterators, DistFDB lanes, server side API calls, ...).
+///
+/// Tasks are typically long running, and block on bounded queues whilst waiting for their
+/// consumers, so they must never wait for a free thread. A task is given to an idle thread if
+/// there is one, and a new thread is started otherwise. Threads that finish a task wait to be
+/// reused, up to fdbAsyncMaxIdleThreads of them, for at most fdbAsyncIdleTimeout seconds.
+///
+/// Setting fdbAsyncMaxIdleThreads to 0 gives one thread per task.
+
+class AsyncExecutor : private eckit::NonCopyable {
+
+public: // types
+
+    struct Stats {
+        size_t threads;         // currently alive
+        size_t idleThreads;     // of which waiting for work
+        size_t threadsCreated;  // since startup
+        size_t tasks;           // since startup
+    };
+
+public: // methods
+
+    static AsyncExecutor& instance();
+
+    /// Run fn on a pooled thread. The future becomes ready once it has completed, and holds
+    /// its result, or the exception that it threw. If submit() throws, fn is not run.
+    ///
+    /// n.b. unlike for std::async, destroying the future does not wait for the task. A task that
+    ///      refers to its submitter's state must be waited for before that state goes, however
+    ///      the submitter's scope is left (see AsyncWaitGuard).
+    template <typename F>
+    auto submit(F&& fn) -> std::future<decltype(fn())> {
+        using ResultType = decltype(fn());
+        auto task = std::make_shared<std::packaged_task<ResultType()>>(std::forward<F>(fn));
+        std::future<ResultType> result = task->get_future();
+        enqueue([task] { (*task)(); });
+        return result;
+    }
+
+    Stats stats() const;
+
+private: // methods
+
+    AsyncExecutor();
+    ~AsyncExecutor();
+
+    void enqueue(std::function<void()>&& task);
+    void workerLoop();
+
+private: // members
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+
+    std::deque<std::function<void()>> tasks_;
+
+    size_t maxIdle_;
+    size_t idleTimeout_;
+
+    size_t threads_;
+    size_t idle_;
+    size_t threadsCreated_;
+    size_t tasksRun_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Waits for all the futures in a container when destroyed, including when unwinding. For
+/// tasks that refer to the stack of the scope that submitted them.
+
+template <typename Futures>
+class AsyncWaitGuard : private eckit::NonCopyable {
+
+public: // methods
+
+    explicit AsyncWaitGuard(Futures& futures) : futures_(futures) {}
+
+    ~AsyncWaitGuard() {
+        for (auto& f : futures_) {
+            if (f.valid()) f.wait();
+        }
+    }
+
+private: // members
+
+    Futures& futures_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace fdb5
+
+#endif
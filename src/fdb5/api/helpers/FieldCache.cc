@@ -0,0 +1,291 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include "eckit/exception/Exceptions.h"
+#include "eckit/io/DataHandle.h"
+
+#include "fdb5/api/helpers/FieldCache.h"
+#include "fdb5/api/helpers/ListIterator.h"
+#include "fdb5/database/FieldLocation.h"
+
+using namespace eckit;
+
+namespace fdb5 {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+namespace {
+
+/// Serves a field from its cached copy
+
+class CachedFieldHandle : public DataHandle {
+
+public: // methods
+
+    CachedFieldHandle(std::shared_ptr<const Buffer> data) :
+        data_(std::move(data)),
+        pos_(0) {}
+
+    bool canSeek() const override { return true; }
+
+private: // methods
+
+    void print(std::ostream& s) const override {
+        s << "CachedFieldHandle(size=" << data_->size() << ")";
+    }
+
+    Length openForRead() override {
+        pos_ = 0;
+        return estimate();
+    }
+    void openForWrite(const Length&) override { NOTIMP; }
+    void openForAppend(const Length&) override { NOTIMP; }
+    long write(const void*, long) override { NOTIMP; }
+    void close() override {}
+
+    long read(void* pos, long sz) override {
+        long read = std::min(sz, long(data_->size() - pos_));
+        ::memcpy(pos, static_cast<const char*>(data_->data()) + pos_, read);
+        pos_ += read;
+        return read;
+    }
+
+    Offset seek(const Offset& offset) override {
+        pos_ = std::min(static_cast<size_t>(static_cast<long long>(offset)), data_->size());
+        return pos_;
+    }
+
+    Offset position() override { return pos_; }
+    Length estimate() override { return data_->size(); }
+    Length size() override { return data_->size(); }
+
+private: // members
+
+    std::shared_ptr<const Buffer> data_;
+    size_t pos_;
+};
+
+/// Reads fields from their location, and adds each to the cache once it has been read in full.
+/// Handles on the same file merge into one, reading the fields in turn.
+
+class ReadThroughFieldHandle : public DataHandle {
+
+public: // methods
+
+    ReadThroughFieldHandle(std::weak_ptr<FieldCache> cache, const std::string& key, time_t timestamp,
+                           const Offset& offset, DataHandle* handle, size_t length) :
+        cache_(cache),
+        handle_(handle),
+        segment_(0),
+        segmentPos_(0) {
+        segments_.push_back(Segment{key, timestamp, offset, length});
+    }
+
+    bool canSeek() const override { return false; }
+
+    bool merge(DataHandle* other) override {
+        ReadThroughFieldHandle* rhs = dynamic_cast<ReadThroughFieldHandle*>(other);
+        if (!rhs) return false;
+        if (cache_.owner_before(rhs->cache_) || rhs->cache_.owner_before(cache_)) return false;
+        if (!handle_->merge(rhs->handle_.get())) return false;
+        segments_.insert(segments_.end(), rhs->segments_.begin(), rhs->segments_.end());
+        return true;
+    }
+
+    /// n.b. a sorted handle reads its ranges in order of offset, so the fields are sorted to match
+    bool compress(bool sorted) override {
+        if (sorted) {
+            std::stable_sort(segments_.begin(), segments_.end(), [](const Segment& a, const Segment& b) {
+                return a.offset < b.offset;
+            });
+        }
+        return handle_->compress(sorted);
+    }
+
+private: // types
+
+    struct Segment {
+        std::string key;
+        time_t timestamp;
+        Offset offset;
+        size_t length;
+    };
+
+private: // methods
+
+    void print(std::ostream& s) const override {
+        s << "ReadThroughFieldHandle(" << *handle_ << ")";
+    }
+
+    Length openForRead() override {
+        segment_ = 0;
+        startSegment();
+        return handle_->openForRead();
+    }
+    void openForWrite(const Length&) override { NOTIMP; }
+    void openForAppend(const Length&) override { NOTIMP; }
+    long write(const void*, long) override { NOTIMP; }
+
+    long read(void* pos, long sz) override {
+        long read = handle_->read(pos, sz);
+
+        const char* p = static_cast<const char*>(pos);
+        size_t remaining = (read > 0) ? read : 0;
+        while (remaining > 0 && segment_ < segments_.size()) {
+            size_t n = std::min(remaining, segments_[segment_].length - segmentPos_);
+            ::memcpy(static_cast<char*>(data_->data()) + segmentPos_, p, n);
+            p += n;
+            remaining -= n;
+            segmentPos_ += n;
+            if (segmentPos_ == segments_[segment_].length) {
+                std::shared_ptr<FieldCache> cache = cache_.lock();
+                if (cache) cache->insert(segments_[segment_].key, segments_[segment_].timestamp, std::move(data_));
+                ++segment_;
+                startSegment();
+            }
+        }
+        return read;
+    }
+
+    void close() override {
+        handle_->close();
+        data_.reset();
+    }
+
+    Length estimate() override { return handle_->estimate(); }
+    Length size() override { return handle_->size(); }
+
+    void startSegment() {
+        segmentPos_ = 0;
+        data_.reset();
+        if (segment_ < segments_.size()) data_.reset(new Buffer(segments_[segment_].length));
+    }
+
+private: // members
+
+    std::weak_ptr<FieldCache> cache_;
+    std::vector<Segment> segments_;
+
+    std::unique_ptr<DataHandle> handle_;
+
+    // The field being read
+    std::shared_ptr<Buffer> data_;
+    size_t segment_;
+    size_t segmentPos_;
+};
+
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+FieldCache::FieldCache(size_t capacity, size_t maxFieldSize) :
+    capacity_(capacity),
+    maxFieldSize_(std::min(maxFieldSize, capacity)),
+    size_(0) {}
+
+
+std::string FieldCache::key(const ListElement& element) {
+    const FieldLocation& location(element.location());
+    std::ostringstream ss;
+    ss << location.uri() << ':' << location.offset() << ':' << location.length();
+    return ss.str();
+}
+
+
+DataHandle* FieldCache::cachedHandle(const ListElement& element) {
+    std::shared_ptr<const Buffer> data = lookup(key(element), element.timestamp());
+    return data ? new CachedFieldHandle(std::move(data)) : nullptr;
+}
+
+
+DataHandle* FieldCache::readThroughHandle(const ListElement& element) {
+
+    const FieldLocation& location(element.location());
+    size_t length = location.length();
+
+    DataHandle* dh = location.dataHandle();
+    if (length == 0 || length > maxFieldSize_) return dh;
+
+    return new ReadThroughFieldHandle(shared_from_this(), key(element), element.timestamp(), location.offset(), dh, length);
+}
+
+
+std::shared_ptr<const Buffer> FieldCache::lookup(const std::string& key, time_t timestamp) {
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return std::shared_ptr<const Buffer>();
+
+    // The field has since been found in a newer index. The cached copy is stale.
+
+    if (it->second->timestamp < timestamp) {
+        erase(it->second);
+        return std::shared_ptr<const Buffer>();
+    }
+
+    // An older version of the field (e.g. from a lower priority database) is not the one cached
+
+    if (it->second->timestamp != timestamp) return std::shared_ptr<const Buffer>();
+
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return lru_.front().data;
+}
+
+
+void FieldCache::insert(const std::string& key, time_t timestamp, std::shared_ptr<const Buffer> data) {
+
+    ASSERT(data);
+    if (data->size() > maxFieldSize_) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        if (it->second->timestamp > timestamp) return;
+        erase(it->second);
+    }
+
+    while (!lru_.empty() && size_ + data->size() > capacity_) {
+        erase(std::prev(lru_.end()));
+    }
+
+    size_ += data->size();
+    lru_.push_front(Entry{key, timestamp, std::move(data)});
+    entries_.emplace(key, lru_.begin());
+}
+
+
+void FieldCache::erase(std::list<Entry>::iterator it) {
+    size_ -= it->data->size();
+    entries_.erase(it->key);
+    lru_.erase(it);
+}
+
+
+size_t FieldCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+
+size_t FieldCache::count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace fdb5
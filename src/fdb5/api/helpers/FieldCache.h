@@ -0,0 +1,100 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+/// @date   Oct 2026
+
+#ifndef fdb5_api_FieldCache_H
+#define fdb5_api_FieldCache_H
+
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "eckit/io/Buffer.h"
+#include "eckit/memory/NonCopyable.h"
+
+namespace eckit {
+class DataHandle;
+}
+
+namespace fdb5 {
+
+class ListElement;
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// An in-process cache of the data of retrieved fields, for long-running services that are asked
+/// for the same fields repeatedly.
+///
+/// Fields are identified by where their data is stored (URI, offset and length), which changes
+/// whenever a field is re-archived, and by the timestamp of the index they were found in, in case
+/// the storage is reused (e.g. after a wipe). A cached copy from an older index is stale, and is
+/// dropped. The least recently used fields are evicted to keep the data within the capacity.
+///
+/// Missing fields are not read eagerly. The read-through handle reads from the field's location,
+/// and the field is only cached once it has been read in full. Read-through handles on the same
+/// file merge, as their underlying handles do, so that adjacent fields are still read together.
+
+class FieldCache : public std::enable_shared_from_this<FieldCache>,
+                   private eckit::NonCopyable {
+
+public: // methods
+
+    FieldCache(size_t capacity, size_t maxFieldSize);
+
+    /// Returns a handle on the cached data of the field, or nullptr if it is not cached
+    eckit::DataHandle* cachedHandle(const ListElement& element);
+
+    /// Returns a handle on the field's location, that caches the field once it has been read
+    eckit::DataHandle* readThroughHandle(const ListElement& element);
+
+    static std::string key(const ListElement& element);
+
+    std::shared_ptr<const eckit::Buffer> lookup(const std::string& key, time_t timestamp);
+    void insert(const std::string& key, time_t timestamp, std::shared_ptr<const eckit::Buffer> data);
+
+    size_t capacity() const { return capacity_; }
+    size_t size() const;
+    size_t count() const;
+
+private: // types
+
+    struct Entry {
+        std::string key;
+        time_t timestamp;
+        std::shared_ptr<const eckit::Buffer> data;
+    };
+
+private: // methods
+
+    void erase(std::list<Entry>::iterator it);
+
+private: // members
+
+    const size_t capacity_;
+    const size_t maxFieldSize_;
+
+    mutable std::mutex mutex_;
+
+    // Most recently used first
+    std::list<Entry> lru_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+
+    size_t size_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace fdb5
+
+#endif
@@ -15,8 +15,13 @@
 
 #include "fdb5/api/helpers/ListIterator.h"
 
+#include <functional>
+#include <map>
+
 #include "eckit/log/JSON.h"
 
+#include "metkit/hypercube/HyperCube.h"
+
 namespace fdb5 {
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -71,4 +76,107 @@ void ListElement::encode(eckit::Stream &s) const {
 
 //----------------------------------------------------------------------------------------------------------------------
 
+namespace {
+
+// Finaliser from splitmix64, to spread the bits of the combined std::hash values
+uint64_t mix(uint64_t h) {
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+}
+
+// n.b. the sum over the keyword/value pairs does not depend on how the key is split into parts
+
+uint64_t ListElementDeduplicator::hash(const ListElement& elem) {
+    std::hash<std::string> h;
+    uint64_t result = 0;
+    for (const Key& part : elem.key()) {
+        for (const auto& kv : part) {
+            result += mix(h(kv.first) * 31 + h(kv.second));
+        }
+    }
+    return result;
+}
+
+void ListElementDeduplicator::add(ListElement&& elem) {
+
+    uint64_t h = hash_(elem);
+
+    // Only compare the keys themselves when the hashes match (i.e. almost only for true duplicates)
+
+    auto range = index_.equal_range(h);
+    if (range.first != range.second) {
+        Key key = elem.combinedKey();
+        for (auto it = range.first; it != range.second; ++it) {
+            ListElement& existing(elements_[it->second]);
+            if (existing.combinedKey() == key) {
+                if (existing.timestamp() < elem.timestamp()) {
+                    existing = std::move(elem);
+                }
+                return;
+            }
+        }
+    }
+
+    index_.emplace(h, elements_.size());
+    elements_.emplace_back(std::move(elem));
+}
+
+std::vector<metkit::mars::MarsRequest> ListElementDeduplicator::vacantRequests() const {
+
+    std::vector<metkit::mars::MarsRequest> result;
+    if (elements_.empty()) return result;
+
+    // Count the fields found for each value of each axis
+
+    std::map<std::string, std::map<std::string, size_t>> axes;
+
+    for (const ListElement& elem : elements_) {
+        for (const Key& part : elem.key()) {
+            for (const auto& kv : part) {
+                ++axes[kv.first][kv.second];
+            }
+        }
+    }
+
+    // The fields form a full hypercube if each value of an axis has as many fields as there are
+    // combinations of the values of the other axes.
+
+    size_t expected = 1;
+    for (const auto& axis : axes) {
+        expected *= axis.second.size();
+    }
+
+    bool full = (elements_.size() == expected);
+    for (const auto& axis : axes) {
+        for (const auto& value : axis.second) {
+            full = full && (value.second == expected / axis.second.size());
+        }
+    }
+    if (full) return result;
+
+    metkit::mars::MarsRequest cubeRequest = elements_.front().combinedKey().request();
+    for (const ListElement& elem : elements_) {
+        cubeRequest.merge(elem.combinedKey().request());
+    }
+
+    metkit::hypercube::HyperCube cube(cubeRequest);
+    for (const ListElement& elem : elements_) {
+        cube.clear(elem.combinedKey().request());
+    }
+
+    for (const auto& request : cube.vacantRequests()) {
+        result.push_back(request);
+    }
+
+    return result;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
 } // namespace fdb5
@@ -20,10 +20,14 @@
 #define fdb5_ListIterator_H
 
 #include <vector>
+#include <unordered_map>
 #include <unordered_set>
 #include <memory>
 #include <iosfwd>
 #include <chrono>
+#include <cstdint>
+
+#include "metkit/mars/MarsRequest.h"
 
 #include "fdb5/database/Key.h"
 #include "fdb5/database/FieldLocation.h"
@@ -94,6 +98,44 @@ using ListAsyncIterator = APIAsyncIterator<ListElement>;
 
 //----------------------------------------------------------------------------------------------------------------------
 
+/// Removes duplicate fields (with the same combined key) from a stream of ListElements, keeping
+/// the most recently archived. Elements are identified by a hash of their key parts, so no
+/// combined Key (or MarsRequest) is built per element. The unique elements are kept in the
+/// order that they were first seen.
+
+class ListElementDeduplicator {
+public: // types
+
+    using Hash = uint64_t (*)(const ListElement&);
+
+public: // methods
+
+    /// n.b. the hash function may be replaced, e.g. to check the handling of collisions
+    explicit ListElementDeduplicator(Hash hash = &ListElementDeduplicator::hash) : hash_(hash) {}
+
+    void add(ListElement&& elem);
+
+    const std::vector<ListElement>& elements() const { return elements_; }
+
+    /// The requests for the fields missing from the tensor product of the values found on each
+    /// axis. The (expensive) hypercube is only built if counting the fields per axis value
+    /// shows that something is missing.
+    std::vector<metkit::mars::MarsRequest> vacantRequests() const;
+
+private: // methods
+
+    static uint64_t hash(const ListElement& elem);
+
+private: // members
+
+    Hash hash_;
+
+    std::vector<ListElement> elements_;
+    std::unordered_multimap<uint64_t, size_t> index_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
 class ListIterator : public APIIterator<ListElement> {
 public:
     ListIterator(APIIterator<ListElement>&& iter, bool deduplicate=false) :
@@ -0,0 +1,268 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+/// @date   Oct 2026
+
+#ifndef fdb5_helpers_SPSCQueue_H
+#define fdb5_helpers_SPSCQueue_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "eckit/exception/Exceptions.h"
+#include "eckit/memory/NonCopyable.h"
+
+namespace fdb5 {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// A bounded, lock-free, ring buffer queue for exactly one producer and one consumer thread.
+///
+/// The interface matches that of eckit::Queue as used by the APIAsyncIterator, so that it can
+/// be used in its place where elements are produced by a single thread. Neither side takes a
+/// lock to pass elements, and each side only reads the other's position once it has used up
+/// the elements (or space) that it last saw. A side that has to wait spins briefly, then
+/// yields, and then blocks on a condition variable until the other side wakes it. The lock is
+/// only taken to wait, or to wake a side that is waiting.
+///
+/// close() and interrupt() behave as for eckit::Queue. Once interrupted, both sides rethrow
+/// the exception when they would otherwise wait, including those already waiting.
+
+template <typename ValueType>
+class SPSCQueue : private eckit::NonCopyable {
+
+public: // methods
+
+    SPSCQueue(size_t size) :
+        slots_(capacityFor(size)),
+        mask_(slots_.size() - 1),
+        head_(0),
+        tailCache_(0),
+        tail_(0),
+        headCache_(0),
+        state_(Open),
+        waiting_(0) {}
+
+    // Producer
+
+    template <typename... Args>
+    void emplace(Args&&... args) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        waitForSpace(tail);
+        slots_[tail & mask_] = ValueType(std::forward<Args>(args)...);
+        tail_.store(tail + 1, std::memory_order_release);
+        wake();
+    }
+
+    void push(const ValueType& elem) {
+        emplace(elem);
+    }
+
+    /// Move all of the elements of the batch into the queue, publishing them as space allows
+    void push(std::vector<ValueType>& batch) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t done = 0;
+        while (done < batch.size()) {
+            size_t n = std::min(waitForSpace(tail), batch.size() - done);
+            for (size_t i = 0; i < n; ++i) {
+                slots_[(tail + i) & mask_] = std::move(batch[done + i]);
+            }
+            done += n;
+            tail += n;
+            tail_.store(tail, std::memory_order_release);
+            wake();
+        }
+        batch.clear();
+    }
+
+    void close() {
+        int expected = Open;
+        if (state_.compare_exchange_strong(expected, Closed, std::memory_order_seq_cst)) {
+            wakeAll();
+        }
+    }
+
+    // Consumer
+
+    /// Returns -1 once the queue is closed, and all the elements have been consumed
+    long pop(ValueType& elem) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (waitForElements(head) == 0) return -1;
+        elem = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        wake();
+        return tailCache_ - head - 1;
+    }
+
+    /// Append up to maxElements available elements to the batch. Returns the number appended,
+    /// or -1 once the queue is closed, and all the elements have been consumed.
+    long pop(std::vector<ValueType>& batch, size_t maxElements) {
+        ASSERT(maxElements > 0);
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t n = std::min(waitForElements(head), maxElements);
+        if (n == 0) return -1;
+        for (size_t i = 0; i < n; ++i) {
+            batch.emplace_back(std::move(slots_[(head + i) & mask_]));
+        }
+        head_.store(head + n, std::memory_order_release);
+        wake();
+        return n;
+    }
+
+    // Either
+
+    bool closed() const {
+        return state_.load(std::memory_order_acquire) == Closed;
+    }
+
+    void interrupt(std::exception_ptr exception) {
+        std::lock_guard<std::mutex> lock(interruptMutex_);
+        if (state_.load(std::memory_order_relaxed) == Interrupted) return;
+        exception_ = exception;
+        state_.store(Interrupted, std::memory_order_seq_cst);
+        wakeAll();
+    }
+
+    size_t capacity() const { return slots_.size(); }
+
+private: // types
+
+    enum State { Open, Closed, Interrupted };
+
+    /// Returns false once the caller should stop spinning, and block instead
+    class Backoff {
+    public:
+        Backoff() : count_(0) {}
+        bool spin() {
+            if (count_ >= 128) return false;
+            if (++count_ > 64) std::this_thread::yield();
+            return true;
+        }
+    private:
+        size_t count_;
+    };
+
+private: // methods
+
+    static size_t capacityFor(size_t size) {
+        size_t capacity = 2;
+        while (capacity < size) capacity <<= 1;
+        return capacity;
+    }
+
+    void checkInterrupt() {
+        if (state_.load(std::memory_order_acquire) == Interrupted) {
+            std::rethrow_exception(exception_);
+        }
+    }
+
+    /// Block until ready() is true. ready() is evaluated with the lock held.
+    ///
+    /// n.b. The waiting side registers itself before checking ready(), and the other side
+    ///      publishes its change before checking for waiters. With a full fence between the
+    ///      two steps on each side, at least one of them sees the other, so no wake up is lost.
+    template <typename Predicate>
+    void block(Predicate ready) {
+        std::unique_lock<std::mutex> lock(waitMutex_);
+        waiting_.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cv_.wait(lock, ready);
+        waiting_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /// Wake the other side if it is blocked
+    void wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting_.load(std::memory_order_relaxed) > 0) wakeAll();
+    }
+
+    void wakeAll() {
+        std::lock_guard<std::mutex> lock(waitMutex_);
+        cv_.notify_all();
+    }
+
+    /// Returns the number of free slots (at least one)
+    size_t waitForSpace(size_t tail) {
+        Backoff backoff;
+        while (true) {
+            size_t space = slots_.size() - (tail - headCache_);
+            if (space > 0) return space;
+            headCache_ = head_.load(std::memory_order_acquire);
+            space = slots_.size() - (tail - headCache_);
+            if (space > 0) return space;
+            checkInterrupt();
+            if (!backoff.spin()) {
+                block([this, tail] {
+                    headCache_ = head_.load(std::memory_order_acquire);
+                    return tail - headCache_ < slots_.size() ||
+                           state_.load(std::memory_order_acquire) == Interrupted;
+                });
+            }
+        }
+    }
+
+    /// Returns the number of available elements, or zero if closed and drained
+    size_t waitForElements(size_t head) {
+        Backoff backoff;
+        while (true) {
+            if (tailCache_ != head) return tailCache_ - head;
+            tailCache_ = tail_.load(std::memory_order_acquire);
+            if (tailCache_ != head) return tailCache_ - head;
+
+            // n.b. the producer publishes its last elements before closing
+            int state = state_.load(std::memory_order_acquire);
+            if (state == Interrupted) std::rethrow_exception(exception_);
+            if (state == Closed) {
+                tailCache_ = tail_.load(std::memory_order_acquire);
+                return tailCache_ - head;
+            }
+            if (!backoff.spin()) {
+                block([this, head] {
+                    tailCache_ = tail_.load(std::memory_order_acquire);
+                    return tailCache_ != head || state_.load(std::memory_order_acquire) != Open;
+                });
+            }
+        }
+    }
+
+private: // members
+
+    std::vector<ValueType> slots_;
+    const size_t mask_;
+
+    // Keep the consumer's and producer's state on separate cache lines
+
+    alignas(64) std::atomic<size_t> head_;
+    size_t tailCache_;  // consumer's copy of tail_
+
+    alignas(64) std::atomic<size_t> tail_;
+    size_t headCache_;  // producer's copy of head_
+
+    alignas(64) std::atomic<int> state_;
+    std::exception_ptr exception_;
+    std::mutex interruptMutex_;
+
+    // Only used by a side that has stopped spinning, and to wake it
+
+    alignas(64) std::atomic<int> waiting_;
+    std::mutex waitMutex_;
+    std::condition_variable cv_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace fdb5
+
+#endif
@@ -32,10 +32,12 @@ namespace local {
 
 //----------------------------------------------------------------------------------------------------------------------
 
-struct ListVisitor : public QueryVisitor<ListElement> {
+// Listings can run to millions of elements, so use the lock-free queue
+
+struct ListVisitor : public QueryVisitor<ListElement, SPSCQueue<ListElement>> {
 
 public:
-    using QueryVisitor<ListElement>::QueryVisitor;
+    using QueryVisitor<ListElement, SPSCQueue<ListElement>>::QueryVisitor;
 
     /// Make a note of the current database. Subtract its key from the current
     /// request so we can test request is used in its entirety
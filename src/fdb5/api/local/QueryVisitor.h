@@ -23,6 +23,8 @@
 
 #include "eckit/container/Queue.h"
 
+#include "fdb5/api/helpers/SPSCQueue.h"
+
 #include "metkit/mars/MarsRequest.h"
 
 namespace fdb5 {
@@ -33,19 +35,23 @@ namespace local {
 
 //----------------------------------------------------------------------------------------------------------------------
 
-template <typename T>
+/// The visitor is run on a single worker thread, so visitors that only push from visitDatum()
+/// etc. may use a lock-free SPSCQueue as their QueueType.
+
+template <typename T, typename Q = eckit::Queue<T>>
 class QueryVisitor : public EntryVisitor {
 
 public: // methods
 
     using ValueType = T;
+    using QueueType = Q;
 
-    QueryVisitor(eckit::Queue<ValueType>& queue, const metkit::mars::MarsRequest& request) :
+    QueryVisitor(QueueType& queue, const metkit::mars::MarsRequest& request) :
         queue_(queue), request_(request) {}
 
 protected: // members
 
-    eckit::Queue<ValueType>& queue_;
+    QueueType& queue_;
     metkit::mars::MarsRequest request_;
 };
 
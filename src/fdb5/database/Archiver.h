@@ -58,12 +58,14 @@ public: // methods
         return s;
     }
 
+protected: // methods
+
+    DB& database(const Key &key);
+
 private: // methods
 
     void print(std::ostream &out) const;
 
-    DB& database(const Key &key);
-
 private: // members
 
     friend class BaseArchiveVisitor;
@@ -10,6 +10,7 @@
 
 #include <sstream>
 
+#include "eckit/exception/Exceptions.h"
 #include "eckit/thread/AutoLock.h"
 #include "eckit/log/Log.h"
 
@@ -61,5 +62,90 @@ void AxisRegistry::deduplicate(const keyword_t& keyword, std::shared_ptr<axis_t>
     }
 }
 
+AxisRegistry::id_t AxisRegistry::intern(const keyword_t& keyword, const axis_t& values, std::vector<id_t>& ids) {
+
+    ids.clear();
+    ids.reserve(values.size());
+
+    std::unique_lock<std::shared_mutex> lock(internMutex_);
+
+    auto kw = keywordIds_.emplace(keyword, id_t(valueIds_.size()));
+    if (kw.second) {
+        valueIds_.emplace_back();
+    }
+
+    Values& interned(valueIds_[kw.first->second]);
+    for (const auto& v : values) {
+
+        id_t next = interned.released.empty() ? id_t(interned.values.size()) : interned.released.back();
+
+        auto it = interned.ids.emplace(v, next);
+        id_t id = it.first->second;
+
+        if (it.second) {
+            if (id == interned.values.size()) {
+                interned.values.push_back(nullptr);
+                interned.references.push_back(0);
+            } else {
+                interned.released.pop_back();
+            }
+            interned.values[id] = &it.first->first;
+        }
+
+        ++interned.references[id];
+        ids.push_back(id);
+    }
+
+    return kw.first->second;
+}
+
+void AxisRegistry::unintern(id_t keyword, const std::vector<id_t>& ids) {
+
+    std::unique_lock<std::shared_mutex> lock(internMutex_);
+
+    ASSERT(keyword < valueIds_.size());
+    Values& interned(valueIds_[keyword]);
+
+    bool released = false;
+    for (id_t id : ids) {
+        ASSERT(id < interned.values.size() && interned.references[id] > 0);
+        if (--interned.references[id] == 0) {
+            interned.ids.erase(*interned.values[id]);
+            interned.values[id] = nullptr;
+            interned.released.push_back(id);
+            released = true;
+        }
+    }
+
+    if (released) {
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+}
+
+AxisRegistry::id_t AxisRegistry::keywordId(const keyword_t& keyword) const {
+
+    std::shared_lock<std::shared_mutex> lock(internMutex_);
+
+    auto it = keywordIds_.find(keyword);
+    return it == keywordIds_.end() ? unknown : it->second;
+}
+
+AxisRegistry::id_t AxisRegistry::valueId(id_t keyword, const std::string& value) const {
+
+    std::shared_lock<std::shared_mutex> lock(internMutex_);
+
+    ASSERT(keyword < valueIds_.size());
+    auto it = valueIds_[keyword].ids.find(value);
+    return it == valueIds_[keyword].ids.end() ? unknown : it->second;
+}
+
+size_t AxisRegistry::values(id_t keyword) const {
+
+    std::shared_lock<std::shared_mutex> lock(internMutex_);
+
+    ASSERT(keyword < valueIds_.size());
+    return valueIds_[keyword].ids.size();
+}
+
 }
 
@@ -16,10 +16,16 @@
 #ifndef fdb5_AxisRegistry_H
 #define fdb5_AxisRegistry_H
 
+#include <atomic>
+#include <cstdint>
 #include <map>
 #include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <functional>
+#include <vector>
 
 #include "eckit/container/DenseSet.h"
 #include "eckit/thread/Mutex.h"
@@ -35,6 +41,10 @@ public: // types
     typedef eckit::DenseSet<std::string> axis_t;
     typedef std::shared_ptr<axis_t> ptr_axis_t;
 
+    /// Keywords, and the values of each keyword, are interned as small dense integers
+    typedef uint32_t id_t;
+    static constexpr id_t unknown = id_t(-1);
+
     struct HashDenseSet
     {
         std::size_t operator()(ptr_axis_t const& p) const noexcept
@@ -69,11 +79,46 @@ public: // methods
     void deduplicate(const keyword_t& key, std::shared_ptr<axis_t>& ptr);
     void release(const keyword_t& key, std::shared_ptr<axis_t>& ptr);
 
+    /// Intern the keyword and all the values of its axis, taking a reference to each value.
+    /// Every call must be matched by a call to unintern with the same ids.
+    id_t intern(const keyword_t& keyword, const axis_t& values, std::vector<id_t>& ids);
+    void unintern(id_t keyword, const std::vector<id_t>& ids);
+
+    /// Look up interned ids, without interning. Returns unknown if not interned.
+    id_t keywordId(const keyword_t& keyword) const;
+    id_t valueId(id_t keyword, const std::string& value) const;
+
+    /// The number of values of the keyword that are currently interned
+    size_t values(id_t keyword) const;
+
+    /// Incremented whenever the id of a value is released, after which it may be reused for
+    /// another value. Ids looked up in an earlier generation may no longer be valid.
+    size_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+private: // types
+
+    struct Values {
+        std::unordered_map<std::string, id_t> ids;
+        std::vector<const std::string*> values;  ///< By id. Points to the keys of ids
+        std::vector<size_t> references;          ///< By id
+        std::vector<id_t> released;              ///< Ids to reuse
+    };
+
 private: // members
 
     axis_map_t axes_;
 
     mutable eckit::Mutex mutex_;
+
+    // The ids of values are released once no axis refers to them, so that they stay dense. There
+    // are few distinct keywords (those of the schema), and their ids are never released.
+
+    std::unordered_map<keyword_t, id_t> keywordIds_;
+    std::vector<Values> valueIds_;
+
+    std::atomic<size_t> generation_{0};
+
+    mutable std::shared_mutex internMutex_;
 };
 
 }
@@ -0,0 +1,120 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <algorithm>
+#include <ostream>
+
+#include "eckit/exception/Exceptions.h"
+#include "eckit/serialisation/Stream.h"
+
+#include "fdb5/database/BloomFilter.h"
+
+namespace fdb5 {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+namespace {
+
+constexpr size_t blockBytes = 64;
+constexpr size_t blockBits = blockBytes * 8;
+constexpr size_t bitsPerKey = 10;
+constexpr size_t numProbes = 7;
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+BloomFilter::BloomFilter() {}
+
+
+BloomFilter::BloomFilter(const std::vector<uint64_t>& hashes, size_t maxBytes) {
+
+    if (hashes.empty() || maxBytes < blockBytes) return;
+
+    size_t blocks = (hashes.size() * bitsPerKey + blockBits - 1) / blockBits;
+    blocks = std::min(blocks, maxBytes / blockBytes);
+
+    bits_.assign(blocks * blockBytes, '\0');
+    for (uint64_t h : hashes) {
+        insert(h);
+    }
+}
+
+
+// FNV-1a, which (unlike std::hash) gives the same result on every platform
+
+uint64_t BloomFilter::hash(const std::string& fingerprint) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : fingerprint) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return mix(h);
+}
+
+
+void BloomFilter::insert(uint64_t hash) {
+
+    size_t block = (hash >> 32) % (bits_.size() / blockBytes);
+    char* b = &bits_[block * blockBytes];
+
+    uint32_t h1 = uint32_t(hash);
+    uint32_t h2 = uint32_t(mix(hash)) | 1;
+    for (size_t i = 0; i < numProbes; ++i) {
+        uint32_t bit = (h1 + i * h2) % blockBits;
+        b[bit / 8] |= char(1 << (bit % 8));
+    }
+}
+
+
+bool BloomFilter::mayContain(uint64_t hash) const {
+
+    if (bits_.empty()) return true;
+
+    size_t block = (hash >> 32) % (bits_.size() / blockBytes);
+    const char* b = &bits_[block * blockBytes];
+
+    uint32_t h1 = uint32_t(hash);
+    uint32_t h2 = uint32_t(mix(hash)) | 1;
+    for (size_t i = 0; i < numProbes; ++i) {
+        uint32_t bit = (h1 + i * h2) % blockBits;
+        if (!(b[bit / 8] & char(1 << (bit % 8)))) return false;
+    }
+    return true;
+}
+
+
+void BloomFilter::encode(eckit::Stream& s) const {
+    s << bits_;
+}
+
+
+void BloomFilter::decode(eckit::Stream& s) {
+    s >> bits_;
+    ASSERT(bits_.size() % blockBytes == 0);
+}
+
+
+void BloomFilter::print(std::ostream& out) const {
+    out << "BloomFilter(bytes=" << bits_.size() << ")";
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace fdb5
@@ -0,0 +1,75 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+/// @file   BloomFilter.h
+/// @date   Oct 2026
+
+#ifndef fdb5_BloomFilter_H
+#define fdb5_BloomFilter_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace eckit {
+class Stream;
+}
+
+namespace fdb5 {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// A blocked bloom filter over the fingerprints of the fields in an index.
+///
+/// Each fingerprint sets a fixed number of bits within a single 64 byte block, so that a probe
+/// touches only one cache line. An empty filter may contain anything. The hash is stable across
+/// platforms, as filters are persisted in the TOC.
+
+class BloomFilter {
+
+public: // methods
+
+    BloomFilter();
+
+    /// Builds a filter sized for the given hashes, using no more than maxBytes
+    BloomFilter(const std::vector<uint64_t>& hashes, size_t maxBytes);
+
+    static uint64_t hash(const std::string& fingerprint);
+
+    bool mayContain(uint64_t hash) const;
+
+    bool empty() const { return bits_.empty(); }
+    size_t size() const { return bits_.size(); }
+
+    void encode(eckit::Stream& s) const;
+    void decode(eckit::Stream& s);
+
+    void print(std::ostream& out) const;
+
+    friend std::ostream& operator<<(std::ostream& s, const BloomFilter& f) {
+        f.print(s);
+        return s;
+    }
+
+private: // methods
+
+    void insert(uint64_t hash);
+
+private: // members
+
+    std::string bits_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace fdb5
+
+#endif
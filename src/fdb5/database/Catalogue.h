@@ -15,6 +15,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include "eckit/config/LocalConfiguration.h"
 #include "eckit/types/Types.h"
@@ -96,6 +97,9 @@ public:
     virtual bool exists() const = 0;
     virtual void checkUID() const = 0;
 
+    /// Has the catalogue been modified since it was opened for reading?
+    virtual bool stale() const { return false; }
+
     virtual eckit::URI uri() const = 0;
 
 protected: // methods
@@ -128,6 +132,7 @@ public:
     virtual void archive(const Key& key, std::unique_ptr<FieldLocation> fieldLocation) = 0;
     virtual void overlayDB(const Catalogue& otherCatalogue, const std::set<std::string>& variableKeys, bool unmount) = 0;
     virtual void index(const Key& key, const eckit::URI& uri, eckit::Offset offset, eckit::Length length) = 0;
+    virtual void index(const Key& indexKey, const eckit::URI& uri, const std::vector<AdoptedField>& fields) = 0;
     virtual void reconsolidate() = 0;
 };
 
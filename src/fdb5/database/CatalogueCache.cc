@@ -0,0 +1,161 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <sstream>
+
+#include "eckit/config/Resource.h"
+#include "eckit/exception/Exceptions.h"
+#include "eckit/log/Log.h"
+
+#include "fdb5/LibFdb5.h"
+#include "fdb5/database/CatalogueCache.h"
+#include "fdb5/database/DB.h"
+
+using namespace eckit;
+
+namespace fdb5 {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+CatalogueCache& CatalogueCache::instance() {
+
+    // n.b. Never destroyed, as readers may still be released during static destruction
+
+    static CatalogueCache* cache = new CatalogueCache(
+        Resource<size_t>("fdbCatalogueCacheSize;$FDB_CATALOGUE_CACHE_SIZE", 64),
+        Resource<size_t>("fdbCatalogueCacheShards", 16));
+    return *cache;
+}
+
+
+CatalogueCache::CatalogueCache(size_t capacity, size_t shards) :
+    shardCapacity_((capacity + std::max(shards, size_t(1)) - 1) / std::max(shards, size_t(1))),
+    hits_(0),
+    misses_(0),
+    refreshes_(0) {
+
+    for (size_t i = 0; i < std::max(shards, size_t(1)); ++i) {
+        shards_.emplace_back(new Shard);
+    }
+}
+
+
+CatalogueCache::~CatalogueCache() {}
+
+
+std::string CatalogueCache::configId(const Config& config) {
+    std::ostringstream ss;
+    ss << config << config.userConfig();
+    return ss.str();
+}
+
+
+std::shared_ptr<DB> CatalogueCache::reader(const Key& key, const Config& config, const std::string& configId) {
+
+    std::string id = configId + '\0' + key.toString();
+    Shard& s(shard(id));
+
+    std::unique_ptr<DB> db;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (auto it = s.idle.begin(); it != s.idle.end(); ++it) {
+            if (it->id == id) {
+                db = std::move(it->db);
+                s.idle.erase(it);
+                break;
+            }
+        }
+    }
+
+    if (db && db->stale()) {
+        Log::debug<LibFdb5>() << "Reopening database " << key << ", as it has been modified" << std::endl;
+        db.reset();
+        ++refreshes_;
+    }
+
+    bool reused = bool(db);
+    if (reused) {
+        Log::debug<LibFdb5>() << "FDB5 Reusing database " << key << std::endl;
+        ++hits_;
+    } else {
+        ++misses_;
+        db = DB::buildReader(key, config);
+    }
+
+    // If this database is locked for retrieval then it "does not exist". n.b. checked on every
+    // checkout, as it may have been locked since the reader was opened.
+
+    if (!db->enabled(ControlIdentifier::Retrieve)) {
+        std::ostringstream ss;
+        ss << "Database " << *db << " is LOCKED for retrieval";
+        Log::warning() << ss.str() << std::endl;
+        return std::shared_ptr<DB>();
+    }
+
+    if (!reused) {
+        Log::debug<LibFdb5>() << "Opening database " << key << " (type=" << db->dbType() << ")" << std::endl;
+
+        if (!db->open()) {
+            Log::debug() << "Database does not exist " << key << std::endl;
+            return std::shared_ptr<DB>();
+        }
+    }
+
+    return std::shared_ptr<DB>(db.release(), [this, id](DB* db) { release(id, db); });
+}
+
+
+void CatalogueCache::release(const std::string& id, DB* db) {
+
+    std::unique_ptr<DB> released(db);
+    std::list<Entry> evicted;
+
+    Shard& s(shard(id));
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.idle.push_front(Entry{id, std::move(released)});
+        while (s.idle.size() > shardCapacity_) {
+            evicted.splice(evicted.end(), s.idle, std::prev(s.idle.end()));
+        }
+    }
+
+    // Close evicted databases outside of the lock
+    for (const Entry& e : evicted) {
+        Log::debug() << "Purging DB with key " << e.db->key() << std::endl;
+    }
+}
+
+
+CatalogueCache::Shard& CatalogueCache::shard(const std::string& id) {
+    return *shards_[std::hash<std::string>()(id) % shards_.size()];
+}
+
+
+CatalogueCache::Stats CatalogueCache::stats() const {
+
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.refreshes = refreshes_;
+    stats.idle = 0;
+
+    for (const auto& s : shards_) {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        stats.idle += s->idle.size();
+    }
+
+    return stats;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace fdb5
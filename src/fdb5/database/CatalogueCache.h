@@ -0,0 +1,108 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+/// @file   CatalogueCache.h
+/// @date   Oct 2026
+
+#ifndef fdb5_CatalogueCache_H
+#define fdb5_CatalogueCache_H
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "eckit/memory/NonCopyable.h"
+
+#include "fdb5/config/Config.h"
+#include "fdb5/database/Key.h"
+
+namespace fdb5 {
+
+class DB;
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Keeps databases opened for reading, so that their catalogues are not re-opened (and their
+/// TOCs re-parsed) for every retrieve.
+///
+/// A reader is checked out for the exclusive use of one visitor at a time, as selecting an index
+/// modifies its state. It is returned to the cache when the last reference to it is released,
+/// and threads that need the same database concurrently are given readers of their own. Idle
+/// readers are kept in shards, each with its own lock, and the least recently used are closed
+/// once there are more than the capacity.
+///
+/// A reader whose catalogue has been extended since it was opened (e.g. new indexes have been
+/// written to the TOC) is reopened, rather than reused. A database that is locked for retrieval
+/// is not returned, even if a reader for it is cached.
+
+class CatalogueCache : private eckit::NonCopyable {
+
+public: // types
+
+    struct Stats {
+        size_t hits;
+        size_t misses;
+        size_t refreshes;
+        size_t idle;
+    };
+
+public: // methods
+
+    /// Shared by all the FDBs in the process
+    static CatalogueCache& instance();
+
+    CatalogueCache(size_t capacity, size_t shards = 1);
+    ~CatalogueCache();
+
+    /// Identifies the configuration that databases are opened with
+    static std::string configId(const Config& config);
+
+    /// Returns an open reader for the database, or a null pointer if it doesn't exist or is
+    /// locked for retrieval.
+    std::shared_ptr<DB> reader(const Key& key, const Config& config, const std::string& configId);
+
+    Stats stats() const;
+
+private: // types
+
+    struct Entry {
+        std::string id;
+        std::unique_ptr<DB> db;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> idle;  // most recently used first
+    };
+
+private: // methods
+
+    Shard& shard(const std::string& id);
+
+    void release(const std::string& id, DB* db);
+
+private: // members
+
+    const size_t shardCapacity_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    std::atomic<size_t> hits_;
+    std::atomic<size_t> misses_;
+    std::atomic<size_t> refreshes_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace fdb5
+
+#endif
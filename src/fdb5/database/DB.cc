@@ -138,6 +138,10 @@ bool DB::exists() const {
     return (catalogue_->exists()/* && store_->exists()*/);
 }
 
+bool DB::stale() const {
+    return catalogue_->stale();
+}
+
 void DB::hideContents() {
     if (catalogue_->type() == TocEngine::typeName()) {
         catalogue_->hideContents();
@@ -173,6 +177,15 @@ void DB::index(const Key &key, const eckit::PathName &path, eckit::Offset offset
     }
 }
 
+void DB::index(const Key &indexKey, const eckit::PathName &path, const std::vector<AdoptedField>& fields) {
+    if (catalogue_->type() == TocEngine::typeName()) {
+        CatalogueWriter* cat = dynamic_cast<CatalogueWriter*>(catalogue_.get());
+        ASSERT(cat);
+
+        cat->index(indexKey, eckit::URI("file", path), fields);
+    }
+}
+
 void DB::dump(std::ostream& out, bool simple, const eckit::Configuration& conf) const {
     catalogue_->dump(out, simple, conf);
 }
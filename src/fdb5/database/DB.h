@@ -21,6 +21,7 @@
 #include "fdb5/config/Config.h"
 #include "fdb5/database/Catalogue.h"
 #include "fdb5/database/EntryVisitMechanism.h"
+#include "fdb5/database/Field.h"
 #include "fdb5/database/Key.h"
 #include "fdb5/database/Store.h"
 
@@ -63,6 +64,7 @@ public: // methods
     void close();
 
     bool exists() const;
+    bool stale() const;
 
     void dump(std::ostream& out, bool simple=false, const eckit::Configuration& conf = eckit::LocalConfiguration()) const;
 
@@ -80,6 +82,8 @@ public: // methods
     void visitEntries(EntryVisitor& visitor, bool sorted = false);
     /// Used for adopting & indexing external data to the TOC dir
     void index(const Key &key, const eckit::PathName &path, eckit::Offset offset, eckit::Length length);
+    /// Indexes a run of fields of the same file into the index with the given key, in one go
+    void index(const Key &indexKey, const eckit::PathName &path, const std::vector<AdoptedField>& fields);
 
     // Control access properties of the DB
     void control(const ControlAction& action, const ControlIdentifiers& identifiers) const;
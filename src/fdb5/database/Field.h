@@ -78,6 +78,16 @@ private: // members
 
 //----------------------------------------------------------------------------------------------------------------------
 
+/// A field of an external file, as indexed (under the key of its datum) when adopting the file
+
+struct AdoptedField {
+    Key key;
+    eckit::Offset offset;
+    eckit::Length length;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
 } // namespace fdb5
 
 #endif
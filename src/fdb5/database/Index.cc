@@ -8,6 +8,8 @@
  * does it submit to any jurisdiction.
  */
 
+#include "eckit/config/Resource.h"
+
 #include "fdb5/LibFdb5.h"
 #include "fdb5/database/Index.h"
 #include "fdb5/rules/Schema.h"
@@ -28,7 +30,8 @@ enum IndexBaseStreamKeys {
     IndexKeyUnrecognised,
     IndexKey,
     IndexType,
-    IndexTimestamp
+    IndexTimestamp,
+    IndexFilter
 };
 
 IndexBaseStreamKeys keyId(const std::string& s) {
@@ -36,6 +39,7 @@ IndexBaseStreamKeys keyId(const std::string& s) {
         {"key" , IndexKey},
         {"type", IndexType},
         {"time", IndexTimestamp},
+        {"filter", IndexFilter},
     };
 
     auto it = keys.find(s);
@@ -65,6 +69,10 @@ void IndexBase::decodeCurrent(eckit::Stream& s, const int version) {
             case IndexTimestamp:
                 s >> timestamp_;
                 break;
+            case IndexFilter:
+                ASSERT(version >= 4);
+                filter_.decode(s);
+                break;
             default:
                 throw eckit::SeriousBug("IndexBase de-serialization error: "+k+" field is not recognized");
         }
@@ -113,6 +121,10 @@ void IndexBase::encodeCurrent(eckit::Stream& s, const int version) const {
     s << "key" << key_;
     s << "type" << type_;
     s << "time" << timestamp_;
+    if (version >= 4 && !filter_.empty()) {
+        s << "filter";
+        filter_.encode(s);
+    }
     s.endObject();
 }
 
@@ -133,6 +145,19 @@ void IndexBase::put(const Key &key, const Field &field) {
     add(key, field);
 }
 
+void IndexBase::updateFilter() {
+
+    // n.b. the filter is stored in the TOC record of the index, so must fit comfortably in it
+    static size_t maxBytes = eckit::Resource<size_t>("fdbIndexFilterMaxBytes", 64 * 1024);
+
+    filter_ = BloomFilter(filterHashes_, maxBytes);
+}
+
+void IndexBase::wipeFilter() {
+    filter_ = BloomFilter();
+    filterHashes_.clear();
+}
+
 bool IndexBase::partialMatch(const metkit::mars::MarsRequest& request) const {
 
     if (!key_.partialMatch(request)) return false;
@@ -143,7 +168,14 @@ bool IndexBase::partialMatch(const metkit::mars::MarsRequest& request) const {
 }
 
 bool IndexBase::mayContain(const Key &key) const {
-    return axes_.contains(key);
+    return mayContain(AxisProbe(key));
+}
+
+bool IndexBase::mayContain(const AxisProbe& probe) const {
+    if (!axes_.contains(probe)) return false;
+
+    // The axes may contain every value of the key, without containing the combination
+    return filter_.empty() || filter_.mayContain(BloomFilter::hash(probe.fingerprint()));
 }
 
 const Key &IndexBase::key() const {
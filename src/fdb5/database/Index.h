@@ -27,6 +27,7 @@
 #include "fdb5/database/EntryVisitMechanism.h"
 #include "fdb5/database/Field.h"
 #include "fdb5/database/IndexStats.h"
+#include "fdb5/database/BloomFilter.h"
 #include "fdb5/database/IndexAxis.h"
 #include "fdb5/database/IndexLocation.h"
 #include "fdb5/database/Indexer.h"
@@ -89,6 +90,7 @@ public: // methods
 
     virtual bool partialMatch(const metkit::mars::MarsRequest& request) const;
     virtual bool mayContain(const Key& key) const;
+    virtual bool mayContain(const AxisProbe& probe) const;
 
     virtual IndexStats statistics() const = 0;
 
@@ -100,6 +102,10 @@ public: // methods
 protected: // methods
     void takeTimestamp() { time(&timestamp_); }
 
+    /// Rebuild the filter over the fields added to this index (for writing on flush)
+    void updateFilter();
+    void wipeFilter();
+
 private: // methods
 
     void encodeCurrent(eckit::Stream& s, const int version) const;
@@ -119,6 +125,9 @@ protected: // members
     Key       key_;       ///< key that selected this index
     time_t    timestamp_; ///< timestamp when this Index was flushed
 
+    BloomFilter           filter_;        ///< Over the fields of this Index. Empty if not available
+    std::vector<uint64_t> filterHashes_;  ///< Of the fields added to this Index, when writing
+
     Indexer   indexer_;
 
     friend std::ostream& operator<<(std::ostream& s, const IndexBase& o) {
@@ -176,6 +185,7 @@ public: // methods
 
     bool partialMatch(const metkit::mars::MarsRequest& request) const { return content_->partialMatch(request); }
     bool mayContain(const Key& key) const { return content_->mayContain(key); }
+    bool mayContain(const AxisProbe& probe) const { return content_->mayContain(probe); }
 
     bool null() const { return null_; }
 
@@ -8,6 +8,7 @@
  * does it submit to any jurisdiction.
  */
 
+#include <algorithm>
 
 #include "eckit/log/Log.h"
 #include "eckit/exception/Exceptions.h"
@@ -24,12 +25,56 @@ namespace fdb5 {
 
 //----------------------------------------------------------------------------------------------------------------------
 
+AxisProbe::AxisProbe(const Key& key) :
+    key_(key),
+    generation_(AxisRegistry::instance().generation()) {
+
+    const AxisRegistry& registry(AxisRegistry::instance());
+
+    entries_.reserve(key.size());
+    for (const auto& kv : key) {
+
+        // n.b. A keyword that has never been interned is not in any axis
+        uint32_t keyword = registry.keywordId(kv.first);
+        if (keyword == AxisRegistry::unknown) continue;
+
+        uint32_t value = registry.valueId(keyword, kv.second);
+        std::string canonical = key.canonicalValue(kv.first);
+        entries_.push_back(Entry{keyword, value,
+                                 canonical == kv.second ? value : registry.valueId(keyword, canonical)});
+    }
+}
+
+const std::string& AxisProbe::fingerprint() const {
+    if (fingerprint_.empty()) {
+        fingerprint_ = key_.valuesToString();
+    }
+    return fingerprint_;
+}
+
+bool AxisProbe::find(uint32_t keyword, uint32_t& value, uint32_t& canonical) const {
+    for (const Entry& e : entries_) {
+        if (e.keyword == keyword) {
+            value = e.value;
+            canonical = e.canonical;
+            return true;
+        }
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
 IndexAxis::IndexAxis() :
     readOnly_(false),
-    dirty_(false) {
+    dirty_(false),
+    internedValid_(false) {
 }
 
 IndexAxis::~IndexAxis() {
+
+    unintern();
+
    if (!readOnly_)
       return;
 
@@ -40,7 +85,8 @@ IndexAxis::~IndexAxis() {
 
 IndexAxis::IndexAxis(eckit::Stream &s, const int version) :
     readOnly_(true),
-    dirty_(false) {
+    dirty_(false),
+    internedValid_(false) {
 
     decode(s, version);
 }
@@ -90,6 +136,8 @@ void IndexAxis::decode(eckit::Stream &s, const int version) {
         decodeCurrent(s, version);
     else
         decodeLegacy(s, version);
+
+    intern();
 }
 
 enum IndexAxisStreamKeys {
@@ -230,6 +278,86 @@ bool IndexAxis::contains(const Key &key) const {
     return true;
 }
 
+bool IndexAxis::contains(const AxisProbe& probe) const {
+
+    // Once an id has been released it may be reused for another value, so the ids of an older
+    // probe can't be trusted
+
+    if (!internedValid_ || probe.generation() != AxisRegistry::instance().generation()) {
+        return contains(probe.key());
+    }
+
+    // n.b. interned_ are in the same order as axis_
+
+    uint32_t value;
+    uint32_t canonical;
+    AxisMap::const_iterator i = axis_.begin();
+    for (const Interned& axis : interned_) {
+        ASSERT(i != axis_.end());
+        if (probe.find(axis.keyword, value, canonical)) {
+            if (std::binary_search(axis.ids.begin(), axis.ids.end(), value) ||
+                (canonical != value && std::binary_search(axis.ids.begin(), axis.ids.end(), canonical))) {
+                ++i;
+                continue;
+            }
+            if (value != AxisRegistry::unknown && canonical != AxisRegistry::unknown) {
+                return false;
+            }
+        }
+
+        // The ids may have been interned after the probe was resolved. Compare the strings.
+        if (!probe.key().match(i->first, *(i->second))) {
+            return false;
+        }
+        ++i;
+    }
+    return true;
+}
+
+bool IndexAxis::interned(std::map<uint32_t, std::vector<uint32_t>>& ids) const {
+
+    ids.clear();
+    if (!internedValid_) return false;
+
+    for (const Interned& axis : interned_) {
+        ids[axis.keyword] = axis.ids;
+    }
+    return true;
+}
+
+void IndexAxis::intern() {
+
+    AxisRegistry& registry(AxisRegistry::instance());
+
+    // n.b. Take the new references before releasing any old ones, so unchanged values keep their ids
+
+    std::vector<Interned> interned;
+    interned.reserve(axis_.size());
+
+    for (const auto& kv : axis_) {
+        Interned axis;
+        axis.keyword = registry.intern(kv.first, *kv.second, axis.ids);
+        std::sort(axis.ids.begin(), axis.ids.end());
+        interned.emplace_back(std::move(axis));
+    }
+
+    unintern();
+    interned_ = std::move(interned);
+    internedValid_ = true;
+}
+
+void IndexAxis::unintern() {
+
+    AxisRegistry& registry(AxisRegistry::instance());
+
+    for (const Interned& axis : interned_) {
+        registry.unintern(axis.keyword, axis.ids);
+    }
+
+    interned_.clear();
+    internedValid_ = false;
+}
+
 void IndexAxis::insert(const Key &key) {
     ASSERT(!readOnly_);
 
@@ -243,6 +371,9 @@ void IndexAxis::insert(const Key &key) {
         axis_set->insert(key.canonicalValue(keyword));
 
         dirty_ = true;
+
+        // n.b. The references are kept until the axis is interned again, so the ids are stable
+        internedValid_ = false;
     }
 }
 
@@ -259,6 +390,8 @@ void IndexAxis::clean() {
 void IndexAxis::sort() {
     for (AxisMap::iterator i = axis_.begin(); i != axis_.end(); ++i)
        i->second->sort();
+
+    intern();
 }
 
 void IndexAxis::wipe() {
@@ -266,6 +399,7 @@ void IndexAxis::wipe() {
     ASSERT(!readOnly_);
 
     axis_.clear();
+    unintern();
     clean();
 }
 
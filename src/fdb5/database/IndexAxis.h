@@ -16,9 +16,12 @@
 #ifndef fdb5_IndexAxis_H
 #define fdb5_IndexAxis_H
 
+#include <cstdint>
 #include <iosfwd>
 #include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "eckit/container/DenseSet.h"
 #include "eckit/memory/NonCopyable.h"
@@ -39,6 +42,43 @@ class Key;
 
 //----------------------------------------------------------------------------------------------------------------------
 
+/// A key resolved to the ids that the AxisRegistry interns axis values as, so that it can be
+/// tested against the axes of many indexes without comparing (or canonicalising) strings again.
+
+class AxisProbe : private eckit::NonCopyable {
+
+public: // methods
+
+    AxisProbe(const Key& key);
+
+    const Key& key() const { return key_; }
+
+    /// The values of the key as used to fingerprint fields in an index
+    const std::string& fingerprint() const;
+
+    /// Returns false if the keyword is not in the key. Values that are not in any axis are unknown.
+    bool find(uint32_t keyword, uint32_t& value, uint32_t& canonical) const;
+
+    /// The generation of the AxisRegistry that the ids were looked up in
+    size_t generation() const { return generation_; }
+
+private: // members
+
+    struct Entry {
+        uint32_t keyword;
+        uint32_t value;
+        uint32_t canonical;
+    };
+
+    const Key& key_;
+    std::vector<Entry> entries_;
+    size_t generation_;
+
+    mutable std::string fingerprint_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
 class IndexAxis : private eckit::NonCopyable {
 
 public: // methods
@@ -61,6 +101,11 @@ public: // methods
 
     bool partialMatch(const metkit::mars::MarsRequest& request) const;
     bool contains(const Key& key) const;
+    bool contains(const AxisProbe& probe) const;
+
+    /// The interned ids of the values of each axis, by the id of its keyword. Returns false if
+    /// the axes have not been interned (i.e. they have been inserted into since they were sorted).
+    bool interned(std::map<uint32_t, std::vector<uint32_t>>& ids) const;
 
     /// Provide a means to test if the index has changed since it was last written out, and to
     /// mark that it has been written out.
@@ -88,6 +133,10 @@ private: // methods
 
     void print(std::ostream &out) const;
 
+    /// Intern the values of each axis (again), or release them
+    void intern();
+    void unintern();
+
 
 private: // members
 
@@ -97,6 +146,17 @@ private: // members
     bool readOnly_;
     bool dirty_;
 
+    // Only valid once the axes are sorted, after which values are not inserted. The ids are sorted,
+    // and are held in the AxisRegistry until they are released.
+
+    struct Interned {
+        uint32_t keyword;
+        std::vector<uint32_t> ids;
+    };
+
+    std::vector<Interned> interned_;
+    bool internedValid_;
+
 };
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -17,6 +17,7 @@
 #include "metkit/mars/MarsRequest.h"
 
 #include "fdb5/LibFdb5.h"
+#include "fdb5/database/CatalogueCache.h"
 #include "fdb5/database/Notifier.h"
 #include "fdb5/database/MultiRetrieveVisitor.h"
 #include "fdb5/io/HandleGatherer.h"
@@ -48,14 +49,20 @@ bool InspectIterator::next(ListElement& elem) {
 
 //----------------------------------------------------------------------------------------------------------------------
 
-static void purgeDB(Key& key, DB*& db) {
-    Log::debug() << "Purging DB with key " << key << std::endl;
-    delete db;
+// By default, databases opened for reading are shared with all the other FDBs in the process
+
+static CatalogueCache* privateCatalogueCache(const Config& dbConfig) {
+    if (dbConfig.getBool("sharedCatalogueCache", true)) {
+        return nullptr;
+    }
+    return new CatalogueCache(Resource<size_t>("fdbMaxOpenDatabases", 16));
 }
 
 Inspector::Inspector(const Config& dbConfig) :
-    databases_(Resource<size_t>("fdbMaxOpenDatabases", 16), &purgeDB),
-    dbConfig_(dbConfig) {}
+    privateDatabases_(privateCatalogueCache(dbConfig)),
+    databases_(privateDatabases_ ? *privateDatabases_ : CatalogueCache::instance()),
+    dbConfig_(dbConfig),
+    configId_(CatalogueCache::configId(dbConfig)) {}
 
 Inspector::~Inspector() {
 }
@@ -65,7 +72,7 @@ ListIterator Inspector::inspect(const metkit::mars::MarsRequest& request,
                                 const fdb5::Notifier& notifyee) const {
 
     InspectIterator* iterator = new InspectIterator();
-    MultiRetrieveVisitor visitor(notifyee, *iterator, databases_, dbConfig_);
+    MultiRetrieveVisitor visitor(notifyee, *iterator, databases_, dbConfig_, configId_);
 
     Log::debug<LibFdb5>() << "Using schema: " << schema << std::endl;
 
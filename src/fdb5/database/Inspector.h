@@ -19,12 +19,13 @@
 #include <iosfwd>
 #include <cstdlib>
 #include <map>
+#include <memory>
+#include <string>
 
 #include "fdb5/config/Config.h"
 #include "fdb5/api/helpers/ListIterator.h"
 
 #include "eckit/memory/NonCopyable.h"
-#include "eckit/container/CacheLRU.h"
 #include "eckit/config/LocalConfiguration.h"
 
 namespace eckit {
@@ -38,6 +39,7 @@ namespace mars {
 
 namespace fdb5 {
 
+class CatalogueCache;
 class Key;
 class Op;
 class DB;
@@ -98,9 +100,13 @@ private: // methods
 
 private: // data
 
-    mutable eckit::CacheLRU<Key,DB*> databases_;
+    // Only if the shared catalogue cache is disabled
+    std::unique_ptr<CatalogueCache> privateDatabases_;
+
+    CatalogueCache& databases_;
 
     Config dbConfig_;
+    std::string configId_;
 };
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -304,7 +304,7 @@ std::string Key::canonicalise(const std::string& keyword, const std::string& val
     if (value.empty()) {
         return value;
     } else {
-        return this->registry().lookupType(keyword).toKey(keyword, value);
+        return this->registry().lookupType(keyword).canonicalise(keyword, value);
     }
 }
 
@@ -15,6 +15,7 @@
 #include "eckit/config/Resource.h"
 
 #include "fdb5/LibFdb5.h"
+#include "fdb5/database/CatalogueCache.h"
 #include "fdb5/database/DB.h"
 #include "fdb5/database/Key.h"
 #include "fdb5/io/HandleGatherer.h"
@@ -29,13 +30,16 @@ namespace fdb5 {
 
 MultiRetrieveVisitor::MultiRetrieveVisitor(const Notifier& wind,
                                            InspectIterator& iterator,
-                                           eckit::CacheLRU<Key,DB*>& databases,
-                                           const Config& config) :
+                                           CatalogueCache& databases,
+                                           const Config& config,
+                                           const std::string& configId) :
     db_(nullptr),
     wind_(wind),
     databases_(databases),
     iterator_(iterator),
-    config_(config) {
+    config_(config),
+    configId_(configId),
+    request_(nullptr) {
 }
 
 MultiRetrieveVisitor::~MultiRetrieveVisitor() {
@@ -47,6 +51,8 @@ bool MultiRetrieveVisitor::selectDatabase(const Key& key, const Key&) {
 
 	eckit::Log::debug() << "FDB5 selectDatabase " << key  << std::endl;
 
+    clearValues();
+
     /* is it the current DB ? */
 
     if(db_) {
@@ -58,40 +64,29 @@ bool MultiRetrieveVisitor::selectDatabase(const Key& key, const Key&) {
 
     /* is the DB already open ? */
 
-    if(databases_.exists(key)) {
-        eckit::Log::debug<LibFdb5>() << "FDB5 Reusing database " << key << std::endl;
-        db_ = databases_.access(key);
+    auto it = opened_.find(key);
+    if (it != opened_.end()) {
+        db_ = it->second.get();
         return true;
     }
 
-    /* DB not yet open */
-
-    //std::unique_ptr<DB> newDB( DBFactory::buildReader(key, config_) );
-    std::unique_ptr<DB> newDB = DB::buildReader(key, config_);
+    /* Otherwise check out a reader, which may have been opened before */
 
-    // If this database is locked for retrieval then it "does not exist"
-    if (!newDB->enabled(ControlIdentifier::Retrieve)) {
-        std::ostringstream ss;
-        ss << "Database " << *newDB << " is LOCKED for retrieval";
-        eckit::Log::warning() << ss.str() << std::endl;
+    std::shared_ptr<DB> db = databases_.reader(key, config_, configId_);
+    if (!db) {
         return false;
     }
 
-    eckit::Log::debug<LibFdb5>() << "selectDatabase opening database " << key << " (type=" << newDB->dbType() << ")" << std::endl;
-
-    if (!newDB->open()) {
-        eckit::Log::debug() << "Database does not exist " << key << std::endl;
-        return false;
-    } else {
-        db_ = newDB.release();
-        databases_.insert(key, db_);
-        return true;
-    }
+    db_ = db.get();
+    opened_.emplace(key, std::move(db));
+    return true;
 }
 
 bool MultiRetrieveVisitor::selectIndex(const Key& key, const Key&) {
     ASSERT(db_);
     eckit::Log::debug() << "selectIndex " << key << std::endl;
+
+    clearValues();
     return db_->selectIndex(key);
 }
 
@@ -119,8 +114,22 @@ void MultiRetrieveVisitor::values(const metkit::mars::MarsRequest &request,
                              const std::string &keyword,
                              const TypesRegistry &registry,
                              eckit::StringList &values) {
+
+    if (&request != request_) {
+        clearValues();
+        request_ = &request;
+    }
+
+    auto cached = values_.find(std::make_pair(&registry, keyword));
+    if (cached != values_.end()) {
+        values.insert(values.end(), cached->second.begin(), cached->second.end());
+        return;
+    }
+
+    const Type& type(registry.lookupType(keyword));
+
     eckit::StringList list;
-    registry.lookupType(keyword).getValues(request, keyword, list, wind_, db_);
+    type.getValues(request, keyword, list, wind_, db_);
 
     eckit::StringSet filter;
     bool toFilter = false;
@@ -128,12 +137,18 @@ void MultiRetrieveVisitor::values(const metkit::mars::MarsRequest &request,
         toFilter = db_->axis(keyword, filter);
     }
 
-    for(auto l: list) {
-        std::string v = registry.lookupType(keyword).toKey(keyword, l);
-        if (!toFilter || filter.find(v) != filter.end()) {
-            values.push_back(l);
+    eckit::StringList& result(values_[std::make_pair(&registry, keyword)]);
+    for (const auto& l : list) {
+        if (!toFilter || filter.find(type.canonicalise(keyword, l)) != filter.end()) {
+            result.push_back(l);
         }
     }
+
+    values.insert(values.end(), result.begin(), result.end());
+}
+
+void MultiRetrieveVisitor::clearValues() {
+    values_.clear();
 }
 
 void MultiRetrieveVisitor::print( std::ostream &out ) const {
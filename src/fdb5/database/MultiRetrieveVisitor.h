@@ -16,9 +16,11 @@
 #ifndef fdb5_MultiRetrieveVisitor_H
 #define fdb5_MultiRetrieveVisitor_H
 
+#include <map>
+#include <memory>
 #include <string>
+#include <utility>
 
-#include "eckit/container/CacheLRU.h"
 #include "eckit/container/Queue.h"
 
 #include "fdb5/api/helpers/ListIterator.h"
@@ -28,6 +30,7 @@
 
 namespace fdb5 {
 
+class CatalogueCache;
 class HandleGatherer;
 class Notifier;
 
@@ -41,8 +44,9 @@ public: // methods
 
     MultiRetrieveVisitor(const Notifier& wind,
                          InspectIterator& queue,
-                         eckit::CacheLRU<Key,DB*>& databases,
-                         const Config& config);
+                         CatalogueCache& databases,
+                         const Config& config,
+                         const std::string& configId);
 
     ~MultiRetrieveVisitor();
 
@@ -65,17 +69,29 @@ private:  // methods
 
     virtual const Schema& databaseSchema() const override;
 
+    void clearValues();
+
 private:
 
     DB* db_;
 
     const Notifier& wind_;
 
-    eckit::CacheLRU<Key,DB*>& databases_;
+    CatalogueCache& databases_;
+
+    // The databases checked out of the cache for this visit
+    std::map<Key, std::shared_ptr<DB>> opened_;
 
     InspectIterator& iterator_;
 
     Config config_;
+    std::string configId_;
+
+    // The values of each keyword in the request, canonicalised and filtered against the axes of
+    // the current database and index. The schema asks for the values of the inner keywords once
+    // for every combination of the outer ones, so they are only worked out once per index.
+    const metkit::mars::MarsRequest* request_;
+    std::map<std::pair<const TypesRegistry*, std::string>, eckit::StringList> values_;
 };
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -8,8 +8,12 @@
  * does it submit to any jurisdiction.
  */
 
+#include <deque>
+#include <exception>
+#include <future>
 #include <vector>
 
+#include "eckit/config/Resource.h"
 #include "eckit/log/Timer.h"
 #include "eckit/log/Plural.h"
 #include "eckit/log/Bytes.h"
@@ -26,6 +30,7 @@
 #include "metkit/mars/MarsRequest.h"
 
 #include "fdb5/LibFdb5.h"
+#include "fdb5/api/helpers/AsyncExecutor.h"
 #include "fdb5/message/MessageArchiver.h"
 #include "fdb5/database/ArchiveVisitor.h"
 
@@ -43,7 +48,8 @@ MessageArchiver::MessageArchiver(const fdb5::Key& key, bool completeTransfers, b
     fdb_(config),
     key_(key),
     completeTransfers_(completeTransfers),
-    verbose_(verbose)
+    verbose_(verbose),
+    decodeThreads_(eckit::Resource<size_t>("fdbArchiveDecodeThreads;$FDB_ARCHIVE_DECODE_THREADS", 0))
 {
 }
 
@@ -122,6 +128,10 @@ void MessageArchiver::modifiers(const std::string& modify) {
     // Log::info() << "modifiers : " << modifiers_ << std::endl;
 }
 
+void MessageArchiver::decodeThreads(size_t threads) {
+    decodeThreads_ = threads;
+}
+
 eckit::message::Message MessageArchiver::transform(eckit::message::Message& msg) {
     return msg.transform(modifiers_);
 }
@@ -161,6 +171,62 @@ eckit::Channel& MessageArchiver::logVerbose() const {
     return verbose_ ? Log::info() : Log::debug<LibFdb5>();
 }
 
+MessageArchiver::Decoded MessageArchiver::decode(const eckit::message::Message& msg) {
+
+    Decoded decoded{msg, Key(), false, Key()};
+
+#ifdef metkit_HAVE_FAIL_ON_CCSDS
+
+    if(msg.getString("packingType") == "grid_ccsds") {
+        throw eckit::SeriousBug("grid_ccsds is disabled");
+    }
+
+#endif
+
+    // n.b. duplicates are checked when archiving, as they depend on the order of the messages
+    MessageDecoder::decode(decoded.msg, decoded.key);
+
+    ASSERT(decoded.key.match(key_));
+
+    if (filterOut(decoded.key)) {
+        decoded.filtered = true;
+        return decoded;
+    }
+
+    if (modifiers_.size()) {
+        decoded.msg = transform(decoded.msg);
+        decoded.original = std::move(decoded.key);
+        decoded.key.clear();
+        MessageDecoder::decode(decoded.msg, decoded.key);  // re-build the key, as it may have changed
+    }
+
+    return decoded;
+}
+
+void MessageArchiver::archive(const Decoded& decoded, size_t& count, size_t& totalSize, eckit::Progress& progress) {
+
+    checkDuplicate(decoded.original.empty() ? decoded.key : decoded.original);
+
+    if (decoded.filtered)
+        return;
+
+    if (!decoded.original.empty()) {
+        checkDuplicate(decoded.key);
+    }
+
+    LOG_DEBUG_LIB(LibFdb5) << "Archiving message "
+                           << " key: " << key_ << " data: " << decoded.msg.data() << " length:" << decoded.msg.length()
+                           << std::endl;
+
+    logVerbose() << "Archiving " << decoded.key << std::endl;
+
+    fdb_.archive(decoded.key, decoded.msg.data(), decoded.msg.length());
+
+    totalSize += decoded.msg.length();
+    count++;
+    progress(totalSize);
+}
+
 eckit::Length MessageArchiver::archive(eckit::DataHandle& source) {
 
     eckit::Timer timer("fdb::service::archive");
@@ -172,58 +238,70 @@ eckit::Length MessageArchiver::archive(eckit::DataHandle& source) {
 
     eckit::Progress progress("FDB archive", 0, source.estimate());
 
+    // Messages being decoded on other threads, in the order they were read. The decoders refer
+    // to this archiver, so must complete before it is left.
+    std::deque<std::future<Decoded>> decoding;
+    AsyncWaitGuard<std::deque<std::future<Decoded>>> guard(decoding);
+
+    bool messageFailed = false;
+
+    auto archiveNext = [&] {
+        std::future<Decoded> next = std::move(decoding.front());
+        decoding.pop_front();
+        try {
+            archive(next.get(), count, total_size, progress);
+        } catch (...) {
+            messageFailed = true;
+            throw;
+        }
+    };
+
     try {
 
         eckit::message::Message msg;
 
         while ( (msg = reader.next()) ) {
 
-#ifdef metkit_HAVE_FAIL_ON_CCSDS
-
-            if(msg.getString("packingType") == "grid_ccsds") {
-                throw eckit::SeriousBug("grid_ccsds is disabled");
+            if (decodeThreads_ == 0) {
+                archive(decode(msg), count, total_size, progress);
+                continue;
             }
 
-#endif
+            if (decoding.size() >= decodeThreads_) {
+                archiveNext();
+            }
 
-            Key key;
+            decoding.emplace_back(AsyncExecutor::instance().submit([this, msg] { return decode(msg); }));
+        }
 
-            messageToKey(msg, key);
+        while (!decoding.empty()) {
+            archiveNext();
+        }
 
-            LOG_DEBUG_LIB(LibFdb5) << "Archiving message "
-                                   << " key: " << key_ << " data: " << msg.data() << " length:" << msg.length()
-                                   << std::endl;
+    } catch (...) {
 
-            ASSERT(key.match(key_));
+        // As when decoding one message at a time, the messages read before the failure are
+        // archived in order, up to the first that fails. If a message failed, those read after
+        // it are discarded.
 
-            if (filterOut(key))
-                continue;
+        std::exception_ptr error = std::current_exception();
 
-            if (modifiers_.size()) {
-                msg = transform(msg);
-                key.clear();
-                messageToKey(msg, key);  // re-build the key, as it may have changed
+        if (!messageFailed) {
+            try {
+                while (!decoding.empty()) {
+                    archiveNext();
+                }
+            } catch (...) {
+                error = std::current_exception();
             }
-
-            logVerbose() << "Archiving " << key << std::endl;
-
-            fdb_.archive(key, msg.data(), msg.length());
-
-            total_size += msg.length();
-            count++;
-            progress(total_size);
-
-            // flush();
         }
 
-    } catch (...) {
-
         if (completeTransfers_) {
             eckit::Log::error() << "Exception received. Completing transfer." << std::endl;
             // Consume rest of datahandle otherwise client retries for ever
             while ( reader.next() ) { /* empty */ }
         }
-        throw;
+        std::rethrow_exception(error);
     }
 
     eckit::Log::userInfo() << "Archived " << eckit::Plural(count, "message") << std::endl;
@@ -18,6 +18,7 @@
 #include <iosfwd>
 
 #include "eckit/io/Length.h"
+#include "eckit/message/Message.h"
 
 #include "metkit/mars/MarsRequest.h"
 
@@ -29,6 +30,7 @@
 
 namespace eckit {
 class DataHandle;
+class Progress;
 }
 
 namespace fdb5 {
@@ -47,14 +49,34 @@ public: // methods
     void filters(const std::string& include, const std::string& exclude);
     void modifiers(const std::string& modify);
 
+    /// Decode messages on this many threads, whilst archiving them in order on the calling
+    /// thread. 0 decodes each message on the calling thread before archiving it.
+    void decodeThreads(size_t threads);
+
     eckit::Length archive(eckit::DataHandle &source);
 
     void flush();
 
+private: // types
+
+    struct Decoded {
+        eckit::message::Message msg;
+        Key key;
+        bool filtered;
+        Key original;  ///< Before the modifiers were applied. Empty if they weren't
+    };
+
 private: // protected
 
     eckit::Channel& logVerbose() const;
 
+    /// Extract the key of a message, and apply the filters and modifiers. Safe to call on
+    /// several threads at once.
+    Decoded decode(const eckit::message::Message& msg);
+
+    /// Check for duplicates and archive, in the order the messages were read
+    void archive(const Decoded& decoded, size_t& count, size_t& totalSize, eckit::Progress& progress);
+
     bool filterOut(const Key& k) const;
 
     eckit::message::Message transform(eckit::message::Message&);
@@ -73,6 +95,8 @@ private: // members
     bool completeTransfers_;
 
     bool verbose_;
+
+    size_t decodeThreads_;
 };
 
 //----------------------------------------------------------------------------------------------------------------------
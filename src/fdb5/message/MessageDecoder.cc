@@ -10,6 +10,10 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "fdb5/message/MessageDecoder.h"
 
@@ -55,8 +59,151 @@ public:
 
 //----------------------------------------------------------------------------------------------------------------------
 
-MessageDecoder::MessageDecoder(bool checkDuplicates):
+/// The keys of the messages seen so far, optionally only the most recent ones. Keys are
+/// remembered as 128 bit hashes. If exact, each is also remembered in a compact form (the
+/// interned ids of its keywords and values) to confirm that keys with equal hashes are equal.
+
+class MessageDecoder::Duplicates {
+
+public: // methods
+
+    Duplicates(bool exact, size_t window) :
+        exact_(exact),
+        window_(window) {}
+
+    /// Returns false if the key has been seen already
+    bool insert(const Key& key) {
+
+        std::string canonical;
+        for (const auto& kv : key) {
+            canonical += kv.first;
+            canonical += '=';
+            canonical += kv.second;
+            canonical += '\0';
+        }
+
+        Fingerprint f = fingerprint(canonical);
+
+        if (!exact_) {
+            if (!hashes_.insert(f).second) {
+                return false;
+            }
+            remember(f, nullptr);
+            return true;
+        }
+
+        // Keys with the same hash are all kept, so that a (very unlikely) collision is not
+        // mistaken for a duplicate
+
+        Encoded encoded(encode(key));
+        auto range = exactKeys_.equal_range(f);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == encoded) {
+                return false;
+            }
+        }
+
+        auto it = exactKeys_.emplace(f, std::move(encoded));
+        remember(f, &it->second);
+        return true;
+    }
+
+private: // types
+
+    struct Fingerprint {
+        uint64_t h1;
+        uint64_t h2;
+        bool operator==(const Fingerprint& other) const { return h1 == other.h1 && h2 == other.h2; }
+    };
+
+    struct FingerprintHash {
+        size_t operator()(const Fingerprint& f) const { return f.h1; }
+    };
+
+    typedef std::vector<uint32_t> Encoded;
+
+    struct Seen {
+        Fingerprint fingerprint;
+        const Encoded* encoded;  ///< If exact. Points into exactKeys_
+    };
+
+private: // methods
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    /// Two FNV-1a hashes, with different offsets and primes
+    static Fingerprint fingerprint(const std::string& s) {
+        uint64_t h1 = 0xcbf29ce484222325ULL;
+        uint64_t h2 = 0x84222325cbf29ce4ULL;
+        for (unsigned char c : s) {
+            h1 = (h1 ^ c) * 0x100000001b3ULL;
+            h2 = (h2 ^ c) * 0x100000001b5ULL;
+        }
+        return Fingerprint{mix(h1), mix(h2 + s.size())};
+    }
+
+    /// The keywords and values of the key, as ids. There are few distinct keywords and values,
+    /// however many keys there are.
+    Encoded encode(const Key& key) {
+        Encoded encoded;
+        encoded.reserve(2 * key.size());
+        for (const auto& kv : key) {
+            encoded.push_back(strings_.emplace(kv.first, uint32_t(strings_.size())).first->second);
+            encoded.push_back(strings_.emplace(kv.second, uint32_t(strings_.size())).first->second);
+        }
+        return encoded;
+    }
+
+    /// Forget the oldest key once there are more than window_
+    void remember(const Fingerprint& f, const Encoded* encoded) {
+
+        if (!window_) return;
+
+        order_.push_back(Seen{f, encoded});
+        if (order_.size() <= window_) return;
+
+        const Seen& oldest(order_.front());
+        if (exact_) {
+            auto range = exactKeys_.equal_range(oldest.fingerprint);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (&it->second == oldest.encoded) {
+                    exactKeys_.erase(it);
+                    break;
+                }
+            }
+        } else {
+            hashes_.erase(oldest.fingerprint);
+        }
+        order_.pop_front();
+    }
+
+private: // members
+
+    bool exact_;
+    size_t window_;
+
+    std::unordered_set<Fingerprint, FingerprintHash> hashes_;
+    std::unordered_multimap<Fingerprint, Encoded, FingerprintHash> exactKeys_;
+    std::unordered_map<std::string, uint32_t> strings_;
+
+    std::deque<Seen> order_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+MessageDecoder::MessageDecoder(bool checkDuplicates, bool exactDuplicates, size_t duplicatesWindow):
     checkDuplicates_(checkDuplicates) {
+
+    if (checkDuplicates_) {
+        seen_.reset(new Duplicates(exactDuplicates, duplicatesWindow));
+    }
 }
 
 MessageDecoder::~MessageDecoder() {}
@@ -77,19 +224,24 @@ void MessageDecoder::msgToKey(const eckit::message::Message& msg, Key& key) {
 }
 
 void MessageDecoder::messageToKey(const eckit::message::Message& msg, Key& key) {
+    decode(msg, key);
+    checkDuplicate(key);
+}
+
+void MessageDecoder::decode(const eckit::message::Message& msg, Key& key) {
 
     eckit::message::Message patched = patch(msg);
 
     msgToKey(patched, key);
+}
 
+void MessageDecoder::checkDuplicate(const Key& key) {
     if ( checkDuplicates_ ) {
-        if ( seen_.find(key) != seen_.end() ) {
+        if ( !seen_->insert(key) ) {
             std::ostringstream oss;
             oss << "Message has duplicate parameters in the same request: " << key;
             throw eckit::SeriousBug( oss.str() );
         }
-
-        seen_.insert(key);
     }
 }
 
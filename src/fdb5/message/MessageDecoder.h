@@ -19,6 +19,7 @@
 
 #include "eckit/io/Buffer.h"
 #include "metkit/mars/MarsRequest.h"
+#include <memory>
 #include <vector>
 
 struct grib_handle;
@@ -44,7 +45,11 @@ namespace fdb5 {
 class MessageDecoder {
 public:
 
-    MessageDecoder(bool checkDuplicates = false);
+    /// If checkDuplicates is set, messages with the same key as one already decoded are rejected.
+    /// The keys are remembered as 128 bit hashes, which exactDuplicates confirms against the keys
+    /// themselves. They are remembered for all the messages decoded, or only for the most recent
+    /// duplicatesWindow messages, for inputs in which duplicates can only be close to each other.
+    MessageDecoder(bool checkDuplicates = false, bool exactDuplicates = false, size_t duplicatesWindow = 0);
 
     virtual ~MessageDecoder();
 
@@ -53,14 +58,24 @@ public:
     metkit::mars::MarsRequest messageToRequest(const eckit::PathName &path, const char *verb = "retrieve");
     std::vector<metkit::mars::MarsRequest> messageToRequests(const eckit::PathName &path, const char *verb = "retrieve");
 
+protected:
+
+    /// Builds the key of a message, without checking it for duplicates. Safe to call from
+    /// several threads at once, provided patch() is.
+    void decode(const eckit::message::Message& msg, Key& key);
+
+    /// Throws if checkDuplicates is set and the key has already been seen
+    void checkDuplicate(const Key& key);
 
 private:
 
     virtual eckit::message::Message patch(const eckit::message::Message& msg);
     static void msgToKey(const eckit::message::Message& msg, Key& key);
 
+    class Duplicates;
+
     bool checkDuplicates_;
-    std::set<Key> seen_;
+    std::unique_ptr<Duplicates> seen_;
 };
 
 //----------------------------------------------------------------------------------------------------------------------
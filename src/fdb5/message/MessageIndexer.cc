@@ -8,6 +8,18 @@
  * does it submit to any jurisdiction.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "eckit/config/Resource.h"
+#include "eckit/exception/Exceptions.h"
+#include "eckit/io/DataHandle.h"
+#include "eckit/io/PartFileHandle.h"
 #include "eckit/log/Timer.h"
 #include "eckit/log/Plural.h"
 #include "eckit/log/Bytes.h"
@@ -17,6 +29,10 @@
 #include "eckit/message/Reader.h"
 #include "eckit/message/Message.h"
 
+#include "fdb5/LibFdb5.h"
+#include "fdb5/api/helpers/AsyncExecutor.h"
+#include "fdb5/database/BaseArchiveVisitor.h"
+#include "fdb5/database/DB.h"
 #include "fdb5/message/MessageIndexer.h"
 #include "fdb5/toc/AdoptVisitor.h"
 
@@ -25,15 +41,88 @@ namespace fdb5 {
 
 //----------------------------------------------------------------------------------------------------------------------
 
-MessageIndexer::MessageIndexer(bool checkDuplicates) :
-    MessageDecoder(checkDuplicates) {
+namespace {
+
+/// The fields to be indexed, by database and index key
+typedef std::map<std::pair<Key, Key>, std::vector<AdoptedField>> AdoptedFields;
+
+/// Expands a field against the schema as AdoptVisitor does, but rather than indexing it straight
+/// away, collects it with the other fields of the same index.
+
+class CollectVisitor : public BaseArchiveVisitor {
+
+public: // methods
+
+    CollectVisitor(Archiver& owner, const Key& field, eckit::Offset offset, eckit::Length length,
+                   AdoptedFields& fields) :
+        BaseArchiveVisitor(owner, field),
+        offset_(offset),
+        length_(length),
+        fields_(fields) {
+        ASSERT(offset_ >= eckit::Offset(0));
+        ASSERT(length_ > eckit::Length(0));
+    }
+
+protected: // methods
+
+    bool selectDatabase(const Key& key, const Key& full) override {
+        databaseKey_ = key;
+        return BaseArchiveVisitor::selectDatabase(key, full);
+    }
+
+    // The index is only selected once all of its fields have been collected
+    bool selectIndex(const Key& key, const Key&) override {
+        indexKey_ = key;
+        return true;
+    }
+
+    bool selectDatum(const Key& key, const Key& full) override {
+        checkMissingKeys(full);
+        fields_[std::make_pair(databaseKey_, indexKey_)].push_back(AdoptedField{key, offset_, length_});
+        return true;
+    }
+
+    void print(std::ostream& out) const override {
+        out << "CollectVisitor["
+            << "offset=" << offset_
+            << ",length=" << length_
+            << "]";
+    }
+
+private: // members
+
+    eckit::Offset offset_;
+    eckit::Length length_;
+
+    AdoptedFields& fields_;
+
+    Key databaseKey_;
+    Key indexKey_;
+};
+
+}  // namespace
+
+//----------------------------------------------------------------------------------------------------------------------
+
+MessageIndexer::MessageIndexer(bool checkDuplicates, bool exactDuplicates, size_t duplicatesWindow,
+                               const Config& config) :
+    Archiver(config),
+    MessageDecoder(checkDuplicates, exactDuplicates, duplicatesWindow),
+    threads_(eckit::Resource<size_t>("fdbIndexerThreads;$FDB_INDEXER_THREADS", 0)),
+    chunkSize_(eckit::Resource<size_t>("fdbIndexerChunkSize;$FDB_INDEXER_CHUNK_SIZE", 256 * 1024 * 1024)) {
+}
+
+void MessageIndexer::threads(size_t threads) {
+    threads_ = threads;
+}
+
+void MessageIndexer::chunkSize(eckit::Length chunkSize) {
+    chunkSize_ = chunkSize;
 }
 
 void MessageIndexer::index(const eckit::PathName &path) {
     eckit::Timer timer("fdb::service::archive");
 
-    eckit::message::Reader reader(path);
-
     size_t count = 0;
     eckit::Length total_size = 0;
 
@@ -43,6 +132,98 @@ void MessageIndexer::index(const eckit::PathName &path) {
 
     eckit::PathName full(path.realName());
 
+    std::vector<Chunk> chunks;
+
+    if (threads_ > 0 && scan(full, chunkSize_, chunks)) {
+        eckit::Log::debug<LibFdb5>() << "Indexing " << full << " in " << eckit::Plural(chunks.size(), "chunk")
+                                     << " on " << eckit::Plural(threads_, "thread") << std::endl;
+        indexChunks(full, chunks, count, total_size, progress);
+    } else {
+        indexSequential(full, count, total_size, progress);
+    }
+
+    eckit::Log::info() << "FDB indexer " << eckit::Plural(count, "message") << ","
+                       << " size " << eckit::Bytes(total_size) << ","
+                       << " in " << eckit::Seconds(timer.elapsed())
+                       << " (" << eckit::Bytes(total_size, timer) << ")" <<  std::endl;
+
+}
+
+bool MessageIndexer::scan(const eckit::PathName& path, eckit::Length chunkSize, std::vector<Chunk>& chunks) {
+
+    std::unique_ptr<eckit::DataHandle> dh(path.fileHandle());
+    dh->openForRead();
+    eckit::AutoClose closer(*dh);
+
+    const long long size = path.size();
+    const long headerLength = 16;
+
+    unsigned char header[headerLength];
+    char trailer[4];
+
+    long long chunkOffset = 0;
+    long long chunkLength = 0;
+    size_t chunkMessages = 0;
+
+    long long pos = 0;
+    while (pos < size) {
+
+        if (size - pos < headerLength) {
+            return false;
+        }
+
+        dh->seek(pos);
+        if (dh->read(header, headerLength) != headerLength || ::memcmp(header, "GRIB", 4) != 0) {
+            return false;
+        }
+
+        long long length = 0;
+        if (header[7] == 1) {
+            length = (header[4] << 16) | (header[5] << 8) | header[6];
+            if (length & 0x800000) {  // large messages are scaled, and need the full decoder
+                return false;
+            }
+        } else if (header[7] == 2) {
+            for (size_t i = 8; i < 16; ++i) {
+                length = (length << 8) | header[i];
+            }
+        } else {
+            return false;
+        }
+
+        if (length < headerLength || length > size - pos) {
+            return false;
+        }
+
+        dh->seek(pos + length - 4);
+        if (dh->read(trailer, 4) != 4 || ::memcmp(trailer, "7777", 4) != 0) {
+            return false;
+        }
+
+        if (chunkMessages > 0 && chunkLength + length > static_cast<long long>(chunkSize)) {
+            chunks.push_back(Chunk{chunkOffset, chunkLength, chunkMessages});
+            chunkOffset = pos;
+            chunkLength = 0;
+            chunkMessages = 0;
+        }
+
+        chunkLength += length;
+        chunkMessages++;
+        pos += length;
+    }
+
+    if (chunkMessages > 0) {
+        chunks.push_back(Chunk{chunkOffset, chunkLength, chunkMessages});
+    }
+
+    return true;
+}
+
+void MessageIndexer::indexSequential(const eckit::PathName& path, size_t& count, eckit::Length& totalSize,
+                                     eckit::Progress& progress) {
+
+    eckit::message::Reader reader(path);
+
     eckit::message::Message msg;
     while ( (msg = reader.next()) ) {
 
@@ -55,20 +236,93 @@ void MessageIndexer::index(const eckit::PathName &path) {
         eckit::Length length = msg.length();
         eckit::Offset offset = reader.position() - length;
 
-        AdoptVisitor visitor(*this, key, full, offset, length);
+        AdoptVisitor visitor(*this, key, path, offset, length);
 
         archive(key, visitor);
 
-        total_size += length;
-        progress(total_size);
+        totalSize += length;
+        progress(totalSize);
         count++;
     }
+}
 
-    eckit::Log::info() << "FDB indexer " << eckit::Plural(count, "message") << ","
-                       << " size " << eckit::Bytes(total_size) << ","
-                       << " in " << eckit::Seconds(timer.elapsed())
-                       << " (" << eckit::Bytes(total_size, timer) << ")" <<  std::endl;
+void MessageIndexer::indexChunks(const eckit::PathName& path, const std::vector<Chunk>& chunks, size_t& count,
+                                 eckit::Length& totalSize, eckit::Progress& progress) {
+
+    // Chunks being decoded on other threads, in the order of the file. The decoders refer
+    // to this indexer, so must complete before it is left.
+    std::deque<std::future<std::vector<AdoptedField>>> decoding;
+    AsyncWaitGuard<std::deque<std::future<std::vector<AdoptedField>>>> guard(decoding);
+
+    for (const Chunk& chunk : chunks) {
+
+        if (decoding.size() >= threads_) {
+            adopt(path, decoding.front().get(), count, totalSize, progress);
+            decoding.pop_front();
+        }
+
+        decoding.emplace_back(AsyncExecutor::instance().submit([this, &path, chunk] { return decodeChunk(path, chunk); }));
+    }
+
+    while (!decoding.empty()) {
+        adopt(path, decoding.front().get(), count, totalSize, progress);
+        decoding.pop_front();
+    }
+}
+
+std::vector<AdoptedField> MessageIndexer::decodeChunk(const eckit::PathName& path, const Chunk& chunk) {
 
+    eckit::PartFileHandle handle(path, chunk.offset, chunk.length);
+    eckit::message::Reader reader(handle);
+
+    std::vector<AdoptedField> fields;
+    fields.reserve(chunk.messages);
+
+    eckit::message::Message msg;
+    while ( (msg = reader.next()) ) {
+
+        AdoptedField field{Key(), eckit::Offset(0), eckit::Length(msg.length())};
+
+        decode(msg, field.key);
+
+        // The reader's position is relative to the start of the chunk
+        field.offset = static_cast<long long>(chunk.offset) + static_cast<long long>(reader.position() - field.length);
+
+        fields.push_back(std::move(field));
+    }
+
+    ASSERT(fields.size() == chunk.messages);
+
+    return fields;
+}
+
+void MessageIndexer::adopt(const eckit::PathName& path, const std::vector<AdoptedField>& fields, size_t& count,
+                           eckit::Length& totalSize, eckit::Progress& progress) {
+
+    AdoptedFields collected;
+
+    for (const AdoptedField& f : fields) {
+
+        checkDuplicate(f.key);
+
+        CollectVisitor visitor(*this, f.key, f.offset, f.length, collected);
+
+        archive(f.key, visitor);
+
+        totalSize += f.length;
+        progress(totalSize);
+        count++;
+    }
+
+    // The sort is stable, so where fields share a key the last one in the file is indexed last
+
+    for (auto& c : collected) {
+        std::vector<AdoptedField>& run = c.second;
+        std::stable_sort(run.begin(), run.end(),
+                         [](const AdoptedField& a, const AdoptedField& b) { return a.key < b.key; });
+
+        database(c.first.first).index(c.first.second, path, run);
+    }
 }
 
 //----------------------------------------------------------------------------------------------------------------------
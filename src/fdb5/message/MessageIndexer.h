@@ -16,28 +16,74 @@
 #ifndef fdb5_MessageIndexer_H
 #define fdb5_MessageIndexer_H
 
+#include <vector>
+
 #include "eckit/filesystem/PathName.h"
+#include "eckit/io/Length.h"
+#include "eckit/io/Offset.h"
 
 #include "fdb5/database/Archiver.h"
+#include "fdb5/database/Field.h"
 #include "fdb5/message/MessageDecoder.h"
 
-namespace eckit   { class DataHandle; }
+namespace eckit   { class DataHandle; class Progress; }
 
 namespace fdb5 {
 
 //----------------------------------------------------------------------------------------------------------------------
 
+/// Indexes the messages of an existing file into the FDB, in place.
+///
+/// With threads, a file of GRIB messages is split at the message boundaries found from their
+/// headers, and the chunks are decoded concurrently. The fields of each chunk are then grouped by
+/// the index they belong to, and each group is indexed in one go, sorted by key. Chunks are
+/// indexed in the order of the file, so that the last of several fields with the same key wins.
+/// Files that cannot be split this way are indexed sequentially.
+
 class MessageIndexer : public Archiver, public MessageDecoder {
 
 public: // methods
 
-    MessageIndexer(bool checkDuplicates = false);
+    MessageIndexer(bool checkDuplicates = false, bool exactDuplicates = false, size_t duplicatesWindow = 0,
+                   const Config& config = Config().expandConfig());
 
     void index(const eckit::PathName& path);
 
-private: // members
+    /// Number of chunks of a file decoded at once (0 decodes the messages one at a time as
+    /// they are indexed)
+    void threads(size_t threads);
+
+    /// Largest size of the chunks, unless a single message is larger
+    void chunkSize(eckit::Length chunkSize);
+
+public: // types
+
+    struct Chunk {
+        eckit::Offset offset;
+        eckit::Length length;
+        size_t messages;
+    };
 
+    /// Finds the GRIB messages of a file from their headers alone, and groups them into chunks of
+    /// up to chunkSize bytes. Gives up on files holding anything but contiguous GRIB messages whose
+    /// length is in their header (e.g. padding, other formats, or large GRIB 1 messages).
+    static bool scan(const eckit::PathName& path, eckit::Length chunkSize, std::vector<Chunk>& chunks);
+
+private: // methods
+
+    void indexSequential(const eckit::PathName& path, size_t& count, eckit::Length& totalSize,
+                         eckit::Progress& progress);
+    void indexChunks(const eckit::PathName& path, const std::vector<Chunk>& chunks, size_t& count,
+                     eckit::Length& totalSize, eckit::Progress& progress);
+
+    std::vector<AdoptedField> decodeChunk(const eckit::PathName& path, const Chunk& chunk);
+    void adopt(const eckit::PathName& path, const std::vector<AdoptedField>& fields, size_t& count,
+               eckit::Length& totalSize, eckit::Progress& progress);
+
+private: // members
 
+    size_t threads_;
+    eckit::Length chunkSize_;
 };
 
 //----------------------------------------------------------------------------------------------------------------------
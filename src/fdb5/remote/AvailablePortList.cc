@@ -177,6 +177,26 @@ int AvailablePortList::acquire() {
     throw eckit::SeriousBug("Data ports exhausted", Here());
 }
 
+void AvailablePortList::release(int port) {
+
+    std::lock_guard<decltype(shared_)> lock(shared_);
+
+    pid_t pid = ::getpid();
+
+    for (auto it = shared_.begin(); it != shared_.end(); ++it) {
+        if (it->port == port) {
+            ASSERT(it->pid == pid);
+            it->pid = 0;
+            it->deadTime = 0;
+            shared_.sync();
+            eckit::Log::info() << "Releasing port: " << port << std::endl;
+            return;
+        }
+    }
+
+    throw eckit::SeriousBug("Released port not found in port list", Here());
+}
+
 void AvailablePortList::reap(int deadTime) {
 
     std::lock_guard<decltype(shared_)> lock(shared_);
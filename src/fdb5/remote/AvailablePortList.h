@@ -53,6 +53,10 @@ public: // methods
     /// It is cleaned up by a reaper
     int acquire();
 
+    /// Release a port acquired by this process, for use when a process serves many
+    /// connections and so does not die with each of them
+    void release(int port);
+
     /// Clean up any processes that have been been dead for deadTime seconds.
     /// Any newly dead processes should be marked with the current time.
     void reap(int deadTime=60);
@@ -0,0 +1,832 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <algorithm>
+#include <sstream>
+
+#include "eckit/config/Resource.h"
+#include "eckit/io/ResizableBuffer.h"
+#include "eckit/log/Bytes.h"
+#include "eckit/log/Log.h"
+#include "eckit/os/BackTrace.h"
+#include "eckit/serialisation/MemoryStream.h"
+#include "eckit/utils/Translator.h"
+
+#include "fdb5/LibFdb5.h"
+#include "fdb5/remote/ClientConnection.h"
+
+using namespace eckit;
+using namespace eckit::net;
+
+
+namespace eckit {
+template<> struct Translator<Endpoint, std::string> {
+    std::string operator()(const net::Endpoint& e) {
+        std::stringstream ss;
+        ss << e;
+        return ss.str();
+    }
+};
+}
+
+namespace fdb5 {
+namespace remote {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+class ConnectionError : public eckit::Exception {
+public:
+    ConnectionError(const int, const eckit::net::Endpoint&);
+
+    bool retryOnClient() const override { return true; }
+};
+
+ConnectionError::ConnectionError(const int retries, const eckit::net::Endpoint& endpoint) {
+    std::ostringstream s;
+    s << "Unable to create a connection with the FDB endpoint " << endpoint << " after " << retries << " retries";
+    reason(s.str());
+    Log::status() << what() << std::endl;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+namespace {
+class TCPException : public Exception {
+public:
+    TCPException(const std::string& msg, const CodeLocation& here) :
+        Exception(std::string("TCPException: ") + msg, here) {
+
+        eckit::Log::error() << "TCP Exception; backtrace(): " << std::endl;
+        eckit::Log::error() << eckit::BackTrace::dump() << std::endl;
+    }
+};
+}
+
+RemoteFDBException::RemoteFDBException(const std::string& msg, const net::Endpoint& endpoint) :
+    RemoteException(msg, eckit::Translator<Endpoint, std::string>()(endpoint)) {}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// n.b. if we get integer overflow, we reuse the IDs. This is not a
+//      big deal. The idea that we could be on the 2.1 billionth (successful)
+//      request, and still have an ongoing request 0 is ... laughable.
+//
+// n.b. IDs are unique across the process, so that requests from different clients
+//      sharing a connection can be told apart.
+
+uint32_t ClientConnection::generateRequestID() {
+
+    static std::mutex m;
+    static uint32_t id = 0;
+
+    std::lock_guard<std::mutex> lock(m);
+    return ++id;
+}
+
+ClientConnection::Throttle::Throttle(size_t bytesPerSecond) :
+    bytesPerSecond_(bytesPerSecond),
+    bytes_(0),
+    start_(std::chrono::steady_clock::now()) {}
+
+void ClientConnection::Throttle::operator()(size_t bytes) {
+
+    if (bytesPerSecond_ == 0) return;
+
+    bytes_ += bytes;
+
+    auto due = start_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            std::chrono::duration<double>(double(bytes_) / bytesPerSecond_));
+    auto now = std::chrono::steady_clock::now();
+
+    if (due > now) {
+        std::this_thread::sleep_for(due - now);
+    } else if (now - due > std::chrono::seconds(1)) {
+        // Idle time is not credited, so that a link left unused does not then burst
+        start_ = now;
+        bytes_ = 0;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+ClientConnection::ClientConnection(const eckit::net::Endpoint& controlEndpoint, const std::string& compression,
+                                   size_t bandwidth) :
+    controlEndpoint_(controlEndpoint),
+    requestedCompression_(compression),
+    compression_("none"),
+    readThrottle_(bandwidth),
+    writeThrottle_(bandwidth),
+    maxBufferedBytes_(eckit::Resource<size_t>("fdbRemoteMaxBufferedBytes;$FDB_REMOTE_MAX_BUFFERED_BYTES", 1024 * 1024 * 1024)),
+    connected_(false),
+    listening_(false),
+    archiving_(false),
+    lastUsed_(::time(nullptr)) {
+
+    if (!eckit::CompressorFactory::instance().has(requestedCompression_)) {
+        std::ostringstream ss;
+        ss << "Compressor '" << requestedCompression_ << "' for the FDB data connection is not available. Available: ";
+        eckit::CompressorFactory::instance().list(ss);
+        throw UserError(ss.str(), Here());
+    }
+}
+
+ClientConnection::~ClientConnection() {
+    try {
+        disconnect();
+    } catch (std::exception& e) {
+        Log::error() << "Error closing connection to " << controlEndpoint_ << ": " << e.what() << std::endl;
+    }
+}
+
+// Protocol negotiation:
+//
+// i) Connect to server. Send:
+//     - session identification
+//     - supported functionality for protocol negotiation
+//
+// ii) Server responds. Sends:
+//     - returns the client session id (for verification)
+//     - the server session id
+//     - endpoint for data connection
+//     - selected functionality for protocol negotiation
+//
+// iii) Open data connection, and write to server:
+//     - client session id
+//     - server session id
+//
+// This appears quite verbose in terms of protocol negotiation, but the repeated
+// sending of both session ids allows clients and servers to be sure that they are
+// connected to the correct endpoint in a multi-process, multi-host environment.
+//
+// This was an issue on the NextGenIO prototype machine, where TCP connections were
+// getting lost, and/or incorrectly reset, and as a result sessions were being
+// mispaired by the network stack!
+
+void ClientConnection::connect() {
+
+    std::lock_guard<std::mutex> lock(connectMutex_);
+
+    if (!connected_) {
+
+        static int fdbMaxConnectRetries = eckit::Resource<int>("fdbMaxConnectRetries", 5);
+
+        try {
+            // Connect to server, and check that the server is happy on the response
+
+            Log::debug<LibFdb5>() << "Connecting to host: " << controlEndpoint_ << std::endl;
+            controlClient_.connect(controlEndpoint_, fdbMaxConnectRetries);
+            writeControlStartupMessage();
+            SessionID serverSession = verifyServerStartupResponse();
+
+            // Connect to the specified data port
+            Log::debug<LibFdb5>() << "Received data endpoint from host: " << dataEndpoint_ << std::endl;
+            dataClient_.connect(dataEndpoint_, fdbMaxConnectRetries);
+            writeDataStartupMessage(serverSession);
+
+            // And the connections are set up. Let everything start up!
+            listening_ = true;
+            listeningThread_ = std::thread([this] { listeningThreadLoop(); });
+            connected_ = true;
+            touch();
+        } catch(TooManyRetries& e) {
+            if (controlClient_.isConnected()) {
+                controlClient_.close();
+                throw ConnectionError(fdbMaxConnectRetries, dataEndpoint_);
+            } else {
+                throw ConnectionError(fdbMaxConnectRetries, controlEndpoint_);
+            }
+        }
+    }
+}
+
+void ClientConnection::disconnect() {
+
+    std::lock_guard<std::mutex> lock(connectMutex_);
+
+    if (connected_) {
+
+        connected_ = false;
+
+        // Send termination message. If the server has already gone away, the listening
+        // thread will have terminated, and there is nobody to tell.
+        if (listening_) {
+            controlWrite(Message::Exit, generateRequestID());
+        }
+
+        listeningThread_.join();
+
+        // Close both the control and data connections
+        controlClient_.close();
+        dataClient_.close();
+
+        // Requests still outstanding will receive nothing more
+        interruptAll(std::make_exception_ptr(RemoteFDBException("Connection closed", controlEndpoint_)));
+    }
+}
+
+bool ClientConnection::healthy() const {
+    return connected_ && listening_;
+}
+
+time_t ClientConnection::idleTime() const {
+    return ::time(nullptr) - lastUsed_;
+}
+
+void ClientConnection::touch() {
+    lastUsed_ = ::time(nullptr);
+}
+
+void ClientConnection::writeControlStartupMessage() {
+
+    Buffer payload(4096);
+    MemoryStream s(payload);
+    s << sessionID_;
+    s << controlEndpoint_;
+    s << LibFdb5::instance().remoteProtocolVersion().used();
+
+    // TODO: Abstract this dictionary into a RemoteConfiguration object, which
+    //       understands how to do the negotiation, etc, but uses Value (i.e.
+    //       essentially JSON) over the wire for flexibility.
+    s << availableFunctionality().get();
+
+    controlWrite(Message::Startup, 0, payload.data(), s.position());
+}
+
+SessionID ClientConnection::verifyServerStartupResponse() {
+
+    MessageHeader hdr;
+    controlRead(&hdr, sizeof(hdr));
+
+    ASSERT(hdr.marker == StartMarker);
+    ASSERT(hdr.version == CurrentVersion);
+    ASSERT(hdr.message == Message::Startup);
+    ASSERT(hdr.requestID == 0);
+
+    Buffer payload(hdr.payloadSize);
+    eckit::FixedString<4> tail;
+    controlRead(payload, hdr.payloadSize);
+    controlRead(&tail, sizeof(tail));
+    ASSERT(tail == EndMarker);
+
+    MemoryStream s(payload);
+    SessionID clientSession(s);
+    SessionID serverSession(s);
+    Endpoint dataEndpoint(s);
+    LocalConfiguration serverFunctionality(s);
+
+    dataEndpoint_ = dataEndpoint;
+
+    // n.b. servers that predate compression will not agree on any compressor
+
+    compression_ = serverFunctionality.getString("DataCompression", "none");
+    if (compression_ != "none") {
+        Log::debug<LibFdb5>() << "Protocol negotiation - DataCompression " << compression_ << std::endl;
+        compressor_.reset(eckit::CompressorFactory::instance().build(compression_));
+    }
+
+    if (dataEndpoint_.hostname() != controlEndpoint_.hostname()) {
+        Log::warning() << "Data and control interface hostnames do not match. "
+                       << dataEndpoint_.hostname() << " /= "
+                       << controlEndpoint_.hostname() << std::endl;
+    }
+
+    if (clientSession != sessionID_) {
+        std::stringstream ss;
+        ss << "Session ID does not match session received from server: "
+           << sessionID_ << " != " << clientSession;
+        throw BadValue(ss.str(), Here());
+    }
+
+    return serverSession;
+}
+
+void ClientConnection::writeDataStartupMessage(const eckit::SessionID& serverSession) {
+
+    Buffer payload(1024);
+    MemoryStream s(payload);
+
+    s << sessionID_;
+    s << serverSession;
+
+    dataWrite(Message::Startup, 0, payload.data(), s.position());
+}
+
+eckit::LocalConfiguration ClientConnection::availableFunctionality() const {
+    eckit::LocalConfiguration conf;
+    std::vector<int> remoteFieldLocationVersions = {1};
+    conf.set("RemoteFieldLocation", remoteFieldLocationVersions);
+    std::vector<int> listBatchVersions = {1};
+    conf.set("ListBatch", listBatchVersions);
+    if (requestedCompression_ != "none") {
+        std::vector<std::string> compressors = {requestedCompression_};
+        conf.set("DataCompression", compressors);
+    }
+    return conf;
+}
+
+void ClientConnection::addRequest(uint32_t requestID, std::shared_ptr<MessageQueue> queue) {
+    std::lock_guard<std::mutex> lock(routesMutex_);
+    ASSERT(routes_.emplace(requestID, Route{queue, false, ErrorCallback{}, false}).second);
+}
+
+void ClientConnection::addStreamRequest(uint32_t requestID, std::shared_ptr<MessageQueue> queue) {
+    std::lock_guard<std::mutex> lock(routesMutex_);
+    ASSERT(routes_.emplace(requestID, Route{queue, true, ErrorCallback{}, false}).second);
+}
+
+void ClientConnection::addArchiveRequest(uint32_t requestID, ErrorCallback onError) {
+    std::lock_guard<std::mutex> lock(routesMutex_);
+    ASSERT(routes_.emplace(requestID, Route{nullptr, false, onError, false}).second);
+}
+
+void ClientConnection::removeRequest(uint32_t requestID) {
+    std::lock_guard<std::mutex> lock(routesMutex_);
+    routes_.erase(requestID);
+}
+
+bool ClientConnection::findRoute(uint32_t requestID, Route& route, bool erase) {
+    std::lock_guard<std::mutex> lock(routesMutex_);
+    auto it = routes_.find(requestID);
+    if (it == routes_.end()) return false;
+    route = it->second;
+    if (erase) routes_.erase(it);
+    return true;
+}
+
+// The rest of an abandoned request is discarded as it arrives, until it ends. Only its own queue is
+// interrupted: the listening thread carries on routing the messages of the other requests.
+
+void ClientConnection::abandonRoute(uint32_t requestID, Route& route) {
+
+    std::ostringstream ss;
+    ss << "Request " << requestID << " abandoned, as more than " << Bytes(maxBufferedBytes_)
+       << " of its data was received but not consumed";
+    Log::warning() << ss.str() << std::endl;
+
+    {
+        std::lock_guard<std::mutex> lock(routesMutex_);
+        auto it = routes_.find(requestID);
+        if (it != routes_.end()) it->second.abandoned = true;
+    }
+    route.abandoned = true;
+
+    route.queue->interrupt(std::make_exception_ptr(RemoteFDBException(ss.str(), dataEndpoint_)));
+}
+
+bool ClientConnection::acquireArchive() {
+    bool expected = false;
+    return archiving_.compare_exchange_strong(expected, true);
+}
+
+void ClientConnection::releaseArchive() {
+    ASSERT(archiving_);
+    archiving_ = false;
+}
+
+void ClientConnection::listeningThreadLoop() {
+
+    /// @note This routine retrieves BOTH normal API asynchronously returned data, AND
+    /// fields that are being returned by a read. Both are delivered to the queue
+    /// registered for the requestID.
+    ///
+    /// @note The queues are pushed to without holding the routing lock, and pushing never blocks,
+    /// so that one client that stops reading cannot stall this thread (and so every other client
+    /// of the connection). A request that buffers too much unread data is abandoned instead.
+
+    try {
+
+    MessageHeader hdr;
+    eckit::FixedString<4> tail;
+    Route route;
+
+    while (true) {
+
+        dataRead(&hdr, sizeof(hdr));
+
+        ASSERT(hdr.marker == StartMarker);
+        ASSERT(hdr.version == CurrentVersion);
+
+        switch (hdr.message) {
+
+        case Message::Exit:
+            listening_ = false;
+            return;
+
+        case Message::Blob: {
+            Buffer payload(hdr.payloadSize);
+            if (hdr.payloadSize > 0) dataRead(payload, hdr.payloadSize);
+
+            if (findRoute(hdr.requestID, route, false) && route.queue) {
+                if (!route.abandoned && route.queue->bytes() + payload.size() > maxBufferedBytes_) {
+                    abandonRoute(hdr.requestID, route);
+                }
+                if (!route.abandoned) {
+                    route.queue->emplace(std::make_pair(hdr, std::move(payload)));
+                }
+            } else {
+                Log::warning() << "Discarding data for unknown request ID " << hdr.requestID << std::endl;
+            }
+            break;
+        }
+
+        case Message::Complete: {
+            if (findRoute(hdr.requestID, route, true) && route.queue && !route.abandoned) {
+                // Erasing the route drops our reference --> the message queue will be
+                // destroyed when it goes out of scope in the worker thread.
+                if (route.stream) {
+                    route.queue->emplace(std::make_pair(hdr, Buffer(0)));
+                } else {
+                    route.queue->close();
+                }
+            }
+            break;
+        }
+
+        case Message::Error: {
+
+            std::string msg;
+            if (hdr.payloadSize > 0) {
+                msg.resize(hdr.payloadSize, ' ');
+                dataRead(&msg[0], hdr.payloadSize);
+            }
+
+            if (findRoute(hdr.requestID, route, true)) {
+                if (route.abandoned) {
+                    Log::error() << "Error received for abandoned request ID " << hdr.requestID << ": " << msg << std::endl;
+                } else if (route.onError) {
+                    route.onError(std::make_exception_ptr(RemoteFDBException(msg, dataEndpoint_)));
+                } else if (route.stream) {
+                    route.queue->emplace(std::make_pair(hdr, Buffer(msg.c_str(), msg.size())));
+                } else {
+                    route.queue->interrupt(std::make_exception_ptr(RemoteFDBException(msg, dataEndpoint_)));
+                }
+            } else {
+                Log::error() << "Error received for unknown request ID " << hdr.requestID << ": " << msg << std::endl;
+            }
+            break;
+        }
+
+        default: {
+            std::stringstream ss;
+            ss << "ERROR: Unexpected message recieved (" << static_cast<int>(hdr.message) << "). ABORTING";
+            Log::status() << ss.str() << std::endl;
+            Log::error() << "Retrieving... " << ss.str() << std::endl;
+            throw SeriousBug(ss.str(), Here());
+        }
+        };
+
+        // Ensure we have consumed exactly the correct amount from the socket.
+
+        dataRead(&tail, sizeof(tail));
+        ASSERT(tail == EndMarker);
+    }
+
+    // We don't want to let exceptions escape inside a worker thread.
+
+    } catch (const std::exception& e) {
+        listening_ = false;
+        interruptAll(std::make_exception_ptr(e));
+    } catch (...) {
+        listening_ = false;
+        interruptAll(std::current_exception());
+    }
+}
+
+void ClientConnection::interruptAll(std::exception_ptr e) {
+
+    std::map<uint32_t, Route> routes;
+    {
+        std::lock_guard<std::mutex> lock(routesMutex_);
+        std::swap(routes, routes_);
+    }
+
+    for (auto& it : routes) {
+        if (it.second.onError) {
+            it.second.onError(e);
+        } else {
+            it.second.queue->interrupt(e);
+        }
+    }
+}
+
+void ClientConnection::controlWriteCheckResponse(Message msg, uint32_t requestID, const void* payload, uint32_t payloadLength) {
+
+    std::lock_guard<std::mutex> lock(controlMutex_);
+
+    controlWriteUnsafe(msg, requestID, payload, payloadLength);
+
+    // Wait for the receipt acknowledgement
+
+    MessageHeader response;
+    controlRead(&response, sizeof(MessageHeader));
+
+    handleError(response);
+
+    ASSERT(response.marker == StartMarker);
+    ASSERT(response.version == CurrentVersion);
+    ASSERT(response.message == Message::Received);
+
+    eckit::FixedString<4> tail;
+    controlRead(&tail, sizeof(tail));
+    ASSERT(tail == EndMarker);
+}
+
+void ClientConnection::controlWrite(Message msg, uint32_t requestID, const void* payload, uint32_t payloadLength) {
+    std::lock_guard<std::mutex> lock(controlMutex_);
+    controlWriteUnsafe(msg, requestID, payload, payloadLength);
+}
+
+void ClientConnection::controlWriteUnsafe(Message msg, uint32_t requestID, const void* payload, uint32_t payloadLength) {
+
+    ASSERT((payload == nullptr) == (payloadLength == 0));
+
+    touch();
+
+    MessageHeader message(msg, requestID, payloadLength);
+    controlWrite(&message, sizeof(message));
+    if (payload) {
+        controlWrite(payload, payloadLength);
+    }
+    controlWrite(&EndMarker, sizeof(EndMarker));
+}
+
+void ClientConnection::controlWrite(const void* data, size_t length) {
+    size_t written = controlClient_.write(data, length);
+    if (length != written) {
+        std::stringstream ss;
+        ss << "Write error. Expected " << length << " bytes, wrote " << written;
+        throw TCPException(ss.str(), Here());
+    }
+}
+
+void ClientConnection::controlRead(void* data, size_t length) {
+    size_t read = controlClient_.read(data, length);
+    if (length != read) {
+        std::stringstream ss;
+        ss << "Read error. Expected " << length << " bytes, read " << read;
+        throw TCPException(ss.str(), Here());
+    }
+}
+
+void ClientConnection::dataWrite(Message msg, uint32_t requestID, const void* payload, uint32_t payloadLength) {
+
+    ASSERT((payload == nullptr) == (payloadLength == 0));
+
+    MessageHeader message(msg, requestID, payloadLength);
+    dataWrite(&message, sizeof(message));
+    if (payload) {
+        dataWrite(payload, payloadLength);
+    }
+    dataWrite(&EndMarker, sizeof(EndMarker));
+}
+
+void ClientConnection::dataWrite(const void* data, size_t length) {
+    size_t written = dataClient_.write(data, length);
+    if (length != written) {
+        std::stringstream ss;
+        ss << "Write error. Expected " << length << " bytes, wrote " << written;
+        throw TCPException(ss.str(), Here());
+    }
+    writeThrottle_(length);
+}
+
+void ClientConnection::dataWriteBatch(uint32_t requestID, const void* data, size_t length) {
+
+    static double fdbRemoteCompressionMaxRatio = eckit::Resource<double>("fdbRemoteCompressionMaxRatio", 0.9);
+
+    if (compressor_) {
+
+        // Payload: the uncompressed length, followed by the compressed data
+
+        eckit::ResizableBuffer compressed(length);
+        size_t compressedLength = compressor_->compress(data, length, compressed);
+
+        if (compressedLength <= fdbRemoteCompressionMaxRatio * length) {
+            uint64_t uncompressedLength = length;
+            MessageHeader message(Message::CompressedMultiBlob, requestID, sizeof(uncompressedLength) + compressedLength);
+            dataWrite(&message, sizeof(message));
+            dataWrite(&uncompressedLength, sizeof(uncompressedLength));
+            dataWrite(compressed, compressedLength);
+            dataWrite(&EndMarker, sizeof(EndMarker));
+            return;
+        }
+
+        Log::debug<LibFdb5>() << "Sending batch uncompressed, " << compression_ << " ratio "
+                              << double(compressedLength) / length << std::endl;
+    }
+
+    dataWrite(Message::MultiBlob, requestID, data, length);
+}
+
+void ClientConnection::dataRead(void* data, size_t length) {
+    size_t read = dataClient_.read(data, length);
+    if (length != read) {
+        std::stringstream ss;
+        ss << "Read error. Expected " << length << " bytes, read " << read;
+        throw TCPException(ss.str(), Here());
+    }
+    readThrottle_(length);
+}
+
+void ClientConnection::handleError(const MessageHeader& hdr) {
+
+    ASSERT(hdr.marker == StartMarker);
+    ASSERT(hdr.version == CurrentVersion);
+
+    if (hdr.message == Message::Error) {
+        ASSERT(hdr.payloadSize > 9);
+
+        std::string what(hdr.payloadSize, ' ');
+        controlRead(&what[0], hdr.payloadSize);
+        what[hdr.payloadSize] = 0; // Just in case
+
+        try {
+            eckit::FixedString<4> tail;
+            controlRead(&tail, sizeof(tail));
+        } catch (...) {}
+
+        throw RemoteFDBException(what, controlEndpoint_);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+ClientConnectionPool& ClientConnectionPool::instance() {
+    static ClientConnectionPool pool;
+    return pool;
+}
+
+ClientConnectionPool::ClientConnectionPool() :
+    idleTimeout_(eckit::Resource<long>("fdbRemoteConnectionIdleTimeout;$FDB_REMOTE_CONNECTION_IDLE_TIMEOUT", 60)),
+    stopping_(false) {}
+
+ClientConnectionPool::~ClientConnectionPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    reaperCv_.notify_all();
+    if (reaper_.joinable()) {
+        reaper_.join();
+    }
+}
+
+size_t ClientConnectionPool::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t n = 0;
+    for (const auto& it : connections_) {
+        n += it.second.size();
+    }
+    return n;
+}
+
+void ClientConnectionPool::idleTimeout(time_t seconds) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idleTimeout_ = seconds;
+    }
+    reaperCv_.notify_all();
+}
+
+void ClientConnectionPool::add(const std::string& key, std::shared_ptr<ClientConnection> conn) {
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    connections_[key].push_back(conn);
+
+    if (!reaper_.joinable()) {
+        reaper_ = std::thread([this] { reaperLoop(); });
+    }
+}
+
+void ClientConnectionPool::reaperLoop() {
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!stopping_) {
+
+        reaperCv_.wait_for(lock, std::chrono::seconds(std::max(time_t(1), idleTimeout_ / 2)));
+        if (stopping_) break;
+
+        std::vector<std::shared_ptr<ClientConnection>> evicted;
+        evictUnlocked(evicted);
+
+        // Disconnect outside of the lock
+        lock.unlock();
+        evicted.clear();
+        lock.lock();
+    }
+}
+
+std::string ClientConnectionPool::compression(const eckit::Configuration& config) const {
+    static std::string fdbRemoteCompression = eckit::Resource<std::string>("fdbRemoteCompression;$FDB_REMOTE_COMPRESSION", "none");
+    return config.getString("compression", fdbRemoteCompression);
+}
+
+size_t ClientConnectionPool::bandwidth(const eckit::Configuration& config) const {
+    static long fdbRemoteBandwidth = eckit::Resource<long>("fdbRemoteBandwidth;$FDB_REMOTE_BANDWIDTH", 0);
+    return config.getLong("bandwidth", fdbRemoteBandwidth);
+}
+
+std::string ClientConnectionPool::key(const eckit::net::Endpoint& endpoint, const eckit::Configuration& config) const {
+    std::ostringstream ss;
+    ss << endpoint << " " << config;
+    return ss.str();
+}
+
+std::shared_ptr<ClientConnection> ClientConnectionPool::connection(const eckit::net::Endpoint& endpoint,
+                                                                   const eckit::Configuration& config) {
+
+    std::string k = key(endpoint, config);
+    std::vector<std::shared_ptr<ClientConnection>> evicted;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        evictUnlocked(evicted);
+
+        auto it = connections_.find(k);
+        if (it != connections_.end() && !it->second.empty()) {
+            return it->second.front();
+        }
+    }
+
+    // n.b. connect outside of the lock, so that a slow server does not hold up other endpoints.
+    //      Two clients racing here will both add a connection, which is harmless.
+
+    auto conn = std::make_shared<ClientConnection>(endpoint, compression(config), bandwidth(config));
+    conn->connect();
+
+    add(k, conn);
+    return conn;
+}
+
+std::shared_ptr<ClientConnection> ClientConnectionPool::archiveConnection(const eckit::net::Endpoint& endpoint,
+                                                                          const eckit::Configuration& config) {
+
+    std::string k = key(endpoint, config);
+    std::vector<std::shared_ptr<ClientConnection>> evicted;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        evictUnlocked(evicted);
+
+        auto it = connections_.find(k);
+        if (it != connections_.end()) {
+            for (const auto& conn : it->second) {
+                if (conn->acquireArchive()) return conn;
+            }
+        }
+    }
+
+    auto conn = std::make_shared<ClientConnection>(endpoint, compression(config), bandwidth(config));
+    conn->connect();
+    ASSERT(conn->acquireArchive());
+
+    add(k, conn);
+    return conn;
+}
+
+void ClientConnectionPool::evict() {
+    std::vector<std::shared_ptr<ClientConnection>> evicted;
+    std::lock_guard<std::mutex> lock(mutex_);
+    evictUnlocked(evicted);
+}
+
+void ClientConnectionPool::evictUnlocked(std::vector<std::shared_ptr<ClientConnection>>& evicted) {
+
+    // Connections that are still in use by a client are only dropped from the pool if they
+    // have failed. The client retains ownership, and they are closed when released.
+    //
+    // n.b. the evicted connections are destroyed (and so disconnected) by the caller, after
+    //      the lock has been released.
+
+    for (auto it = connections_.begin(); it != connections_.end(); /* empty */) {
+        auto& conns = it->second;
+        for (auto c = conns.begin(); c != conns.end(); /* empty */) {
+            bool unused = (c->use_count() == 1);
+            if (!(*c)->healthy() || (unused && (*c)->idleTime() > idleTimeout_)) {
+                Log::debug<LibFdb5>() << "Evicting connection to " << (*c)->controlEndpoint() << std::endl;
+                evicted.push_back(*c);
+                c = conns.erase(c);
+            } else {
+                ++c;
+            }
+        }
+        if (conns.empty()) {
+            connections_.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace remote
+} // namespace fdb5
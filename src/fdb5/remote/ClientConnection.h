@@ -0,0 +1,279 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+/// @date   Oct 2026
+
+#ifndef fdb5_remote_ClientConnection_H
+#define fdb5_remote_ClientConnection_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "eckit/config/LocalConfiguration.h"
+#include "eckit/exception/Exceptions.h"
+#include "eckit/io/Buffer.h"
+#include "eckit/io/compression/Compressor.h"
+#include "eckit/memory/NonCopyable.h"
+#include "eckit/net/Endpoint.h"
+#include "eckit/net/TCPClient.h"
+#include "eckit/runtime/SessionID.h"
+
+#include "fdb5/remote/MessageQueue.h"
+#include "fdb5/remote/Messages.h"
+
+namespace fdb5 {
+namespace remote {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+class RemoteFDBException : public eckit::RemoteException {
+public:
+    RemoteFDBException(const std::string& msg, const eckit::net::Endpoint& endpoint);
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// A control/data connection pair to an FDB server, together with the thread listening
+/// on the data connection.
+///
+/// Messages arriving on the data connection are routed to the queue registered for their
+/// requestID, which allows several RemoteFDB clients to multiplex their requests over the
+/// same connection. The listening thread never waits for a client to consume its messages:
+/// a request whose queue holds more than fdbRemoteMaxBufferedBytes is abandoned, and its
+/// consumer interrupted, rather than holding up the others.
+///
+/// The server only supports one archive at a time per connection, so the archive slot is
+/// acquired exclusively.
+
+class ClientConnection : private eckit::NonCopyable {
+
+public: // types
+
+    using MessageQueue = remote::MessageQueue;
+    using StoredMessage = MessageQueue::StoredMessage;
+    using ErrorCallback = std::function<void(std::exception_ptr)>;
+
+public: // methods
+
+    /// @param compression Preferred compressor for the data connection, or "none"
+    /// @param bandwidth Limit on the rate of the data connection in each direction, in bytes per
+    ///                  second (0 for none). Used to benchmark the protocol over slower links.
+    ClientConnection(const eckit::net::Endpoint& controlEndpoint, const std::string& compression="none",
+                     size_t bandwidth=0);
+    ~ClientConnection();
+
+    static uint32_t generateRequestID();
+
+    void connect();
+    void disconnect();
+
+    /// The connection is established, and the listening thread has not observed a failure
+    bool healthy() const;
+
+    /// Seconds since the connection was last used to issue a request
+    time_t idleTime() const;
+
+    const eckit::net::Endpoint& controlEndpoint() const { return controlEndpoint_; }
+    const eckit::net::Endpoint& dataEndpoint() const { return dataEndpoint_; }
+
+    /// The compressor agreed with the server, or "none"
+    const std::string& compression() const { return compression_; }
+
+    // Routing of messages received on the data connection. Routes must be registered
+    // before the request is sent to the server.
+
+    /// API calls. The queue is closed on Complete, and interrupted on Error
+    void addRequest(uint32_t requestID, std::shared_ptr<MessageQueue> queue);
+
+    /// Streamed data. The Complete and Error messages are delivered to the queue
+    void addStreamRequest(uint32_t requestID, std::shared_ptr<MessageQueue> queue);
+
+    /// Archival. Errors are reported through the callback
+    void addArchiveRequest(uint32_t requestID, ErrorCallback onError);
+
+    void removeRequest(uint32_t requestID);
+
+    bool acquireArchive();
+    void releaseArchive();
+
+    // Handle data going in either direction on the wire
+
+    void controlWriteCheckResponse(Message msg, uint32_t requestID, const void* payload=nullptr, uint32_t payloadLength=0);
+    void controlWrite(Message msg, uint32_t requestID, const void* payload=nullptr, uint32_t payloadLength=0);
+
+    /// n.b. Only the holder of the archive slot writes to the data connection
+    void dataWrite(Message msg, uint32_t requestID, const void* payload=nullptr, uint32_t payloadLength=0);
+    void dataWrite(const void* data, size_t length);
+
+    /// Send the contents of a MultiBlob, compressing it if agreed with the server. Batches
+    /// that do not compress well are sent as they are.
+    void dataWriteBatch(uint32_t requestID, const void* data, size_t length);
+
+private: // types
+
+    struct Route {
+        std::shared_ptr<MessageQueue> queue;
+        bool stream;
+        ErrorCallback onError;
+        bool abandoned;
+    };
+
+    /// Paces the transfers in one direction to a given average rate
+    class Throttle {
+    public:
+        Throttle(size_t bytesPerSecond);
+        void operator()(size_t bytes);
+    private:
+        size_t bytesPerSecond_;
+        size_t bytes_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+private: // methods
+
+    // Session negotiation with the server
+    void writeControlStartupMessage();
+    eckit::SessionID verifyServerStartupResponse();
+    void writeDataStartupMessage(const eckit::SessionID& serverSession);
+
+    // Construct dictionary for protocol negotiation
+    eckit::LocalConfiguration availableFunctionality() const;
+
+    // Listen to the dataClient for incoming messages, and push them onto
+    // appropriate queues.
+    void listeningThreadLoop();
+    void interruptAll(std::exception_ptr e);
+    bool findRoute(uint32_t requestID, Route& route, bool erase);
+    void abandonRoute(uint32_t requestID, Route& route);
+
+    void controlWriteUnsafe(Message msg, uint32_t requestID, const void* payload, uint32_t payloadLength);
+    void controlWrite(const void* data, size_t length);
+    void controlRead(void* data, size_t length);
+    void dataRead(void* data, size_t length);
+    void handleError(const MessageHeader& hdr);
+
+    void touch();
+
+private: // members
+
+    eckit::SessionID sessionID_;
+
+    eckit::net::Endpoint controlEndpoint_;
+    eckit::net::Endpoint dataEndpoint_;
+
+    eckit::net::TCPClient controlClient_;
+    eckit::net::TCPClient dataClient_;
+
+    std::string requestedCompression_;
+    std::string compression_;
+    std::unique_ptr<eckit::Compressor> compressor_;
+
+    Throttle readThrottle_;
+    Throttle writeThrottle_;
+
+    size_t maxBufferedBytes_;
+
+    // Listen on the dataClient for incoming messages.
+    std::thread listeningThread_;
+
+    // Where do we put received messages
+    // @note At the point that a request is complete, errored or otherwise killed, its
+    // route needs to be removed from the map. The shared_ptr allows this removal to be
+    // asynchronous with the actual task cleaning up and returning to the client.
+    std::map<uint32_t, Route> routes_;
+    std::mutex routesMutex_;
+
+    // Request/response pairs on the control connection must not interleave
+    std::mutex controlMutex_;
+    std::mutex connectMutex_;
+
+    std::atomic<bool> connected_;
+    std::atomic<bool> listening_;
+    std::atomic<bool> archiving_;
+    std::atomic<time_t> lastUsed_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Process-wide pool of ClientConnections, keyed by endpoint and configuration.
+///
+/// Connections no longer referenced by any client are closed once they have been idle for
+/// longer than fdbRemoteConnectionIdleTimeout seconds. A background thread checks for them
+/// (as well as on every use of the pool), so that idle connections are also closed in a
+/// process that has stopped using the pool. Connections whose listening thread has failed
+/// are dropped from the pool, and replaced on the next request.
+
+class ClientConnectionPool : private eckit::NonCopyable {
+
+public: // methods
+
+    static ClientConnectionPool& instance();
+
+    /// A connection for API calls and reads, shared with other clients
+    std::shared_ptr<ClientConnection> connection(const eckit::net::Endpoint& endpoint,
+                                                 const eckit::Configuration& config);
+
+    /// A connection whose archive slot has been acquired on behalf of the caller
+    std::shared_ptr<ClientConnection> archiveConnection(const eckit::net::Endpoint& endpoint,
+                                                        const eckit::Configuration& config);
+
+    /// Close idle and unhealthy connections
+    void evict();
+
+    /// Number of connections in the pool
+    size_t size();
+
+    /// Seconds after which unused connections are closed
+    void idleTimeout(time_t seconds);
+
+    /// The compressor requested for the data connection
+    std::string compression(const eckit::Configuration& config) const;
+
+    /// The limit on the rate of the data connection, in bytes per second (0 for none)
+    size_t bandwidth(const eckit::Configuration& config) const;
+
+private: // methods
+
+    ClientConnectionPool();
+    ~ClientConnectionPool();
+
+    std::string key(const eckit::net::Endpoint& endpoint, const eckit::Configuration& config) const;
+
+    void evictUnlocked(std::vector<std::shared_ptr<ClientConnection>>& evicted);
+
+    void add(const std::string& key, std::shared_ptr<ClientConnection> conn);
+    void reaperLoop();
+
+private: // members
+
+    std::map<std::string, std::vector<std::shared_ptr<ClientConnection>>> connections_;
+    std::mutex mutex_;
+
+    time_t idleTimeout_;
+
+    std::thread reaper_;
+    std::condition_variable reaperCv_;
+    bool stopping_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace remote
+} // namespace fdb5
+
+#endif // fdb5_remote_ClientConnection_H
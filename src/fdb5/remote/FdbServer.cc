@@ -13,14 +13,21 @@
  * (Project ID: 671951) www.nextgenio.eu
  */
 
+#include "eckit/exception/Exceptions.h"
+#include "eckit/net/TCPClient.h"
 #include "eckit/thread/Thread.h"
 #include "eckit/thread/ThreadControler.h"
 
 #include "fdb5/remote/FdbServer.h"
 
+#include "fdb5/fdb5_config.h"
 #include "fdb5/remote/AvailablePortList.h"
 #include "fdb5/remote/Handler.h"
 
+#ifdef fdb5_HAVE_SERVER_REACTOR
+#include "fdb5/remote/ServerReactor.h"
+#endif
+
 using namespace eckit;
 
 
@@ -84,37 +91,81 @@ void FDBServerThread::run() {
 
 //----------------------------------------------------------------------------------------------------------------------
 
-FdbServerBase::FdbServerBase() {}
+FdbServerBase::FdbServerBase() : port_(0), stopping_(false) {}
+
+FdbServerBase::~FdbServerBase() {
+    stopping_ = true;
+    if (reaperThread_.joinable()) {
+        reaperThread_.join();
+    }
+}
+
+void FdbServerBase::stop() {
+
+    stopping_ = true;
 
-FdbServerBase::~FdbServerBase() {}
+    // Wake up the accept() call with a connection of our own
+
+    if (port_ != 0) {
+        try {
+            net::TCPClient client;
+            client.connect("localhost", port_);
+        }
+        catch (std::exception& e) {
+            eckit::Log::warning() << "Stopping FDB server on port " << port_ << ": " << e.what() << std::endl;
+        }
+    }
+}
 
 void FdbServerBase::doRun() {
 
     hookUnique();
 
-    Config config = LibFdb5::instance().defaultConfig();
+    Config config = serverConfig();
     config.set("statistics", true);
 
-    // If we are using a specified range of ports, start a thread that
-    // maintains the list of available ports.
-    startPortReaperThread(config);
-
     int port = config.getInt("serverPort", 7654);
     bool threaded = config.getBool("serverThreaded", false);
+    bool reactor = FdbServerBase::reactor(config);
+
+    // If we are using a specified range of ports, start a thread that
+    // maintains the list of available ports. The event-driven server
+    // releases its ports explicitly, so only needs the list initialised.
+    startPortReaperThread(config, !reactor);
 
     net::TCPServer server(net::Port("fdb", port), net::SocketOptions::server().reusePort(true));
     server.closeExec(false);
 
     port_ = server.localPort();
 
-    while (true) {
+#ifdef fdb5_HAVE_SERVER_REACTOR
+    if (reactor) {
+        ServerReactor handlers(config);
+        while (!stopping_) {
+            try {
+                net::TCPSocket socket(server.accept());
+                if (stopping_) break;
+                handlers.add(socket);
+            }
+            catch (std::exception& e) {
+                eckit::Log::error() << "** " << e.what() << " Caught in " << Here() << std::endl;
+                eckit::Log::error() << "** Exception is ignored" << std::endl;
+            }
+        }
+        return;
+    }
+#endif
+
+    while (!stopping_) {
         try {
+            net::TCPSocket socket(server.accept());
+            if (stopping_) break;
             if (threaded) {
-                ThreadControler t(new FDBServerThread(server.accept(), config));
+                ThreadControler t(new FDBServerThread(socket, config));
                 t.start();
             }
             else {
-                FDBForker f(server.accept(), config);
+                FDBForker f(socket, config);
                 f.start();
             }
         }
@@ -125,7 +176,25 @@ void FdbServerBase::doRun() {
     }
 }
 
-void FdbServerBase::startPortReaperThread(const Config &config) {
+bool FdbServerBase::reactor(const Config& config) {
+
+    bool reactor = config.getBool("serverReactor", false);
+
+#ifndef fdb5_HAVE_SERVER_REACTOR
+    if (reactor) {
+        throw eckit::UserError("serverReactor: the event-driven FDB server needs epoll, which is not available "
+                               "on this platform. Use serverThreaded (a thread per connection) instead", Here());
+    }
+#endif
+
+    return reactor;
+}
+
+Config FdbServerBase::serverConfig() const {
+    return LibFdb5::instance().defaultConfig();
+}
+
+void FdbServerBase::startPortReaperThread(const Config &config, bool reap) {
 
     if (config.has("dataPortStart")) {
         ASSERT(config.has("dataPortCount"));
@@ -139,13 +208,17 @@ void FdbServerBase::startPortReaperThread(const Config &config) {
         AvailablePortList portList(startPort, count);
         portList.initialise();
 
-        reaperThread_ = std::thread([startPort, count]() {
+        if (!reap) return;
+
+        reaperThread_ = std::thread([this, startPort, count]() {
 
             AvailablePortList portList(startPort, count);
 
-            while (true) {
+            while (!stopping_) {
                 portList.reap(120);
-                std::this_thread::sleep_for(std::chrono::seconds(10));
+                for (int i = 0; i < 100 && !stopping_; ++i) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
             }
         });
     }
@@ -17,6 +17,7 @@
 
 #include <unistd.h>
 #include <stdlib.h>
+#include <atomic>
 #include <thread>
 
 #include "eckit/net/Port.h"
@@ -67,9 +68,26 @@ public:
 
     virtual void doRun();
 
+    /// The port the server is listening on, once it has started. Zero before that.
+    int port() const { return port_; }
+
+    /// Stop accepting connections, and return from doRun(). Connections already accepted
+    /// are served until their clients disconnect.
+    void stop();
+
+    /// Whether the configuration asks for the event-driven server (serverReactor). Throws a
+    /// UserError if it does, but the event-driven server is not built on this platform.
+    static bool reactor(const Config& config);
+
+protected:
+
+    /// The configuration of the served FDB, and of the server itself
+    virtual Config serverConfig() const;
+
 private:
 
-    int port_;
+    std::atomic<int> port_;
+    std::atomic<bool> stopping_;
     std::thread reaperThread_;
 
     FdbServerBase(const FdbServerBase&) = delete;
@@ -77,7 +95,7 @@ private:
 
     virtual void hookUnique() = 0;
 
-    void startPortReaperThread(const Config& config);
+    void startPortReaperThread(const Config& config, bool reap=true);
 };
 
 //----------------------------------------------------------------------------------------------------------------------
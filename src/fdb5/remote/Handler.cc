@@ -13,9 +13,14 @@
  * (Project ID: 671951) www.nextgenio.eu
  */
 
+#include <sys/socket.h>
+#include <cerrno>
 #include <chrono>
+#include <cstring>
 
 #include "eckit/config/Resource.h"
+#include "eckit/io/ResizableBuffer.h"
+#include "eckit/io/compression/Compressor.h"
 #include "eckit/maths/Functions.h"
 #include "eckit/net/Endpoint.h"
 #include "eckit/runtime/Main.h"
@@ -26,10 +31,12 @@
 
 #include "fdb5/LibFdb5.h"
 #include "fdb5/fdb5_version.h"
+#include "fdb5/api/helpers/AsyncExecutor.h"
 #include "fdb5/api/helpers/FDBToolRequest.h"
 #include "fdb5/database/Key.h"
 #include "fdb5/remote/AvailablePortList.h"
 #include "fdb5/remote/Handler.h"
+#include "fdb5/remote/ListElementBatch.h"
 #include "fdb5/remote/Messages.h"
 #include "fdb5/remote/RemoteFieldLocation.h"
 
@@ -85,15 +92,44 @@ struct BaseHelper {
         s << elem;
         return {s.position(), std::move(encodeBuffer)};
     }
+
+    // Helpers may send many elements per message, using their own encoding. Returns false
+    // if the elements are to be sent one per Blob.
+    template <typename Iterator, typename Write>
+    bool sendBatched(Iterator&, const RemoteHandler&, Write&&) const { return false; }
 };
 
-struct ListHelper : public BaseHelper<ListElement> {
+struct ListBaseHelper : public BaseHelper<ListElement> {
+
+    template <typename Write>
+    bool sendBatched(ListIterator& iterator, const RemoteHandler& handler, Write&& write) const {
+
+        if (!handler.agreedConf().has("ListBatch")) return false;
+
+        ListElementBatchEncoder batch;
+        ListElement elem;
+        while (iterator.next(elem)) {
+            batch.add(elem);
+            if (batch.full()) {
+                write(Message::ListBatch, batch.data(), batch.size());
+                batch.clear();
+            }
+        }
+
+        if (batch.count() != 0) {
+            write(Message::ListBatch, batch.data(), batch.size());
+        }
+        return true;
+    }
+};
+
+struct ListHelper : public ListBaseHelper {
     ListIterator apiCall(FDB& fdb, const FDBToolRequest& request) const {
         return fdb.list(request);
     }
 };
 
-struct InspectHelper : public BaseHelper<ListElement> {
+struct InspectHelper : public ListBaseHelper {
     ListIterator apiCall(FDB& fdb, const FDBToolRequest& request) const {
         return fdb.inspect(request.request());
     }
@@ -180,12 +216,21 @@ private:
 // is a common idiom to queue _many_ requests behind each other (and then aggregate the
 // results in a MultiHandle/HandleGatherer).
 
-RemoteHandler::RemoteHandler(eckit::net::TCPSocket& socket, const Config& config) :
+RemoteHandler::RemoteHandler(eckit::net::TCPSocket& socket, const Config& config, bool eventDriven) :
     config_(config),
+    eventDriven_(eventDriven),
     controlSocket_(socket),
-    dataSocket_(selectDataPort()),
+    dataPort_(selectDataPort()),
+    dataSocket_(dataPort_),
     dataListenHostname_(config.getString("dataListenHostname", "")),
     fdb_(config),
+    archiveID_(0),
+    dataPayload_(0),
+    dataRead_(0),
+    dataReady_(false),
+    archiveQueueSize_(config.getInt("serverArchiveQueueSize", eckit::Resource<size_t>("fdbServerMaxQueueSize", 32))),
+    archiveQueued_(0),
+    waitingForSpace_(false),
     readLocationQueue_(eckit::Resource<size_t>("fdbRetrieveQueueSize", 10000)) {}
 
 RemoteHandler::~RemoteHandler() {
@@ -193,11 +238,58 @@ RemoteHandler::~RemoteHandler() {
 
     waitForWorkers();
 
-    // And notify the client that we are done.
+    // A client that goes away whilst archiving hasn't flushed. Don't archive what is left.
+
+    if (archiveFuture_.valid() && archiveQueue_) {
+        Log::warning() << "Connection closed whilst archiving. Abandoning archive." << std::endl;
+        archiveQueue_->interrupt(std::make_exception_ptr(SeriousBug("Connection closed whilst archiving", Here())));
+        try {
+            archiveFuture_.get();
+        }
+        catch (std::exception& e) {
+            Log::debug<LibFdb5>() << "Archive worker stopped: " << e.what() << std::endl;
+        }
+    }
+
+    // And notify the client that we are done. It may already have gone.
+
+    try {
+        Log::info() << "Sending exit message to client" << std::endl;
+        dataWrite(Message::Exit, 0);
+        Log::info() << "Done" << std::endl;
+    }
+    catch (std::exception& e) {
+        Log::warning() << "Failed to send exit message to client: " << e.what() << std::endl;
+    }
+
+    // Forked servers rely on the reaper to recycle data ports once the process has gone.
+    // With many handlers per process, hand the port back directly.
+
+    if (eventDriven_ && dataPort_ != 0) {
+        AvailablePortList(config_.getInt("dataPortStart"), config_.getLong("dataPortCount")).release(dataPort_);
+    }
+}
+
+// n.b. TCPServer::socket() returns the listening socket. We want the accepted connection.
 
-    Log::info() << "Sending exit message to client" << std::endl;
-    dataWrite(Message::Exit, 0);
-    Log::info() << "Done" << std::endl;
+int RemoteHandler::controlSocketFd() {
+    return controlSocket_.socket();
+}
+
+int RemoteHandler::dataSocketFd() {
+    return dataSocket_.net::TCPSocket::socket();
+}
+
+int RemoteHandler::dataListenFd() {
+    return dataSocket_.socket();
+}
+
+void RemoteHandler::shutdown() {
+    // n.b. only reads. The client is still told that we are done.
+    ::shutdown(controlSocketFd(), SHUT_RD);
+    if (dataSocketFd() >= 0) {
+        ::shutdown(dataSocketFd(), SHUT_RD);
+    }
 }
 
 
@@ -206,6 +298,8 @@ eckit::LocalConfiguration RemoteHandler::availableFunctionality() const {
 //    Add to the configuration all the components that require to be versioned, as in the following example, with a vector of supported version numbers
     std::vector<int> remoteFieldLocationVersions = {1};
     conf.set("RemoteFieldLocation", remoteFieldLocationVersions);
+    std::vector<int> listBatchVersions = {1};
+    conf.set("ListBatch", listBatchVersions);
     return conf;
 }
 
@@ -225,6 +319,12 @@ std::vector<int> intersection(const LocalConfiguration& c1, const LocalConfigura
 }
 
 void RemoteHandler::initialiseConnections() {
+    if (initialiseControlConnection()) {
+        initialiseDataConnection();
+    }
+}
+
+bool RemoteHandler::initialiseControlConnection() {
     // Read the startup message from the client. Check that it all checks out.
 
     MessageHeader hdr;
@@ -241,7 +341,7 @@ void RemoteHandler::initialiseConnections() {
     ASSERT(tail == EndMarker);
 
     MemoryStream s1(payload1);
-    SessionID clientSession(s1);
+    clientSession_ = SessionID(s1);
     net::Endpoint endpointFromClient(s1);
     unsigned int remoteProtocolVersion = 0;
     std::string errorMsg;
@@ -278,6 +378,27 @@ void RemoteHandler::initialiseConnections() {
              ss << "    client functionality: " << clientAvailableFunctionality << std::endl;
              errorMsg = ss.str();
          }
+
+         // Batching of list/inspect results is optional, and older clients won't ask for it.
+         if (clientAvailableFunctionality.has("ListBatch")) {
+             std::vector<int> lbCommon = intersection(clientAvailableFunctionality, serverConf, "ListBatch");
+             if (lbCommon.size() > 0) {
+                 Log::debug() << "Protocol negotiation - ListBatch version " << lbCommon.back() << std::endl;
+                 agreedConf_.set("ListBatch", lbCommon.back());
+             }
+         }
+
+         // Compression of archived data is optional. Use the first of the client's preferences
+         // that we can decode, or nothing. It can be turned off, e.g. to act as an older server.
+         if (clientAvailableFunctionality.has("DataCompression") && config_.getBool("serverDataCompression", true)) {
+             for (const std::string& name : clientAvailableFunctionality.getStringVector("DataCompression")) {
+                 if (name != "none" && eckit::CompressorFactory::instance().has(name)) {
+                     Log::debug() << "Protocol negotiation - DataCompression " << name << std::endl;
+                     agreedConf_.set("DataCompression", name);
+                     break;
+                 }
+             }
+         }
     }
 
     // We want a data connection too. Send info to RemoteFDB, and wait for connection
@@ -297,7 +418,7 @@ void RemoteHandler::initialiseConnections() {
         Buffer startupBuffer(1024);
         MemoryStream s(startupBuffer);
 
-        s << clientSession;
+        s << clientSession_;
         s << sessionID_;
         s << dataEndpoint;
 
@@ -310,9 +431,14 @@ void RemoteHandler::initialiseConnections() {
 
     if (!errorMsg.empty()) {
         controlWrite(Message::Error, 0, errorMsg.c_str(), errorMsg.length());
-        return;
+        return false;
     }
 
+    return true;
+}
+
+void RemoteHandler::initialiseDataConnection() {
+
     dataSocket_.accept();
 
     // Check the response from the client.
@@ -329,6 +455,7 @@ void RemoteHandler::initialiseConnections() {
     ASSERT(dataHdr.requestID == 0);
 
     Buffer payload2 = receivePayload(dataHdr, dataSocket_);
+    eckit::FixedString<4> tail;
     socketRead(&tail, sizeof(tail), dataSocket_);
     ASSERT(tail == EndMarker);
 
@@ -336,9 +463,9 @@ void RemoteHandler::initialiseConnections() {
     SessionID clientSession2(s2);
     SessionID serverSession(s2);
 
-    if (clientSession != clientSession2) {
+    if (clientSession_ != clientSession2) {
         std::stringstream ss;
-        ss << "Client session IDs do not match: " << clientSession << " != " << clientSession2;
+        ss << "Client session IDs do not match: " << clientSession_ << " != " << clientSession2;
         throw BadValue(ss.str(), Here());
     }
 
@@ -356,98 +483,103 @@ void RemoteHandler::handle() {
 
     Log::info() << "Server started ..." << std::endl;
 
+    while (handleControlMessage()) {}
+}
+
+bool RemoteHandler::handleControlMessage() {
+
     MessageHeader hdr;
     eckit::FixedString<4> tail;
 
-    while (true) {
-        tidyWorkers();
+    tidyWorkers();
 
-        socketRead(&hdr, sizeof(hdr), controlSocket_);
+    socketRead(&hdr, sizeof(hdr), controlSocket_);
 
-        ASSERT(hdr.marker == StartMarker);
-        ASSERT(hdr.version == CurrentVersion);
-        Log::debug<LibFdb5>() << "Got message with request ID: " << hdr.requestID << std::endl;
+    ASSERT(hdr.marker == StartMarker);
+    ASSERT(hdr.version == CurrentVersion);
+    Log::debug<LibFdb5>() << "Got message with request ID: " << hdr.requestID << std::endl;
 
-        try {
-            switch (hdr.message) {
-                case Message::Exit:
-                    Log::status() << "Exiting" << std::endl;
-                    Log::info() << "Exiting" << std::endl;
-                    return;
-
-                case Message::List:
-                    forwardApiCall<ListHelper>(hdr);
-                    break;
-
-                case Message::Dump:
-                    forwardApiCall<DumpHelper>(hdr);
-                    break;
-
-                case Message::Purge:
-                    forwardApiCall<PurgeHelper>(hdr);
-                    break;
-
-                case Message::Stats:
-                    forwardApiCall<StatsHelper>(hdr);
-                    break;
-
-                case Message::Status:
-                    forwardApiCall<StatusHelper>(hdr);
-                    break;
-
-                case Message::Wipe:
-                    forwardApiCall<WipeHelper>(hdr);
-                    break;
-
-                case Message::Control:
-                    forwardApiCall<ControlHelper>(hdr);
-                    break;
-
-                case Message::Inspect:
-                    forwardApiCall<InspectHelper>(hdr);
-                    break;
-
-                case Message::Read:
-                    read(hdr);
-                    break;
-
-                case Message::Flush:
-                    flush(hdr);
-                    break;
-
-                case Message::Archive:
-                    archive(hdr);
-                    break;
-
-                default: {
-                    std::stringstream ss;
-                    ss << "ERROR: Unexpected message recieved (" << static_cast<int>(hdr.message)
-                       << "). ABORTING";
-                    Log::status() << ss.str() << std::endl;
-                    Log::error() << "Retrieving... " << ss.str() << std::endl;
-                    throw SeriousBug(ss.str(), Here());
-                }
-            }
+    try {
+        switch (hdr.message) {
+            case Message::Exit:
+                Log::status() << "Exiting" << std::endl;
+                Log::info() << "Exiting" << std::endl;
+                return false;
+
+            case Message::List:
+                forwardApiCall<ListHelper>(hdr);
+                break;
 
-            // Ensure we have consumed exactly the correct amount from the socket.
+            case Message::Dump:
+                forwardApiCall<DumpHelper>(hdr);
+                break;
 
-            socketRead(&tail, sizeof(tail), controlSocket_);
-            ASSERT(tail == EndMarker);
+            case Message::Purge:
+                forwardApiCall<PurgeHelper>(hdr);
+                break;
 
-            // Acknowledge receipt of command
+            case Message::Stats:
+                forwardApiCall<StatsHelper>(hdr);
+                break;
 
-            controlWrite(Message::Received, hdr.requestID);
-        }
-        catch (std::exception& e) {
-            // n.b. more general than eckit::Exception
-            std::string what(e.what());
-            controlWrite(Message::Error, hdr.requestID, what.c_str(), what.length());
-        }
-        catch (...) {
-            std::string what("Caught unexpected and unknown error");
-            controlWrite(Message::Error, hdr.requestID, what.c_str(), what.length());
+            case Message::Status:
+                forwardApiCall<StatusHelper>(hdr);
+                break;
+
+            case Message::Wipe:
+                forwardApiCall<WipeHelper>(hdr);
+                break;
+
+            case Message::Control:
+                forwardApiCall<ControlHelper>(hdr);
+                break;
+
+            case Message::Inspect:
+                forwardApiCall<InspectHelper>(hdr);
+                break;
+
+            case Message::Read:
+                read(hdr);
+                break;
+
+            case Message::Flush:
+                flush(hdr);
+                break;
+
+            case Message::Archive:
+                archive(hdr);
+                break;
+
+            default: {
+                std::stringstream ss;
+                ss << "ERROR: Unexpected message recieved (" << static_cast<int>(hdr.message)
+                   << "). ABORTING";
+                Log::status() << ss.str() << std::endl;
+                Log::error() << "Retrieving... " << ss.str() << std::endl;
+                throw SeriousBug(ss.str(), Here());
+            }
         }
+
+        // Ensure we have consumed exactly the correct amount from the socket.
+
+        socketRead(&tail, sizeof(tail), controlSocket_);
+        ASSERT(tail == EndMarker);
+
+        // Acknowledge receipt of command
+
+        controlWrite(Message::Received, hdr.requestID);
+    }
+    catch (std::exception& e) {
+        // n.b. more general than eckit::Exception
+        std::string what(e.what());
+        controlWrite(Message::Error, hdr.requestID, what.c_str(), what.length());
+    }
+    catch (...) {
+        std::string what("Caught unexpected and unknown error");
+        controlWrite(Message::Error, hdr.requestID, what.c_str(), what.length());
     }
+
+    return true;
 }
 
 int RemoteHandler::selectDataPort() {
@@ -578,14 +710,20 @@ void RemoteHandler::forwardApiCall(const MessageHeader& hdr) {
     ASSERT(workerThreads_.find(hdr.requestID) == workerThreads_.end());
 
     workerThreads_.emplace(
-        hdr.requestID, std::async(std::launch::async, [request, hdr, helper, this]() {
+        hdr.requestID, AsyncExecutor::instance().submit([request, hdr, helper, this]() {
             try {
                 auto iterator = helper.apiCall(fdb_, request);
 
-                typename decltype(iterator)::value_type elem;
-                while (iterator.next(elem)) {
-                    auto encoded(helper.encode(elem, *this));
-                    dataWrite(Message::Blob, hdr.requestID, encoded.buf, encoded.position);
+                auto write = [this, &hdr](Message msg, const void* data, size_t length) {
+                    dataWrite(msg, hdr.requestID, data, length);
+                };
+
+                if (!helper.sendBatched(iterator, *this, write)) {
+                    typename decltype(iterator)::value_type elem;
+                    while (iterator.next(elem)) {
+                        auto encoded(helper.encode(elem, *this));
+                        dataWrite(Message::Blob, hdr.requestID, encoded.buf, encoded.position);
+                    }
                 }
 
                 dataWrite(Message::Complete, hdr.requestID);
@@ -611,14 +749,23 @@ void RemoteHandler::archive(const MessageHeader& hdr) {
 
     ASSERT(!archiveFuture_.valid());
 
-    // Start archive worker thread
+    // Start archive worker thread. When event driven, the data socket is read message by
+    // message through handleDataMessage(), rather than by a dedicated thread.
 
-    uint32_t id    = hdr.requestID;
-    archiveFuture_ = std::async(std::launch::async, [this, id] { return archiveThreadLoop(id); });
+    uint32_t id = hdr.requestID;
+    if (eventDriven_) {
+        dataRead_  = 0;
+        dataReady_ = false;
+        archiveFuture_ = startArchiveWorker(id);
+        archiveID_     = id;
+    }
+    else {
+        archiveFuture_ = std::async(std::launch::async, [this, id] { return archiveThreadLoop(id); });
+    }
 }
 
 
-// A helper function to make archiveThreadLoop a bit cleaner
+// Helper functions to make archiveThreadLoop a bit cleaner
 
 static void archiveBlobPayload(FDB& fdb, const void* data, size_t length) {
     MemoryStream s(data, length);
@@ -634,114 +781,158 @@ static void archiveBlobPayload(FDB& fdb, const void* data, size_t length) {
     Log::status() << "Archiving done: " << ss_key.str() << std::endl;
 }
 
+static size_t archiveMultiBlobPayload(FDB& fdb, uint32_t id, const void* data, size_t length) {
 
-size_t RemoteHandler::archiveThreadLoop(uint32_t id) {
-    size_t totalArchived = 0;
+    size_t archived = 0;
+
+    const char* firstData = static_cast<const char*>(data);  // For pointer arithmetic
+    const char* charData = firstData;
+    while (size_t(charData - firstData) < length) {
+        const MessageHeader* hdr = static_cast<const MessageHeader*>(static_cast<const void*>(charData));
+        ASSERT(hdr->marker == StartMarker);
+        ASSERT(hdr->version == CurrentVersion);
+        ASSERT(hdr->message == Message::Blob);
+        ASSERT(hdr->requestID == id);
+        charData += sizeof(MessageHeader);
+
+        const void* payloadData = charData;
+        charData += hdr->payloadSize;
+
+        const decltype(EndMarker)* e = static_cast<const decltype(EndMarker)*>(static_cast<const void*>(charData));
+        ASSERT(*e == EndMarker);
+        charData += sizeof(EndMarker);
+
+        archiveBlobPayload(fdb, payloadData, hdr->payloadSize);
+        archived += 1;
+    }
+
+    return archived;
+}
+
+
+std::future<size_t> RemoteHandler::startArchiveWorker(uint32_t id) {
 
     // Create a worker that will do the actual archiving
 
-    static size_t queueSize(eckit::Resource<size_t>("fdbServerMaxQueueSize", 32));
-    eckit::Queue<std::pair<eckit::Buffer, bool>> queue(queueSize);
+    archiveQueue_.reset(new eckit::Queue<std::pair<eckit::Buffer, Message>>(archiveQueueSize_));
+    eckit::Queue<std::pair<eckit::Buffer, Message>>& queue(*archiveQueue_);
+
+    {
+        std::lock_guard<std::mutex> lock(archiveSpaceMutex_);
+        archiveQueued_   = 0;
+        waitingForSpace_ = false;
+    }
 
-    std::future<size_t> worker = std::async(std::launch::async, [this, &queue, id] {
+    std::string compression = agreedConf_.getString("DataCompression", "none");
+
+    return std::async(std::launch::async, [this, &queue, id, compression] {
         size_t totalArchived = 0;
 
-        std::pair<eckit::Buffer, bool> elem = std::make_pair(Buffer{0}, false);
+        std::pair<eckit::Buffer, Message> elem = std::make_pair(Buffer{0}, Message::None);
+        std::unique_ptr<eckit::Compressor> compressor;
+        eckit::ResizableBuffer uncompressed(0);
 
         try {
             long queuelen;
             while ((queuelen = queue.pop(elem)) != -1) {
-                if (elem.second) {
-                    // Handle MultiBlob
-
-                    const char* firstData =
-                        static_cast<const char*>(elem.first.data());  // For pointer arithmetic
-                    const char* charData = firstData;
-                    while (size_t(charData - firstData) < elem.first.size()) {
-                        const MessageHeader* hdr =
-                            static_cast<const MessageHeader*>(static_cast<const void*>(charData));
-                        ASSERT(hdr->marker == StartMarker);
-                        ASSERT(hdr->version == CurrentVersion);
-                        ASSERT(hdr->message == Message::Blob);
-                        ASSERT(hdr->requestID == id);
-                        charData += sizeof(MessageHeader);
-
-                        const void* payloadData = charData;
-                        charData += hdr->payloadSize;
-
-                        const decltype(EndMarker)* e = static_cast<const decltype(EndMarker)*>(
-                            static_cast<const void*>(charData));
-                        ASSERT(*e == EndMarker);
-                        charData += sizeof(EndMarker);
-
-                        archiveBlobPayload(fdb_, payloadData, hdr->payloadSize);
-                        totalArchived += 1;
+                archiveSpaceFreed(false);
+                switch (elem.second) {
+                    case Message::MultiBlob:
+                        totalArchived += archiveMultiBlobPayload(fdb_, id, elem.first.data(), elem.first.size());
+                        break;
+
+                    case Message::CompressedMultiBlob: {
+                        // Decompress on the worker, rather than the thread reading the socket.
+                        // The payload leads with the uncompressed length.
+                        ASSERT(compression != "none");
+                        if (!compressor) {
+                            compressor.reset(eckit::CompressorFactory::instance().build(compression));
+                        }
+                        uint64_t length;
+                        ASSERT(elem.first.size() > sizeof(length));
+                        ::memcpy(&length, elem.first.data(), sizeof(length));
+                        const char* compressed = static_cast<const char*>(elem.first.data()) + sizeof(length);
+                        compressor->uncompress(compressed, elem.first.size() - sizeof(length), uncompressed, length);
+                        totalArchived += archiveMultiBlobPayload(fdb_, id, uncompressed.data(), length);
+                        break;
                     }
-                }
-                else {
-                    // Handle single blob
-                    archiveBlobPayload(fdb_, elem.first.data(), elem.first.size());
-                    totalArchived += 1;
+
+                    default:
+                        // Handle single blob
+                        archiveBlobPayload(fdb_, elem.first.data(), elem.first.size());
+                        totalArchived += 1;
                 }
             }
         }
         catch (...) {
             // Ensure exception propagates across the queue back to the parent thread.
             queue.interrupt(std::current_exception());
+            archiveSpaceFreed(true);
             throw;
         }
 
         return totalArchived;
     });
+}
 
-    try {
-        // The archive loop is the only thing that can listen on the data socket,
-        // so we don't need to to anything clever here.
-
-        // n.b. we also don't need to lock on read. We are the only thing that reads.
-
-        while (true) {
-            MessageHeader hdr;
-            socketRead(&hdr, sizeof(hdr), dataSocket_);
-
-            ASSERT(hdr.marker == StartMarker);
-            ASSERT(hdr.version == CurrentVersion);
-            ASSERT(hdr.requestID == id);
-
-            // Have we been told that we are done yet?
-            if (hdr.message == Message::Flush)
-                break;
+// Read one message from the data socket, and queue it for the archive worker.
+// Returns false once the client has signalled the end of the archive with a Flush.
+//
+// n.b. the archive is the only thing that listens on the data socket, so we don't need
+//      to lock on read. We are the only thing that reads.
 
-            ASSERT(hdr.message == Message::Blob || hdr.message == Message::MultiBlob);
+bool RemoteHandler::readArchiveMessage(uint32_t id) {
 
-            Buffer payload(receivePayload(hdr, dataSocket_));
-            MemoryStream s(payload);
+    ASSERT(archiveQueue_);
 
-            eckit::FixedString<4> tail;
-            socketRead(&tail, sizeof(tail), dataSocket_);
-            ASSERT(tail == EndMarker);
+    MessageHeader hdr;
+    socketRead(&hdr, sizeof(hdr), dataSocket_);
 
-            // Queueing payload
+    ASSERT(hdr.marker == StartMarker);
+    ASSERT(hdr.version == CurrentVersion);
+    ASSERT(hdr.requestID == id);
 
-            size_t sz = payload.size();
-            Log::debug<LibFdb5>() << "Queueing data: " << sz << std::endl;
-            size_t queuelen = queue.emplace(
-                std::make_pair(std::move(payload), hdr.message == Message::MultiBlob));
-            Log::status() << "Queued data (" << queuelen << ", size=" << sz << ")" << std::endl;
-            ;
-            Log::debug<LibFdb5>() << "Queued data (" << queuelen << ", size=" << sz << ")"
-                                  << std::endl;
-            ;
-        }
+    // Have we been told that we are done yet?
+    if (hdr.message == Message::Flush) {
 
         // Trigger cleanup of the workers
-        queue.close();
+        archiveQueue_->close();
 
         // Complete reading the Flush instruction
 
         eckit::FixedString<4> tail;
         socketRead(&tail, sizeof(tail), dataSocket_);
         ASSERT(tail == EndMarker);
+        return false;
+    }
+
+    ASSERT(hdr.message == Message::Blob || hdr.message == Message::MultiBlob
+           || hdr.message == Message::CompressedMultiBlob);
+
+    Buffer payload(receivePayload(hdr, dataSocket_));
+
+    eckit::FixedString<4> tail;
+    socketRead(&tail, sizeof(tail), dataSocket_);
+    ASSERT(tail == EndMarker);
+
+    // Queueing payload
+
+    size_t sz = payload.size();
+    Log::debug<LibFdb5>() << "Queueing data: " << sz << std::endl;
+    size_t queuelen = archiveQueue_->emplace(std::make_pair(std::move(payload), hdr.message));
+    Log::status() << "Queued data (" << queuelen << ", size=" << sz << ")" << std::endl;
+    Log::debug<LibFdb5>() << "Queued data (" << queuelen << ", size=" << sz << ")" << std::endl;
+
+    return true;
+}
+
+size_t RemoteHandler::archiveThreadLoop(uint32_t id) {
+    size_t totalArchived = 0;
+
+    std::future<size_t> worker = startArchiveWorker(id);
+
+    try {
+        while (readArchiveMessage(id)) {}
 
         // Ensure worker is done
 
@@ -752,19 +943,164 @@ size_t RemoteHandler::archiveThreadLoop(uint32_t id) {
         // n.b. more general than eckit::Exception
         std::string what(e.what());
         dataWrite(Message::Error, id, what.c_str(), what.length());
-        queue.interrupt(std::current_exception());
+        archiveQueue_->interrupt(std::current_exception());
         throw;
     }
     catch (...) {
         std::string what("Caught unexpected, unknown exception in retrieve worker");
         dataWrite(Message::Error, id, what.c_str(), what.length());
-        queue.interrupt(std::current_exception());
+        archiveQueue_->interrupt(std::current_exception());
         throw;
     }
 
     return totalArchived;
 }
 
+// Event-driven archive data. Messages are assembled from whatever the data socket has
+// available, so that the reactor thread never waits on a slow client, nor on a full queue.
+
+bool RemoteHandler::handleDataMessage() {
+
+    uint32_t id = archiveID_;
+    ASSERT(id != 0);
+
+    try {
+        while (queueDataMessage() && readDataMessage(id)) {}
+    }
+    catch (std::exception& e) {
+        archiveID_ = 0;
+        dataReady_ = false;
+        std::string what(e.what());
+        dataWrite(Message::Error, id, what.c_str(), what.length());
+        archiveQueue_->interrupt(std::current_exception());
+        throw;
+    }
+    catch (...) {
+        archiveID_ = 0;
+        dataReady_ = false;
+        std::string what("Caught unexpected, unknown exception reading archive data");
+        dataWrite(Message::Error, id, what.c_str(), what.length());
+        archiveQueue_->interrupt(std::current_exception());
+        throw;
+    }
+
+    return archiving() && !dataReady_;
+}
+
+// Read the part [offset, offset + length) of the current message, as far as possible.
+// Returns true once it is complete.
+
+bool RemoteHandler::readDataAvailable(void* data, size_t offset, size_t length) {
+
+    while (dataRead_ < offset + length) {
+        size_t done = dataRead_ - offset;
+        ssize_t n = ::recv(dataSocketFd(), static_cast<char*>(data) + done, length - done, MSG_DONTWAIT);
+        if (n > 0) {
+            dataRead_ += n;
+        }
+        else if (n == 0) {
+            throw TCPException("Data connection closed by client whilst archiving", Here());
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return false;
+        }
+        else if (errno != EINTR) {
+            std::stringstream ss;
+            ss << "Read error on data connection: " << ::strerror(errno);
+            throw TCPException(ss.str(), Here());
+        }
+    }
+
+    return true;
+}
+
+// Returns true once a complete message has been read
+
+bool RemoteHandler::readDataMessage(uint32_t id) {
+
+    ASSERT(!dataReady_);
+
+    size_t offset = 0;
+    if (!readDataAvailable(&dataHdr_, offset, sizeof(dataHdr_))) return false;
+    offset += sizeof(dataHdr_);
+
+    if (dataRead_ == offset) {
+        ASSERT(dataHdr_.marker == StartMarker);
+        ASSERT(dataHdr_.version == CurrentVersion);
+        ASSERT(dataHdr_.requestID == id);
+        ASSERT(dataHdr_.message == Message::Flush || dataHdr_.message == Message::Blob
+               || dataHdr_.message == Message::MultiBlob || dataHdr_.message == Message::CompressedMultiBlob);
+        ASSERT(dataHdr_.message == Message::Flush || dataHdr_.payloadSize > 0);
+        dataPayload_ = Buffer(dataHdr_.payloadSize);
+    }
+
+    if (!readDataAvailable(dataPayload_.data(), offset, dataHdr_.payloadSize)) return false;
+    offset += dataHdr_.payloadSize;
+
+    if (!readDataAvailable(&dataTail_, offset, sizeof(dataTail_))) return false;
+    ASSERT(dataTail_ == EndMarker);
+
+    dataReady_ = true;
+    return true;
+}
+
+// Hand a complete message over to the archive worker. Returns false if that isn't possible
+// (yet), or once the client has signalled the end of the archive with a Flush.
+
+bool RemoteHandler::queueDataMessage() {
+
+    if (!dataReady_) return true;
+
+    if (dataHdr_.message == Message::Flush) {
+        // Trigger cleanup of the workers
+        archiveQueue_->close();
+        archiveID_ = 0;
+        dataRead_  = 0;
+        dataReady_ = false;
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(archiveSpaceMutex_);
+        if (archiveQueued_ == archiveQueueSize_) {
+            waitingForSpace_ = true;
+            return false;
+        }
+        ++archiveQueued_;
+    }
+
+    // n.b. there is space, so this doesn't block
+
+    size_t sz = dataPayload_.size();
+    size_t queuelen = archiveQueue_->emplace(std::make_pair(std::move(dataPayload_), dataHdr_.message));
+    Log::debug<LibFdb5>() << "Queued data (" << queuelen << ", size=" << sz << ")" << std::endl;
+
+    dataPayload_ = Buffer(0);
+    dataRead_  = 0;
+    dataReady_ = false;
+    return true;
+}
+
+// Called by the archive worker whenever it takes a message from the queue, or gives up
+
+void RemoteHandler::archiveSpaceFreed(bool failed) {
+
+    if (!eventDriven_) return;
+
+    bool resume = false;
+    {
+        std::lock_guard<std::mutex> lock(archiveSpaceMutex_);
+        archiveQueued_ = failed ? 0 : archiveQueued_ - 1;
+        std::swap(resume, waitingForSpace_);
+    }
+
+    // n.b. a held message is pushed into the interrupted queue, which reports the failure
+
+    if (resume && resumeData_) {
+        resumeData_();
+    }
+}
+
 void RemoteHandler::flush(const MessageHeader& hdr) {
     Buffer payload(receivePayload(hdr, controlSocket_));
     MemoryStream s(payload);
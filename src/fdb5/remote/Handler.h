@@ -20,14 +20,18 @@
 #ifndef fdb5_remote_Handler_H
 #define fdb5_remote_Handler_H
 
+#include <atomic>
+#include <functional>
 #include <future>
 #include <mutex>
 
+#include "eckit/container/Queue.h"
 #include "eckit/io/Buffer.h"
 #include "eckit/io/DataHandle.h"
 #include "eckit/net/TCPServer.h"
 #include "eckit/net/TCPSocket.h"
 #include "eckit/runtime/SessionID.h"
+#include "eckit/types/FixedString.h"
 
 #include "metkit/mars/MarsRequest.h"
 
@@ -42,17 +46,47 @@ class Config;
 
 namespace remote {
 
-struct MessageHeader;
-
 //----------------------------------------------------------------------------------------------------------------------
 
 class RemoteHandler : private eckit::NonCopyable {
 public:  // methods
-    RemoteHandler(eckit::net::TCPSocket& socket, const Config& config);
+    /// @param eventDriven The caller drives the handler message by message (see ServerReactor),
+    ///                    rather than calling handle()
+    RemoteHandler(eckit::net::TCPSocket& socket, const Config& config, bool eventDriven = false);
     ~RemoteHandler();
 
     void handle();
 
+    // Event-driven operation. The handshake is done in two steps: the first once the client's
+    // startup message is readable on the control socket, the second once the client has
+    // connected to the data listening socket. Thereafter the caller invokes
+    // handleControlMessage() when the control socket is readable, and handleDataMessage()
+    // when the data socket is readable whilst archiving.
+
+    void initialiseConnections();
+    /// Returns false if the client has been refused
+    bool initialiseControlConnection();
+    void initialiseDataConnection();
+
+    int controlSocketFd();
+    int dataSocketFd();
+    int dataListenFd();
+
+    /// Returns false once the client has asked to exit
+    bool handleControlMessage();
+
+    bool archiving() const { return archiveID_ != 0; }
+
+    /// Reads whatever archive data is available without blocking, and queues complete messages
+    /// for the archive worker. Returns true if the data socket should be watched again, or false
+    /// if archiving is over, or if a message is waiting for space in the archive queue. In the
+    /// latter case the resume callback is called (from the archive worker) once there is space.
+    bool handleDataMessage();
+    void resumeData(std::function<void()> resume) { resumeData_ = std::move(resume); }
+
+    /// Wakes up anything waiting on the client, when the server is shutting down
+    void shutdown();
+
     std::string host() const { return controlSocket_.localHost(); }
     int port() const { return controlSocket_.localPort(); }
     const eckit::LocalConfiguration& agreedConf() const { return agreedConf_; }
@@ -61,7 +95,6 @@ private:  // methods
     // Socket methods
 
     int selectDataPort();
-    void initialiseConnections();
     eckit::LocalConfiguration availableFunctionality() const;
 
     void controlWrite(Message msg, uint32_t requestID, const void* payload = nullptr,
@@ -97,15 +130,26 @@ private:  // methods
     void writeToParent(const uint32_t requestID, std::unique_ptr<eckit::DataHandle> dh);
 
     size_t archiveThreadLoop(uint32_t id);
+    std::future<size_t> startArchiveWorker(uint32_t id);
+    bool readArchiveMessage(uint32_t id);
+
+    bool readDataAvailable(void* data, size_t offset, size_t length);
+    bool readDataMessage(uint32_t id);
+    bool queueDataMessage();
+    void archiveSpaceFreed(bool failed);
+
     void readLocationThreadLoop();
 
 private:  // members
     Config config_;
+    bool eventDriven_;
     eckit::SessionID sessionID_;
+    eckit::SessionID clientSession_;
 
     eckit::LocalConfiguration agreedConf_;
 
     eckit::net::TCPSocket controlSocket_;
+    int dataPort_;
     eckit::net::EphemeralTCPServer dataSocket_;
     std::string dataListenHostname_;
     std::mutex dataWriteMutex_;
@@ -117,7 +161,26 @@ private:  // members
 
     // Archive helpers
 
+    // n.b. the queue must outlive the worker that pops from it
+
+    std::unique_ptr<eckit::Queue<std::pair<eckit::Buffer, Message>>> archiveQueue_;
     std::future<size_t> archiveFuture_;
+    std::atomic<uint32_t> archiveID_;
+
+    // Event-driven archive data, read incrementally. The queue is never pushed to when full,
+    // so that the reactor thread doesn't block. A complete message is held until there is space.
+
+    MessageHeader dataHdr_;
+    eckit::Buffer dataPayload_;
+    eckit::FixedString<4> dataTail_;
+    size_t dataRead_;
+    bool dataReady_;
+
+    std::mutex archiveSpaceMutex_;
+    size_t archiveQueueSize_;
+    size_t archiveQueued_;
+    bool waitingForSpace_;
+    std::function<void()> resumeData_;
 
     // Retrieve helpers
 
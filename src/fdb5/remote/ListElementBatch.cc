@@ -0,0 +1,113 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <algorithm>
+
+#include "eckit/config/Resource.h"
+#include "eckit/exception/Exceptions.h"
+#include "eckit/serialisation/Reanimator.h"
+
+#include "fdb5/remote/ListElementBatch.h"
+
+using namespace eckit;
+
+
+namespace fdb5 {
+namespace remote {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// n.b. elements are assumed to encode into 4096 bytes, as for elements sent individually
+
+namespace {
+constexpr size_t maxElementSize = 4096;
+}
+
+ListElementBatchEncoder::ListElementBatchEncoder() :
+    buffer_(std::max(eckit::Resource<size_t>("fdbRemoteListBatchBytes;$FDB_REMOTE_LIST_BATCH_BYTES", 1024 * 1024),
+                     2 * maxElementSize)),
+    count_(0),
+    maxCount_(eckit::Resource<size_t>("fdbRemoteListBatchSize;$FDB_REMOTE_LIST_BATCH_SIZE", 1024)) {
+    clear();
+}
+
+void ListElementBatchEncoder::add(const ListElement& elem) {
+
+    ASSERT(!full());
+
+    const std::vector<Key>& parts(elem.key());
+
+    size_t shared = 0;
+    while (shared < parts.size() && shared < previous_.size() && parts[shared] == previous_[shared]) {
+        ++shared;
+    }
+
+    MemoryStream& s(*stream_);
+    s << static_cast<unsigned long>(parts.size());
+    s << static_cast<unsigned long>(shared);
+    for (size_t i = shared; i < parts.size(); ++i) {
+        s << parts[i];
+    }
+    s << elem.location();
+    s << elem.timestamp();
+
+    previous_ = parts;
+    ++count_;
+}
+
+bool ListElementBatchEncoder::full() const {
+    return count_ >= maxCount_ || (size() + maxElementSize) > buffer_.size();
+}
+
+void ListElementBatchEncoder::clear() {
+    stream_.reset(new MemoryStream(buffer_));
+    previous_.clear();
+    count_ = 0;
+}
+
+size_t ListElementBatchEncoder::size() const {
+    return stream_->position();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+ListElementBatchDecoder::ListElementBatchDecoder(const Buffer& payload) :
+    payload_(payload),
+    stream_(payload) {}
+
+bool ListElementBatchDecoder::next(ListElement& elem) {
+
+    if (size_t(stream_.position()) >= payload_.size()) return false;
+
+    unsigned long nparts;
+    unsigned long shared;
+    stream_ >> nparts;
+    stream_ >> shared;
+    ASSERT(shared <= nparts);
+    ASSERT(shared <= previous_.size());
+
+    previous_.resize(nparts);
+    for (size_t i = shared; i < nparts; ++i) {
+        previous_[i] = Key(stream_);
+    }
+
+    std::shared_ptr<const FieldLocation> location(eckit::Reanimator<FieldLocation>::reanimate(stream_));
+
+    time_t timestamp;
+    stream_ >> timestamp;
+
+    elem = ListElement(previous_, location, timestamp);
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace remote
+} // namespace fdb5
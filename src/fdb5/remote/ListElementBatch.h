@@ -0,0 +1,89 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+/// @date   Oct 2026
+
+#ifndef fdb5_remote_ListElementBatch_H
+#define fdb5_remote_ListElementBatch_H
+
+#include <memory>
+#include <vector>
+
+#include "eckit/io/Buffer.h"
+#include "eckit/memory/NonCopyable.h"
+#include "eckit/serialisation/MemoryStream.h"
+
+#include "fdb5/api/helpers/ListIterator.h"
+
+namespace fdb5 {
+namespace remote {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Encoding of many ListElements into the payload of a single ListBatch message.
+///
+/// Elements from a list arrive grouped by database and index, so consecutive elements
+/// share the leading parts of their keys. Each element only carries the key parts that
+/// differ from the previous element in the batch, followed by its location and timestamp.
+
+class ListElementBatchEncoder : private eckit::NonCopyable {
+
+public: // methods
+
+    ListElementBatchEncoder();
+
+    void add(const ListElement& elem);
+
+    /// The batch should be sent before adding further elements
+    bool full() const;
+
+    void clear();
+
+    size_t count() const { return count_; }
+    const void* data() const { return buffer_.data(); }
+    size_t size() const;
+
+private: // members
+
+    eckit::Buffer buffer_;
+    std::unique_ptr<eckit::MemoryStream> stream_;
+
+    std::vector<Key> previous_;
+    size_t count_;
+
+    size_t maxCount_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Decodes the elements of a ListBatch payload one at a time
+
+class ListElementBatchDecoder : private eckit::NonCopyable {
+
+public: // methods
+
+    ListElementBatchDecoder(const eckit::Buffer& payload);
+
+    bool next(ListElement& elem);
+
+private: // members
+
+    const eckit::Buffer& payload_;
+    eckit::MemoryStream stream_;
+
+    std::vector<Key> previous_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace remote
+} // namespace fdb5
+
+#endif // fdb5_remote_ListElementBatch_H
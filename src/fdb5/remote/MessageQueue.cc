@@ -0,0 +1,82 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include "eckit/exception/Exceptions.h"
+
+#include "fdb5/remote/MessageQueue.h"
+
+
+namespace fdb5 {
+namespace remote {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+MessageQueue::MessageQueue() :
+    bytes_(0),
+    closed_(false) {}
+
+void MessageQueue::emplace(StoredMessage&& msg) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (exception_) return;
+        ASSERT(!closed_);
+        bytes_ += msg.second.size();
+        messages_.emplace_back(std::move(msg));
+    }
+    cv_.notify_one();
+}
+
+long MessageQueue::pop(StoredMessage& msg) {
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return exception_ || closed_ || !messages_.empty(); });
+
+    if (exception_) std::rethrow_exception(exception_);
+    if (messages_.empty()) return -1;
+
+    msg = std::move(messages_.front());
+    messages_.pop_front();
+    bytes_ -= msg.second.size();
+    return messages_.size();
+}
+
+void MessageQueue::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    cv_.notify_all();
+}
+
+void MessageQueue::interrupt(std::exception_ptr exception) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (exception_) return;
+        exception_ = exception;
+        messages_.clear();
+        bytes_ = 0;
+    }
+    cv_.notify_all();
+}
+
+bool MessageQueue::interrupted() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bool(exception_);
+}
+
+size_t MessageQueue::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace remote
+} // namespace fdb5
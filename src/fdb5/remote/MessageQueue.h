@@ -0,0 +1,82 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+/// @date   Oct 2026
+
+#ifndef fdb5_remote_MessageQueue_H
+#define fdb5_remote_MessageQueue_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <utility>
+
+#include "eckit/io/Buffer.h"
+#include "eckit/memory/NonCopyable.h"
+
+#include "fdb5/remote/Messages.h"
+
+namespace fdb5 {
+namespace remote {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// The messages received for a request (or for a stream of requests), passed from the
+/// connection's listening thread to the client consuming them.
+///
+/// Pushing never blocks, so that a client that stops consuming its messages cannot stall the
+/// listening thread, and with it every other request sharing the connection. Instead, the queue
+/// counts the bytes it holds, and the listening thread interrupts a queue that holds too many
+/// (see ClientConnection).
+///
+/// pop(), close() and interrupt() behave as for eckit::Queue, except that an interrupted queue
+/// drops the messages it holds, and any pushed later.
+
+class MessageQueue : private eckit::NonCopyable {
+
+public: // types
+
+    using StoredMessage = std::pair<MessageHeader, eckit::Buffer>;
+
+public: // methods
+
+    MessageQueue();
+
+    void emplace(StoredMessage&& msg);
+
+    /// Returns -1 once the queue is closed, and all the messages have been consumed
+    long pop(StoredMessage& msg);
+
+    void close();
+    void interrupt(std::exception_ptr exception);
+
+    bool interrupted() const;
+
+    /// The size of the payloads held
+    size_t bytes() const;
+
+private: // members
+
+    std::deque<StoredMessage> messages_;
+    size_t bytes_;
+    bool closed_;
+    std::exception_ptr exception_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace remote
+} // namespace fdb5
+
+#endif // fdb5_remote_MessageQueue_H
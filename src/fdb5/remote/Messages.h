@@ -70,6 +70,8 @@ enum class Message : uint16_t {
     // Data communication
     Blob = 300,
     MultiBlob,
+    CompressedMultiBlob,
+    ListBatch,
 };
 
 
@@ -0,0 +1,372 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+
+#include "eckit/exception/Exceptions.h"
+#include "eckit/log/Log.h"
+
+#include "fdb5/LibFdb5.h"
+#include "fdb5/remote/Handler.h"
+#include "fdb5/remote/ServerReactor.h"
+
+using namespace eckit;
+
+
+namespace fdb5 {
+namespace remote {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+// The epoll user data identifies the connection, and which of its sockets is ready
+
+namespace {
+
+constexpr uint64_t socketBits = 2;
+
+}
+
+ServerReactor::ServerReactor(const Config& config) :
+    config_(config),
+    tasks_(config.getInt("serverTaskQueueSize", 1024)),
+    nextId_(0),
+    stopping_(false) {
+
+    size_t nreactors = config.getInt("serverReactorThreads", 2);
+    size_t nworkers  = config.getInt("serverWorkerThreads", 16);
+    ASSERT(nreactors > 0);
+    ASSERT(nworkers > 0);
+
+    Log::info() << "Starting event-driven server with " << nreactors << " reactor threads and "
+                << nworkers << " worker threads" << std::endl;
+
+    for (size_t i = 0; i < nreactors; ++i) {
+        int fd;
+        SYSCALL(fd = ::epoll_create1(EPOLL_CLOEXEC));
+        epollFds_.push_back(fd);
+    }
+
+    for (int fd : epollFds_) {
+        reactors_.emplace_back([this, fd] { reactorLoop(fd); });
+    }
+
+    for (size_t i = 0; i < nworkers; ++i) {
+        workers_.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ServerReactor::~ServerReactor() {
+
+    // Stop reading from the clients. The connections then wind down through the usual paths,
+    // which also wakes any worker waiting on a client (e.g. a Flush waiting for archive data).
+
+    std::vector<std::shared_ptr<Connection>> conns;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& kv : connections_) conns.push_back(kv.second);
+    }
+
+    for (auto& conn : conns) {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        if (!conn->closed) conn->handler->shutdown();
+    }
+    conns.clear();
+
+    // n.b. connections still in their handshake have nothing to wind down
+
+    for (int i = 0; i < 50 && connections() != 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    // Stop the reactors before the task queue, so that nothing is submitted to a closed queue
+
+    stopping_ = true;
+    for (auto& t : reactors_) t.join();
+
+    tasks_.close();
+    for (auto& t : workers_) t.join();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.clear();
+    }
+
+    for (int fd : epollFds_) ::close(fd);
+}
+
+void ServerReactor::add(eckit::net::TCPSocket& socket) {
+
+    auto conn = std::make_shared<Connection>();
+    conn->handler.reset(new RemoteHandler(socket, config_, true));
+    conn->initialised = false;
+    conn->dataArmed   = false;
+    conn->closed      = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        conn->id      = ++nextId_;
+        conn->epollFd = epollFds_[conn->id % epollFds_.size()];
+        connections_.emplace(conn->id, conn);
+    }
+
+    uint64_t id = conn->id;
+    conn->handler->resumeData([this, id] { resumeData(id); });
+
+    // The handshake starts once the client's startup message has arrived
+
+    std::lock_guard<std::mutex> lock(conn->mutex);
+    arm(*conn, Socket::Control, true);
+}
+
+size_t ServerReactor::connections() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return connections_.size();
+}
+
+std::shared_ptr<ServerReactor::Connection> ServerReactor::find(uint64_t id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = connections_.find(id);
+    return (it == connections_.end()) ? nullptr : it->second;
+}
+
+void ServerReactor::submit(Task&& task) {
+    tasks_.emplace(std::move(task));
+}
+
+void ServerReactor::workerLoop() {
+    Task task;
+    while (tasks_.pop(task) != -1) {
+        try {
+            task();
+        }
+        catch (std::exception& e) {
+            Log::error() << "** " << e.what() << " Caught in " << Here() << std::endl;
+            Log::error() << "** Exception is ignored" << std::endl;
+        }
+        task = Task();
+    }
+}
+
+void ServerReactor::reactorLoop(int epollFd) {
+
+    std::vector<struct epoll_event> events(64);
+
+    while (!stopping_) {
+
+        int n = ::epoll_wait(epollFd, events.data(), events.size(), 1000);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            Log::error() << "epoll_wait failed" << Log::syserr << std::endl;
+            continue;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            uint64_t id   = events[i].data.u64 >> socketBits;
+            Socket socket = static_cast<Socket>(events[i].data.u64 & ((1 << socketBits) - 1));
+
+            std::shared_ptr<Connection> conn = find(id);
+            if (!conn) continue;
+
+            // Reading archive data doesn't block, and the worker pool must not be relied upon
+            // for it, as a Flush on the control socket blocks a worker until the archive data
+            // has been drained.
+
+            switch (socket) {
+                case Socket::Data:
+                    handleData(conn);
+                    break;
+                case Socket::DataListen:
+                    submit([this, conn] { initialiseData(conn); });
+                    break;
+                case Socket::Control:
+                    if (conn->initialised) {
+                        submit([this, conn] { handleControl(conn); });
+                    }
+                    else {
+                        submit([this, conn] { initialiseControl(conn); });
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+void ServerReactor::arm(Connection& conn, Socket socket, bool add) {
+
+    struct epoll_event ev;
+    ev.events   = EPOLLIN | EPOLLONESHOT;
+    ev.data.u64 = (conn.id << socketBits) | static_cast<uint64_t>(socket);
+
+    int fd = -1;
+    switch (socket) {
+        case Socket::Control:
+            fd = conn.handler->controlSocketFd();
+            break;
+        case Socket::Data:
+            fd = conn.handler->dataSocketFd();
+            break;
+        case Socket::DataListen:
+            fd = conn.handler->dataListenFd();
+            break;
+    }
+
+    // n.b. the data socket is registered disarmed, until an archive starts
+
+    if (add && socket == Socket::Data) ev.events = EPOLLONESHOT;
+
+    SYSCALL(::epoll_ctl(conn.epollFd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev));
+}
+
+void ServerReactor::initialiseControl(std::shared_ptr<Connection> conn) {
+
+    try {
+        if (!conn->handler->initialiseControlConnection()) {
+            close(conn);
+            return;
+        }
+    }
+    catch (std::exception& e) {
+        Log::error() << "Failed to initialise connection: " << e.what() << std::endl;
+        close(conn);
+        return;
+    }
+
+    // Wait for the client to connect to the data port, rather than waiting in accept()
+
+    std::lock_guard<std::mutex> lock(conn->mutex);
+    if (!conn->closed) arm(*conn, Socket::DataListen, true);
+}
+
+void ServerReactor::initialiseData(std::shared_ptr<Connection> conn) {
+
+    try {
+        conn->handler->initialiseDataConnection();
+    }
+    catch (std::exception& e) {
+        Log::error() << "Failed to initialise connection: " << e.what() << std::endl;
+        close(conn);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(conn->mutex);
+    if (conn->closed) return;
+
+    ::epoll_ctl(conn->epollFd, EPOLL_CTL_DEL, conn->handler->dataListenFd(), nullptr);
+    conn->initialised = true;
+    arm(*conn, Socket::Data, true);
+    arm(*conn, Socket::Control, false);
+}
+
+void ServerReactor::handleControl(std::shared_ptr<Connection> conn) {
+
+    bool keep = false;
+    try {
+        keep = conn->handler->handleControlMessage();
+    }
+    catch (std::exception& e) {
+        Log::error() << "Error handling control message: " << e.what() << std::endl;
+    }
+
+    if (!keep) {
+        close(conn);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(conn->mutex);
+
+    if (conn->handler->archiving() && !conn->dataArmed) {
+        conn->dataArmed = true;
+        arm(*conn, Socket::Data, false);
+    }
+
+    arm(*conn, Socket::Control, false);
+}
+
+void ServerReactor::handleData(std::shared_ptr<Connection> conn) {
+
+    std::lock_guard<std::mutex> lock(conn->mutex);
+
+    if (conn->closed) return;
+
+    conn->dataArmed = false;
+
+    // Spurious wakeups (e.g. a hangup whilst not archiving) are left to the control socket
+
+    if (!conn->handler->archiving()) return;
+
+    bool more = false;
+    try {
+        more = conn->handler->handleDataMessage();
+    }
+    catch (std::exception& e) {
+        // Closing the connection is left to the control path, which owns the handler.
+        // Make sure that it wakes up.
+        Log::error() << "Error handling archive data: " << e.what() << std::endl;
+        ::shutdown(conn->handler->controlSocketFd(), SHUT_RDWR);
+        return;
+    }
+
+    if (more) {
+        conn->dataArmed = true;
+        arm(*conn, Socket::Data, false);
+    }
+}
+
+// Called by a connection's archive worker once there is space for held archive data
+
+void ServerReactor::resumeData(uint64_t id) {
+
+    std::shared_ptr<Connection> conn = find(id);
+    if (!conn) return;
+
+    std::lock_guard<std::mutex> lock(conn->mutex);
+
+    if (conn->closed || conn->dataArmed) return;
+
+    conn->dataArmed = true;
+    arm(*conn, Socket::Data, false);
+}
+
+void ServerReactor::close(std::shared_ptr<Connection> conn) {
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.erase(conn->id);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        conn->closed = true;
+        ::epoll_ctl(conn->epollFd, EPOLL_CTL_DEL, conn->handler->controlSocketFd(), nullptr);
+        if (conn->initialised) {
+            ::epoll_ctl(conn->epollFd, EPOLL_CTL_DEL, conn->handler->dataSocketFd(), nullptr);
+        }
+        else {
+            ::epoll_ctl(conn->epollFd, EPOLL_CTL_DEL, conn->handler->dataListenFd(), nullptr);
+        }
+    }
+
+    // The handler waits for its workers, and tells the client that we are done.
+    try {
+        conn->handler.reset();
+    }
+    catch (std::exception& e) {
+        Log::error() << "Error closing connection: " << e.what() << std::endl;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace remote
+} // namespace fdb5
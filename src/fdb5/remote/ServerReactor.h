@@ -0,0 +1,117 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+/// @date   Oct 2026
+
+#ifndef fdb5_remote_ServerReactor_H
+#define fdb5_remote_ServerReactor_H
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "eckit/container/Queue.h"
+#include "eckit/memory/NonCopyable.h"
+#include "eckit/net/TCPSocket.h"
+
+#include "fdb5/config/Config.h"
+
+namespace fdb5 {
+namespace remote {
+
+class RemoteHandler;
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Event-driven serving of many client connections within one process.
+///
+/// A small pool of reactor threads wait (with epoll) for the control and data sockets of
+/// all connections to become readable. Control messages, and the steps of the handshake, are
+/// handed to a bounded pool of worker threads once the client has something for them.
+/// Archive data is read on the reactor thread, without blocking, and queued for the
+/// connection's archive worker. Idle connections cost no threads.
+///
+/// Each socket is registered one-shot, and re-armed once its message has been handled, so
+/// that a connection never has two control messages in flight. The data socket is left
+/// disarmed whilst the archive queue is full, and re-armed by the archive worker.
+
+class ServerReactor : private eckit::NonCopyable {
+
+public: // methods
+
+    ServerReactor(const Config& config);
+    ~ServerReactor();
+
+    /// Take over a newly accepted connection. The handshake is done on the worker pool.
+    void add(eckit::net::TCPSocket& socket);
+
+    size_t connections() const;
+
+private: // types
+
+    enum class Socket { Control = 0, Data = 1, DataListen = 2 };
+
+    struct Connection {
+        uint64_t id;
+        int epollFd;
+        std::unique_ptr<RemoteHandler> handler;
+        std::atomic<bool> initialised;
+        bool dataArmed;
+        bool closed;
+        std::mutex mutex;
+    };
+
+    using Task = std::function<void()>;
+
+private: // methods
+
+    void reactorLoop(int epollFd);
+    void workerLoop();
+
+    void submit(Task&& task);
+
+    void initialiseControl(std::shared_ptr<Connection> conn);
+    void initialiseData(std::shared_ptr<Connection> conn);
+    void handleControl(std::shared_ptr<Connection> conn);
+    void handleData(std::shared_ptr<Connection> conn);
+    void resumeData(uint64_t id);
+
+    void arm(Connection& conn, Socket socket, bool add);
+    void close(std::shared_ptr<Connection> conn);
+
+    std::shared_ptr<Connection> find(uint64_t id) const;
+
+private: // members
+
+    Config config_;
+
+    std::vector<int> epollFds_;
+    std::vector<std::thread> reactors_;
+    std::vector<std::thread> workers_;
+
+    eckit::Queue<Task> tasks_;
+
+    std::map<uint64_t, std::shared_ptr<Connection>> connections_;
+    mutable std::mutex mutex_;
+
+    uint64_t nextId_;
+    std::atomic<bool> stopping_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace remote
+} // namespace fdb5
+
+#endif // fdb5_remote_ServerReactor_H
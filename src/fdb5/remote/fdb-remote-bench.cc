@@ -0,0 +1,526 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+/// @date   Oct 2026
+
+/// Throughput and latency of the remote protocol, measured against an FdbServer started
+/// within this process on loopback, and serving a temporary TOC root.
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "eckit/config/LocalConfiguration.h"
+#include "eckit/exception/Exceptions.h"
+#include "eckit/filesystem/PathName.h"
+#include "eckit/filesystem/TmpDir.h"
+#include "eckit/io/EmptyHandle.h"
+#include "eckit/log/Bytes.h"
+#include "eckit/log/Log.h"
+#include "eckit/log/Timer.h"
+#include "eckit/option/CmdArgs.h"
+#include "eckit/option/SimpleOption.h"
+#include "eckit/utils/StringTools.h"
+
+#include "metkit/mars/MarsRequest.h"
+
+#include "fdb5/api/FDB.h"
+#include "fdb5/api/helpers/FDBToolRequest.h"
+#include "fdb5/config/Config.h"
+#include "fdb5/database/Key.h"
+#include "fdb5/remote/ClientConnection.h"
+#include "fdb5/remote/FdbServer.h"
+#include "fdb5/tools/FDBTool.h"
+
+using namespace eckit;
+using namespace eckit::option;
+
+namespace {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Latencies, in power-of-two buckets of microseconds
+
+class LatencyHistogram {
+
+public: // methods
+
+    LatencyHistogram() : buckets_(40, 0), count_(0), total_(0), max_(0) {}
+
+    void add(double seconds) {
+        size_t us = static_cast<size_t>(seconds * 1e6);
+        size_t bucket = 0;
+        while ((size_t(1) << bucket) <= us && bucket + 1 < buckets_.size()) ++bucket;
+        ++buckets_[bucket];
+        ++count_;
+        total_ += seconds;
+        max_ = std::max(max_, seconds);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < buckets_.size(); ++i) buckets_[i] += other.buckets_[i];
+        count_ += other.count_;
+        total_ += other.total_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    size_t count() const { return count_; }
+
+    /// Upper bound of the bucket containing the given percentile, in seconds
+    double percentile(double p) const {
+        size_t target = static_cast<size_t>(std::ceil(p * count_ / 100.0));
+        size_t seen = 0;
+        for (size_t i = 0; i < buckets_.size(); ++i) {
+            seen += buckets_[i];
+            if (seen >= target && seen != 0) return (size_t(1) << i) * 1e-6;
+        }
+        return max_;
+    }
+
+    void report(std::ostream& out, const std::string& title) const {
+        if (count_ == 0) return;
+        out << "    " << std::left << std::setw(10) << title << std::right
+            << " count=" << count_
+            << " mean=" << (total_ / count_) * 1e3 << "ms"
+            << " p50<=" << percentile(50) * 1e3 << "ms"
+            << " p90<=" << percentile(90) * 1e3 << "ms"
+            << " p99<=" << percentile(99) * 1e3 << "ms"
+            << " max=" << max_ * 1e3 << "ms" << std::endl;
+        out << "    histogram (us):";
+        for (size_t i = 0; i < buckets_.size(); ++i) {
+            if (buckets_[i] != 0) out << " <" << (size_t(1) << i) << ":" << buckets_[i];
+        }
+        out << std::endl;
+    }
+
+private: // members
+
+    std::vector<size_t> buckets_;
+    size_t count_;
+    double total_;
+    double max_;
+};
+
+struct WorkerResult {
+    size_t operations = 0;
+    size_t bytes = 0;
+    LatencyHistogram latency;
+    LatencyHistogram flushLatency;
+};
+
+double since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// An FdbServer serving the given configuration, rather than the default one
+
+class LoopbackServer : public fdb5::remote::FdbServerBase {
+public:
+    LoopbackServer(const fdb5::Config& config) : config_(config) {}
+
+private:
+    void hookUnique() override {}
+    fdb5::Config serverConfig() const override { return config_; }
+
+    fdb5::Config config_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+} // namespace
+
+
+class FDBRemoteBench : public fdb5::FDBTool {
+
+public: // methods
+
+    FDBRemoteBench(int argc, char** argv) :
+        fdb5::FDBTool(argc, argv) {
+
+        options_.push_back(new SimpleOption<std::string>("workloads", "Comma separated workloads to run, in order, from archive,list,retrieve,read. Default: all"));
+        options_.push_back(new SimpleOption<long>("nsteps", "Number of steps. Default: 10"));
+        options_.push_back(new SimpleOption<long>("nparams", "Number of parameters. Default: 100"));
+        options_.push_back(new SimpleOption<long>("field-size", "Size of each field in bytes. Default: 65536"));
+        options_.push_back(new SimpleOption<long>("threads", "Number of concurrent clients. Default: 1"));
+        options_.push_back(new SimpleOption<long>("flush-every", "Flush after this many fields archived by a client. Default: 0 (once, at the end)"));
+        options_.push_back(new SimpleOption<long>("archive-batch", "Number of fields sent in each archive message. Default: 1"));
+        options_.push_back(new SimpleOption<std::string>("compression", "Compression of archived data on the wire. Default: none"));
+        options_.push_back(new SimpleOption<long>("bandwidth", "Limit the data connections of each client to this many bytes per second, in each direction. Default: 0 (unlimited)"));
+        options_.push_back(new SimpleOption<bool>("connection-pool", "Let the clients share pooled connections, rather than each having its own"));
+        options_.push_back(new SimpleOption<bool>("reactor", "Use the event-driven server, rather than a thread per connection"));
+        options_.push_back(new SimpleOption<long>("idle-clients", "Number of further clients that stay connected, but idle, throughout. Default: 0"));
+        options_.push_back(new SimpleOption<std::string>("root", "Directory to hold the served FDB. Default: a temporary directory"));
+        options_.push_back(new SimpleOption<std::string>("schema", "Schema of the served FDB. Default: the library schema"));
+        options_.push_back(new SimpleOption<std::string>("expver", "Experiment version of the generated fields. Default: xxxx"));
+    }
+
+private: // methods
+
+    void usage(const std::string& tool) const override;
+    void init(const CmdArgs& args) override;
+    void execute(const CmdArgs& args) override;
+
+    fdb5::Key fieldKey(size_t field) const;
+    metkit::mars::MarsRequest request() const;
+
+    template <typename Work>
+    void run(const std::string& name, Work work);
+
+    void archive(fdb5::FDB& fdb, size_t thread, WorkerResult& result);
+    void list(fdb5::FDB& fdb, size_t thread, WorkerResult& result);
+    void retrieve(fdb5::FDB& fdb, size_t thread, WorkerResult& result);
+    void read(fdb5::FDB& fdb, size_t thread, WorkerResult& result);
+
+private: // members
+
+    std::vector<std::string> workloads_;
+
+    size_t nsteps_ = 10;
+    size_t nparams_ = 100;
+    size_t fieldSize_ = 65536;
+    size_t threads_ = 1;
+    size_t flushEvery_ = 0;
+    std::string expver_ = "xxxx";
+
+    eckit::LocalConfiguration clientConfig_;
+};
+
+void FDBRemoteBench::usage(const std::string& tool) const {
+    Log::info() << std::endl
+                << "Usage: " << tool << " [--workloads=archive,list,retrieve,read] [--threads=<n>] [--nsteps=<n>] [--nparams=<n>] [--field-size=<bytes>]" << std::endl
+                << "       [--flush-every=<n>] [--archive-batch=<n>] [--compression=<name>] [--bandwidth=<bytes/s>]" << std::endl
+                << "       [--connection-pool] [--reactor] [--idle-clients=<n>]" << std::endl;
+    fdb5::FDBTool::usage(tool);
+}
+
+void FDBRemoteBench::init(const CmdArgs& args) {
+    FDBTool::init(args);
+
+    workloads_ = StringTools::split(",", args.getString("workloads", "archive,list,retrieve,read"));
+    nsteps_ = args.getLong("nsteps", nsteps_);
+    nparams_ = args.getLong("nparams", nparams_);
+    fieldSize_ = args.getLong("field-size", fieldSize_);
+    threads_ = args.getLong("threads", threads_);
+    flushEvery_ = args.getLong("flush-every", flushEvery_);
+    expver_ = args.getString("expver", expver_);
+
+    ASSERT(nsteps_ > 0 && nparams_ > 0 && threads_ > 0);
+    ASSERT(fieldSize_ > 0);
+
+    for (const auto& w : workloads_) {
+        if (w != "archive" && w != "list" && w != "retrieve" && w != "read") {
+            throw UserError("Unknown workload: " + w, Here());
+        }
+    }
+}
+
+// Fields are spread over steps and parameters. Each client handles every n'th field.
+
+fdb5::Key FDBRemoteBench::fieldKey(size_t field) const {
+    fdb5::Key key;
+    key.set("class", "rd");
+    key.set("expver", expver_);
+    key.set("stream", "oper");
+    key.set("date", "20201102");
+    key.set("time", "0000");
+    key.set("domain", "g");
+    key.set("type", "fc");
+    key.set("levtype", "sfc");
+    key.set("step", std::to_string(field / nparams_));
+    key.set("param", std::to_string(1 + field % nparams_));
+    return key;
+}
+
+metkit::mars::MarsRequest FDBRemoteBench::request() const {
+
+    metkit::mars::MarsRequest request("retrieve");
+    fdb5::Key key = fieldKey(0);
+    for (const auto& kv : key) {
+        request.setValue(kv.first, kv.second);
+    }
+
+    std::vector<std::string> steps;
+    for (size_t i = 0; i < nsteps_; ++i) steps.push_back(std::to_string(i));
+    request.values("step", steps);
+
+    std::vector<std::string> params;
+    for (size_t i = 0; i < nparams_; ++i) params.push_back(std::to_string(1 + i));
+    request.values("param", params);
+
+    return request;
+}
+
+template <typename Work>
+void FDBRemoteBench::run(const std::string& name, Work work) {
+
+    std::vector<WorkerResult> results(threads_);
+    std::vector<std::exception_ptr> errors(threads_);
+    std::vector<std::thread> workers;
+
+    Timer timer;
+    timer.start();
+
+    // Failures are rethrown here, once every worker has finished, so that the server is still stopped
+
+    for (size_t t = 0; t < threads_; ++t) {
+        workers.emplace_back([this, t, &results, &errors, &work] {
+            try {
+                fdb5::FDB fdb(fdb5::Config(clientConfig_).expandConfig());
+                (this->*work)(fdb, t, results[t]);
+            }
+            catch (...) {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+
+    for (auto& w : workers) w.join();
+
+    timer.stop();
+
+    for (const auto& e : errors) {
+        if (e) std::rethrow_exception(e);
+    }
+
+    WorkerResult total;
+    for (const auto& r : results) {
+        total.operations += r.operations;
+        total.bytes += r.bytes;
+        total.latency.merge(r.latency);
+        total.flushLatency.merge(r.flushLatency);
+    }
+
+    double elapsed = timer.elapsed();
+
+    Log::info() << "fdb-remote-bench - " << name << ": " << total.operations << " operations, "
+                << Bytes(total.bytes) << " in " << elapsed << "s" << std::endl;
+    Log::info() << "    rate: " << total.operations / elapsed << " ops/s, "
+                << Bytes(total.bytes / elapsed) << "/s" << std::endl;
+    total.latency.report(Log::info(), name);
+    total.flushLatency.report(Log::info(), "flush");
+}
+
+void FDBRemoteBench::archive(fdb5::FDB& fdb, size_t thread, WorkerResult& result) {
+
+    std::vector<char> data(fieldSize_, char(thread));
+    size_t sinceFlush = 0;
+
+    auto flush = [&] {
+        auto start = std::chrono::steady_clock::now();
+        fdb.flush();
+        result.flushLatency.add(since(start));
+        sinceFlush = 0;
+    };
+
+    for (size_t field = thread; field < nsteps_ * nparams_; field += threads_) {
+        fdb5::Key key = fieldKey(field);
+
+        auto start = std::chrono::steady_clock::now();
+        fdb.archive(key, data.data(), data.size());
+        result.latency.add(since(start));
+
+        result.operations++;
+        result.bytes += data.size();
+
+        if (flushEvery_ != 0 && ++sinceFlush == flushEvery_) flush();
+    }
+
+    flush();
+}
+
+// Every client lists (and reads) everything
+
+void FDBRemoteBench::list(fdb5::FDB& fdb, size_t, WorkerResult& result) {
+
+    auto start = std::chrono::steady_clock::now();
+
+    fdb5::ListIterator it = fdb.list(fdb5::FDBToolRequest(request()));
+    fdb5::ListElement elem;
+    size_t count = 0;
+    while (it.next(elem)) ++count;
+
+    result.latency.add(since(start));
+    result.operations += count;
+
+    if (count != nsteps_ * nparams_) {
+        std::ostringstream ss;
+        ss << "Listed " << count << " fields, expected " << nsteps_ * nparams_;
+        throw SeriousBug(ss.str(), Here());
+    }
+}
+
+void FDBRemoteBench::retrieve(fdb5::FDB& fdb, size_t thread, WorkerResult& result) {
+
+    metkit::mars::MarsRequest base = request();
+
+    for (size_t field = thread; field < nsteps_ * nparams_; field += threads_) {
+
+        metkit::mars::MarsRequest req(base);
+        req.setValue("step", std::to_string(field / nparams_));
+        req.setValue("param", std::to_string(1 + field % nparams_));
+
+        auto start = std::chrono::steady_clock::now();
+
+        std::unique_ptr<DataHandle> dh(fdb.retrieve(req));
+        EmptyHandle sink;
+        size_t bytes = dh->copyTo(sink);
+
+        result.latency.add(since(start));
+        result.operations++;
+        result.bytes += bytes;
+
+        if (bytes != fieldSize_) {
+            std::ostringstream ss;
+            ss << "Retrieved " << bytes << " bytes for " << fieldKey(field) << ", expected " << fieldSize_;
+            throw SeriousBug(ss.str(), Here());
+        }
+    }
+}
+
+void FDBRemoteBench::read(fdb5::FDB& fdb, size_t, WorkerResult& result) {
+
+    auto start = std::chrono::steady_clock::now();
+
+    fdb5::ListIterator it = fdb.list(fdb5::FDBToolRequest(request()));
+    std::unique_ptr<DataHandle> dh(fdb.read(it));
+    EmptyHandle sink;
+    size_t bytes = dh->copyTo(sink);
+
+    result.latency.add(since(start));
+    result.operations += nsteps_ * nparams_;
+    result.bytes += bytes;
+
+    if (bytes != nsteps_ * nparams_ * fieldSize_) {
+        std::ostringstream ss;
+        ss << "Read " << bytes << " bytes, expected " << nsteps_ * nparams_ * fieldSize_;
+        throw SeriousBug(ss.str(), Here());
+    }
+}
+
+void FDBRemoteBench::execute(const CmdArgs& args) {
+
+    // The served FDB lives in its own root, so that the results are checkable
+
+    std::unique_ptr<TmpDir> tmpdir;
+    PathName root;
+    if (args.has("root")) {
+        root = args.getString("root");
+        root.mkdir();
+    }
+    else {
+        tmpdir.reset(new TmpDir);
+        root = *tmpdir;
+    }
+
+    eckit::LocalConfiguration rootConfig;
+    rootConfig.set("path", root.asString());
+
+    eckit::LocalConfiguration space;
+    space.set("handler", "Default");
+    space.set("roots", std::vector<eckit::LocalConfiguration>{rootConfig});
+
+    eckit::LocalConfiguration serverConfig;
+    serverConfig.set("type", "local");
+    serverConfig.set("engine", "toc");
+    if (args.has("schema")) serverConfig.set("schema", args.getString("schema"));
+    serverConfig.set("spaces", std::vector<eckit::LocalConfiguration>{space});
+    serverConfig.set("serverPort", 0);
+    serverConfig.set("serverThreaded", true);
+    serverConfig.set("serverReactor", args.getBool("reactor", false));
+
+    // Unsupported server options are reported here, rather than on the server's thread
+    fdb5::remote::FdbServerBase::reactor(fdb5::Config(serverConfig));
+
+    LoopbackServer server(fdb5::Config(serverConfig).expandConfig());
+    std::thread serverThread([&server] { server.doRun(); });
+
+    // The server must have stopped before its root is removed, including on error
+
+    struct StopServer {
+        LoopbackServer& server;
+        std::thread& thread;
+        ~StopServer() {
+            server.stop();
+            thread.join();
+        }
+    } stopServer{server, serverThread};
+
+    while (server.port() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    Log::info() << "fdb-remote-bench - server listening on port " << server.port()
+                << ", serving " << root << std::endl;
+
+    // Unless asked otherwise, each client has its own connection, as separate processes would
+
+    clientConfig_.set("type", "remote");
+    clientConfig_.set("host", "localhost");
+    clientConfig_.set("port", server.port());
+    clientConfig_.set("maxBatchSize", args.getLong("archive-batch", 1));
+    clientConfig_.set("compression", args.getString("compression", "none"));
+    clientConfig_.set("bandwidth", args.getLong("bandwidth", 0));
+    clientConfig_.set("connectionPool", args.getBool("connection-pool", false));
+
+    // Idle clients are what the event-driven server is for. Each costs a thread per connection
+    // otherwise. n.b. each needs a handful of file descriptors, on both sides.
+
+    std::vector<std::unique_ptr<fdb5::remote::ClientConnection>> idle;
+    size_t nidle = args.getLong("idle-clients", 0);
+    if (nidle > 0) {
+        struct rlimit limit;
+        if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            ::setrlimit(RLIMIT_NOFILE, &limit);
+        }
+
+        Timer timer;
+        timer.start();
+        for (size_t i = 0; i < nidle; ++i) {
+            idle.emplace_back(new fdb5::remote::ClientConnection(eckit::net::Endpoint("localhost", server.port())));
+            idle.back()->connect();
+        }
+        timer.stop();
+
+        Log::info() << "fdb-remote-bench - " << nidle << " idle clients connected in " << timer.elapsed() << "s" << std::endl;
+    }
+
+    Log::info() << "fdb-remote-bench - " << threads_ << " clients, " << nsteps_ * nparams_
+                << " fields of " << Bytes(fieldSize_) << std::endl;
+
+    for (const auto& w : workloads_) {
+        if (w == "archive") run(w, &FDBRemoteBench::archive);
+        if (w == "list") run(w, &FDBRemoteBench::list);
+        if (w == "retrieve") run(w, &FDBRemoteBench::retrieve);
+        if (w == "read") run(w, &FDBRemoteBench::read);
+    }
+
+    for (auto& conn : idle) {
+        conn->disconnect();
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+    FDBRemoteBench app(argc, argv);
+    return app.start();
+}
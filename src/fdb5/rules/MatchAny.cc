@@ -35,6 +35,11 @@ bool MatchAny::match(const std::string &keyword, const Key &key) const {
     return (values_.find(i->second) != values_.end());
 }
 
+bool MatchAny::restricts(std::vector<std::string>& values) const {
+    values.assign(values_.begin(), values_.end());
+    return true;
+}
+
 void MatchAny::dump(std::ostream &s, const std::string &keyword, const TypesRegistry &registry) const {
     const char *sep = "";
     registry.dump(s, keyword);
@@ -34,6 +34,11 @@ bool MatchValue::match(const std::string &keyword, const Key &key) const {
     return ( i->second == value_ );
 }
 
+bool MatchValue::restricts(std::vector<std::string>& values) const {
+    values.assign(1, value_);
+    return true;
+}
+
 void MatchValue::dump(std::ostream &s, const std::string &keyword, const TypesRegistry &registry) const {
     registry.dump(s, keyword);
     s << "=" << value_;
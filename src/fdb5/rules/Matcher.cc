@@ -37,6 +37,10 @@ const std::vector<std::string> &Matcher::values(const metkit::mars::MarsRequest&
     return rq.values(keyword);
 }
 
+bool Matcher::restricts(std::vector<std::string>&) const {
+    return false;
+}
+
 void Matcher::fill(Key &key, const std::string &keyword, const std::string& value) const {
     key.push(keyword, value);
 }
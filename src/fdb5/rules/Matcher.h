@@ -50,6 +50,10 @@ public: // methods
     virtual const std::string &defaultValue() const;
 
     virtual bool match(const std::string &keyword, const Key &key) const = 0;
+
+    /// If the matcher only accepts certain values, returns true and fills in the values (sorted).
+    /// Lets rules test a value without building the Key that match() tests.
+    virtual bool restricts(std::vector<std::string>& values) const;
     virtual void fill(Key &key, const std::string &keyword, const std::string& value) const;
 
 
@@ -47,6 +47,10 @@ bool Predicate::optional() const {
     return matcher_->optional();
 }
 
+bool Predicate::restricts(std::vector<std::string>& values) const {
+    return matcher_->restricts(values);
+}
+
 const std::string &Predicate::value(const Key &key) const {
     return matcher_->value(key, keyword_);
 }
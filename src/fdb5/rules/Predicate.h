@@ -50,6 +50,7 @@ public: // methods
     const std::string &defaultValue() const;
 
     bool optional() const;
+    bool restricts(std::vector<std::string>& values) const;
 
     std::string keyword() const;
 
@@ -37,6 +37,7 @@ Rule::Rule(const Schema &schema,
     for (std::map<std::string, std::string>::const_iterator i = types.begin(); i != types.end(); ++i) {
         registry_.addType(i->first, i->second);
     }
+    compile();
 }
 
 Rule::~Rule() {
@@ -49,182 +50,215 @@ Rule::~Rule() {
     }
 }
 
-void Rule::expand( const metkit::mars::MarsRequest &request,
-                   std::vector<Predicate *>::const_iterator cur,
-                   size_t depth,
-                   std::vector<Key> &keys,
-                   Key &full,
-                   ReadVisitor &visitor) const {
+void Rule::compile() {
 
-	ASSERT(depth < 3);
+    steps_.clear();
+    steps_.reserve(predicates_.size());
 
-    if (cur == predicates_.end()) {
+    for (const Predicate* p : predicates_) {
+        Step step;
+        step.predicate = p;
+        step.keyword = p->keyword();
+        step.restricted = p->restricts(step.values);
+        step.optional = p->optional();
+        if (step.optional) {
+            step.defaultValue = p->defaultValue();
+        }
+        steps_.emplace_back(std::move(step));
+    }
+}
+
+bool Rule::Step::accepts(const std::string& value) const {
+    if (!restricted) {
+        return true;
+    }
+    if (values.size() == 1) {
+        return values[0] == value;
+    }
+    return std::binary_search(values.begin(), values.end(), value);
+}
 
-        // TODO: join these 2 methods
-        keys[depth].rule(this);
+void Rule::expanded(const metkit::mars::MarsRequest &request,
+                    size_t depth,
+                    std::vector<Key> &keys,
+                    Key &full,
+                    ReadVisitor &visitor) const {
 
-        if (rules_.empty()) {
-            ASSERT(depth == 2); /// we have 3 levels ATM
-            if (!visitor.selectDatum( keys[2], full)) {
-                return; // This it not useful
-            }
-        } else {
+    // TODO: join these 2 methods
+    keys[depth].rule(this);
 
-            switch (depth) {
-            case 0:
-                if (!visitor.selectDatabase(keys[0], full)) {
-                    return;
-                };
+    if (rules_.empty()) {
+        ASSERT(depth == 2); /// we have 3 levels ATM
+        if (!visitor.selectDatum( keys[2], full)) {
+            return; // This it not useful
+        }
+    } else {
 
-                // Here we recurse on the database's schema (rather than the master schema)
-                ASSERT(keys[0] == full);
-                visitor.databaseSchema().expandSecond(request, visitor, keys[0]);
+        switch (depth) {
+        case 0:
+            if (!visitor.selectDatabase(keys[0], full)) {
                 return;
+            };
 
-            case 1:
-                if (!visitor.selectIndex(keys[1], full)) {
-                    return;
-                }
-                break;
+            // Here we recurse on the database's schema (rather than the master schema)
+            ASSERT(keys[0] == full);
+            visitor.databaseSchema().expandSecond(request, visitor, keys[0]);
+            return;
 
-            default:
-                ASSERT(depth == 0 || depth == 1);
-                break;
+        case 1:
+            if (!visitor.selectIndex(keys[1], full)) {
+                return;
             }
+            break;
 
-            for (std::vector<Rule *>::const_iterator i = rules_.begin(); i != rules_.end(); ++i ) {
-                (*i)->expand(request, visitor, depth + 1, keys, full);
-            }
+        default:
+            ASSERT(depth == 0 || depth == 1);
+            break;
+        }
+
+        for (std::vector<Rule *>::const_iterator i = rules_.begin(); i != rules_.end(); ++i ) {
+            (*i)->expand(request, visitor, depth + 1, keys, full);
         }
-        return;
     }
+}
 
-    std::vector<Predicate *>::const_iterator next = cur;
-    ++next;
+void Rule::expand( const metkit::mars::MarsRequest &request,
+                   size_t step,
+                   size_t depth,
+                   std::vector<Key> &keys,
+                   Key &full,
+                   ReadVisitor &visitor) const {
 
-    const std::string &keyword = (*cur)->keyword();
+	ASSERT(depth < 3);
+
+    if (step == steps_.size()) {
+        expanded(request, depth, keys, full, visitor);
+        return;
+    }
+
+    const Step& cur = steps_[step];
 
     eckit::StringList values;
-    visitor.values(request, keyword, registry_, values);
+    visitor.values(request, cur.keyword, registry_, values);
 
     // eckit::Log::info() << "keyword " << keyword << " values " << values << std::endl;
 
     Key &k = keys[depth];
 
-    if (values.empty() && (*cur)->optional()) {
-        values.push_back((*cur)->defaultValue());
+    if (values.empty() && cur.optional) {
+        values.push_back(cur.defaultValue);
     }
 
     for (eckit::StringList::const_iterator i = values.begin(); i != values.end(); ++i) {
 
-        k.push(keyword, *i);
-        full.push(keyword, *i);
+        if (!cur.accepts(*i)) {
+            continue;
+        }
 
-        if ((*cur)->match(k))
-            expand(request, next, depth, keys, full, visitor);
+        k.push(cur.keyword, *i);
+        full.push(cur.keyword, *i);
 
-        full.pop(keyword);
-        k.pop(keyword);
+        expand(request, step + 1, depth, keys, full, visitor);
 
+        full.pop(cur.keyword);
+        k.pop(cur.keyword);
     }
 
 }
 
 void Rule::expand(const metkit::mars::MarsRequest &request, ReadVisitor &visitor, size_t depth, std::vector<Key> &keys, Key &full) const {
     ASSERT(keys.size() == 3);
-    expand(request, predicates_.begin(), depth, keys, full, visitor);
+    expand(request, 0, depth, keys, full, visitor);
 }
 
-void Rule::expand( const Key &field,
-                   std::vector<Predicate *>::const_iterator cur,
-                   size_t depth,
-                   std::vector<Key> &keys,
-                   Key &full,
-                   WriteVisitor &visitor) const {
-
-    static bool matchFirstFdbRule = eckit::Resource<bool>("matchFirstFdbRule", true);
-
-    if (matchFirstFdbRule && visitor.rule()) {
-        return;
-    }
-
-    ASSERT(depth < 3);
+void Rule::expanded(const Key &field,
+                    size_t depth,
+                    std::vector<Key> &keys,
+                    Key &full,
+                    WriteVisitor &visitor) const {
+
+    keys[depth].rule(this);
+
+    if (rules_.empty()) {
+        ASSERT(depth == 2); /// we have 3 levels ATM
+        if (visitor.rule() != 0) {
+            std::ostringstream oss;
+            oss << "More than one rule matching "
+                << keys[0] << ", "
+                << keys[1] << ", "
+                << keys[2] << " "
+                << topRule() << " and "
+                << visitor.rule()->topRule();
+            throw eckit::SeriousBug(oss.str());
+        }
+        visitor.rule(this);
+        visitor.selectDatum( keys[2], full);
+    } else {
 
+        switch (depth) {
+        case 0:
+            if (keys[0] != visitor.prev_[0] /*|| keys[0].registry() != visitor.prev_[0].registry()*/) {
+                visitor.selectDatabase(keys[0], full);
+                visitor.prev_[0] = keys[0];
+                visitor.prev_[1] = Key();
+            }
 
-    if (cur == predicates_.end()) {
+            // Here we recurse on the database's schema (rather than the master schema)
+            visitor.databaseSchema().expandSecond(field, visitor, keys[0]);
+            return;
 
-        keys[depth].rule(this);
-
-        if (rules_.empty()) {
-            ASSERT(depth == 2); /// we have 3 levels ATM
-            if (visitor.rule() != 0) {
-                std::ostringstream oss;
-                oss << "More than one rule matching "
-                    << keys[0] << ", "
-                    << keys[1] << ", "
-                    << keys[2] << " "
-                    << topRule() << " and "
-                    << visitor.rule()->topRule();
-                throw eckit::SeriousBug(oss.str());
+        case 1:
+            if (keys[1] != visitor.prev_[1] /*|| keys[1].registry() != visitor.prev_[1].registry()*/) {
+                visitor.selectIndex(keys[1], full);
+                visitor.prev_[1] = keys[1];
             }
-            visitor.rule(this);
-            visitor.selectDatum( keys[2], full);
-        } else {
+            break;
 
-            switch (depth) {
-            case 0:
-                if (keys[0] != visitor.prev_[0] /*|| keys[0].registry() != visitor.prev_[0].registry()*/) {
-                    visitor.selectDatabase(keys[0], full);
-                    visitor.prev_[0] = keys[0];
-                    visitor.prev_[1] = Key();
-                }
+        default:
+            ASSERT(depth == 0 || depth == 1);
+            break;
+        }
 
-                // Here we recurse on the database's schema (rather than the master schema)
-                visitor.databaseSchema().expandSecond(field, visitor, keys[0]);
-                return;
+        for (std::vector<Rule *>::const_iterator i = rules_.begin(); i != rules_.end(); ++i ) {
+            (*i)->expand(field, visitor, depth + 1, keys, full);
+        }
+    }
+}
 
-            case 1:
-                if (keys[1] != visitor.prev_[1] /*|| keys[1].registry() != visitor.prev_[1].registry()*/) {
-                    visitor.selectIndex(keys[1], full);
-                    visitor.prev_[1] = keys[1];
-                }
-                break;
+void Rule::expand(const Key &field, WriteVisitor &visitor, size_t depth, std::vector<Key> &keys, Key &full) const {
+    ASSERT(keys.size() == 3);
 
-            default:
-                ASSERT(depth == 0 || depth == 1);
-                break;
-            }
+    static bool matchFirstFdbRule = eckit::Resource<bool>("matchFirstFdbRule", true);
 
-            for (std::vector<Rule *>::const_iterator i = rules_.begin(); i != rules_.end(); ++i ) {
-                (*i)->expand(field, visitor, depth + 1, keys, full);
-            }
-        }
+    if (matchFirstFdbRule && visitor.rule()) {
         return;
     }
 
-    std::vector<Predicate *>::const_iterator next = cur;
-    ++next;
+    ASSERT(depth < 3);
 
-    const std::string &keyword = (*cur)->keyword();
-    const std::string &value = (*cur)->value(field);
+    // A field has a single value for each predicate, so the rule is a flat sequence of tests.
+    // Test them all before modifying the keys, as most rules do not match.
 
-    Key &k = keys[depth];
+    for (const Step& step : steps_) {
+        if (!step.accepts(step.predicate->value(field))) {
+            return;
+        }
+    }
 
-    k.push(keyword, value);
-    full.push(keyword, value);
+    Key &k = keys[depth];
 
-    if ((*cur)->match(k)) {
-        expand(field, next, depth, keys, full, visitor);
+    for (const Step& step : steps_) {
+        const std::string& value = step.predicate->value(field);
+        k.push(step.keyword, value);
+        full.push(step.keyword, value);
     }
 
-    full.pop(keyword);
-    k.pop(keyword);
+    expanded(field, depth, keys, full, visitor);
 
-
-}
-void Rule::expand(const Key &field, WriteVisitor &visitor, size_t depth, std::vector<Key> &keys, Key &full) const {
-    ASSERT(keys.size() == 3);
-    expand(field, predicates_.begin(), depth, keys, full, visitor);
+    for (auto step = steps_.rbegin(); step != steps_.rend(); ++step) {
+        full.pop(step->keyword);
+        k.pop(step->keyword);
+    }
 }
 
 void Rule::expandFirstLevel( const Key &dbKey, std::vector<Predicate *>::const_iterator cur, Key &result, bool& found) const {
@@ -370,9 +404,12 @@ void Rule::matchFirstLevel(const metkit::mars::MarsRequest& request,  std::set<K
 
 
 bool Rule::match(const Key &key) const {
-    for (std::vector<Predicate *>::const_iterator i = predicates_.begin(); i != predicates_.end(); ++i ) {
-        if (!(*i)->match(key)) {
-            return false;
+    for (const Step& step : steps_) {
+        if (step.restricted) {
+            Key::const_iterator i = key.find(step.keyword);
+            if (i == key.end() || !step.accepts(i->second)) {
+                return false;
+            }
         }
     }
     return true;
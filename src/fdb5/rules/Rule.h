@@ -17,6 +17,7 @@
 #define fdb5_Rule_H
 
 #include <iosfwd>
+#include <string>
 #include <vector>
 
 #include "eckit/memory/NonCopyable.h"
@@ -85,21 +86,44 @@ public: // methods
 
     void check(const Key& key) const;
 
+private: // types
+
+    /// A predicate compiled when the schema is loaded, so that values can be tested against it
+    /// directly, rather than by pushing them onto a Key for the predicate to look up again.
+    struct Step {
+        const Predicate* predicate;
+        std::string keyword;
+        bool restricted;
+        std::vector<std::string> values;  // sorted. The values accepted, if restricted.
+        bool optional;
+        std::string defaultValue;
+
+        bool accepts(const std::string& value) const;
+    };
+
 private: // methods
 
+    void compile();
+
     void expand(const metkit::mars::MarsRequest &request,
-                std::vector<Predicate *>::const_iterator cur,
+                size_t step,
                 size_t depth,
                 std::vector<Key> &keys,
                 Key &full,
                 ReadVisitor &Visitor) const;
 
-    void expand(const Key &field,
-                std::vector<Predicate *>::const_iterator cur,
-                size_t depth,
-                std::vector<Key> &keys,
-                Key &full,
-                WriteVisitor &Visitor) const;
+    /// Visit the rule once the keys have been expanded for all of its predicates
+    void expanded(const metkit::mars::MarsRequest &request,
+                  size_t depth,
+                  std::vector<Key> &keys,
+                  Key &full,
+                  ReadVisitor &Visitor) const;
+
+    void expanded(const Key &field,
+                  size_t depth,
+                  std::vector<Key> &keys,
+                  Key &full,
+                  WriteVisitor &Visitor) const;
 
     void expandFirstLevel(const Key &dbKey, std::vector<Predicate *>::const_iterator cur, Key &result, bool& done) const;
     void expandFirstLevel(const Key &dbKey,  Key &result, bool& done) const ;
@@ -127,6 +151,8 @@ private: // members
     std::vector<Predicate *> predicates_;
     std::vector<Rule *>      rules_;
 
+    std::vector<Step> steps_;
+
     TypesRegistry registry_;
 
     friend class Schema;
@@ -9,7 +9,10 @@
  */
 
 #include <algorithm>
+#include <iterator>
+#include <set>
 
+#include "eckit/config/Resource.h"
 #include "eckit/log/Log.h"
 
 #include "fdb5/LibFdb5.h"
@@ -22,12 +25,14 @@ namespace fdb5 {
 //----------------------------------------------------------------------------------------------------------------------
 
 TocCatalogueReader::TocCatalogueReader(const Key& key, const fdb5::Config& config) :
-    TocCatalogue(key, config) {
+    TocCatalogue(key, config),
+    matching_(nullptr) {
     loadIndexesAndRemap();
 }
 
 TocCatalogueReader::TocCatalogueReader(const eckit::URI& uri, const fdb5::Config& config) :
-    TocCatalogue(uri.path(), ControlIdentifiers{}, config) {
+    TocCatalogue(uri.path(), ControlIdentifiers{}, config),
+    matching_(nullptr) {
     loadIndexesAndRemap();
 }
 
@@ -36,14 +41,63 @@ TocCatalogueReader::~TocCatalogueReader() {
 }
 
 void TocCatalogueReader::loadIndexesAndRemap() {
+
+    // n.b. take the size of the TOC before reading it, so that records appended meanwhile make it stale
+    if (tocPath().exists()) {
+        tocSizes_.emplace_back(tocPath(), tocPath().size());
+    }
+
+    std::set<std::string> subTocs;
     std::vector<Key> remapKeys;
-    std::vector<Index> indexes = loadIndexes(false, nullptr, nullptr, &remapKeys);
+    std::vector<Index> indexes = loadIndexes(false, &subTocs, nullptr, &remapKeys);
+
+    for (const std::string& subToc : subTocs) {
+        eckit::PathName path(subToc);
+        tocSizes_.emplace_back(path, path.size());
+    }
 
     ASSERT(remapKeys.size() == indexes.size());
     indexes_.reserve(remapKeys.size());
     for (size_t i = 0; i < remapKeys.size(); ++i) {
         indexes_.emplace_back(indexes[i], remapKeys[i]);
     }
+
+    for (IndexRemap& idx : indexes_) {
+        groups_[idx.first.key()].indexes.push_back(&idx);
+    }
+}
+
+void TocCatalogueReader::buildPostings(IndexGroup& group) const {
+
+    static size_t minIndexes = eckit::Resource<size_t>("fdbIndexPostingsMinIndexes", 8);
+
+    group.indexed = true;
+    if (group.indexes.size() < minIndexes) return;
+
+    decltype(group.postings) postings;
+    std::map<uint32_t, size_t> counts;
+    std::map<uint32_t, std::vector<uint32_t>> ids;
+
+    for (uint32_t i = 0; i < group.indexes.size(); ++i) {
+        if (!group.indexes[i]->first.axes().interned(ids)) return;
+        for (const auto& kw : ids) {
+            auto& values(postings[kw.first]);
+            for (uint32_t v : kw.second) {
+                values[v].push_back(i);
+            }
+            ++counts[kw.first];
+        }
+    }
+
+    // An index without an axis for a keyword does not restrict its value, so those keywords
+    // cannot be used to select indexes
+    for (const auto& c : counts) {
+        if (c.second != group.indexes.size()) {
+            postings.erase(c.first);
+        }
+    }
+
+    group.postings = std::move(postings);
 }
 
 bool TocCatalogueReader::selectIndex(const Key &key) {
@@ -53,18 +107,15 @@ bool TocCatalogueReader::selectIndex(const Key &key) {
     }
 
     currentIndexKey_ = key;
-    matching_.clear();
 
-    for (auto idx = indexes_.begin(); idx != indexes_.end(); ++idx) {
-        if (idx->first.key() == key) {
-            matching_.push_back(&(*idx));
-        }
-    }
+    auto group = groups_.find(key);
+    matching_ = (group == groups_.end()) ? nullptr : &group->second;
 
+    size_t found = matching_ ? matching_->indexes.size() : 0;
     eckit::Log::debug<LibFdb5>() << "TocCatalogueReader::selectIndex " << key << ", found "
-                                << matching_.size() << " matche(s)" << std::endl;
+                                << found << " matche(s)" << std::endl;
 
-    return (matching_.size() != 0);
+    return (found != 0);
 }
 
 void TocCatalogueReader::deselectIndex() {
@@ -85,9 +136,20 @@ bool TocCatalogueReader::open() {
     return true;
 }
 
+bool TocCatalogueReader::stale() const {
+    for (const auto& toc : tocSizes_) {
+        if (!toc.first.exists() || toc.first.size() != toc.second) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool TocCatalogueReader::axis(const std::string &keyword, eckit::StringSet &s) const {
     bool found = false;
-    for (auto m = matching_.begin(); m != matching_.end(); ++m) {
+    if (!matching_) return found;
+
+    for (auto m = matching_->indexes.begin(); m != matching_->indexes.end(); ++m) {
         if ((*m)->first.axes().has(keyword)) {
             found = true;
             const eckit::DenseSet<std::string>& a = (*m)->first.axes().values(keyword);
@@ -105,17 +167,61 @@ void TocCatalogueReader::close() {
 
 bool TocCatalogueReader::retrieve(const Key& key, Field& field) const {
     eckit::Log::debug<LibFdb5>() << "Trying to retrieve key " << key << std::endl;
-    eckit::Log::debug<LibFdb5>() << "Scanning indexes " << matching_.size() << std::endl;
+    if (!matching_) return false;
 
-    for (auto m = matching_.begin(); m != matching_.end(); ++m) {
-        const Index& idx((*m)->first);
-        Key remapKey = (*m)->second;
+    eckit::Log::debug<LibFdb5>() << "Scanning indexes " << matching_->indexes.size() << std::endl;
 
-        if (idx.mayContain(key)) {
-            const_cast<Index&>(idx).open();
-            if (idx.get(key, remapKey, field)) {
-                return true;
-            }
+    // Resolve the key once, rather than against the axes of each index
+    AxisProbe probe(key);
+
+    if (!matching_->indexed) {
+        buildPostings(*matching_);
+    }
+
+    // Narrow the indexes down to those with the key's value on the axis with the fewest of them.
+    // n.b. The ids of the postings are held by the indexes, which were all read before the probe
+    //      was resolved, so they can't have been reused for other values since.
+
+    static const std::vector<uint32_t> none;
+    auto posting = [](const std::unordered_map<uint32_t, std::vector<uint32_t>>& values,
+                      uint32_t id) -> const std::vector<uint32_t>& {
+        auto it = values.find(id);
+        return it == values.end() ? none : it->second;
+    };
+
+    std::vector<uint32_t> candidates;
+    bool narrowed = false;
+
+    for (const auto& kw : matching_->postings) {
+        uint32_t value;
+        uint32_t canonical;
+        if (!probe.find(kw.first, value, canonical)) return false;
+
+        const std::vector<uint32_t>& a(posting(kw.second, value));
+        const std::vector<uint32_t>& b(canonical == value ? none : posting(kw.second, canonical));
+        if (narrowed && a.size() + b.size() >= candidates.size()) continue;
+
+        candidates.clear();
+        std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(candidates));
+        narrowed = true;
+
+        if (candidates.empty()) return false;
+    }
+
+    auto tryIndex = [&](const IndexRemap& m) {
+        const Index& idx(m.first);
+        if (!idx.mayContain(probe)) return false;
+        const_cast<Index&>(idx).open();
+        return idx.get(key, m.second, field);
+    };
+
+    if (narrowed) {
+        for (uint32_t i : candidates) {
+            if (tryIndex(*matching_->indexes[i])) return true;
+        }
+    } else {
+        for (const IndexRemap* m : matching_->indexes) {
+            if (tryIndex(*m)) return true;
         }
     }
     return false;
@@ -16,6 +16,10 @@
 #ifndef fdb5_TocCatalogueReader_H
 #define fdb5_TocCatalogueReader_H
 
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+
 #include "fdb5/toc/TocCatalogue.h"
 
 namespace fdb5 {
@@ -36,13 +40,29 @@ public: // methods
     std::vector<Index> indexes(bool sorted) const override;
     DbStats stats() const override { return TocHandler::stats(); }
 
+private: // types
+
+    typedef std::pair<Index, Key> IndexRemap;
+
+    /// The indexes with the same (second level) key, in order of precedence
+    struct IndexGroup {
+        std::vector<IndexRemap*> indexes;
+
+        // For the keywords on the axes of every index in the group, the positions in indexes of
+        // those with each value on their axis, by keyword id and then value id. Built on first use.
+        std::unordered_map<uint32_t, std::unordered_map<uint32_t, std::vector<uint32_t>>> postings;
+        bool indexed = false;
+    };
+
 private: // methods
 
     void loadIndexesAndRemap();
+    void buildPostings(IndexGroup& group) const;
     bool selectIndex(const Key &key) override;
     void deselectIndex() override;
 
     bool open() override;
+    bool stale() const override;
     void flush() override {}
     void clean() override {}
     void close() override;
@@ -57,11 +77,17 @@ private: // members
 
     // Indexes matching current key. If there is a key remapping for a mounted
     // SubToc, then this is stored alongside
-    std::vector<std::pair<Index, Key>*> matching_;
+    IndexGroup* matching_;
 
     // All indexes
     // If there is a key remapping for a mounted SubToc, this is stored alongside
-    std::vector<std::pair<Index, Key>> indexes_;
+    std::vector<IndexRemap> indexes_;
+
+    // All indexes, by their key
+    std::map<Key, IndexGroup> groups_;
+
+    // The sizes of the TOC and sub-TOCs when the indexes were loaded
+    std::vector<std::pair<eckit::PathName, eckit::Length>> tocSizes_;
 
 };
 
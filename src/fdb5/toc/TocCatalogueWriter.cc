@@ -137,6 +137,28 @@ void TocCatalogueWriter::index(const Key &key, const eckit::URI &uri, eckit::Off
         currentFull_.put(key, field);
 }
 
+void TocCatalogueWriter::index(const Key &indexKey, const eckit::URI &uri, const std::vector<AdoptedField>& fields) {
+
+    if (fields.empty())
+        return;
+
+    dirty_ = true;
+
+    selectIndex(indexKey);
+
+    time_t timestamp = currentIndex().timestamp();
+
+    for (const AdoptedField& f : fields) {
+
+        Field field(TocFieldLocation(uri, f.offset, f.length, Key()), timestamp);
+
+        current_.put(f.key, field);
+
+        if (useSubToc())
+            currentFull_.put(f.key, field);
+    }
+}
+
 void TocCatalogueWriter::reconsolidateIndexesAndTocs() {
 
     // TODO: This tool needs to be rewritten to reindex properly using the schema.
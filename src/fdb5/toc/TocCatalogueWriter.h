@@ -45,6 +45,10 @@ public: // methods
     /// Used for adopting & indexing external data to the TOC dir
     void index(const Key &key, const eckit::URI &uri, eckit::Offset offset, eckit::Length length) override;
 
+    /// Selects the index once for a whole run of fields, which are best sorted by key so that
+    /// they are inserted into the index in order
+    void index(const Key &indexKey, const eckit::URI &uri, const std::vector<AdoptedField>& fields) override;
+
     void reconsolidate() override { reconsolidateIndexesAndTocs(); }
 
     /// Mount an existing TocCatalogue, which has a different metadata key (within
@@ -113,6 +113,7 @@ void TocIndex::reopen() {
     // at the second level of the schema, but is a NEW index).
 
     axes_.wipe();
+    wipeFilter();
 
     open();
 }
@@ -129,9 +130,12 @@ void TocIndex::add(const Key &key, const Field &field) {
     ASSERT( mode_ == TocIndex::WRITE );
 
     FieldRef ref(files_, field);
+    std::string fingerprint = key.valuesToString();
 
     //  bool replace =
-    btree_->set(key.valuesToString(), ref); // returns true if replace, false if new insert
+    btree_->set(fingerprint, ref); // returns true if replace, false if new insert
+
+    filterHashes_.push_back(BloomFilter::hash(fingerprint));
 
     dirty_ = true;
 
@@ -142,6 +146,7 @@ void TocIndex::flush() {
 
     if (dirty_) {
         axes_.sort();
+        updateFilter();
         ASSERT(btree_);
         btree_->flush();
         btree_->sync();
@@ -35,7 +35,8 @@ public:
 
     FDBWrite(int argc, char **argv) :
         fdb5::FDBTool(argc, argv),
-        verbose_(false) {
+        verbose_(false),
+        decodeThreads_(-1) {
 
         options_.push_back(
                     new eckit::option::SimpleOption<std::string>("include-filter",
@@ -50,6 +51,10 @@ public:
                                                          "List of comma separated key-values of modifiers to each message "
                                                          "int input data, e.g --modifiers=packingType=grib_ccsds,expver=0042"));
 
+        options_.push_back(
+            new eckit::option::SimpleOption<long>("decode-threads",
+                                                  "Number of threads to decode messages on, whilst archiving them in order"));
+
         options_.push_back(new eckit::option::SimpleOption<bool>("statistics", "Report timing statistics"));
 
         options_.push_back(new eckit::option::SimpleOption<bool>("verbose", "Print verbose output"));
@@ -59,6 +64,7 @@ public:
     std::string filterExclude_;
     std::string modifiers_;
     bool verbose_;
+    long decodeThreads_;
 };
 
 void FDBWrite::usage(const std::string &tool) const {
@@ -73,6 +79,7 @@ void FDBWrite::init(const eckit::option::CmdArgs& args)
     args.get("exclude-filter", filterExclude_);
     args.get("modifiers", modifiers_);
     verbose_ = args.getBool("verbose", false);
+    args.get("decode-threads", decodeThreads_);
 }
 
 void FDBWrite::execute(const eckit::option::CmdArgs &args) {
@@ -81,6 +88,9 @@ void FDBWrite::execute(const eckit::option::CmdArgs &args) {
 
     archiver.filters(filterInclude_, filterExclude_);
     archiver.modifiers(modifiers_);
+    if (decodeThreads_ >= 0) {
+        archiver.decodeThreads(decodeThreads_);
+    }
 
     for (size_t i = 0; i < args.count(); i++) {
 
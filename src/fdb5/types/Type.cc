@@ -8,6 +8,14 @@
  * does it submit to any jurisdiction.
  */
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "eckit/config/Resource.h"
+
 #include "fdb5/types/Type.h"
 #include "metkit/mars/MarsRequest.h"
 
@@ -15,11 +23,105 @@ namespace fdb5 {
 
 //----------------------------------------------------------------------------------------------------------------------
 
+/// The canonical forms of the values of a type, shared between threads. Once it is full, it is
+/// emptied rather than evicting entries one by one, as the values in use change slowly.
+
+class Type::Memo {
+
+public: // methods
+
+    Memo(size_t capacity) :
+        capacity_(capacity),
+        hits_(0),
+        misses_(0),
+        nanoseconds_(0) {}
+
+    bool find(const std::string& value, std::string& result) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = values_.find(value);
+        if (it == values_.end()) return false;
+        result = it->second;
+        return true;
+    }
+
+    void insert(const std::string& value, const std::string& result) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (values_.size() >= capacity_) {
+            values_.clear();
+        }
+        values_.emplace(value, result);
+    }
+
+public: // members
+
+    const size_t capacity_;
+
+    mutable std::atomic<size_t> hits_;
+    mutable std::atomic<size_t> misses_;
+    mutable std::atomic<uint64_t> nanoseconds_;
+
+private: // members
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, std::string> values_;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
 Type::Type(const std::string &name, const std::string &type) :
     name_(name),
     type_(type) {
 }
 
+void Type::memoise() {
+    static size_t capacity = eckit::Resource<size_t>("fdbTypeCacheSize;$FDB_TYPE_CACHE_SIZE", 4096);
+    if (capacity > 0) {
+        memo_.reset(new Memo(capacity));
+    }
+}
+
+bool Type::canonical(const std::string&) const {
+    return false;
+}
+
+std::string Type::canonicalise(const std::string &keyword, const std::string &value) const {
+
+    if (!memo_) {
+        return toKey(keyword, value);
+    }
+
+    std::string result;
+    if (canonical(value)) {
+        ++memo_->hits_;
+        return value;
+    }
+    if (memo_->find(value, result)) {
+        ++memo_->hits_;
+        return result;
+    }
+
+    // n.b. values that fail to canonicalise throw, and are not memoised
+
+    auto start = std::chrono::steady_clock::now();
+    result = toKey(keyword, value);
+    memo_->nanoseconds_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    ++memo_->misses_;
+
+    memo_->insert(value, result);
+    return result;
+}
+
+Type::CanonicalisationStats Type::canonicalisationStats() const {
+    CanonicalisationStats stats{0, 0, 0};
+    if (memo_) {
+        stats.hits = memo_->hits_;
+        stats.misses = memo_->misses_;
+        stats.elapsed = memo_->nanoseconds_ / 1e9;
+    }
+    return stats;
+}
+
 Type::~Type() {
 }
 
@@ -16,6 +16,7 @@
 #ifndef fdb5_Type_H
 #define fdb5_Type_H
 
+#include <memory>
 #include <string>
 
 #include "eckit/memory/NonCopyable.h"
@@ -38,6 +39,14 @@ class Notifier;
 
 class Type : private eckit::NonCopyable {
 
+public: // types
+
+    struct CanonicalisationStats {
+        size_t hits;     // memoised, or already canonical
+        size_t misses;
+        double elapsed;  // seconds spent canonicalising the misses
+    };
+
 public: // methods
 
     Type(const std::string &name, const std::string &type);
@@ -50,6 +59,12 @@ public: // methods
     virtual std::string toKey(const std::string &keyword,
                               const std::string &value) const ;
 
+    /// As toKey, but memoising the results of the types that parse the value to canonicalise it
+    std::string canonicalise(const std::string &keyword,
+                             const std::string &value) const;
+
+    CanonicalisationStats canonicalisationStats() const;
+
     virtual void getValues(const metkit::mars::MarsRequest &request,
                            const std::string &keyword,
                            eckit::StringList &values,
@@ -66,6 +81,14 @@ public: // class methods
 
     const std::string &type() const;
 
+protected: // methods
+
+    /// Called by the constructors of types whose toKey is expensive
+    void memoise();
+
+    /// Whether the value is known to be canonical already, without parsing it
+    virtual bool canonical(const std::string &value) const;
+
 private: // methods
 
     virtual void print( std::ostream &out ) const = 0;
@@ -75,6 +98,11 @@ protected: // members
     std::string name_;
     std::string type_;
 
+private: // members
+
+    class Memo;
+    std::unique_ptr<Memo> memo_;
+
 };
 
 //----------------------------------------------------------------------------------------------------------------------
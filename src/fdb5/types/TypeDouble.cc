@@ -21,6 +21,7 @@ namespace fdb5 {
 
 TypeDouble::TypeDouble(const std::string &name, const std::string &type) :
   Type(name, type) {
+    memoise();
 }
 
 TypeDouble::~TypeDouble() {
@@ -38,6 +39,16 @@ std::string TypeDouble::toKey(const std::string&,
   }
 }
 
+// Integers without leading zeros, small enough to be held exactly as a double
+
+bool TypeDouble::canonical(const std::string& value) const {
+    if (value.empty() || value.size() > 15 || (value[0] == '0' && value.size() > 1)) return false;
+    for (char c : value) {
+        if (c < '0' || c > '9') return false;
+    }
+    return true;
+}
+
 void TypeDouble::getValues(const metkit::mars::MarsRequest& request,
                            const std::string& keyword,
                            eckit::StringList& values,
@@ -41,6 +41,8 @@ public: // methods
 
 private: // methods
 
+    virtual bool canonical(const std::string& value) const override;
+
     virtual void print( std::ostream &out ) const override;
 
 };
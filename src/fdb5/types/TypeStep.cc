@@ -28,6 +28,7 @@ namespace fdb5 {
 
 TypeStep::TypeStep(const std::string &name, const std::string &type) :
     Type(name, type) {
+    memoise();
 }
 
 TypeStep::~TypeStep() {
@@ -39,6 +40,16 @@ std::string TypeStep::toKey(const std::string&,
     return StepRange(value);
 }
 
+// Whole steps without leading zeros are their own step range
+
+bool TypeStep::canonical(const std::string& value) const {
+    if (value.empty() || (value[0] == '0' && value.size() > 1)) return false;
+    for (char c : value) {
+        if (c < '0' || c > '9') return false;
+    }
+    return true;
+}
+
 bool TypeStep::match(const std::string&, const std::string& value1, const std::string& value2) const
 {
     if(value1 == value2) { return true; }
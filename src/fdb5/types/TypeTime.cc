@@ -24,6 +24,7 @@ namespace fdb5 {
 
 TypeTime::TypeTime(const std::string &name, const std::string &type) :
     Type(name, type) {
+    memoise();
 }
 
 TypeTime::~TypeTime() {
@@ -56,6 +57,16 @@ std::string TypeTime::toKey(const std::string& keyword,
     return oss.str();
 }
 
+// Already in the form hhmm
+
+bool TypeTime::canonical(const std::string& value) const {
+    if (value.size() != 4) return false;
+    for (char c : value) {
+        if (c < '0' || c > '9') return false;
+    }
+    return (value[0] - '0') * 10 + (value[1] - '0') < 24 && value[2] < '6';
+}
+
 void TypeTime::print(std::ostream &out) const {
     out << "TypeTime[name=" << name_ << "]";
 }
@@ -38,6 +38,8 @@ public: // methods
 
 private: // methods
 
+    virtual bool canonical(const std::string& value) const override;
+
     virtual void print( std::ostream &out ) const override;
 
 };
@@ -0,0 +1,53 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+/// @date   Oct 2026
+
+#ifndef fdb_testing_TocConfig_H
+#define fdb_testing_TocConfig_H
+
+#include <vector>
+
+#include "eckit/config/LocalConfiguration.h"
+#include "eckit/filesystem/PathName.h"
+
+#include "fdb5/config/Config.h"
+
+namespace fdb {
+namespace test {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// The configuration of a local TOC FDB storing everything under one root (e.g. an
+/// eckit::TmpDir), together with any other settings given
+
+inline fdb5::Config tocConfig(const eckit::PathName& root,
+                              const eckit::LocalConfiguration& extra = eckit::LocalConfiguration()) {
+
+    eckit::LocalConfiguration rootConfig;
+    rootConfig.set("path", root.asString());
+
+    eckit::LocalConfiguration space;
+    space.set("handler", "Default");
+    space.set("roots", std::vector<eckit::LocalConfiguration>{rootConfig});
+
+    eckit::LocalConfiguration config(extra);
+    config.set("type", "local");
+    config.set("engine", "toc");
+    config.set("spaces", std::vector<eckit::LocalConfiguration>{space});
+    return fdb5::Config(config);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+}  // namespace test
+}  // namespace fdb
+
+#endif
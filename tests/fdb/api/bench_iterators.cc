@@ -0,0 +1,104 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+/// @date   Oct 2026
+
+/// Element throughput of the APIAsyncIterator with each of the queues it can use, and the
+/// latency of many short lived iterators sharing the AsyncExecutor.
+///
+/// Usage: fdb5_api_bench_iterators [elements]
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "eckit/exception/Exceptions.h"
+#include "eckit/log/Log.h"
+#include "eckit/log/Timer.h"
+#include "eckit/runtime/Main.h"
+
+#include "fdb5/api/helpers/APIIterator.h"
+#include "fdb5/api/helpers/AsyncExecutor.h"
+#include "fdb5/api/helpers/SPSCQueue.h"
+
+namespace {
+
+template <typename Queue>
+double asyncThroughput(size_t n) {
+
+    fdb5::APIIterator<std::string> it(new fdb5::APIAsyncIterator<std::string, Queue>([n](Queue& queue) {
+        for (size_t i = 0; i < n; ++i) queue.emplace("element");
+    }));
+
+    eckit::Timer timer;
+    std::string elem;
+    size_t count = 0;
+    while (it.next(elem)) ++count;
+    ASSERT(count == n);
+
+    return n / std::max(timer.elapsed(), 1e-9);
+}
+
+/// Rounds of concurrent iterators, each timed until it has produced all its elements
+void asyncLatency(size_t rounds) {
+
+    fdb5::AsyncExecutor& executor(fdb5::AsyncExecutor::instance());
+
+    using Queue = fdb5::SPSCQueue<int>;
+    const size_t concurrent = 8;
+
+    fdb5::AsyncExecutor::Stats before = executor.stats();
+
+    std::vector<double> latencies;
+    for (size_t round = 0; round < rounds; ++round) {
+        std::vector<std::unique_ptr<eckit::Timer>> timers;
+        std::vector<fdb5::APIIterator<int>> iterators;
+        for (size_t i = 0; i < concurrent; ++i) {
+            timers.emplace_back(new eckit::Timer);
+            iterators.emplace_back(new fdb5::APIAsyncIterator<int, Queue>([](Queue& queue) {
+                for (int n = 0; n < 100; ++n) queue.emplace(n);
+            }));
+        }
+        for (size_t i = 0; i < concurrent; ++i) {
+            int elem;
+            while (iterators[i].next(elem)) {}
+            latencies.push_back(timers[i]->elapsed());
+        }
+    }
+
+    fdb5::AsyncExecutor::Stats after = executor.stats();
+
+    std::sort(latencies.begin(), latencies.end());
+    eckit::Log::info() << rounds * concurrent << " async iterators used "
+                       << (after.threadsCreated - before.threadsCreated) << " new threads. Latency p50 "
+                       << latencies[latencies.size() / 2] << "s, p99 " << latencies[latencies.size() * 99 / 100]
+                       << "s, max " << latencies.back() << "s" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+
+    eckit::Main::initialise(argc, argv);
+
+    size_t n = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    double locking  = asyncThroughput<eckit::Queue<std::string>>(n);
+    double lockFree = asyncThroughput<fdb5::SPSCQueue<std::string>>(n);
+
+    eckit::Log::info() << "APIAsyncIterator throughput (elements/s): eckit::Queue " << size_t(locking)
+                       << ", SPSCQueue " << size_t(lockFree) << std::endl;
+
+    asyncLatency(std::max<size_t>(1, n / 5000));
+
+    return 0;
+}
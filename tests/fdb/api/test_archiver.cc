@@ -0,0 +1,196 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "eckit/exception/Exceptions.h"
+#include "eckit/filesystem/PathName.h"
+#include "eckit/filesystem/TmpDir.h"
+#include "eckit/io/AutoClose.h"
+#include "eckit/io/FileHandle.h"
+#include "eckit/message/Message.h"
+#include "eckit/message/Reader.h"
+#include "eckit/testing/Test.h"
+
+#include "fdb5/fdb5_config.h"
+#include "fdb5/api/FDB.h"
+#include "fdb5/api/helpers/FDBToolRequest.h"
+#include "fdb5/api/helpers/ListIterator.h"
+#include "fdb5/config/Config.h"
+#include "fdb5/database/Key.h"
+#include "fdb5/message/MessageArchiver.h"
+
+#include "TocConfig.h"
+
+using namespace eckit::testing;
+using namespace eckit;
+
+
+namespace fdb {
+namespace test {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+#if fdb5_HAVE_GRIB
+
+/// The messages of the test data, in one file
+class Messages {
+
+public: // methods
+
+    Messages(const eckit::PathName& directory) :
+        path_(directory / "messages.grib") {
+
+        eckit::FileHandle out(path_);
+        out.openForWrite(0);
+        eckit::AutoClose closer(out);
+
+        for (const char* file : {"x138-300.grib", "x138-400.grib", "y138-400.grib"}) {
+            eckit::message::Reader reader{eckit::PathName(file)};
+            eckit::message::Message msg;
+            while ((msg = reader.next())) {
+                out.write(msg.data(), msg.length());
+                index_[content(msg)] = messages_++;
+            }
+        }
+    }
+
+    const eckit::PathName& path() const { return path_; }
+    size_t size() const { return messages_; }
+
+    /// The position of the message in the file
+    size_t index(const eckit::message::Message& msg) const {
+        auto it = index_.find(content(msg));
+        ASSERT(it != index_.end());
+        return it->second;
+    }
+
+private: // methods
+
+    static std::string content(const eckit::message::Message& msg) {
+        return std::string(static_cast<const char*>(msg.data()), msg.length());
+    }
+
+private: // members
+
+    eckit::PathName path_;
+    size_t messages_ = 0;
+    std::map<std::string, size_t> index_;
+};
+
+/// Decodes the first messages slowest, so that they complete out of order. Optionally fails to
+/// decode one of them.
+class TestArchiver : public fdb5::MessageArchiver {
+
+public: // methods
+
+    TestArchiver(const fdb5::Config& config, const Messages& messages, size_t failAt = size_t(-1)) :
+        fdb5::MessageArchiver(fdb5::Key(), false, false, config),
+        messages_(messages),
+        failAt_(failAt) {}
+
+private: // methods
+
+    eckit::message::Message patch(const eckit::message::Message& msg) override {
+        size_t i = messages_.index(msg);
+        if (i < 8) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(4 * (8 - i)));
+        }
+        if (i == failAt_) {
+            throw eckit::BadValue("Failing to decode message " + std::to_string(i));
+        }
+        return msg;
+    }
+
+private: // members
+
+    const Messages& messages_;
+    size_t failAt_;
+};
+
+/// The offset and length of each archived field, which reflect the order they were archived in
+using Locations = std::map<fdb5::Key, std::pair<unsigned long long, unsigned long long>>;
+
+Locations archived(const fdb5::Config& config) {
+
+    Locations result;
+
+    fdb5::FDB fdb(config);
+    fdb5::ListIterator it = fdb.list(fdb5::FDBToolRequest({}, true));
+    fdb5::ListElement elem;
+    while (it.next(elem)) {
+        result[elem.combinedKey()] = std::make_pair((unsigned long long)(elem.location().offset()),
+                                                    (unsigned long long)(elem.location().length()));
+    }
+    return result;
+}
+
+Locations archive(size_t decodeThreads, size_t failAt = size_t(-1)) {
+
+    eckit::TmpDir root;
+    fdb5::Config config(tocConfig(root));
+
+    Messages messages(root);
+    EXPECT(messages.size() > 4);
+
+    TestArchiver archiver(config, messages, failAt);
+    archiver.decodeThreads(decodeThreads);
+
+    eckit::FileHandle source(messages.path());
+    source.openForRead();
+    eckit::AutoClose closer(source);
+
+    if (failAt < messages.size()) {
+        EXPECT_THROWS_AS(archiver.archive(source), eckit::BadValue);
+    } else {
+        archiver.archive(source);
+    }
+    archiver.flush();
+
+    return archived(config);
+}
+
+CASE( "messages_decoded_on_threads_are_archived_in_order" ) {
+
+    Locations sequential = archive(0);
+    EXPECT(!sequential.empty());
+
+    for (size_t threads : {1, 3, 16}) {
+        EXPECT(archive(threads) == sequential);
+    }
+}
+
+CASE( "decoding_errors_are_rethrown_after_archiving_the_preceding_messages" ) {
+
+    for (size_t failAt : {0, 3}) {
+
+        Locations sequential = archive(0, failAt);
+        EXPECT(sequential.empty() == (failAt == 0));
+
+        for (size_t threads : {1, 3, 16}) {
+            EXPECT(archive(threads, failAt) == sequential);
+        }
+    }
+}
+
+#endif  // fdb5_HAVE_GRIB
+
+//----------------------------------------------------------------------------------------------------------------------
+
+}  // namespace test
+}  // namespace fdb
+
+int main(int argc, char **argv)
+{
+    return run_tests ( argc, argv );
+}
@@ -0,0 +1,139 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <string>
+#include <vector>
+
+#include "eckit/filesystem/PathName.h"
+#include "eckit/message/Message.h"
+#include "eckit/message/Reader.h"
+#include "eckit/testing/Test.h"
+
+#include "fdb5/fdb5_config.h"
+#include "fdb5/database/Key.h"
+#include "fdb5/message/MessageDecoder.h"
+
+using namespace eckit::testing;
+using namespace eckit;
+
+
+namespace fdb {
+namespace test {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+#if fdb5_HAVE_GRIB
+
+std::vector<eckit::message::Message> readMessages(const std::vector<std::string>& paths) {
+    std::vector<eckit::message::Message> messages;
+    for (const std::string& path : paths) {
+        eckit::message::Reader reader{eckit::PathName(path)};
+        eckit::message::Message msg;
+        while ((msg = reader.next())) {
+            messages.push_back(msg);
+        }
+    }
+    return messages;
+}
+
+CASE( "Duplicate messages are detected" ) {
+
+    std::vector<eckit::message::Message> messages = readMessages({"x138-300.grib"});
+    EXPECT(!messages.empty());
+
+    fdb5::MessageDecoder decoder(true);
+
+    for (const auto& msg : messages) {
+        fdb5::Key key;
+        EXPECT_NO_THROW(decoder.messageToKey(msg, key));
+    }
+
+    fdb5::Key key;
+    EXPECT_THROWS_AS(decoder.messageToKey(messages.front(), key), eckit::SeriousBug);
+}
+
+#endif  // fdb5_HAVE_GRIB
+
+/// Checks keys for duplicates directly, without decoding messages
+class DuplicatesChecker : public fdb5::MessageDecoder {
+public:
+    DuplicatesChecker(bool exact, size_t window) : fdb5::MessageDecoder(true, exact, window) {}
+    using fdb5::MessageDecoder::checkDuplicate;
+};
+
+fdb5::Key fieldKey(size_t step, const std::string& param = "167") {
+    fdb5::Key key;
+    key.set("class", "rd");
+    key.set("expver", "xxxx");
+    key.set("step", std::to_string(step));
+    key.set("param", param);
+    return key;
+}
+
+CASE( "Duplicate keys are detected by hash or exactly" ) {
+
+    for (bool exact : {false, true}) {
+
+        DuplicatesChecker checker(exact, 0);
+
+        for (size_t step = 0; step < 100; ++step) {
+            EXPECT_NO_THROW(checker.checkDuplicate(fieldKey(step)));
+            EXPECT_NO_THROW(checker.checkDuplicate(fieldKey(step, "168")));
+        }
+
+        EXPECT_THROWS_AS(checker.checkDuplicate(fieldKey(0)), eckit::SeriousBug);
+        EXPECT_THROWS_AS(checker.checkDuplicate(fieldKey(99, "168")), eckit::SeriousBug);
+
+        // The same values, under other keywords, are another key
+
+        fdb5::Key other;
+        other.set("class", "rd");
+        other.set("expver", "xxxx");
+        other.set("levelist", "0");
+        other.set("param", "167");
+        EXPECT_NO_THROW(checker.checkDuplicate(other));
+        EXPECT_THROWS_AS(checker.checkDuplicate(other), eckit::SeriousBug);
+    }
+}
+
+CASE( "Duplicate keys are only remembered within the window" ) {
+
+    for (bool exact : {false, true}) {
+
+        DuplicatesChecker checker(exact, 3);
+
+        for (size_t step = 0; step < 10; ++step) {
+            EXPECT_NO_THROW(checker.checkDuplicate(fieldKey(step)));
+        }
+
+        // Steps 7, 8 and 9 are remembered. A rejected duplicate doesn't count towards the window.
+
+        EXPECT_THROWS_AS(checker.checkDuplicate(fieldKey(9)), eckit::SeriousBug);
+        EXPECT_THROWS_AS(checker.checkDuplicate(fieldKey(7)), eckit::SeriousBug);
+        EXPECT_NO_THROW(checker.checkDuplicate(fieldKey(6)));
+
+        // Now 8, 9 and 6
+
+        EXPECT_NO_THROW(checker.checkDuplicate(fieldKey(7)));
+        EXPECT_THROWS_AS(checker.checkDuplicate(fieldKey(6)), eckit::SeriousBug);
+        EXPECT_THROWS_AS(checker.checkDuplicate(fieldKey(7)), eckit::SeriousBug);
+        EXPECT_NO_THROW(checker.checkDuplicate(fieldKey(8)));
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+}  // namespace test
+}  // namespace fdb
+
+int main(int argc, char **argv)
+{
+    return run_tests ( argc, argv );
+}
@@ -0,0 +1,166 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "eckit/testing/Test.h"
+
+#include "metkit/mars/MarsRequest.h"
+
+#include "fdb5/api/helpers/ListIterator.h"
+#include "fdb5/database/Key.h"
+#include "fdb5/toc/TocFieldLocation.h"
+
+using namespace eckit::testing;
+using namespace eckit;
+
+
+namespace fdb {
+namespace test {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// A field of a forecast, split into key parts as the TOC catalogue does. The location's
+/// length identifies the element.
+
+fdb5::ListElement field(const std::string& step, const std::string& param, size_t length, time_t timestamp) {
+
+    fdb5::Key db;
+    db.set("class", "rd");
+    db.set("expver", "xxxx");
+    fdb5::Key index;
+    index.set("type", "fc");
+    fdb5::Key datum;
+    datum.set("step", step);
+    datum.set("param", param);
+
+    std::shared_ptr<const fdb5::FieldLocation> location(
+        new fdb5::TocFieldLocation(eckit::PathName("/a/b/data"), eckit::Offset(0), eckit::Length(length), fdb5::Key()));
+    return fdb5::ListElement(std::vector<fdb5::Key>{db, index, datum}, location, timestamp);
+}
+
+std::vector<size_t> lengths(const fdb5::ListElementDeduplicator& fields) {
+    std::vector<size_t> result;
+    for (const fdb5::ListElement& elem : fields.elements()) {
+        result.push_back(size_t(elem.location().length()));
+    }
+    return result;
+}
+
+CASE( "deduplicator_keeps_the_newest_field_in_first_seen_order" ) {
+
+    fdb5::ListElementDeduplicator fields;
+
+    fields.add(field("0", "167", 100, 10));
+    fields.add(field("6", "167", 200, 10));
+    fields.add(field("0", "167", 101, 20));  // newer, replaces 100
+    fields.add(field("6", "167", 201, 5));   // older, ignored
+    fields.add(field("0", "168", 300, 10));
+
+    EXPECT(lengths(fields) == std::vector<size_t>({101, 200, 300}));
+    EXPECT(fields.elements()[0].timestamp() == 20);
+}
+
+CASE( "deduplicator_matches_keys_however_they_are_split" ) {
+
+    fdb5::ListElementDeduplicator fields;
+
+    fields.add(field("0", "167", 100, 10));
+
+    // The same keywords and values, in different key parts
+
+    fdb5::Key db;
+    db.set("class", "rd");
+    fdb5::Key index;
+    index.set("expver", "xxxx");
+    index.set("type", "fc");
+    index.set("step", "0");
+    fdb5::Key datum;
+    datum.set("param", "167");
+
+    std::shared_ptr<const fdb5::FieldLocation> location(
+        new fdb5::TocFieldLocation(eckit::PathName("/a/b/data"), eckit::Offset(0), eckit::Length(400), fdb5::Key()));
+    fields.add(fdb5::ListElement(std::vector<fdb5::Key>{db, index, datum}, location, 20));
+
+    EXPECT(lengths(fields) == std::vector<size_t>({400}));
+}
+
+CASE( "deduplicator_confirms_hash_matches" ) {
+
+    // Every field has the same hash, so only comparing the keys tells them apart
+
+    fdb5::ListElementDeduplicator fields([](const fdb5::ListElement&) -> uint64_t { return 42; });
+
+    fields.add(field("0", "167", 100, 10));
+    fields.add(field("6", "167", 200, 10));
+    fields.add(field("0", "168", 300, 10));
+    fields.add(field("6", "167", 201, 20));
+    fields.add(field("0", "168", 301, 5));
+
+    EXPECT(lengths(fields) == std::vector<size_t>({100, 201, 300}));
+}
+
+CASE( "deduplicator_reports_no_vacancies_for_a_full_cube" ) {
+
+    fdb5::ListElementDeduplicator fields;
+    EXPECT(fields.vacantRequests().empty());
+
+    size_t length = 100;
+    for (const char* step : {"0", "6", "12"}) {
+        for (const char* param : {"167", "168"}) {
+            fields.add(field(step, param, length++, 10));
+        }
+    }
+
+    // Duplicates don't count twice
+
+    fields.add(field("6", "168", length++, 20));
+
+    EXPECT(fields.elements().size() == 6);
+    EXPECT(fields.vacantRequests().empty());
+}
+
+CASE( "deduplicator_reports_the_fields_missing_from_a_partial_cube" ) {
+
+    fdb5::ListElementDeduplicator fields;
+
+    fields.add(field("0", "167", 100, 10));
+    fields.add(field("0", "168", 101, 10));
+    fields.add(field("6", "167", 102, 10));
+    fields.add(field("6", "167", 103, 20));
+
+    std::vector<metkit::mars::MarsRequest> vacant = fields.vacantRequests();
+    EXPECT(vacant.size() == 1);
+    EXPECT(vacant[0].values("step") == std::vector<std::string>{"6"});
+    EXPECT(vacant[0].values("param") == std::vector<std::string>{"168"});
+
+    // Where each value appears equally often, but the values don't all combine
+
+    fdb5::ListElementDeduplicator diagonal;
+    diagonal.add(field("0", "167", 100, 10));
+    diagonal.add(field("6", "168", 101, 10));
+
+    vacant = diagonal.vacantRequests();
+    size_t missing = 0;
+    for (const auto& request : vacant) missing += request.count();
+    EXPECT(missing == 2);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+}  // namespace test
+}  // namespace fdb
+
+int main(int argc, char **argv)
+{
+    return run_tests ( argc, argv );
+}
@@ -13,17 +13,22 @@
  * (Project ID: 671951) www.nextgenio.eu
  */
 
+#include <algorithm>
 #include <cstdlib>
 
+#include "eckit/filesystem/TmpDir.h"
 #include "eckit/testing/Test.h"
+#include "eckit/utils/RendezvousHash.h"
 #include "eckit/utils/Translator.h"
 
 #include "metkit/mars/TypeAny.h"
 
 #include "fdb5/config/Config.h"
 #include "fdb5/api/helpers/FDBToolRequest.h"
+#include "fdb5/api/helpers/ListIterator.h"
 
 #include "ApiSpy.h"
+#include "TocConfig.h"
 
 using namespace eckit::testing;
 using namespace eckit;
@@ -201,6 +206,154 @@ CASE( "retrieves_distributed_according_to_dist" ) {
     }
 }
 
+fdb5::Key fieldKey(const std::string& step) {
+    fdb5::Key key;
+    key.set("class", "rd");
+    key.set("expver", "xxxx");
+    key.set("stream", "oper");
+    key.set("date", "20201102");
+    key.set("time", "0000");
+    key.set("domain", "g");
+    key.set("type", "fc");
+    key.set("levtype", "sfc");
+    key.set("step", step);
+    key.set("param", "167");
+    return key;
+}
+
+/// A request for the fields of fieldKey() with the given steps. n.b. values are used as given.
+
+metkit::mars::MarsRequest fieldRequest(const std::vector<std::string>& steps) {
+    metkit::mars::MarsRequest req;
+    for (const auto& kv : fieldKey("0").keyDict()) {
+        std::vector<std::string> values = (kv.first == "step") ? steps : std::vector<std::string>{kv.second};
+        req.setValuesTyped(new metkit::mars::TypeAny(kv.first), values);
+    }
+    return req;
+}
+
+size_t inspectAll(fdb5::FDB& fdb, const metkit::mars::MarsRequest& req) {
+    size_t count = 0;
+    fdb5::ListIterator it = fdb.inspect(req);
+    fdb5::ListElement elem;
+    while (it.next(elem)) ++count;
+    return count;
+}
+
+CASE( "hashed_retrieves_probe_the_preferred_lane" ) {
+
+    const char* fallbacks[] = {"none", "sequential", "parallel"};
+
+    for (const char* fallback : fallbacks) {
+
+        fdb5::Config cfg = defaultConfig();
+        cfg.set("hashedRetrieve", true);
+        cfg.set("hashedRetrieveFallback", fallback);
+
+        fdb5::FDB fdb(cfg);
+        EXPECT(ApiSpy::knownSpies().size() == 3);
+        ApiSpy& spy1(*ApiSpy::knownSpies()[0]);
+        ApiSpy& spy2(*ApiSpy::knownSpies()[1]);
+        ApiSpy& spy3(*ApiSpy::knownSpies()[2]);
+
+        // Archive some fields, to find out where they live
+
+        std::vector<std::string> steps = {"1", "2", "3", "4", "5", "6"};
+        std::vector<int> data = {1, 2, 3, 4, 5};
+
+        for (const std::string& step : steps) {
+            fdb.archive(fieldKey(step), data.data(), data.size()*sizeof(int));
+        }
+        fdb.flush();
+
+        EXPECT(inspectAll(fdb, fieldRequest(steps)) == 0);
+
+        // The spies never find anything, so each field is looked for once on the lane it was
+        // archived to, and then on all the other lanes unless fallback is disabled. Each lane
+        // is sent one request for all the fields it is asked for at once.
+
+        ApiSpy* spies[] = {&spy1, &spy2, &spy3};
+        for (ApiSpy* spy : spies) {
+            if (std::string(fallback) == "none") {
+                std::vector<std::string> archived;
+                for (const auto& a : spy->archives()) archived.push_back(std::get<0>(a).get("step"));
+                EXPECT(spy->counts().inspect == (archived.empty() ? 0 : 1));
+                if (!archived.empty()) {
+                    EXPECT(spy->retrieves()[0].values("step") == archived);
+                }
+            } else {
+                EXPECT(spy->counts().inspect <= (std::string(fallback) == "parallel" ? 2 : 3));
+                std::vector<std::string> asked;
+                for (const auto& r : spy->retrieves()) {
+                    asked.insert(asked.end(), r.values("step").begin(), r.values("step").end());
+                }
+                std::sort(asked.begin(), asked.end());
+                EXPECT(asked == steps);
+            }
+        }
+    }
+}
+
+CASE( "hashed_retrieves_canonicalise_the_request" ) {
+
+    fdb5::Config cfg = defaultConfig();
+    cfg.set("hashedRetrieve", true);
+    cfg.set("hashedRetrieveFallback", "none");
+
+    fdb5::FDB fdb(cfg);
+    EXPECT(ApiSpy::knownSpies().size() == 3);
+
+    std::vector<int> data = {1, 2, 3, 4, 5};
+    for (const std::string& step : {"6", "12", "18"}) {
+        fdb.archive(fieldKey(step), data.data(), data.size()*sizeof(int));
+    }
+    fdb.flush();
+
+    // Steps are given as they might appear in a request, but are looked for as archived
+
+    EXPECT(inspectAll(fdb, fieldRequest({"06", "012", "18"})) == 0);
+
+    for (ApiSpy* spy : ApiSpy::knownSpies()) {
+        std::vector<std::string> archived;
+        for (const auto& a : spy->archives()) archived.push_back(std::get<0>(a).get("step"));
+        EXPECT(spy->counts().inspect == (archived.empty() ? 0 : 1));
+        if (!archived.empty()) {
+            EXPECT(spy->retrieves()[0].values("step") == archived);
+        }
+    }
+}
+
+CASE( "incomplete_or_unknown_requests_are_sent_to_all_lanes" ) {
+
+    fdb5::Config cfg = defaultConfig();
+    cfg.set("hashedRetrieve", true);
+    cfg.set("hashedRetrieveFallback", "none");
+
+    fdb5::FDB fdb(cfg);
+    EXPECT(ApiSpy::knownSpies().size() == 3);
+
+    std::vector<metkit::mars::MarsRequest> requests;
+
+    // Keywords missing, parameters named rather than numbered, and keywords the schema doesn't use
+
+    requests.push_back(fieldRequest({"0"}));
+    requests.back().unsetValues("param");
+
+    requests.push_back(fieldRequest({"0"}));
+    requests.back().setValuesTyped(new metkit::mars::TypeAny("param"), std::vector<std::string>{"2t"});
+
+    requests.push_back(fieldRequest({"0"}));
+    requests.back().setValuesTyped(new metkit::mars::TypeAny("number"), std::vector<std::string>{"1"});
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+        EXPECT(inspectAll(fdb, requests[i]) == 0);
+        for (ApiSpy* spy : ApiSpy::knownSpies()) {
+            EXPECT(spy->counts().inspect == i + 1);
+            EXPECT(spy->retrieves().back().params() == requests[i].params());
+        }
+    }
+}
+
 CASE( "lists_distributed_according_to_dist" ) {
 
     // Build FDB from default config
@@ -671,6 +824,192 @@ CASE( "control_distributed_according_to_dist" ) {
     }
 }
 
+CASE( "the_same_field_on_two_lanes_is_listed_in_lane_order" ) {
+
+    eckit::TmpDir root1;
+    eckit::TmpDir root2;
+
+    fdb5::Key key;
+    key.set("class", "rd");
+    key.set("expver", "xxxx");
+    key.set("stream", "oper");
+    key.set("date", "20201102");
+    key.set("time", "0000");
+    key.set("domain", "g");
+    key.set("type", "fc");
+    key.set("levtype", "sfc");
+    key.set("step", "0");
+    key.set("param", "167");
+
+    // n.b. archived to each lane directly, newest on the first. Different lengths tell them apart.
+
+    std::string second(1024, 'b');
+    std::string first(2048, 'a');
+    {
+        fdb5::FDB lane2{tocConfig(root2)};
+        lane2.archive(key, second.data(), second.size());
+        lane2.flush();
+    }
+    {
+        fdb5::FDB lane1{tocConfig(root1)};
+        lane1.archive(key, first.data(), first.size());
+        lane1.flush();
+    }
+
+    fdb5::Config cfg;
+    cfg.set("type", "dist");
+    cfg.set("lanes", std::vector<LocalConfiguration>{tocConfig(root1), tocConfig(root2)});
+
+    fdb5::FDBToolRequest request = fdb5::FDBToolRequest::requestsFromString(
+        "class=rd,expver=xxxx,stream=oper,date=20201102,time=0000,domain=g,type=fc,levtype=sfc,step=0,param=167")[0];
+
+    // Whichever lane answers first, the listing doesn't change
+
+    for (int i = 0; i < 20; ++i) {
+
+        fdb5::FDB fdb(cfg);
+
+        std::vector<size_t> lengths;
+        fdb5::ListIterator all = fdb.list(request);
+        fdb5::ListElement elem;
+        while (all.next(elem)) lengths.push_back(size_t(elem.location().length()));
+        EXPECT(lengths == std::vector<size_t>({first.size(), second.size()}));
+
+        size_t count = 0;
+        fdb5::ListIterator deduplicated = fdb.list(request, true);
+        while (deduplicated.next(elem)) {
+            EXPECT(size_t(elem.location().length()) == first.size());
+            ++count;
+        }
+        EXPECT(count == 1);
+    }
+}
+
+CASE( "hashed_retrieves_find_fields_on_every_lane" ) {
+
+    eckit::TmpDir root1;
+    eckit::TmpDir root2;
+    eckit::TmpDir root3;
+
+    std::vector<std::string> steps = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "10", "11"};
+
+    fdb5::Config cfg;
+    cfg.set("type", "dist");
+    cfg.set("lanes", std::vector<LocalConfiguration>{tocConfig(root1), tocConfig(root2), tocConfig(root3)});
+    cfg.set("hashedRetrieve", true);
+    cfg.set("hashedRetrieveFallback", "none");
+
+    // Each field is archived to one lane, and identified by its length
+
+    {
+        fdb5::FDB fdb(cfg);
+        for (size_t i = 0; i < steps.size(); ++i) {
+            std::string data(100 + i, 'x');
+            fdb.archive(fieldKey(steps[i]), data.data(), data.size());
+        }
+        fdb.flush();
+    }
+
+    size_t archived = 0;
+    for (const eckit::PathName& root : std::vector<eckit::PathName>{root1, root2, root3}) {
+        fdb5::FDB lane{tocConfig(root)};
+        archived += inspectAll(lane, fieldRequest(steps));
+    }
+    EXPECT(archived == steps.size());
+
+    fdb5::FDB fdb(cfg);
+
+    // Looked up on each field's own lane, even where the request is spelled differently
+
+    std::vector<std::string> padded;
+    for (const std::string& step : steps) padded.push_back("0" + step);
+
+    for (const auto& req : {fieldRequest(steps), fieldRequest(padded)}) {
+        std::vector<size_t> lengths;
+        fdb5::ListIterator it = fdb.inspect(req);
+        fdb5::ListElement elem;
+        while (it.next(elem)) lengths.push_back(size_t(elem.location().length()));
+        EXPECT(lengths.size() == steps.size());
+        for (size_t i = 0; i < lengths.size(); ++i) {
+            EXPECT(lengths[i] == 100 + i);
+        }
+    }
+
+    // And found on all the lanes when the request is not hashed
+
+    metkit::mars::MarsRequest extra = fieldRequest(steps);
+    extra.setValuesTyped(new metkit::mars::TypeAny("number"), std::vector<std::string>{"1"});
+    EXPECT(inspectAll(fdb, extra) == steps.size());
+}
+
+CASE( "hashed_retrieves_fall_back_to_all_the_other_lanes" ) {
+
+    eckit::TmpDir root1;
+    eckit::TmpDir root2;
+    eckit::TmpDir root3;
+
+    std::vector<LocalConfiguration> laneConfigs = {tocConfig(root1), tocConfig(root2), tocConfig(root3)};
+    std::vector<std::string> steps = {"0", "1", "2", "3", "4", "5"};
+
+    // Work out each field's lane preferences, as DistFDB does
+
+    eckit::RendezvousHash hash;
+    for (const LocalConfiguration& laneConfig : laneConfigs) {
+        EXPECT(hash.addNode(fdb5::FDB(fdb5::Config(laneConfig)).id()));
+    }
+
+    std::vector<std::vector<size_t>> orders(steps.size());
+    for (size_t i = 0; i < steps.size(); ++i) {
+        hash.hashOrder(fieldKey(steps[i]).keyDict(), orders[i]);
+        EXPECT(orders[i].size() == laneConfigs.size());
+    }
+
+    // Put each field on every lane except the one it would have been archived to, with a
+    // length identifying the lane
+
+    for (size_t lane = 0; lane < laneConfigs.size(); ++lane) {
+        fdb5::FDB fdb{fdb5::Config(laneConfigs[lane])};
+        for (size_t i = 0; i < steps.size(); ++i) {
+            if (orders[i][0] == lane) continue;
+            std::string data(100 * (lane + 1) + i, 'x');
+            fdb.archive(fieldKey(steps[i]), data.data(), data.size());
+        }
+        fdb.flush();
+    }
+
+    const char* fallbacks[] = {"none", "sequential", "parallel"};
+
+    for (const std::string fallback : fallbacks) {
+
+        fdb5::Config cfg;
+        cfg.set("type", "dist");
+        cfg.set("lanes", laneConfigs);
+        cfg.set("hashedRetrieve", true);
+        cfg.set("hashedRetrieveFallback", fallback);
+
+        fdb5::FDB fdb(cfg);
+
+        std::vector<size_t> lengths;
+        fdb5::ListIterator it = fdb.inspect(fieldRequest(steps));
+        fdb5::ListElement elem;
+        while (it.next(elem)) lengths.push_back(size_t(elem.location().length()));
+
+        // Without fallback nothing is found. Sequentially, the next lane in order of preference
+        // answers. In parallel, every other lane does, in order of preference.
+
+        std::vector<size_t> expected;
+        for (size_t i = 0; i < steps.size(); ++i) {
+            if (fallback == "none") continue;
+            for (size_t n = 1; n < orders[i].size(); ++n) {
+                expected.push_back(100 * (orders[i][n] + 1) + i);
+                if (fallback == "sequential") break;
+            }
+        }
+
+        EXPECT(lengths == expected);
+    }
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 
 }  // namespace test
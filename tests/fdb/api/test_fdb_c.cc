@@ -9,15 +9,23 @@
  */
 
 #include <string.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "eckit/config/Resource.h"
 #include "eckit/filesystem/PathName.h"
 #include "eckit/io/Buffer.h"
 #include "eckit/io/DataHandle.h"
+#include "eckit/log/Log.h"
 #include "eckit/testing/Test.h"
 #include "fdb5/database/Key.h"
 
 #include "fdb5/api/fdb_c.h"
+#include "fdb5/api/helpers/AsyncExecutor.h"
 #include "fdb5/fdb5_config.h"
 
 using namespace eckit::testing;
@@ -205,6 +213,271 @@ CASE( "fdb_c - archive & list" ) {
 
 }
 
+CASE( "fdb_c - batch archive & list" ) {
+    fdb_handle_t* fdb;
+    fdb_new_handle(&fdb);
+
+    fdb_key_t* keys[2];
+    eckit::Buffer* bufs[2];
+    const char* data[2];
+    size_t lengths[2];
+
+    const char* levels[] = {"300", "400"};
+    for (int i = 0; i < 2; ++i) {
+        fdb_new_key(&keys[i]);
+        fdb_key_add(keys[i], "domain", "g");
+        fdb_key_add(keys[i], "stream", "oper");
+        fdb_key_add(keys[i], "levtype", "pl");
+        fdb_key_add(keys[i], "levelist", levels[i]);
+        fdb_key_add(keys[i], "date", "20191110");
+        fdb_key_add(keys[i], "time", "0000");
+        fdb_key_add(keys[i], "step", "0");
+        fdb_key_add(keys[i], "param", "138");
+        fdb_key_add(keys[i], "class", "rd");
+        fdb_key_add(keys[i], "type", "an");
+        fdb_key_add(keys[i], "expver", "xxxz");
+
+        eckit::PathName grib(std::string("x138-") + levels[i] + ".grib");
+        lengths[i] = grib.size();
+        bufs[i] = new eckit::Buffer(lengths[i]);
+        std::unique_ptr<DataHandle> dh(grib.fileHandle());
+        dh->openForRead();
+        dh->read(*bufs[i], lengths[i]);
+        dh->close();
+        data[i] = *bufs[i];
+    }
+
+    EXPECT(FDB_SUCCESS == fdb_archive_batch(fdb, keys, data, lengths, 0));
+    EXPECT(FDB_SUCCESS == fdb_archive_batch(fdb, keys, data, lengths, 2));
+    EXPECT(FDB_SUCCESS == fdb_flush(fdb));
+
+    fdb_request_t* request;
+    fdb_new_request(&request);
+    fdb_request_add1(request, "domain", "g");
+    fdb_request_add1(request, "stream", "oper");
+    fdb_request_add1(request, "levtype", "pl");
+    fdb_request_add(request, "levelist", levels, 2);
+    fdb_request_add1(request, "date", "20191110");
+    fdb_request_add1(request, "time", "0000");
+    fdb_request_add1(request, "step", "0");
+    fdb_request_add1(request, "param", "138");
+    fdb_request_add1(request, "class", "rd");
+    fdb_request_add1(request, "type", "an");
+    fdb_request_add1(request, "expver", "xxxz");
+
+    fdb_listiterator_t* it;
+    fdb_list(fdb, request, &it, true);
+
+    const char *uri;
+    size_t off, attr_len;
+    size_t count = 0;
+    while (fdb_listiterator_next(it) == FDB_SUCCESS) {
+        fdb_listiterator_attrs(it, &uri, &off, &attr_len);
+        EXPECT(attr_len == 3280398);
+        ++count;
+    }
+    EXPECT(count == 2);
+    fdb_delete_listiterator(it);
+
+    fdb_delete_request(request);
+    for (int i = 0; i < 2; ++i) {
+        fdb_delete_key(keys[i]);
+        delete bufs[i];
+    }
+    fdb_delete_handle(fdb);
+}
+
+CASE( "fdb_c - scatter read" ) {
+    fdb_handle_t* fdb;
+    fdb_new_handle(&fdb);
+
+    // Uses the fields archived in "fdb_c - batch archive & list"
+
+    const char* levels[] = {"300", "400"};
+
+    fdb_request_t* request;
+    fdb_new_request(&request);
+    fdb_request_add1(request, "domain", "g");
+    fdb_request_add1(request, "stream", "oper");
+    fdb_request_add1(request, "levtype", "pl");
+    fdb_request_add(request, "levelist", levels, 2);
+    fdb_request_add1(request, "date", "20191110");
+    fdb_request_add1(request, "time", "0000");
+    fdb_request_add1(request, "step", "0");
+    fdb_request_add1(request, "param", "138");
+    fdb_request_add1(request, "class", "rd");
+    fdb_request_add1(request, "type", "an");
+    fdb_request_add1(request, "expver", "xxxz");
+
+    fdb_scatterreader_t* sr;
+    EXPECT(FDB_SUCCESS == fdb_new_scatterreader(fdb, request, &sr));
+
+    size_t count;
+    EXPECT(FDB_SUCCESS == fdb_scatterreader_count(sr, &count));
+    EXPECT(count == 2);
+
+    size_t lengths[2];
+    EXPECT(FDB_SUCCESS == fdb_scatterreader_lengths(sr, lengths));
+
+    // Fields are returned in the order requested
+
+    std::vector<std::unique_ptr<eckit::Buffer>> buffers;
+    void* ptrs[2];
+    for (int i = 0; i < 2; ++i) {
+        EXPECT(lengths[i] == 3280398);
+        buffers.emplace_back(new eckit::Buffer(lengths[i]));
+        ptrs[i] = static_cast<char*>(*buffers[i]);
+    }
+
+    size_t tooSmall[] = {lengths[0], lengths[1] - 1};
+    EXPECT(FDB_ERROR_GENERAL_EXCEPTION == fdb_scatterreader_read(sr, ptrs, tooSmall, 0));
+
+    EXPECT(FDB_SUCCESS == fdb_scatterreader_read(sr, ptrs, lengths, 2));
+
+    for (int i = 0; i < 2; ++i) {
+        eckit::PathName grib(std::string("x138-") + levels[i] + ".grib");
+        eckit::Buffer expected(grib.size());
+        std::unique_ptr<DataHandle> dh(grib.fileHandle());
+        dh->openForRead();
+        dh->read(expected, expected.size());
+        dh->close();
+        EXPECT(::memcmp(static_cast<const char*>(expected), static_cast<const char*>(*buffers[i]), lengths[i]) == 0);
+    }
+
+    fdb_split_key_t* sk;
+    fdb_new_splitkey(&sk);
+    EXPECT(FDB_SUCCESS == fdb_scatterreader_splitkey(sr, 1, sk));
+    fdb_delete_splitkey(sk);
+
+    EXPECT(FDB_SUCCESS == fdb_scatterreader_cancel(sr));
+    EXPECT(FDB_ERROR_CANCELLED == fdb_scatterreader_read(sr, ptrs, lengths, 0));
+
+    EXPECT(FDB_SUCCESS == fdb_delete_scatterreader(sr));
+    fdb_delete_request(request);
+    fdb_delete_handle(fdb);
+}
+
+
+CASE( "fdb_c - scatter read cancelled from another thread" ) {
+    fdb_handle_t* fdb;
+    fdb_new_handle(&fdb);
+
+    // Enough fields that a read is still under way once the first has been read
+
+    const size_t nfields = 64;
+    const size_t length = 1024 * 1024;
+    std::vector<char> field(length, 'x');
+
+    std::vector<std::string> levels;
+    for (size_t i = 0; i < nfields; ++i) {
+        levels.push_back(std::to_string(i + 1));
+
+        fdb_key_t* key;
+        fdb_new_key(&key);
+        fdb_key_add(key, "domain", "g");
+        fdb_key_add(key, "stream", "oper");
+        fdb_key_add(key, "levtype", "pl");
+        fdb_key_add(key, "levelist", levels.back().c_str());
+        fdb_key_add(key, "date", "20191110");
+        fdb_key_add(key, "time", "0000");
+        fdb_key_add(key, "step", "0");
+        fdb_key_add(key, "param", "138");
+        fdb_key_add(key, "class", "rd");
+        fdb_key_add(key, "type", "an");
+        fdb_key_add(key, "expver", "xxxs");
+        EXPECT(FDB_SUCCESS == fdb_archive(fdb, key, field.data(), field.size()));
+        fdb_delete_key(key);
+    }
+    EXPECT(FDB_SUCCESS == fdb_flush(fdb));
+
+    std::vector<const char*> levelValues;
+    for (const std::string& level : levels) levelValues.push_back(level.c_str());
+
+    fdb_request_t* request;
+    fdb_new_request(&request);
+    fdb_request_add1(request, "domain", "g");
+    fdb_request_add1(request, "stream", "oper");
+    fdb_request_add1(request, "levtype", "pl");
+    fdb_request_add(request, "levelist", levelValues.data(), levelValues.size());
+    fdb_request_add1(request, "date", "20191110");
+    fdb_request_add1(request, "time", "0000");
+    fdb_request_add1(request, "step", "0");
+    fdb_request_add1(request, "param", "138");
+    fdb_request_add1(request, "class", "rd");
+    fdb_request_add1(request, "type", "an");
+    fdb_request_add1(request, "expver", "xxxs");
+
+    fdb_scatterreader_t* sr;
+    EXPECT(FDB_SUCCESS == fdb_new_scatterreader(fdb, request, &sr));
+
+    size_t count;
+    EXPECT(FDB_SUCCESS == fdb_scatterreader_count(sr, &count));
+    EXPECT(count == nfields);
+
+    std::vector<std::vector<char>> buffers(count, std::vector<char>(length, 0));
+    std::vector<void*> ptrs;
+    std::vector<size_t> sizes(count, length);
+    for (auto& b : buffers) ptrs.push_back(b.data());
+
+    auto busyThreads = [] {
+        fdb5::AsyncExecutor::Stats stats = fdb5::AsyncExecutor::instance().stats();
+        return stats.threads - stats.idleThreads;
+    };
+    size_t busyBefore = busyThreads();
+
+    // Cancel as soon as any field has been read in full, i.e. its last byte is written.
+    // n.b. volatile, as the buffers are being written by the workers
+
+    std::atomic<bool> done(false);
+    int cancelErr = -1;
+    std::chrono::steady_clock::time_point cancelled;
+    std::thread canceller([&] {
+        while (!done) {
+            for (const auto& b : buffers) {
+                if (static_cast<const volatile char*>(b.data())[length - 1] == 'x') {
+                    cancelled = std::chrono::steady_clock::now();
+                    cancelErr = fdb_scatterreader_cancel(sr);
+                    return;
+                }
+            }
+            std::this_thread::yield();
+        }
+    });
+
+    int err = fdb_scatterreader_read(sr, ptrs.data(), sizes.data(), 4);
+    std::chrono::steady_clock::time_point returned = std::chrono::steady_clock::now();
+    done = true;
+    canceller.join();
+
+    EXPECT(cancelErr == FDB_SUCCESS);
+    EXPECT(err == FDB_ERROR_CANCELLED);
+    EXPECT(returned - cancelled < std::chrono::seconds(1));
+
+    // The read stopped early: at most the fields in flight were completed after cancelling
+
+    size_t complete = 0;
+    for (const auto& b : buffers) {
+        if (b[length - 1] == 'x') ++complete;
+    }
+    eckit::Log::info() << complete << " of " << count << " fields read before cancelling" << std::endl;
+    EXPECT(complete >= 1);
+    EXPECT(complete < count);
+
+    // And no worker is left running, or writing to the buffers
+
+    std::vector<std::vector<char>> after(buffers);
+    for (int i = 0; i < 100 && busyThreads() != busyBefore; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT(busyThreads() == busyBefore);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT(buffers == after);
+
+    EXPECT(FDB_SUCCESS == fdb_delete_scatterreader(sr));
+    fdb_delete_request(request);
+    fdb_delete_handle(fdb);
+}
+
 
 #if fdb5_HAVE_GRIB
 CASE( "fdb_c - multiple archive & list" ) {
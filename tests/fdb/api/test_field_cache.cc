@@ -0,0 +1,265 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "eckit/filesystem/TmpDir.h"
+#include "eckit/io/Buffer.h"
+#include "eckit/io/DataHandle.h"
+#include "eckit/io/FileHandle.h"
+#include "eckit/testing/Test.h"
+
+#include "fdb5/api/FDB.h"
+#include "fdb5/api/helpers/FDBToolRequest.h"
+#include "fdb5/api/helpers/FieldCache.h"
+#include "fdb5/api/helpers/ListIterator.h"
+#include "fdb5/config/Config.h"
+#include "fdb5/database/Key.h"
+#include "fdb5/io/HandleGatherer.h"
+#include "fdb5/toc/TocFieldLocation.h"
+
+#include "TocConfig.h"
+
+using namespace eckit::testing;
+using namespace eckit;
+
+
+namespace fdb {
+namespace test {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+std::string readAll(eckit::DataHandle* handle) {
+    std::unique_ptr<eckit::DataHandle> dh(handle);
+    std::string result;
+    char buf[7];  // n.b. reads span the fields
+    dh->openForRead();
+    long n;
+    while ((n = dh->read(buf, sizeof(buf))) > 0) {
+        result.append(buf, n);
+    }
+    dh->close();
+    return result;
+}
+
+/// Fields stored one after the other in a file
+
+class FieldFile {
+public:
+
+    FieldFile(const eckit::PathName& path, const std::vector<std::string>& fields) : path_(path), fields_(fields) {
+        eckit::FileHandle fh(path_);
+        fh.openForWrite(0);
+        for (const std::string& field : fields_) {
+            offsets_.push_back(size_t(fh.position()));
+            fh.write(field.data(), field.size());
+        }
+        fh.close();
+    }
+
+    fdb5::ListElement element(size_t i, time_t timestamp = 1) const {
+        fdb5::Key key;
+        key.set("param", std::to_string(i));
+        std::shared_ptr<const fdb5::FieldLocation> location(
+            new fdb5::TocFieldLocation(path_, eckit::Offset(offsets_[i]), eckit::Length(fields_[i].size()), fdb5::Key()));
+        return fdb5::ListElement(std::vector<fdb5::Key>{key}, location, timestamp);
+    }
+
+private:
+
+    eckit::PathName path_;
+    std::vector<std::string> fields_;
+    std::vector<size_t> offsets_;
+};
+
+CASE( "field_cache_evicts_least_recently_used_and_stale_fields" ) {
+
+    fdb5::FieldCache cache(1000, 400);
+
+    auto field = [](size_t size) { return std::make_shared<const eckit::Buffer>(size); };
+
+    cache.insert("a", 1, field(300));
+    cache.insert("b", 1, field(300));
+    cache.insert("c", 1, field(300));
+    cache.insert("big", 1, field(500));
+
+    EXPECT(cache.count() == 3);
+    EXPECT(cache.size() == 900);
+    EXPECT(!cache.lookup("big", 1));
+
+    // Using "a" makes "b" the least recently used
+
+    EXPECT(cache.lookup("a", 1));
+    cache.insert("d", 1, field(300));
+    EXPECT(cache.lookup("a", 1));
+    EXPECT(!cache.lookup("b", 1));
+    EXPECT(cache.lookup("c", 1));
+    EXPECT(cache.size() == 900);
+
+    // A field in an older index doesn't replace the newer one, and doesn't match it
+
+    cache.insert("a", 0, field(100));
+    EXPECT(!cache.lookup("a", 0));
+    EXPECT(cache.lookup("a", 1)->size() == 300);
+
+    // Once a field is seen in a newer index, the cached copy is dropped
+
+    EXPECT(!cache.lookup("c", 2));
+    EXPECT(!cache.lookup("c", 1));
+    EXPECT(cache.count() == 2);
+    EXPECT(cache.size() == 600);
+
+    cache.insert("c", 2, field(200));
+    EXPECT(cache.lookup("c", 2)->size() == 200);
+}
+
+CASE( "read_through_handles_merge_and_cache_each_field" ) {
+
+    eckit::TmpDir dir;
+    std::vector<std::string> fields = {"first field", "the second field", "third"};
+    FieldFile file(dir / "data", fields);
+
+    for (bool sorted : {true, false}) {
+
+        auto cache = std::make_shared<fdb5::FieldCache>(1024, 1024);
+
+        // Out of order. Sorted, the handle reads in order of offset. Unsorted, in the order given.
+
+        std::vector<size_t> order = {2, 0, 1};
+        fdb5::HandleGatherer gatherer(sorted);
+        for (size_t i : order) {
+            EXPECT(!cache->cachedHandle(file.element(i)));
+            gatherer.add(cache->readThroughHandle(file.element(i)));
+        }
+
+        std::ostringstream handles;
+        handles << gatherer;
+        EXPECT(handles.str() == "1 handle");
+
+        std::string expected;
+        if (sorted) {
+            for (const std::string& field : fields) expected += field;
+        } else {
+            for (size_t i : order) expected += fields[i];
+        }
+        EXPECT(readAll(gatherer.dataHandle()) == expected);
+
+        // Each field is cached separately
+
+        EXPECT(cache->count() == fields.size());
+        for (size_t i = 0; i < fields.size(); ++i) {
+            EXPECT(readAll(cache->cachedHandle(file.element(i))) == fields[i]);
+        }
+
+        // ... until it is found in a newer index
+
+        EXPECT(!cache->cachedHandle(file.element(1, 2)));
+        EXPECT(cache->count() == fields.size() - 1);
+    }
+}
+
+CASE( "read_through_handles_only_cache_complete_fields" ) {
+
+    eckit::TmpDir dir;
+    std::vector<std::string> fields = {"first field", "the second field"};
+    FieldFile file(dir / "data", fields);
+
+    auto cache = std::make_shared<fdb5::FieldCache>(1024, 1024);
+
+    fdb5::HandleGatherer gatherer(false);
+    gatherer.add(cache->readThroughHandle(file.element(0)));
+    gatherer.add(cache->readThroughHandle(file.element(1)));
+
+    std::unique_ptr<eckit::DataHandle> dh(gatherer.dataHandle());
+    // Stop part way through the second field
+
+    char buf[16];
+    long done = 0;
+    dh->openForRead();
+    while (done < long(sizeof(buf))) {
+        long n = dh->read(buf + done, sizeof(buf) - done);
+        EXPECT(n > 0);
+        done += n;
+    }
+    dh->close();
+
+    EXPECT(cache->count() == 1);
+    EXPECT(readAll(cache->cachedHandle(file.element(0))) == fields[0]);
+    EXPECT(!cache->cachedHandle(file.element(1)));
+}
+
+CASE( "fdb_read_serves_repeated_retrieves_from_the_field_cache" ) {
+
+    eckit::TmpDir root;
+
+    fdb5::Config config(tocConfig(root));
+    config.set("fieldCacheSize", 1024 * 1024);
+
+    fdb5::FDB fdb(config);
+
+    auto key = [](const std::string& step) {
+        fdb5::Key k;
+        k.set("class", "rd");
+        k.set("expver", "xxxx");
+        k.set("stream", "oper");
+        k.set("date", "20201102");
+        k.set("time", "0000");
+        k.set("domain", "g");
+        k.set("type", "fc");
+        k.set("levtype", "sfc");
+        k.set("step", step);
+        k.set("param", "167");
+        return k;
+    };
+
+    std::vector<std::string> data = {std::string(100, 'a'), std::string(200, 'b'), std::string(300, 'c')};
+    for (size_t i = 0; i < data.size(); ++i) {
+        fdb.archive(key(std::to_string(i)), data[i].data(), data[i].size());
+    }
+    fdb.flush();
+
+    fdb5::FDBToolRequest request = fdb5::FDBToolRequest::requestsFromString(
+        "class=rd,expver=xxxx,stream=oper,date=20201102,time=0000,domain=g,type=fc,levtype=sfc,step=0/1/2,param=167")[0];
+
+    auto retrieve = [&] {
+        fdb5::ListIterator it = fdb.inspect(request.request());
+        return readAll(fdb.read(it));
+    };
+
+    std::string expected = data[0] + data[1] + data[2];
+
+    EXPECT(retrieve() == expected);
+    EXPECT(fdb.stats().fieldCacheHitRatio() == 0);
+
+    EXPECT(retrieve() == expected);
+    EXPECT(fdb.stats().fieldCacheHitRatio() == 0.5);
+
+    // A field archived again is read from its new location, not the cache
+
+    data[1] = std::string(250, 'B');
+    fdb.archive(key("1"), data[1].data(), data[1].size());
+    fdb.flush();
+
+    EXPECT(retrieve() == data[0] + data[1] + data[2]);
+    EXPECT(retrieve() == data[0] + data[1] + data[2]);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+}  // namespace test
+}  // namespace fdb
+
+int main(int argc, char **argv)
+{
+    return run_tests ( argc, argv );
+}
@@ -0,0 +1,302 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "eckit/filesystem/PathName.h"
+#include "eckit/filesystem/TmpDir.h"
+#include "eckit/io/AutoClose.h"
+#include "eckit/io/FileHandle.h"
+#include "eckit/message/Message.h"
+#include "eckit/message/Reader.h"
+#include "eckit/testing/Test.h"
+
+#include "fdb5/fdb5_config.h"
+#include "fdb5/api/FDB.h"
+#include "fdb5/api/helpers/FDBToolRequest.h"
+#include "fdb5/api/helpers/ListIterator.h"
+#include "fdb5/config/Config.h"
+#include "fdb5/database/DB.h"
+#include "fdb5/database/Field.h"
+#include "fdb5/database/Key.h"
+#include "fdb5/message/MessageIndexer.h"
+
+#include "TocConfig.h"
+
+using namespace eckit::testing;
+using namespace eckit;
+
+
+namespace fdb {
+namespace test {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// The offset and length of each indexed field
+using Locations = std::map<fdb5::Key, std::pair<unsigned long long, unsigned long long>>;
+
+Locations indexed(const fdb5::Config& config) {
+
+    Locations result;
+
+    fdb5::FDB fdb(config);
+    fdb5::ListIterator it = fdb.list(fdb5::FDBToolRequest({}, true), true);
+    fdb5::ListElement elem;
+    while (it.next(elem)) {
+        fdb5::Key key = elem.combinedKey();
+        EXPECT(result.find(key) == result.end());
+        result[key] = std::make_pair((unsigned long long)(elem.location().offset()),
+                                     (unsigned long long)(elem.location().length()));
+    }
+    return result;
+}
+
+void write(eckit::DataHandle& out, const std::string& data) {
+    EXPECT(out.write(data.data(), data.size()) == long(data.size()));
+}
+
+CASE( "adopted_runs_of_fields_are_indexed_with_the_last_of_each_key" ) {
+
+    eckit::TmpDir root;
+    fdb5::Config config(tocConfig(root));
+
+    eckit::PathName data(root / "external.data");
+    {
+        eckit::FileHandle out(data);
+        out.openForWrite(0);
+        eckit::AutoClose closer(out);
+        write(out, std::string(1000, 'x'));
+    }
+
+    fdb5::Key dbKey;
+    dbKey.set("class", "rd");
+    dbKey.set("expver", "xxxx");
+    dbKey.set("stream", "oper");
+    dbKey.set("date", "20201102");
+    dbKey.set("time", "0000");
+    dbKey.set("domain", "g");
+
+    fdb5::Key indexKey;
+    indexKey.set("type", "fc");
+    indexKey.set("levtype", "sfc");
+
+    auto field = [](const std::string& step, long long offset) {
+        fdb5::Key key;
+        key.set("step", step);
+        key.set("param", "167");
+        return fdb5::AdoptedField{key, eckit::Offset(offset), eckit::Length(10)};
+    };
+
+    {
+        std::unique_ptr<fdb5::DB> db = fdb5::DB::buildWriter(dbKey, config);
+        db->index(indexKey, data, std::vector<fdb5::AdoptedField>{field("0", 0), field("1", 10), field("1", 20),
+                                                                  field("2", 30)});
+        db->index(indexKey, data, std::vector<fdb5::AdoptedField>{});
+        db->index(indexKey, data, std::vector<fdb5::AdoptedField>{field("2", 40), field("3", 50)});
+        db->flush();
+    }
+
+    Locations locations = indexed(config);
+    EXPECT(locations.size() == 4);
+
+    std::map<std::string, unsigned long long> offsets;
+    for (const auto& l : locations) {
+        EXPECT(l.second.second == 10);
+        offsets[l.first.get("step")] = l.second.first;
+    }
+
+    EXPECT(offsets == (std::map<std::string, unsigned long long>{{"0", 0}, {"1", 20}, {"2", 40}, {"3", 50}}));
+}
+
+#if fdb5_HAVE_GRIB
+
+/// The test data, written to one file with (optionally) every message twice
+class Messages {
+
+public: // methods
+
+    Messages(const eckit::PathName& path, size_t copies = 1, const std::string& padding = "") :
+        path_(path) {
+
+        std::vector<std::string> messages;
+        for (const char* file : {"x138-300.grib", "x138-400.grib", "y138-400.grib"}) {
+            eckit::message::Reader reader{eckit::PathName(file)};
+            eckit::message::Message msg;
+            while ((msg = reader.next())) {
+                messages.emplace_back(static_cast<const char*>(msg.data()), msg.length());
+            }
+        }
+
+        eckit::FileHandle out(path_);
+        out.openForWrite(0);
+        eckit::AutoClose closer(out);
+
+        unsigned long long offset = 0;
+        for (size_t copy = 0; copy < copies; ++copy) {
+            for (const std::string& msg : messages) {
+                offsets_.insert(offset);
+                write(out, msg);
+                write(out, padding);
+                offset += msg.size() + padding.size();
+            }
+            if (copy == 0) {
+                copySize_ = offset;
+            }
+        }
+        size_ = offset;
+    }
+
+    const eckit::PathName& path() const { return path_; }
+    size_t count() const { return offsets_.size(); }
+    unsigned long long size() const { return size_; }
+    unsigned long long copySize() const { return copySize_; }
+    const std::set<unsigned long long>& offsets() const { return offsets_; }
+
+private: // members
+
+    eckit::PathName path_;
+    std::set<unsigned long long> offsets_;
+    unsigned long long size_ = 0;
+    unsigned long long copySize_ = 0;
+};
+
+Locations index(const Messages& messages, size_t threads, unsigned long long chunkSize) {
+
+    eckit::TmpDir root;
+    fdb5::Config config(tocConfig(root));
+
+    {
+        fdb5::MessageIndexer indexer(false, false, 0, config);
+        indexer.threads(threads);
+        indexer.chunkSize(chunkSize);
+        indexer.index(messages.path());
+        indexer.flush();
+    }
+
+    return indexed(config);
+}
+
+CASE( "scanning_splits_files_at_message_boundaries" ) {
+
+    eckit::TmpDir directory;
+    Messages messages(directory / "messages.grib");
+    EXPECT(messages.count() > 4);
+
+    unsigned long long average = messages.size() / messages.count();
+
+    for (unsigned long long chunkSize : {1ULL, average, 3 * average + average / 2, messages.size(), 2 * messages.size()}) {
+
+        std::vector<fdb5::MessageIndexer::Chunk> chunks;
+        EXPECT(fdb5::MessageIndexer::scan(messages.path(), chunkSize, chunks));
+        EXPECT(!chunks.empty());
+
+        unsigned long long offset = 0;
+        size_t count = 0;
+        for (const auto& chunk : chunks) {
+            EXPECT((unsigned long long)(chunk.offset) == offset);
+            EXPECT(messages.offsets().count(offset) == 1);
+            EXPECT(chunk.messages > 0);
+            EXPECT((unsigned long long)(chunk.length) <= chunkSize || chunk.messages == 1);
+            offset += (unsigned long long)(chunk.length);
+            count += chunk.messages;
+        }
+        EXPECT(offset == messages.size());
+        EXPECT(count == messages.count());
+
+        if (chunkSize == 1) {
+            EXPECT(chunks.size() == messages.count());
+        }
+        if (chunkSize >= messages.size()) {
+            EXPECT(chunks.size() == 1);
+        }
+    }
+}
+
+CASE( "scanning_gives_up_on_files_that_are_not_only_grib_messages" ) {
+
+    eckit::TmpDir directory;
+    std::vector<fdb5::MessageIndexer::Chunk> chunks;
+
+    Messages padded(directory / "padded.grib", 1, std::string(8, '\0'));
+    EXPECT(!fdb5::MessageIndexer::scan(padded.path(), 1024, chunks));
+
+    Messages messages(directory / "messages.grib");
+    eckit::PathName truncated(directory / "truncated.grib");
+    {
+        eckit::FileHandle in(messages.path());
+        in.openForRead();
+        eckit::AutoClose closeIn(in);
+
+        std::string content(size_t(messages.size()) - 10, '\0');
+        EXPECT(in.read(&content[0], content.size()) == long(content.size()));
+
+        eckit::FileHandle out(truncated);
+        out.openForWrite(0);
+        eckit::AutoClose closeOut(out);
+        write(out, content);
+    }
+    EXPECT(!fdb5::MessageIndexer::scan(truncated, 1024, chunks));
+
+    // Files that can't be split are still indexed, one message at a time
+
+    EXPECT(index(padded, 4, 1024).size() == index(padded, 0, 1024).size());
+}
+
+CASE( "indexing_in_chunks_matches_indexing_sequentially" ) {
+
+    eckit::TmpDir directory;
+    Messages messages(directory / "messages.grib");
+
+    Locations sequential = index(messages, 0, 0);
+    EXPECT(!sequential.empty());
+
+    unsigned long long average = messages.size() / messages.count();
+
+    for (size_t threads : {1, 4}) {
+        for (unsigned long long chunkSize : {1ULL, 3 * average, 2 * messages.size()}) {
+            EXPECT(index(messages, threads, chunkSize) == sequential);
+        }
+    }
+}
+
+CASE( "the_last_of_duplicate_messages_is_indexed" ) {
+
+    eckit::TmpDir directory;
+    Messages messages(directory / "messages.grib", 2);
+
+    Locations sequential = index(messages, 0, 0);
+    EXPECT(!sequential.empty());
+    for (const auto& l : sequential) {
+        EXPECT(l.second.first >= messages.copySize());
+    }
+
+    // With the copies in different chunks, and both in the same one
+
+    for (unsigned long long chunkSize : {1ULL, messages.copySize(), 2 * messages.size()}) {
+        EXPECT(index(messages, 4, chunkSize) == sequential);
+    }
+}
+
+#endif  // fdb5_HAVE_GRIB
+
+//----------------------------------------------------------------------------------------------------------------------
+
+}  // namespace test
+}  // namespace fdb
+
+int main(int argc, char **argv)
+{
+    return run_tests ( argc, argv );
+}
@@ -0,0 +1,311 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "eckit/exception/Exceptions.h"
+#include "eckit/log/Log.h"
+#include "eckit/testing/Test.h"
+
+#include "fdb5/api/helpers/APIIterator.h"
+#include "fdb5/api/helpers/AsyncExecutor.h"
+#include "fdb5/api/helpers/SPSCQueue.h"
+
+using namespace eckit::testing;
+using namespace eckit;
+
+
+namespace fdb {
+namespace test {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+class VectorIterator : public fdb5::APIIteratorBase<int> {
+public:
+    VectorIterator(const std::vector<int>& values) : values_(values), pos_(0) {}
+    bool next(int& elem) override {
+        if (pos_ == values_.size()) return false;
+        elem = values_[pos_++];
+        return true;
+    }
+private:
+    std::vector<int> values_;
+    size_t pos_;
+};
+
+fdb5::APIIterator<int> makeIterator(const std::vector<int>& values) {
+    return fdb5::APIIterator<int>(new VectorIterator(values));
+}
+
+std::vector<int> drain(fdb5::APIIterator<int>& it) {
+    std::vector<int> result;
+    int elem;
+    while (it.next(elem)) result.push_back(elem);
+    return result;
+}
+
+CASE( "fan_in_returns_all_elements_of_all_iterators" ) {
+
+    std::vector<fdb5::APIFanInIterator<int>::Generator> generators;
+    generators.emplace_back([] { return makeIterator({1, 2, 3}); });
+    generators.emplace_back([] { return makeIterator({}); });
+    generators.emplace_back([] { return makeIterator({4, 5}); });
+
+    fdb5::APIIterator<int> it(new fdb5::APIFanInIterator<int>(std::move(generators), 1));
+    std::vector<int> result = drain(it);
+
+    // Order within each iterator is preserved
+
+    EXPECT(result.size() == 5);
+    EXPECT(std::find(result.begin(), result.end(), 1) < std::find(result.begin(), result.end(), 3));
+    EXPECT(std::find(result.begin(), result.end(), 4) < std::find(result.begin(), result.end(), 5));
+
+    std::sort(result.begin(), result.end());
+    EXPECT(result == std::vector<int>({1, 2, 3, 4, 5}));
+}
+
+CASE( "fan_in_of_nothing_is_empty" ) {
+    fdb5::APIIterator<int> it(new fdb5::APIFanInIterator<int>({}));
+    EXPECT(drain(it).empty());
+}
+
+CASE( "fan_in_propagates_errors" ) {
+
+    std::vector<fdb5::APIFanInIterator<int>::Generator> generators;
+    generators.emplace_back([] { return makeIterator({1, 2, 3}); });
+    generators.emplace_back([]() -> fdb5::APIIterator<int> { throw eckit::BadValue("lane failed", Here()); });
+
+    fdb5::APIIterator<int> it(new fdb5::APIFanInIterator<int>(std::move(generators)));
+    EXPECT_THROWS_AS(drain(it), eckit::BadValue);
+}
+
+CASE( "fan_in_can_be_abandoned" ) {
+
+    std::vector<fdb5::APIFanInIterator<int>::Generator> generators;
+    generators.emplace_back([] { return makeIterator(std::vector<int>(1000, 1)); });
+    generators.emplace_back([] { return makeIterator(std::vector<int>(1000, 2)); });
+
+    fdb5::APIIterator<int> it(new fdb5::APIFanInIterator<int>(std::move(generators), 10));
+    int elem;
+    EXPECT(it.next(elem));
+}
+
+CASE( "spsc_queue_passes_elements_in_order" ) {
+
+    fdb5::SPSCQueue<int> queue(5);
+    EXPECT(queue.capacity() == 8);
+
+    const int n = 10000;
+    std::thread producer([&queue] {
+        std::vector<int> batch;
+        for (int i = 0; i < n; ++i) {
+            if (i % 3 == 0) {
+                queue.emplace(i);
+            } else {
+                batch.push_back(i);
+                if (batch.size() == 11) queue.push(batch);
+            }
+        }
+        queue.push(batch);
+        queue.close();
+    });
+
+    std::vector<int> result;
+    std::vector<int> batch;
+    int elem;
+    while (true) {
+        if (result.size() % 2) {
+            if (queue.pop(elem) == -1) break;
+            result.push_back(elem);
+        } else {
+            if (queue.pop(batch, 7) == -1) break;
+            EXPECT(batch.size() <= 7);
+            result.insert(result.end(), batch.begin(), batch.end());
+            batch.clear();
+        }
+    }
+    producer.join();
+
+    EXPECT(queue.closed());
+    EXPECT(result.size() == n);
+    std::sort(result.begin(), result.end());
+    for (int i = 0; i < n; ++i) EXPECT(result[i] == i);
+}
+
+CASE( "spsc_queue_interrupts_both_sides" ) {
+
+    {
+        fdb5::SPSCQueue<int> queue(4);
+        queue.emplace(1);
+        queue.interrupt(std::make_exception_ptr(eckit::BadValue("producer failed", Here())));
+
+        // Elements already queued are still returned
+        int elem;
+        EXPECT(queue.pop(elem) == 0);
+        EXPECT(elem == 1);
+        EXPECT_THROWS_AS(queue.pop(elem), eckit::BadValue);
+    }
+
+    {
+        fdb5::SPSCQueue<int> queue(2);
+        bool interrupted = false;
+        std::thread producer([&queue, &interrupted] {
+            try {
+                for (int i = 0; i < 100; ++i) queue.emplace(i);
+            } catch (eckit::SeriousBug&) {
+                interrupted = true;
+            }
+        });
+        queue.interrupt(std::make_exception_ptr(eckit::SeriousBug("consumer gone", Here())));
+        producer.join();
+        EXPECT(interrupted);
+        EXPECT(!queue.closed());
+    }
+
+    // A consumer blocked on an empty queue is woken by an interrupt, or by the queue closing
+
+    {
+        fdb5::SPSCQueue<int> queue(2);
+        bool interrupted = false;
+        std::thread consumer([&queue, &interrupted] {
+            try {
+                int elem;
+                queue.pop(elem);
+            } catch (eckit::SeriousBug&) {
+                interrupted = true;
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        queue.interrupt(std::make_exception_ptr(eckit::SeriousBug("producer gone", Here())));
+        consumer.join();
+        EXPECT(interrupted);
+    }
+
+    {
+        fdb5::SPSCQueue<int> queue(2);
+        long result = 0;
+        std::thread consumer([&queue, &result] {
+            int elem;
+            result = queue.pop(elem);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        queue.close();
+        consumer.join();
+        EXPECT(result == -1);
+    }
+}
+
+CASE( "async_iterator_with_spsc_queue" ) {
+
+    using Queue = fdb5::SPSCQueue<int>;
+
+    fdb5::APIIterator<int> it(new fdb5::APIAsyncIterator<int, Queue>([](Queue& queue) {
+        for (int i = 0; i < 1000; ++i) queue.emplace(i);
+    }, 16));
+
+    std::vector<int> result = drain(it);
+    EXPECT(result.size() == 1000);
+    for (int i = 0; i < 1000; ++i) EXPECT(result[i] == i);
+
+    // And abandon one part way through
+
+    fdb5::APIIterator<int> it2(new fdb5::APIAsyncIterator<int, Queue>([](Queue& queue) {
+        for (int i = 0; i < 1000; ++i) queue.emplace(i);
+    }, 16));
+
+    int elem;
+    EXPECT(it2.next(elem));
+    EXPECT(elem == 0);
+}
+
+/// Wait (for a while) until the executor has the given number of idle threads
+bool waitForIdleThreads(size_t n) {
+    for (int i = 0; i < 10000; ++i) {
+        if (fdb5::AsyncExecutor::instance().stats().idleThreads >= n) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+CASE( "async_executor_reuses_idle_threads" ) {
+
+    fdb5::AsyncExecutor& executor(fdb5::AsyncExecutor::instance());
+
+    executor.submit([] {}).wait();
+    EXPECT(waitForIdleThreads(1));
+
+    fdb5::AsyncExecutor::Stats before = executor.stats();
+
+    // One task at a time, each given to the thread left idle by the last
+
+    for (size_t i = 0; i < 100; ++i) {
+        executor.submit([] {}).wait();
+        EXPECT(waitForIdleThreads(before.idleThreads));
+    }
+
+    fdb5::AsyncExecutor::Stats after = executor.stats();
+    EXPECT(after.tasks - before.tasks == 100);
+    EXPECT(after.threadsCreated == before.threadsCreated);
+}
+
+CASE( "async_executor_never_queues_behind_busy_threads" ) {
+
+    fdb5::AsyncExecutor& executor(fdb5::AsyncExecutor::instance());
+
+    // More blocked tasks than there are idle threads, each then needing a thread of its own
+
+    const size_t blocked = executor.stats().idleThreads + 4;
+
+    std::promise<void> release;
+    std::shared_future<void> released(release.get_future());
+
+    std::vector<std::future<void>> tasks;
+    for (size_t i = 0; i < blocked; ++i) {
+        tasks.emplace_back(executor.submit([released] { released.wait(); }));
+    }
+
+    std::future<int> next = executor.submit([] { return 42; });
+    EXPECT(next.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    EXPECT(next.get() == 42);
+    EXPECT(executor.stats().threads >= blocked + 1);
+
+    // Destroying a future doesn't wait for its task
+
+    tasks.clear();
+
+    release.set_value();
+    EXPECT(waitForIdleThreads(blocked));
+}
+
+CASE( "async_executor_returns_results_and_errors" ) {
+
+    fdb5::AsyncExecutor& executor(fdb5::AsyncExecutor::instance());
+
+    std::future<int> result = executor.submit([] { return 42; });
+    std::future<void> error = executor.submit([] { throw eckit::BadValue("task failed", Here()); });
+
+    EXPECT(result.get() == 42);
+    EXPECT_THROWS_AS(error.get(), eckit::BadValue);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+}  // namespace test
+}  // namespace fdb
+
+int main(int argc, char **argv)
+{
+    return run_tests ( argc, argv );
+}
@@ -0,0 +1,622 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "eckit/config/LocalConfiguration.h"
+#include "eckit/exception/Exceptions.h"
+#include "eckit/filesystem/TmpDir.h"
+#include "eckit/io/Buffer.h"
+#include "eckit/io/DataHandle.h"
+#include "eckit/io/compression/Compressor.h"
+#include "eckit/net/Endpoint.h"
+#include "eckit/net/TCPClient.h"
+#include "eckit/testing/Test.h"
+
+#include "metkit/mars/MarsRequest.h"
+
+#include "fdb5/fdb5_config.h"
+#include "fdb5/api/FDB.h"
+#include "fdb5/api/helpers/FDBToolRequest.h"
+#include "fdb5/api/helpers/ListIterator.h"
+#include "fdb5/config/Config.h"
+#include "fdb5/database/Key.h"
+#include "fdb5/remote/ClientConnection.h"
+#include "fdb5/remote/FdbServer.h"
+#include "fdb5/remote/ListElementBatch.h"
+#include "fdb5/toc/TocFieldLocation.h"
+
+#include "TocConfig.h"
+
+using namespace eckit::testing;
+using namespace eckit;
+
+
+namespace fdb {
+namespace test {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// An FdbServer on loopback, serving a temporary TOC root, for the duration of a test
+
+class LoopbackServer : public fdb5::remote::FdbServerBase {
+
+public: // methods
+
+    LoopbackServer(const eckit::LocalConfiguration& extra = eckit::LocalConfiguration()) {
+
+        fdb5::Config config(tocConfig(root_, extra));
+        config.set("serverPort", 0);
+        config.set("serverThreaded", true);
+        config_ = config.expandConfig();
+
+        thread_ = std::thread([this] { doRun(); });
+        while (port() == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    ~LoopbackServer() {
+        stop();
+        thread_.join();
+    }
+
+    eckit::net::Endpoint endpoint() const { return eckit::net::Endpoint("localhost", port()); }
+
+    eckit::LocalConfiguration clientConfig() const {
+        eckit::LocalConfiguration config;
+        config.set("type", "remote");
+        config.set("host", "localhost");
+        config.set("port", port());
+        return config;
+    }
+
+private: // methods
+
+    void hookUnique() override {}
+    fdb5::Config serverConfig() const override { return config_; }
+
+private: // members
+
+    eckit::TmpDir root_;
+    fdb5::Config config_;
+    std::thread thread_;
+};
+
+fdb5::Key fieldKey(size_t step, size_t param) {
+    fdb5::Key key;
+    key.set("class", "rd");
+    key.set("expver", "xxxx");
+    key.set("stream", "oper");
+    key.set("date", "20201102");
+    key.set("time", "0000");
+    key.set("domain", "g");
+    key.set("type", "fc");
+    key.set("levtype", "sfc");
+    key.set("step", std::to_string(step));
+    key.set("param", std::to_string(param));
+    return key;
+}
+
+metkit::mars::MarsRequest fieldRequest(const fdb5::Key& key) {
+    metkit::mars::MarsRequest request("retrieve");
+    for (const auto& kv : key) {
+        request.setValue(kv.first, kv.second);
+    }
+    return request;
+}
+
+std::string fieldData(size_t step, size_t param, size_t size = 4096) {
+    std::string data(size, ' ');
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = char('a' + (step * 7 + param * 3 + i) % 26);
+    }
+    return data;
+}
+
+std::string randomData(size_t size) {
+    std::mt19937 generator(size);
+    std::string data(size, ' ');
+    for (char& c : data) {
+        c = char(generator());
+    }
+    return data;
+}
+
+std::string readAll(eckit::DataHandle& dh) {
+    std::string data;
+    char buffer[1024];
+    long len;
+    dh.openForRead();
+    while ((len = dh.read(buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, len);
+    }
+    dh.close();
+    return data;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+CASE( "Clients with the same configuration share a pooled connection" ) {
+
+    LoopbackServer server;
+    fdb5::remote::ClientConnectionPool& pool(fdb5::remote::ClientConnectionPool::instance());
+
+    eckit::LocalConfiguration config = server.clientConfig();
+    auto a = pool.connection(server.endpoint(), config);
+    auto b = pool.connection(server.endpoint(), config);
+    EXPECT(a == b);
+    EXPECT(a->healthy());
+
+    eckit::LocalConfiguration other(config);
+    other.set("maxBatchSize", 4);
+    auto c = pool.connection(server.endpoint(), other);
+    EXPECT(c != a);
+
+    // Only one archive at a time is supported per connection
+
+    auto archiving = pool.archiveConnection(server.endpoint(), config);
+    EXPECT(archiving == a);
+    auto second = pool.archiveConnection(server.endpoint(), config);
+    EXPECT(second != a);
+
+    archiving->releaseArchive();
+    auto third = pool.archiveConnection(server.endpoint(), config);
+    EXPECT(third == a);
+
+    third->releaseArchive();
+    second->releaseArchive();
+}
+
+CASE( "Idle connections are closed without further use of the pool" ) {
+
+    LoopbackServer server;
+    fdb5::remote::ClientConnectionPool& pool(fdb5::remote::ClientConnectionPool::instance());
+
+    auto waitForEmpty = [&pool] {
+        for (int i = 0; i < 100 && pool.size() != 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        return pool.size() == 0;
+    };
+
+    // Connections left over from other tests are closed too
+
+    pool.idleTimeout(1);
+    EXPECT(waitForEmpty());
+
+    {
+        auto conn = pool.connection(server.endpoint(), server.clientConfig());
+        EXPECT(pool.size() == 1);
+
+        // In use, so not closed however long it is idle
+        std::this_thread::sleep_for(std::chrono::seconds(3));
+        EXPECT(pool.size() == 1);
+    }
+
+    EXPECT(waitForEmpty());
+
+    pool.idleTimeout(60);
+}
+
+CASE( "A field that is not read to the end does not disturb the next" ) {
+
+    LoopbackServer server;
+    fdb5::FDB fdb(fdb5::Config(server.clientConfig()).expandConfig());
+
+    for (size_t param = 1; param <= 3; ++param) {
+        std::string data = fieldData(0, param);
+        fdb.archive(fieldKey(0, param), data.data(), data.size());
+    }
+    fdb.flush();
+
+    // Partially read, closed, and abandoned without being opened
+
+    {
+        std::unique_ptr<eckit::DataHandle> dh(fdb.retrieve(fieldRequest(fieldKey(0, 1))));
+        char c;
+        dh->openForRead();
+        EXPECT(dh->read(&c, 1) == 1);
+        dh->close();
+    }
+    {
+        std::unique_ptr<eckit::DataHandle> dh(fdb.retrieve(fieldRequest(fieldKey(0, 2))));
+    }
+
+    std::unique_ptr<eckit::DataHandle> dh(fdb.retrieve(fieldRequest(fieldKey(0, 3))));
+    EXPECT(readAll(*dh) == fieldData(0, 3));
+
+    std::unique_ptr<eckit::DataHandle> again(fdb.retrieve(fieldRequest(fieldKey(0, 1))));
+    EXPECT(readAll(*again) == fieldData(0, 1));
+}
+
+CASE( "A client that stops reading does not hold up the others sharing its connection" ) {
+
+    ::setenv("FDB_REMOTE_MAX_BUFFERED_BYTES", "262144", 1);
+
+    // A server of its own, so that the connection is new, and buffers at most 256KiB per request
+
+    LoopbackServer server;
+    eckit::LocalConfiguration config = server.clientConfig();
+
+    const size_t nfields = 8;
+    const size_t size = 65536;
+    {
+        fdb5::FDB fdb(fdb5::Config(config).expandConfig());
+        for (size_t param = 1; param <= nfields; ++param) {
+            std::string data = fieldData(20, param, size);
+            fdb.archive(fieldKey(20, param), data.data(), data.size());
+        }
+        fdb.flush();
+    }
+
+    // All the fields are sent, but none are read
+
+    fdb5::FDB slow(fdb5::Config(config).expandConfig());
+    metkit::mars::MarsRequest all = fieldRequest(fieldKey(20, 1));
+    std::vector<std::string> params;
+    for (size_t param = 1; param <= nfields; ++param) params.push_back(std::to_string(param));
+    all.values("param", params);
+    std::unique_ptr<eckit::DataHandle> unread(slow.retrieve(all));
+
+    // ... which doesn't stop another client on the same connection from reading
+
+    fdb5::FDB fast(fdb5::Config(config).expandConfig());
+    for (size_t param = 1; param <= nfields; ++param) {
+        std::unique_ptr<eckit::DataHandle> dh(fast.retrieve(fieldRequest(fieldKey(20, param))));
+        EXPECT(readAll(*dh) == fieldData(20, param, size));
+    }
+
+    // The reads that buffered too much were abandoned, and those that follow start afresh
+
+    EXPECT_THROWS_AS(readAll(*unread), fdb5::remote::RemoteFDBException);
+    unread.reset();
+
+    std::unique_ptr<eckit::DataHandle> dh(slow.retrieve(fieldRequest(fieldKey(20, 1))));
+    EXPECT(readAll(*dh) == fieldData(20, 1, size));
+
+    ::unsetenv("FDB_REMOTE_MAX_BUFFERED_BYTES");
+}
+
+CASE( "A connection whose archive failed is not reused" ) {
+
+    LoopbackServer server;
+    fdb5::remote::ClientConnectionPool& pool(fdb5::remote::ClientConnectionPool::instance());
+
+    eckit::LocalConfiguration config = server.clientConfig();
+    auto conn = pool.connection(server.endpoint(), config);
+
+    fdb5::FDB fdb(fdb5::Config(config).expandConfig());
+
+    // A key that matches no rule of the schema fails to archive on the server
+
+    fdb5::Key bad = fieldKey(30, 1);
+    bad.unset("levtype");
+    std::string data = fieldData(30, 1);
+    fdb.archive(bad, data.data(), data.size());
+    EXPECT_THROWS(fdb.flush());
+
+    EXPECT(!conn->healthy());
+    EXPECT(pool.connection(server.endpoint(), config) != conn);
+
+    // ... and the client archives afresh, on a new connection
+
+    fdb.archive(fieldKey(30, 1), data.data(), data.size());
+    fdb.flush();
+
+    std::unique_ptr<eckit::DataHandle> dh(fdb.retrieve(fieldRequest(fieldKey(30, 1))));
+    EXPECT(readAll(*dh) == data);
+}
+
+/// Archives fields that compress well and fields that don't, in batches, and checks that
+/// they are retrieved intact
+
+void archiveAndRetrieve(const eckit::LocalConfiguration& clientConfig) {
+
+    eckit::LocalConfiguration config(clientConfig);
+    config.set("maxBatchSize", 4);
+
+    std::vector<std::string> data;
+    for (size_t param = 1; param <= 8; ++param) {
+        data.push_back(param % 4 == 0 ? randomData(65536 + param) : fieldData(1, param, 65536));
+    }
+
+    {
+        fdb5::FDB fdb(fdb5::Config(config).expandConfig());
+        for (size_t param = 1; param <= data.size(); ++param) {
+            fdb.archive(fieldKey(1, param), data[param - 1].data(), data[param - 1].size());
+        }
+        fdb.flush();
+    }
+
+    fdb5::FDB fdb(fdb5::Config(config).expandConfig());
+    for (size_t param = 1; param <= data.size(); ++param) {
+        std::unique_ptr<eckit::DataHandle> dh(fdb.retrieve(fieldRequest(fieldKey(1, param))));
+        EXPECT(readAll(*dh) == data[param - 1]);
+    }
+}
+
+std::string availableCompressor() {
+    for (const char* name : {"zstd", "lz4", "snappy", "bzip2"}) {
+        if (eckit::CompressorFactory::instance().has(name)) return name;
+    }
+    return "";
+}
+
+CASE( "Archived data is compressed on the wire when the server agrees" ) {
+
+    std::string compressor = availableCompressor();
+    if (compressor.empty()) {
+        Log::warning() << "No compressor available, so nothing to test" << std::endl;
+        return;
+    }
+
+    LoopbackServer server;
+
+    eckit::LocalConfiguration config = server.clientConfig();
+    config.set("compression", compressor);
+    config.set("connectionPool", false);
+
+    fdb5::remote::ClientConnection conn(server.endpoint(), compressor);
+    conn.connect();
+    EXPECT(conn.compression() == compressor);
+    conn.disconnect();
+
+    archiveAndRetrieve(config);
+}
+
+CASE( "Archived data is sent uncompressed to a server that does not compress" ) {
+
+    std::string compressor = availableCompressor();
+
+    eckit::LocalConfiguration options;
+    options.set("serverDataCompression", false);
+    LoopbackServer server(options);
+
+    eckit::LocalConfiguration config = server.clientConfig();
+    config.set("compression", compressor.empty() ? std::string("none") : compressor);
+    config.set("connectionPool", false);
+
+    fdb5::remote::ClientConnection conn(server.endpoint(), compressor.empty() ? std::string("none") : compressor);
+    conn.connect();
+    EXPECT(conn.compression() == "none");
+    conn.disconnect();
+
+    archiveAndRetrieve(config);
+}
+
+/// Fields over two databases, so that batches don't only share everything but the datum
+
+fdb5::Key listedKey(size_t i) {
+    fdb5::Key key = fieldKey(i % 3, 1 + i / 3);
+    if (i % 2 == 1) key.set("date", "20201103");
+    return key;
+}
+
+CASE( "List elements are batched, and decoded as they were sent" ) {
+
+    ::setenv("FDB_REMOTE_LIST_BATCH_SIZE", "5", 1);
+
+    std::vector<fdb5::ListElement> elements;
+    for (size_t i = 0; i < 12; ++i) {
+        fdb5::Key db;
+        db.set("class", "rd");
+        db.set("date", i < 6 ? "20201102" : "20201103");
+        fdb5::Key index;
+        index.set("type", "fc");
+        fdb5::Key datum;
+        datum.set("param", std::to_string(i));
+
+        std::shared_ptr<const fdb5::FieldLocation> location(
+            new fdb5::TocFieldLocation(eckit::PathName("/a/b/data"), eckit::Offset(1024 * i), eckit::Length(100 + i), fdb5::Key()));
+        elements.emplace_back(std::vector<fdb5::Key>{db, index, datum}, location, time_t(1000 + i));
+    }
+
+    fdb5::remote::ListElementBatchEncoder encoder;
+    std::vector<fdb5::ListElement> decoded;
+    size_t batches = 0;
+
+    auto send = [&] {
+        eckit::Buffer payload(encoder.data(), encoder.size());
+        fdb5::remote::ListElementBatchDecoder decoder(payload);
+        fdb5::ListElement elem;
+        while (decoder.next(elem)) decoded.push_back(elem);
+        encoder.clear();
+        ++batches;
+    };
+
+    for (const auto& elem : elements) {
+        encoder.add(elem);
+        if (encoder.full()) send();
+    }
+    if (encoder.count() != 0) send();
+
+    ::unsetenv("FDB_REMOTE_LIST_BATCH_SIZE");
+
+    EXPECT(batches == 3);
+    EXPECT(decoded.size() == elements.size());
+    for (size_t i = 0; i < elements.size(); ++i) {
+        EXPECT(decoded[i].key() == elements[i].key());
+        EXPECT(decoded[i].location().uri().asString() == elements[i].location().uri().asString());
+        EXPECT(decoded[i].location().offset() == elements[i].location().offset());
+        EXPECT(decoded[i].location().length() == elements[i].location().length());
+        EXPECT(decoded[i].timestamp() == elements[i].timestamp());
+    }
+}
+
+CASE( "Listing and inspecting a remote FDB returns every field, over several batches" ) {
+
+    ::setenv("FDB_REMOTE_LIST_BATCH_SIZE", "4", 1);
+
+    LoopbackServer server;
+    eckit::LocalConfiguration config = server.clientConfig();
+    config.set("connectionPool", false);
+    fdb5::FDB fdb(fdb5::Config(config).expandConfig());
+
+    // Each field has its own length, which identifies it in the listing
+
+    const size_t nfields = 18;
+    std::set<size_t> expected;
+    for (size_t i = 0; i < nfields; ++i) {
+        std::string data = fieldData(i, 0, 100 + i);
+        fdb.archive(listedKey(i), data.data(), data.size());
+        expected.insert(data.size());
+    }
+    fdb.flush();
+
+    metkit::mars::MarsRequest request = fieldRequest(listedKey(0));
+    request.values("date", {"20201102", "20201103"});
+    request.values("step", {"0", "1", "2"});
+    std::vector<std::string> params;
+    for (size_t i = 0; i < nfields / 3; ++i) params.push_back(std::to_string(1 + i));
+    request.values("param", params);
+
+    std::set<size_t> listed;
+    fdb5::ListIterator it = fdb.list(fdb5::FDBToolRequest(request));
+    fdb5::ListElement elem;
+    while (it.next(elem)) {
+        EXPECT(listed.insert(size_t(elem.location().length())).second);
+        EXPECT(elem.key().size() == 3);
+        EXPECT(elem.timestamp() != 0);
+    }
+    EXPECT(listed == expected);
+
+    // Inspected locations are read through the server
+
+    for (size_t i = 0; i < nfields; ++i) {
+        fdb5::ListIterator inspected = fdb.inspect(fieldRequest(listedKey(i)));
+        std::unique_ptr<eckit::DataHandle> dh(fdb.read(inspected));
+        EXPECT(readAll(*dh) == fieldData(i, 0, 100 + i));
+    }
+
+    ::unsetenv("FDB_REMOTE_LIST_BATCH_SIZE");
+}
+
+#ifdef fdb5_HAVE_SERVER_REACTOR
+
+eckit::LocalConfiguration reactorOptions() {
+    eckit::LocalConfiguration options;
+    options.set("serverReactor", true);
+    options.set("serverReactorThreads", 1);
+    options.set("serverWorkerThreads", 2);
+    return options;
+}
+
+CASE( "An event-driven server doesn't wait on clients that are yet to say anything" ) {
+
+    LoopbackServer server(reactorOptions());
+
+    // More silent clients than there are workers
+
+    std::vector<std::unique_ptr<eckit::net::TCPClient>> silent;
+    for (size_t i = 0; i < 4; ++i) {
+        silent.emplace_back(new eckit::net::TCPClient);
+        silent.back()->connect("localhost", server.port());
+    }
+
+    eckit::LocalConfiguration config = server.clientConfig();
+    config.set("connectionPool", false);
+    fdb5::FDB fdb(fdb5::Config(config).expandConfig());
+
+    std::string data = fieldData(2, 1);
+    fdb.archive(fieldKey(2, 1), data.data(), data.size());
+    fdb.flush();
+
+    std::unique_ptr<eckit::DataHandle> dh(fdb.retrieve(fieldRequest(fieldKey(2, 1))));
+    EXPECT(readAll(*dh) == data);
+}
+
+CASE( "An event-driven server holds back archive data whilst the archive queue is full" ) {
+
+    eckit::LocalConfiguration options = reactorOptions();
+    options.set("serverArchiveQueueSize", 1);
+    LoopbackServer server(options);
+
+    eckit::LocalConfiguration config = server.clientConfig();
+    config.set("connectionPool", false);
+    config.set("maxBatchSize", 1);
+
+    // Fields big enough to arrive in pieces, from several clients at once
+
+    const size_t nclients = 4;
+    const size_t nfields  = 16;
+    const size_t size     = 1024 * 1024;
+
+    std::vector<std::thread> clients;
+    for (size_t step = 0; step < nclients; ++step) {
+        clients.emplace_back([&config, step, nfields, size] {
+            fdb5::FDB fdb(fdb5::Config(config).expandConfig());
+            for (size_t param = 1; param <= nfields; ++param) {
+                std::string data = fieldData(10 + step, param, size);
+                fdb.archive(fieldKey(10 + step, param), data.data(), data.size());
+            }
+            fdb.flush();
+        });
+    }
+    for (auto& t : clients) t.join();
+
+    fdb5::FDB fdb(fdb5::Config(config).expandConfig());
+    for (size_t step = 0; step < nclients; ++step) {
+        for (size_t param = 1; param <= nfields; ++param) {
+            std::unique_ptr<eckit::DataHandle> dh(fdb.retrieve(fieldRequest(fieldKey(10 + step, param))));
+            EXPECT(readAll(*dh) == fieldData(10 + step, param, size));
+        }
+    }
+}
+
+CASE( "An event-driven server stops with clients still connected" ) {
+
+    std::unique_ptr<fdb5::remote::ClientConnection> idle;
+    {
+        LoopbackServer server(reactorOptions());
+
+        idle.reset(new fdb5::remote::ClientConnection(server.endpoint()));
+        idle->connect();
+
+        eckit::LocalConfiguration config = server.clientConfig();
+        config.set("connectionPool", false);
+        fdb5::FDB fdb(fdb5::Config(config).expandConfig());
+        std::string data = fieldData(3, 1);
+        fdb.archive(fieldKey(3, 1), data.data(), data.size());
+        fdb.flush();
+    }
+
+    // Getting here means that the server didn't wait on the idle client
+}
+
+#else
+
+CASE( "The event-driven server is rejected where it is not built" ) {
+
+    eckit::LocalConfiguration options;
+    options.set("serverReactor", true);
+    EXPECT_THROWS_AS(fdb5::remote::FdbServerBase::reactor(fdb5::Config(options)), eckit::UserError);
+
+    options.set("serverReactor", false);
+    EXPECT(!fdb5::remote::FdbServerBase::reactor(fdb5::Config(options)));
+}
+
+#endif  // fdb5_HAVE_SERVER_REACTOR
+
+//----------------------------------------------------------------------------------------------------------------------
+
+}  // namespace test
+}  // namespace fdb
+
+int main(int argc, char **argv)
+{
+    return run_tests ( argc, argv );
+}
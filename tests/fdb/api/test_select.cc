@@ -690,6 +690,79 @@ CASE( "control_distributed_according_to_select" ) {
     }
 }
 
+CASE( "archives_routed_by_literal_alternation_and_regex_selects" ) {
+
+    LocalConfiguration cfg_op;
+    cfg_op.set("type", "spy");
+    cfg_op.set("select", "class=^\\(od\\|mc\\)$");
+
+    LocalConfiguration cfg_rd1;
+    cfg_rd1.set("type", "spy");
+    cfg_rd1.set("select", "class=rd,expver=^xxxx$");
+
+    LocalConfiguration cfg_rd2;
+    cfg_rd2.set("type", "spy");
+    cfg_rd2.set("select", "class=rd,expver=y.y");
+
+    fdb5::Config cfg;
+    cfg.set("type", "select");
+    cfg.set("fdbs", { cfg_op, cfg_rd1, cfg_rd2 });
+
+    fdb5::FDB fdb(cfg);
+    EXPECT(ApiSpy::knownSpies().size() == 3);
+    ApiSpy& spy_op(*ApiSpy::knownSpies()[0]);
+    ApiSpy& spy_rd1(*ApiSpy::knownSpies()[1]);
+    ApiSpy& spy_rd2(*ApiSpy::knownSpies()[2]);
+
+    fdb5::Key k;
+    k.set("class", "od");
+    k.set("expver", "xxxx");
+    fdb.archive(k, (const void*)0x1234, 1234);
+
+    k.set("class", "mc");
+    fdb.archive(k, (const void*)0x1234, 1234);
+
+    EXPECT(spy_op.counts().archive == 2);
+
+    // Anchored alternatives only match whole values
+
+    k.set("class", "odd");
+    EXPECT_THROWS_AS(fdb.archive(k, (const void*)0x1234, 1234), eckit::UserError);
+
+    // Repeated keys take the same route
+
+    k.set("class", "rd");
+    for (int i = 0; i < 3; ++i) {
+        fdb.archive(k, (const void*)0x1234, 1234);
+    }
+
+    EXPECT(spy_op.counts().archive == 2);
+    EXPECT(spy_rd1.counts().archive == 3);
+    EXPECT(spy_rd2.counts().archive == 0);
+
+    k.set("expver", "xxxxy");
+    EXPECT_THROWS_AS(fdb.archive(k, (const void*)0x1234, 1234), eckit::UserError);
+
+    // Unanchored regexes match substrings
+
+    k.set("expver", "zyzyz");
+    fdb.archive(k, (const void*)0x1234, 1234);
+    fdb.archive(k, (const void*)0x1234, 1234);
+
+    EXPECT(spy_rd1.counts().archive == 3);
+    EXPECT(spy_rd2.counts().archive == 2);
+
+    // Keys that lack a selected keyword are not archived
+
+    fdb5::Key k2;
+    k2.set("class", "rd");
+    EXPECT_THROWS_AS(fdb.archive(k2, (const void*)0x1234, 1234), eckit::UserError);
+
+    EXPECT(spy_op.counts().archive == 2);
+    EXPECT(spy_rd1.counts().archive == 3);
+    EXPECT(spy_rd2.counts().archive == 2);
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 
 }  // namespace test
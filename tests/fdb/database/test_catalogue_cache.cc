@@ -0,0 +1,245 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "eckit/filesystem/TmpDir.h"
+#include "eckit/testing/Test.h"
+
+#include "fdb5/api/FDB.h"
+#include "fdb5/api/helpers/ControlIterator.h"
+#include "fdb5/api/helpers/FDBToolRequest.h"
+#include "fdb5/api/helpers/ListIterator.h"
+#include "fdb5/config/Config.h"
+#include "fdb5/database/CatalogueCache.h"
+#include "fdb5/database/DB.h"
+#include "fdb5/database/Key.h"
+
+#include "TocConfig.h"
+
+using namespace eckit::testing;
+using namespace eckit;
+
+
+namespace fdb {
+namespace test {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+fdb5::Key dbKey(const std::string& expver) {
+    fdb5::Key key;
+    key.set("class", "rd");
+    key.set("expver", expver);
+    key.set("stream", "oper");
+    key.set("date", "20201102");
+    key.set("time", "0000");
+    key.set("domain", "g");
+    return key;
+}
+
+std::string dbRequest(const std::string& expver) {
+    return "class=rd,expver=" + expver + ",stream=oper,date=20201102,time=0000,domain=g";
+}
+
+void archive(fdb5::FDB& fdb, const std::string& expver, const std::string& step) {
+    fdb5::Key key(dbKey(expver));
+    key.set("type", "fc");
+    key.set("levtype", "sfc");
+    key.set("step", step);
+    key.set("param", "167");
+
+    std::string data(1024, 'x');
+    fdb.archive(key, data.data(), data.size());
+    fdb.flush();
+}
+
+void control(fdb5::FDB& fdb, const std::string& expver, fdb5::ControlAction action) {
+    fdb5::ControlIterator it = fdb.control(fdb5::FDBToolRequest::requestsFromString(dbRequest(expver))[0], action,
+                                           fdb5::ControlIdentifiers(fdb5::ControlIdentifier::Retrieve));
+    fdb5::ControlElement elem;
+    while (it.next(elem)) {}
+}
+
+CASE( "readers_are_reused_until_the_catalogue_changes" ) {
+
+    eckit::TmpDir root;
+    fdb5::Config config(tocConfig(root));
+    std::string configId = fdb5::CatalogueCache::configId(config);
+
+    fdb5::FDB fdb(config);
+    archive(fdb, "xxxx", "0");
+
+    fdb5::CatalogueCache cache(4, 1);
+
+    EXPECT(!cache.reader(dbKey("yyyy"), config, configId));
+
+    fdb5::DB* first;
+    {
+        std::shared_ptr<fdb5::DB> db = cache.reader(dbKey("xxxx"), config, configId);
+        EXPECT(db);
+        first = db.get();
+    }
+    {
+        std::shared_ptr<fdb5::DB> db = cache.reader(dbKey("xxxx"), config, configId);
+        EXPECT(db.get() == first);
+    }
+
+    EXPECT(cache.stats().hits == 1);
+    EXPECT(cache.stats().idle == 1);
+
+    // Archiving extends the TOC, so the cached reader is replaced
+
+    archive(fdb, "xxxx", "1");
+    EXPECT(cache.reader(dbKey("xxxx"), config, configId));
+
+    EXPECT(cache.stats().hits == 1);
+    EXPECT(cache.stats().refreshes == 1);
+}
+
+CASE( "locked_databases_are_not_returned_even_if_cached" ) {
+
+    eckit::TmpDir root;
+    fdb5::Config config(tocConfig(root));
+    std::string configId = fdb5::CatalogueCache::configId(config);
+
+    fdb5::FDB fdb(config);
+    archive(fdb, "xxxx", "0");
+
+    fdb5::CatalogueCache cache(4, 1);
+    EXPECT(cache.reader(dbKey("xxxx"), config, configId));
+    EXPECT(cache.stats().idle == 1);
+
+    control(fdb, "xxxx", fdb5::ControlAction::Disable);
+    EXPECT(!cache.reader(dbKey("xxxx"), config, configId));
+
+    control(fdb, "xxxx", fdb5::ControlAction::Enable);
+    EXPECT(cache.reader(dbKey("xxxx"), config, configId));
+}
+
+CASE( "concurrent_checkouts_get_their_own_readers" ) {
+
+    eckit::TmpDir root;
+    fdb5::Config config(tocConfig(root));
+    std::string configId = fdb5::CatalogueCache::configId(config);
+
+    fdb5::FDB fdb(config);
+    archive(fdb, "xxxx", "0");
+
+    fdb5::CatalogueCache cache(8, 4);
+
+    {
+        std::shared_ptr<fdb5::DB> a = cache.reader(dbKey("xxxx"), config, configId);
+        std::shared_ptr<fdb5::DB> b = cache.reader(dbKey("xxxx"), config, configId);
+        EXPECT(a && b);
+        EXPECT(a.get() != b.get());
+    }
+    EXPECT(cache.stats().misses == 2);
+    EXPECT(cache.stats().idle == 2);
+
+    // No reader is ever used by two threads at once
+
+    std::mutex mutex;
+    std::set<fdb5::DB*> inUse;
+    std::atomic<size_t> errors(0);
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 8; ++t) {
+        threads.emplace_back([&] {
+            for (size_t i = 0; i < 50; ++i) {
+                std::shared_ptr<fdb5::DB> db = cache.reader(dbKey("xxxx"), config, configId);
+                if (!db) {
+                    ++errors;
+                    continue;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!inUse.insert(db.get()).second) ++errors;
+                }
+                std::this_thread::yield();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    inUse.erase(db.get());
+                }
+            }
+        });
+    }
+    for (std::thread& t : threads) t.join();
+
+    EXPECT(errors == 0);
+    EXPECT(cache.stats().hits + cache.stats().misses == 2 + 8 * 50);
+    EXPECT(cache.stats().idle <= 8);
+}
+
+CASE( "least_recently_used_readers_are_evicted" ) {
+
+    eckit::TmpDir root;
+    fdb5::Config config(tocConfig(root));
+    std::string configId = fdb5::CatalogueCache::configId(config);
+
+    fdb5::FDB fdb(config);
+    archive(fdb, "xxxx", "0");
+    archive(fdb, "yyyy", "0");
+
+    fdb5::CatalogueCache cache(1, 1);
+
+    EXPECT(cache.reader(dbKey("xxxx"), config, configId));
+    EXPECT(cache.reader(dbKey("yyyy"), config, configId));
+    EXPECT(cache.stats().idle == 1);
+
+    EXPECT(cache.reader(dbKey("yyyy"), config, configId));
+    EXPECT(cache.stats().hits == 1);
+
+    EXPECT(cache.reader(dbKey("xxxx"), config, configId));
+    EXPECT(cache.stats().hits == 1);
+    EXPECT(cache.stats().misses == 3);
+}
+
+CASE( "retrieves_see_fields_archived_after_the_catalogue_was_opened" ) {
+
+    eckit::TmpDir root;
+    fdb5::Config config(tocConfig(root));
+
+    fdb5::FDB writer(config);
+
+    auto retrieved = [&config] {
+        fdb5::FDB reader(config);
+        fdb5::FDBToolRequest request = fdb5::FDBToolRequest::requestsFromString(
+            dbRequest("xxxx") + ",type=fc,levtype=sfc,step=0/1,param=167")[0];
+        fdb5::ListIterator it = reader.inspect(request.request());
+        fdb5::ListElement elem;
+        size_t count = 0;
+        while (it.next(elem)) ++count;
+        return count;
+    };
+
+    archive(writer, "xxxx", "0");
+    EXPECT(retrieved() == 1);
+
+    // The database is now open for reading in the (shared) catalogue cache
+
+    archive(writer, "xxxx", "1");
+    EXPECT(retrieved() == 2);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+}  // namespace test
+}  // namespace fdb
+
+int main(int argc, char **argv)
+{
+    return run_tests ( argc, argv );
+}
@@ -0,0 +1,179 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "eckit/testing/Test.h"
+
+#include "fdb5/database/AxisRegistry.h"
+#include "fdb5/database/IndexAxis.h"
+#include "fdb5/database/Key.h"
+
+using namespace eckit::testing;
+using namespace eckit;
+
+
+namespace fdb {
+namespace test {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// Each test uses its own keywords, so that the values interned by other tests don't interfere
+
+fdb5::Key key(const std::string& keyword, const std::string& value) {
+    fdb5::Key k;
+    k.set(keyword, value);
+    return k;
+}
+
+std::unique_ptr<fdb5::IndexAxis> axis(const std::string& keyword, const std::vector<std::string>& values) {
+    std::unique_ptr<fdb5::IndexAxis> a(new fdb5::IndexAxis);
+    for (const std::string& v : values) {
+        a->insert(key(keyword, v));
+    }
+    a->sort();
+    return a;
+}
+
+std::vector<uint32_t> ids(const fdb5::IndexAxis& axis) {
+    std::map<uint32_t, std::vector<uint32_t>> interned;
+    EXPECT(axis.interned(interned));
+    EXPECT(interned.size() == 1);
+    return interned.begin()->second;
+}
+
+std::vector<std::string> range(const std::string& prefix, size_t n) {
+    std::vector<std::string> values;
+    for (size_t i = 0; i < n; ++i) {
+        values.push_back(prefix + std::to_string(i));
+    }
+    return values;
+}
+
+CASE( "axes_test_probes_against_their_interned_values" ) {
+
+    std::unique_ptr<fdb5::IndexAxis> a = axis("axistest1", {"0", "6", "12"});
+
+    for (const char* v : {"0", "6", "12"}) {
+        fdb5::Key k = key("axistest1", v);
+        EXPECT(a->contains(fdb5::AxisProbe(k)));
+        EXPECT(a->contains(k));
+    }
+
+    for (const char* v : {"1", "18"}) {
+        fdb5::Key k = key("axistest1", v);
+        EXPECT(!a->contains(fdb5::AxisProbe(k)));
+        EXPECT(!a->contains(k));
+    }
+
+    // A value that is interned after the probe was resolved is still found
+
+    fdb5::Key k = key("axistest1", "24");
+    fdb5::AxisProbe probe(k);
+    std::unique_ptr<fdb5::IndexAxis> b = axis("axistest1", {"24"});
+    EXPECT(b->contains(probe));
+    EXPECT(!a->contains(probe));
+
+    // Inserting into a sorted axis invalidates its ids until it is sorted again
+
+    b->insert(key("axistest1", "30"));
+    std::map<uint32_t, std::vector<uint32_t>> interned;
+    EXPECT(!b->interned(interned));
+
+    fdb5::Key k30 = key("axistest1", "30");
+    b->sort();
+    EXPECT(b->contains(fdb5::AxisProbe(k30)));
+    EXPECT(b->contains(probe));
+}
+
+CASE( "equal_axes_share_interned_ids" ) {
+
+    fdb5::AxisRegistry& registry(fdb5::AxisRegistry::instance());
+
+    std::unique_ptr<fdb5::IndexAxis> a = axis("axistest2", {"a", "b", "c"});
+    std::unique_ptr<fdb5::IndexAxis> b = axis("axistest2", {"c", "b", "a"});
+    std::unique_ptr<fdb5::IndexAxis> c = axis("axistest2", {"a", "b", "d"});
+
+    EXPECT(ids(*a) == ids(*b));
+    EXPECT(ids(*a) != ids(*c));
+
+    uint32_t keyword = registry.keywordId("axistest2");
+    EXPECT(keyword != fdb5::AxisRegistry::unknown);
+    EXPECT(registry.values(keyword) == 4);
+
+    // Values stay interned while any axis refers to them
+
+    a.reset();
+    EXPECT(registry.values(keyword) == 4);
+    EXPECT(ids(*b).size() == 3);
+
+    b.reset();
+    EXPECT(registry.values(keyword) == 3);
+    EXPECT(registry.valueId(keyword, "c") == fdb5::AxisRegistry::unknown);
+    EXPECT(registry.valueId(keyword, "a") != fdb5::AxisRegistry::unknown);
+
+    c.reset();
+    EXPECT(registry.values(keyword) == 0);
+}
+
+CASE( "registry_reuses_released_ids" ) {
+
+    fdb5::AxisRegistry& registry(fdb5::AxisRegistry::instance());
+
+    std::unique_ptr<fdb5::IndexAxis> a = axis("axistest3", range("a", 100));
+    uint32_t keyword = registry.keywordId("axistest3");
+    EXPECT(registry.values(keyword) == 100);
+
+    // A probe resolved before the ids are released, and then reused
+
+    fdb5::Key k = key("axistest3", "a7");
+    fdb5::AxisProbe probe(k);
+    size_t generation = registry.generation();
+
+    a.reset();
+    EXPECT(registry.values(keyword) == 0);
+    EXPECT(registry.generation() > generation);
+
+    // The ids don't grow as axes come and go
+
+    for (size_t round = 0; round < 10; ++round) {
+        std::unique_ptr<fdb5::IndexAxis> b = axis("axistest3", range("b" + std::to_string(round) + "-", 100));
+        std::vector<uint32_t> interned = ids(*b);
+        EXPECT(interned.size() == 100);
+        EXPECT(interned.back() < 100);
+
+        // The old probe has one of the reused ids, but is not mistaken for a value of the axis
+        EXPECT(!b->contains(probe));
+    }
+
+    EXPECT(registry.values(keyword) == 0);
+
+    // Wiping an axis releases its values
+
+    fdb5::IndexAxis c;
+    c.insert(key("axistest3", "c"));
+    c.sort();
+    EXPECT(registry.values(keyword) == 1);
+    c.wipe();
+    EXPECT(registry.values(keyword) == 0);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+}  // namespace test
+}  // namespace fdb
+
+int main(int argc, char **argv)
+{
+    return run_tests ( argc, argv );
+}
@@ -0,0 +1,367 @@
+/*
+ * (C) Copyright 1996- ECMWF.
+ *
+ * This software is licensed under the terms of the Apache Licence Version 2.0
+ * which can be obtained at http://www.apache.org/licenses/LICENSE-2.0.
+ * In applying this licence, ECMWF does not waive the privileges and immunities
+ * granted to it by virtue of its status as an intergovernmental organisation nor
+ * does it submit to any jurisdiction.
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "eckit/filesystem/TmpDir.h"
+#include "eckit/io/AutoClose.h"
+#include "eckit/io/FileHandle.h"
+#include "eckit/serialisation/MemoryStream.h"
+#include "eckit/testing/Test.h"
+
+#include "fdb5/api/FDB.h"
+#include "fdb5/api/helpers/FDBToolRequest.h"
+#include "fdb5/api/helpers/ListIterator.h"
+#include "fdb5/config/Config.h"
+#include "fdb5/database/BloomFilter.h"
+#include "fdb5/database/Field.h"
+#include "fdb5/database/Index.h"
+#include "fdb5/database/Key.h"
+#include "fdb5/toc/TocFieldLocation.h"
+#include "fdb5/toc/TocIndex.h"
+#include "fdb5/toc/TocSerialisationVersion.h"
+
+#include "TocConfig.h"
+
+using namespace eckit::testing;
+using namespace eckit;
+
+
+namespace fdb {
+namespace test {
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/// The test is also run with FDB5_SERIALISATION_VERSION set, which selects the version the FDB
+/// writes for the whole process. The index records below are encoded at explicit versions.
+
+fdb5::Key datum(size_t step, size_t param) {
+    fdb5::Key key;
+    key.set("step", std::to_string(step));
+    key.set("param", std::to_string(130 + param));
+    return key;
+}
+
+/// An index of a 10x10 cube of steps and params, missing the diagonal
+class TestIndex {
+
+public: // methods
+
+    TestIndex(const eckit::PathName& directory) :
+        directory_(directory),
+        index_(new fdb5::TocIndex(indexKey(), directory / "test.index", 0, fdb5::TocIndex::WRITE)) {
+        index_.open();
+    }
+
+    ~TestIndex() {
+        index_.close();
+    }
+
+    static fdb5::Key indexKey() {
+        fdb5::Key key;
+        key.set("type", "fc");
+        key.set("levtype", "sfc");
+        return key;
+    }
+
+    void put(size_t step, size_t param) {
+        fdb5::Field field(fdb5::TocFieldLocation(directory_ / "test.data", eckit::Offset(0), eckit::Length(10), fdb5::Key()), 0);
+        index_.put(datum(step, param), field);
+    }
+
+    void putCube(size_t firstStep, size_t lastStep) {
+        for (size_t step = firstStep; step < lastStep; ++step) {
+            for (size_t param = 0; param < 10; ++param) {
+                if (step != param) put(step, param);
+            }
+        }
+    }
+
+    fdb5::Index& index() { return index_; }
+
+    /// Encode the index as it is written into its TOC record
+    std::vector<char> encode(int version) const {
+        std::vector<char> buffer(1024 * 1024);
+        eckit::MemoryStream s(&buffer[0], buffer.size());
+        index_.encode(s, version);
+        buffer.resize(s.position());
+        return buffer;
+    }
+
+    fdb5::Index decode(std::vector<char>& buffer, int version) const {
+        eckit::MemoryStream s(&buffer[0], buffer.size());
+        return fdb5::Index(new fdb5::TocIndex(s, version, directory_, directory_ / "test.index", 0));
+    }
+
+private: // members
+
+    eckit::PathName directory_;
+    fdb5::Index index_;
+};
+
+bool contains(const std::vector<char>& buffer, const std::string& word) {
+    return std::search(buffer.begin(), buffer.end(), word.begin(), word.end()) != buffer.end();
+}
+
+/// The combinations that were never archived, out of those the axes allow
+size_t diagonalMatches(const fdb5::Index& index, size_t steps) {
+    size_t matches = 0;
+    for (size_t step = 0; step < steps; ++step) {
+        if (index.mayContain(datum(step, step))) ++matches;
+    }
+    return matches;
+}
+
+CASE( "bloom_filters_have_no_false_negatives_and_few_false_positives" ) {
+
+    std::vector<uint64_t> hashes;
+    for (size_t i = 0; i < 10000; ++i) {
+        hashes.push_back(fdb5::BloomFilter::hash("field" + std::to_string(i)));
+    }
+
+    fdb5::BloomFilter filter(hashes, 64 * 1024);
+    EXPECT(!filter.empty());
+
+    for (uint64_t h : hashes) {
+        EXPECT(filter.mayContain(h));
+    }
+
+    size_t falsePositives = 0;
+    for (size_t i = 0; i < 10000; ++i) {
+        if (filter.mayContain(fdb5::BloomFilter::hash("other" + std::to_string(i)))) ++falsePositives;
+    }
+    EXPECT(falsePositives < 300);
+
+    // Capped filters are less selective, but still never miss a field
+
+    fdb5::BloomFilter capped(hashes, 64);
+    EXPECT(capped.size() == 64);
+    for (uint64_t h : hashes) {
+        EXPECT(capped.mayContain(h));
+    }
+
+    // Without any fields (or space) there is no filter, and everything may be contained
+
+    EXPECT(fdb5::BloomFilter().empty());
+    EXPECT(fdb5::BloomFilter(std::vector<uint64_t>(), 1024).empty());
+    EXPECT(fdb5::BloomFilter(hashes, 63).empty());
+    EXPECT(fdb5::BloomFilter().mayContain(hashes[0]));
+}
+
+CASE( "bloom_filters_roundtrip_through_streams" ) {
+
+    std::vector<uint64_t> hashes;
+    for (size_t i = 0; i < 1000; ++i) {
+        hashes.push_back(fdb5::BloomFilter::hash(std::to_string(i)));
+    }
+    fdb5::BloomFilter filter(hashes, 64 * 1024);
+
+    std::vector<char> buffer(64 * 1024 + 1024);
+    {
+        eckit::MemoryStream s(&buffer[0], buffer.size());
+        filter.encode(s);
+    }
+
+    fdb5::BloomFilter decoded;
+    {
+        eckit::MemoryStream s(&buffer[0], buffer.size());
+        decoded.decode(s);
+    }
+
+    EXPECT(decoded.size() == filter.size());
+    for (size_t i = 0; i < 2000; ++i) {
+        uint64_t h = fdb5::BloomFilter::hash(std::to_string(i));
+        EXPECT(decoded.mayContain(h) == filter.mayContain(h));
+    }
+}
+
+CASE( "index_filters_roundtrip_through_version_4_records" ) {
+
+    eckit::TmpDir directory;
+    TestIndex index(directory);
+
+    index.putCube(0, 10);
+    index.index().flush();
+
+    std::vector<char> record = index.encode(4);
+    EXPECT(contains(record, "filter"));
+
+    fdb5::Index decoded = index.decode(record, 4);
+
+    for (size_t step = 0; step < 10; ++step) {
+        for (size_t param = 0; param < 10; ++param) {
+            if (step != param) EXPECT(decoded.mayContain(datum(step, param)));
+        }
+    }
+
+    // The axes contain every value of the diagonal, but the filter rejects (almost all) of it
+
+    EXPECT(diagonalMatches(index.index(), 10) <= 2);
+    EXPECT(diagonalMatches(decoded, 10) == diagonalMatches(index.index(), 10));
+
+    // Re-encoding what was read gives the same record
+
+    std::vector<char> again(1024 * 1024);
+    eckit::MemoryStream s(&again[0], again.size());
+    decoded.encode(s, 4);
+    again.resize(s.position());
+    EXPECT(again == record);
+}
+
+CASE( "index_filters_cover_every_flush_and_are_reset_on_reopen" ) {
+
+    eckit::TmpDir directory;
+    TestIndex index(directory);
+
+    index.putCube(0, 5);
+    index.index().flush();
+    index.putCube(5, 10);
+    index.index().flush();
+
+    {
+        std::vector<char> record = index.encode(4);
+        fdb5::Index decoded = index.decode(record, 4);
+        for (size_t step = 0; step < 10; ++step) {
+            for (size_t param = 0; param < 10; ++param) {
+                if (step != param) EXPECT(decoded.mayContain(datum(step, param)));
+            }
+        }
+    }
+
+    // A reopened index is a new (empty) index at the end of the file
+
+    index.index().reopen();
+    EXPECT(!index.index().mayContain(datum(0, 1)));
+
+    index.put(20, 21);
+    index.put(21, 20);
+    index.index().flush();
+
+    std::vector<char> record = index.encode(4);
+    fdb5::Index decoded = index.decode(record, 4);
+
+    EXPECT(decoded.mayContain(datum(20, 21)));
+    EXPECT(decoded.mayContain(datum(21, 20)));
+    EXPECT(!decoded.mayContain(datum(0, 1)));
+}
+
+CASE( "index_records_before_version_4_are_unchanged_and_have_no_filter" ) {
+
+    eckit::TmpDir directory;
+    TestIndex index(directory);
+
+    index.putCube(0, 10);
+    index.index().flush();
+
+    for (int version : {2, 3}) {
+
+        std::vector<char> record = index.encode(version);
+        EXPECT(!contains(record, "filter"));
+
+        // The record is exactly what was written before filters existed: reading it back, without
+        // a filter, and writing it again gives the same bytes
+
+        fdb5::Index decoded = index.decode(record, version);
+
+        std::vector<char> again(1024 * 1024);
+        eckit::MemoryStream s(&again[0], again.size());
+        decoded.encode(s, version);
+        again.resize(s.position());
+        EXPECT(again == record);
+
+        // Without the filter only the axes are checked, which can't exclude the diagonal
+
+        EXPECT(diagonalMatches(decoded, 10) == 10);
+        for (size_t step = 0; step < 10; ++step) {
+            for (size_t param = 0; param < 10; ++param) {
+                EXPECT(decoded.mayContain(datum(step, param)));
+            }
+        }
+
+        // ... and an index read from an old record doesn't gain a filter when it is written again
+
+        std::vector<char> upgraded(1024 * 1024);
+        eckit::MemoryStream u(&upgraded[0], upgraded.size());
+        decoded.encode(u, 4);
+        upgraded.resize(u.position());
+        EXPECT(!contains(upgraded, "filter"));
+    }
+}
+
+CASE( "databases_store_filters_only_from_version_4" ) {
+
+    eckit::TmpDir root;
+
+    fdb5::Config config(tocConfig(root));
+
+    unsigned int version = fdb5::TocSerialisationVersion(config).used();
+    eckit::Log::info() << "Writing TOC serialisation version " << version << std::endl;
+
+    std::string data(1024, 'x');
+    {
+        fdb5::FDB fdb(config);
+        for (size_t step = 0; step < 10; ++step) {
+            for (size_t param = 0; param < 10; ++param) {
+                if (step == param) continue;
+                fdb5::Key key = datum(step, param);
+                key.set("class", "rd");
+                key.set("expver", "xxxx");
+                key.set("stream", "oper");
+                key.set("date", "20201102");
+                key.set("time", "0000");
+                key.set("domain", "g");
+                key.set("type", "fc");
+                key.set("levtype", "sfc");
+                fdb.archive(key, data.data(), data.size());
+            }
+            fdb.flush();
+        }
+    }
+
+    std::vector<eckit::PathName> files;
+    std::vector<eckit::PathName> dirs;
+    root.children(files, dirs);
+    EXPECT(dirs.size() == 1);
+
+    eckit::PathName toc = dirs[0] / "toc";
+    std::vector<char> bytes(size_t(toc.size()));
+    {
+        eckit::FileHandle fh(toc);
+        fh.openForRead();
+        eckit::AutoClose closer(fh);
+        EXPECT(fh.read(&bytes[0], bytes.size()) == long(bytes.size()));
+    }
+    EXPECT(contains(bytes, "filter") == (version >= 4));
+
+    // Whichever version was written, every field is found and nothing else
+
+    fdb5::FDB fdb(config);
+    fdb5::FDBToolRequest request = fdb5::FDBToolRequest::requestsFromString(
+        "class=rd,expver=xxxx,stream=oper,date=20201102,time=0000,domain=g,type=fc,levtype=sfc,"
+        "step=0/1/2/3/4/5/6/7/8/9,param=130/131/132/133/134/135/136/137/138/139")[0];
+
+    fdb5::ListIterator it = fdb.inspect(request.request());
+    fdb5::ListElement elem;
+    size_t count = 0;
+    while (it.next(elem)) ++count;
+    EXPECT(count == 90);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+}  // namespace test
+}  // namespace fdb
+
+int main(int argc, char **argv)
+{
+    return run_tests ( argc, argv );
+}
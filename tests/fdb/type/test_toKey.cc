@@ -18,6 +18,8 @@
 #include "fdb5/database/ArchiveVisitor.h"
 #include "fdb5/database/Key.h"
 #include "fdb5/rules/Rule.h"
+#include "fdb5/types/Type.h"
+#include "fdb5/types/TypesRegistry.h"
 
 using namespace eckit::testing;
 using namespace eckit;
@@ -288,6 +290,40 @@ CASE( "Date - string ctor - expansion" ) {
 
 }
 
+CASE( "Step & Time - memoised canonicalisation" ) {
+
+    fdb5::Key key;
+    const fdb5::Type& step = key.registry().lookupType("step");
+    const fdb5::Type& time = key.registry().lookupType("time");
+
+    fdb5::Type::CanonicalisationStats before = step.canonicalisationStats();
+
+    // Parsed once, then memoised
+
+    EXPECT(step.canonicalise("step", "30m-1") == "30m-60m");
+    EXPECT(step.canonicalise("step", "30m-1") == "30m-60m");
+    EXPECT(step.canonicalise("step", "60m") == "1");
+    EXPECT(step.canonicalise("step", "60m") == "1");
+
+    // Already canonical
+
+    EXPECT(step.canonicalise("step", "12") == "12");
+    EXPECT(step.canonicalise("step", "0") == "0");
+    EXPECT(step.canonicalise("step", "00") == "0");
+
+    fdb5::Type::CanonicalisationStats after = step.canonicalisationStats();
+    EXPECT(after.misses - before.misses <= 3);
+    EXPECT(after.hits - before.hits >= 4);
+
+    // Failures are not memoised
+
+    EXPECT_THROWS(time.canonicalise("time", "12:99"));
+    EXPECT_THROWS(time.canonicalise("time", "12:99"));
+    EXPECT(time.canonicalise("time", "0600") == "0600");
+    EXPECT(time.canonicalise("time", "6") == "0600");
+    EXPECT(time.canonicalise("time", "6") == time.toKey("time", "6"));
+}
+
 
 //----------------------------------------------------------------------------------------------------------------------
 